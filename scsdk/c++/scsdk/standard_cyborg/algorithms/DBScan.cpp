@@ -15,10 +15,15 @@ limitations under the License.
 */
 #include "standard_cyborg/algorithms/DBScan.hpp"
 
+#include "standard_cyborg/algorithms/DBScan.hpp"
+
 #include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/util/ConcurrentUnionFind.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
 
 #include <algorithm>
-#include <random>
+#include <cmath>
+#include <cstdint>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wconversion"
@@ -48,7 +53,7 @@ struct KDTreeVec3VectorAdaptor {
         index->buildIndex();
     }
     
-    KDTreeVec3VectorAdaptor()
+    ~KDTreeVec3VectorAdaptor()
     {
         delete index;
     }
@@ -103,105 +108,256 @@ struct KDTreeVec3VectorAdaptor {
     
 }; // end of KDTreeVectorOfVectorsAdaptor
     
-struct Point {
-public:
-    math::Vec3 p;
-    int ptsCnt = 0, cluster;
-    double getDis(const Point& ot)
+/* Passes each point a nanoflann radius search finds to a callback instead of storing it. The
+ * callback returns false to stop the search early. */
+template <typename Callback>
+struct CallbackResultSet {
+    float radius;
+    Callback& callback;
+    
+    inline bool full() const { return true; }
+    inline float worstDist() const { return radius; }
+    inline bool addPoint(float dist, size_t index)
     {
-        return (p - ot.p).norm();
+        return dist < radius ? callback((int)index) : true;
     }
 };
 
-static std::vector<std::vector<int>> adjPoints;
-static std::vector<Point> points;
-
-static int minPts;
-
-static bool isCoreObject(int idx)
-{
-    return points[idx].ptsCnt >= minPts;
-}
-
-static const int NOISE = -2;
-static const int NOT_CLASSIFIED = -1;
-
-static void dfs(int now, int c)
-{
-    points[now].cluster = c;
-    if (!isCoreObject(now)) return;
+/* Radius queries over nanoflann's kd-tree */
+class KdTreeSearch {
+public:
+    KdTreeSearch(const std::vector<math::Vec3>& points, float squaredRadius) :
+        _points(points),
+        _squaredRadius(squaredRadius),
+        _kdTree(points, 10)
+    {}
     
-    for (auto& next : adjPoints[now]) {
-        if (points[next].cluster != NOT_CLASSIFIED) continue;
-        dfs(next, c);
+    /* Call fn(j), until it returns false, for each point j whose squared distance from point i
+     * is less than the squared radius, including i itself */
+    template <typename Callback>
+    void forEachNeighbor(int i, Callback fn) const
+    {
+        float point[3] = {_points[i].x, _points[i].y, _points[i].z};
+        CallbackResultSet<Callback> resultSet{_squaredRadius, fn};
+        _kdTree.index->findNeighbors(resultSet, point, nanoflann::SearchParams(10));
     }
-}
-
-std::vector<int> DBScan::compute(const std::vector<math::Vec3>& argpoints, size_t minPoints, float epsilon)
-{
-    typedef KDTreeVec3VectorAdaptor<std::vector<math::Vec3>, float> KdTree;
-    
-    minPts = (int)minPoints;
     
-    adjPoints.clear();
-    points.clear();
-    
-    int clusterIdx = -1;
+private:
+    const std::vector<math::Vec3>& _points;
+    float _squaredRadius;
+    KDTreeVec3VectorAdaptor<std::vector<math::Vec3>, float> _kdTree;
+};
+
+/* Radius queries over a grid of cells as wide as the radius, so that a point's neighbors all lie
+ * in the 27 cells around it. Only occupied cells are stored, sorted by key, with x in the lowest
+ * bits so that each row of three neighboring cells is one contiguous range of keys. */
+class GridSearch {
+public:
+    static const int kBitsPerAxis = 21;
     
-    for (int ii = 0; ii < argpoints.size(); ++ii) {
-        Point p;
-        p.p = argpoints[ii];
-        p.cluster = NOT_CLASSIFIED;
-        p.ptsCnt = 0;
+    /* Whether a grid with cells of the given size can index points spanning these bounds */
+    static bool canIndex(const math::Vec3& minCorner, const math::Vec3& maxCorner, float cellSize)
+    {
+        if (!(cellSize > 0.0f)) return false;
         
-        points.push_back(p);
+        math::Vec3 cellCounts = (maxCorner - minCorner) / cellSize;
+        float maxCellCount = (float)((1 << kBitsPerAxis) - 3);
+        return cellCounts.x < maxCellCount && cellCounts.y < maxCellCount && cellCounts.z < maxCellCount;
     }
     
-    adjPoints.resize(points.size());
-    
-    // Check near Points (sped up by Kd tree)
-    KdTree kdTree(argpoints, 10);
-    kdTree.index->buildIndex();
-    
-    for (int i = 0; i < points.size(); ++i) {
-        std::vector<std::pair<size_t, float>> matches;
+    GridSearch(const std::vector<math::Vec3>& points, float squaredRadius, const math::Vec3& minCorner) :
+        _points(points),
+        _squaredRadius(squaredRadius),
+        _cellSize(std::sqrt(squaredRadius)),
+        _origin(minCorner - math::Vec3(_cellSize))
+    {
+        int pointCount = (int)points.size();
         
-        float point[3] = {points[i].p.x, points[i].p.y, points[i].p.z};
-        kdTree.index->radiusSearch(&point[0], epsilon, matches, nanoflann::SearchParams(10));
+        std::vector<std::pair<uint64_t, int>> keyedPoints(pointCount);
+        parallelFor(pointCount, [&](int begin, int end, int threadIndex) {
+            for (int i = begin; i < end; i++) {
+                keyedPoints[i] = std::make_pair(cellKeyOf(points[i]), i);
+            }
+        }, 4096);
+        std::sort(keyedPoints.begin(), keyedPoints.end());
         
-        for (int j = 0; j < matches.size(); ++j) {
-            std::pair<size_t, float> iter = matches[j];
-            adjPoints[i].push_back((int)iter.first);
-            points[i].ptsCnt++;
+        _pointOrder.resize(pointCount);
+        for (int i = 0; i < pointCount; i++) {
+            _pointOrder[i] = keyedPoints[i].second;
+            
+            if (i == 0 || keyedPoints[i].first != keyedPoints[i - 1].first) {
+                _cellKeys.push_back(keyedPoints[i].first);
+                _cellStarts.push_back(i);
+            }
         }
+        _cellStarts.push_back(pointCount);
     }
     
-    // Classify as core or noise, through depth first search
-    for (int i = 0; i < points.size(); i++) {
-        if (points[i].cluster != NOT_CLASSIFIED) continue;
+    int cellCount() const { return (int)_cellKeys.size(); }
+    
+    /* Call fn(i, j), until it returns false for a given i, for every point i in the cell and every
+     * point j whose squared distance from i is less than the squared radius, including i itself */
+    template <typename Callback>
+    void forEachNeighborInCell(int cell, Callback fn) const
+    {
+        uint64_t key = _cellKeys[cell];
         
-        if (isCoreObject(i)) {
-            dfs(i, ++clusterIdx);
-        } else {
-            points[i].cluster = NOISE;
+        // The points of up to 27 cells, gathered as one range of _pointOrder per row of three
+        std::pair<int, int> rows[9];
+        int rowCount = 0;
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                uint64_t rowKey = key + (int64_t)dz * (int64_t)kZStep + (int64_t)dy * (int64_t)kYStep;
+                auto first = std::lower_bound(_cellKeys.begin(), _cellKeys.end(), rowKey - 1);
+                auto last = first;
+                while (last != _cellKeys.end() && *last <= rowKey + 1) last++;
+                if (first != last) {
+                    rows[rowCount++] = std::make_pair(_cellStarts[first - _cellKeys.begin()], _cellStarts[last - _cellKeys.begin()]);
+                }
+            }
         }
+        
+        for (int slot = _cellStarts[cell]; slot < _cellStarts[cell + 1]; slot++) {
+            int i = _pointOrder[slot];
+            const math::Vec3& point = _points[i];
+            bool keepGoing = true;
+            
+            for (int row = 0; row < rowCount && keepGoing; row++) {
+                for (int otherSlot = rows[row].first; otherSlot < rows[row].second && keepGoing; otherSlot++) {
+                    int j = _pointOrder[otherSlot];
+                    math::Vec3 delta = _points[j] - point;
+                    if (delta.x * delta.x + delta.y * delta.y + delta.z * delta.z < _squaredRadius) {
+                        keepGoing = fn(i, j);
+                    }
+                }
+            }
+        }
+    }
+    
+private:
+    static const uint64_t kYStep = (uint64_t)1 << kBitsPerAxis;
+    static const uint64_t kZStep = (uint64_t)1 << (2 * kBitsPerAxis);
+    
+    // The origin sits a cell below the lowest point, so no cell coordinate, or neighbor of one,
+    // is negative
+    uint64_t cellKeyOf(const math::Vec3& point) const
+    {
+        math::Vec3 cell = (point - _origin) / _cellSize;
+        return (uint64_t)cell.x | (uint64_t)cell.y * kYStep | (uint64_t)cell.z * kZStep;
     }
     
-    // finally, asign points to clusters.
-    std::vector<int> result;
-    result.clear();
-    for (int i = 0; i < points.size(); i++) {
-        if (points[i].cluster != NOISE) {
-            //std::cout << "points[i].cluster: " << std::to_string(points[i].cluster) << std::endl;
-            result.push_back(points[i].cluster);
-        } else {
-            result.push_back(-1);
+    const std::vector<math::Vec3>& _points;
+    float _squaredRadius;
+    float _cellSize;
+    math::Vec3 _origin;
+    
+    // The points sorted by cell; those in cell c are _pointOrder[_cellStarts[c]] up to
+    // _pointOrder[_cellStarts[c + 1]]
+    std::vector<int> _pointOrder;
+    std::vector<uint64_t> _cellKeys;
+    std::vector<int> _cellStarts;
+};
+
+/* Visit every point's neighborhood in parallel, calling fn(i, j) until it returns false for
+ * a given i, for each neighbor j of each point i with visitPoint[i] set */
+template <typename Callback>
+static void forEachNeighborhood(const KdTreeSearch& search, const std::vector<uint8_t>& visitPoint, Callback fn)
+{
+    parallelFor((int)visitPoint.size(), [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            if (!visitPoint[i]) continue;
+            
+            search.forEachNeighbor(i, [&fn, i](int j) { return fn(i, j); });
         }
+    }, 1024);
+}
+
+template <typename Callback>
+static void forEachNeighborhood(const GridSearch& search, const std::vector<uint8_t>& visitPoint, Callback fn)
+{
+    parallelFor(search.cellCount(), [&](int begin, int end, int threadIndex) {
+        for (int cell = begin; cell < end; cell++) {
+            search.forEachNeighborInCell(cell, [&](int i, int j) {
+                return visitPoint[i] ? fn(i, j) : false;
+            });
+        }
+    }, 256);
+}
+
+/* DBSCAN with a union-find over the core points. Nothing is kept per point beyond a few flags
+ * and labels, so memory stays linear no matter how many neighbors each point has. */
+template <typename Search>
+static std::vector<int> clusterPoints(const Search& search, int pointCount, int minPoints)
+{
+    // A core point has at least minPoints neighbors, counting itself
+    std::vector<uint8_t> isCore(pointCount, 0);
+    {
+        std::vector<uint8_t> allPoints(pointCount, 1);
+        std::vector<int> neighborCounts(pointCount, 0);
+        forEachNeighborhood(search, allPoints, [&](int i, int j) {
+            if (++neighborCounts[i] < minPoints) return true;
+            
+            isCore[i] = 1;
+            return false;
+        });
     }
     
+    // Neighboring core points belong to the same cluster. A set's root is its lowest point, so
+    // clusters are numbered in the order of their lowest core point.
+    ConcurrentUnionFind coreSets(pointCount);
+    forEachNeighborhood(search, isCore, [&](int i, int j) {
+        if (j > i && isCore[j]) coreSets.unite(i, j);
+        return true;
+    });
+    
+    std::vector<int> clusterOfRoot(pointCount, -1);
+    int clusterCount = 0;
+    for (int i = 0; i < pointCount; i++) {
+        if (isCore[i] && coreSets.find(i) == i) clusterOfRoot[i] = clusterCount++;
+    }
+    
+    std::vector<int> result(pointCount, -1);
+    parallelFor(pointCount, [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            if (isCore[i]) result[i] = clusterOfRoot[coreSets.find(i)];
+        }
+    }, 4096);
+    
+    // Other points join the lowest numbered cluster among the core points they neighbor, or are
+    // left as noise
+    std::vector<uint8_t> isBorderCandidate(pointCount);
+    for (int i = 0; i < pointCount; i++) isBorderCandidate[i] = !isCore[i];
+    
+    forEachNeighborhood(search, isBorderCandidate, [&](int i, int j) {
+        if (isCore[j] && (result[i] == -1 || result[j] < result[i])) result[i] = result[j];
+        return true;
+    });
+    
     return result;
 }
 
+std::vector<int> DBScan::compute(const std::vector<math::Vec3>& points, size_t minPoints, float epsilon)
+{
+    int pointCount = (int)points.size();
+    if (pointCount == 0) return std::vector<int>();
+    
+    int minPointCount = (int)std::min(minPoints, (size_t)pointCount + 1);
+    
+    math::Vec3 minCorner = points[0];
+    math::Vec3 maxCorner = points[0];
+    for (const math::Vec3& point : points) {
+        minCorner = math::Vec3::min(minCorner, point);
+        maxCorner = math::Vec3::max(maxCorner, point);
+    }
+    
+    // Epsilon is compared against squared distances, as nanoflann's radius searches do
+    if (GridSearch::canIndex(minCorner, maxCorner, std::sqrt(epsilon))) {
+        return clusterPoints(GridSearch(points, epsilon, minCorner), pointCount, minPointCount);
+    } else {
+        return clusterPoints(KdTreeSearch(points, epsilon), pointCount, minPointCount);
+    }
+}
+
 }
 
 }
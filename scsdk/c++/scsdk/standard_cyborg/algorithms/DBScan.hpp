@@ -38,6 +38,12 @@ public:
      
      Returns: A list (length n) of the centroid index to which a particular point is assigned
      -1, means that the point was classified as noise.
+     
+     Points are neighbors when their squared distance is less than epsilon. Clusters are numbered
+     in the order of their lowest-indexed core point, and a border point joins the lowest numbered
+     cluster it borders. Safe to call from several threads at once; each call runs its
+     neighborhood queries in parallel, through a grid of epsilon-sized cells where the cloud's
+     extent allows and a kd-tree otherwise.
      */
     static std::vector<int> compute(const std::vector<math::Vec3>& points,
                                     size_t minPoints = 200,
@@ -0,0 +1,490 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "standard_cyborg/algorithms/DecimateMesh.hpp"
+
+#include "standard_cyborg/math/Vec2.hpp"
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/ColorImage.hpp"
+#include "standard_cyborg/sc3d/Face3.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/sc3d/MeshTopology.hpp"
+#include "standard_cyborg/util/IncludeEigen.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <vector>
+
+using standard_cyborg::math::Vec2;
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Face3;
+using standard_cyborg::sc3d::Geometry;
+
+namespace standard_cyborg {
+
+namespace algorithms {
+
+static Eigen::Vector3d toEigen(const Vec3& v)
+{
+    return Eigen::Vector3d(v.x, v.y, v.z);
+}
+
+/* Twice the face's area, in the direction of its normal */
+static Vec3 faceNormal(const Vec3& p0, const Vec3& p1, const Vec3& p2)
+{
+    return Vec3::cross(p1 - p0, p2 - p0);
+}
+
+/* Whether a face has no area to speak of next to its longest edge, like the slivers and repeated
+ * vertices common in scans. Their normals point nowhere in particular. */
+static bool isDegenerate(const Vec3& p0, const Vec3& p1, const Vec3& p2)
+{
+    float longestEdgeSquared = std::max((p1 - p0).squaredNorm(), std::max((p2 - p1).squaredNorm(), (p0 - p2).squaredNorm()));
+    return faceNormal(p0, p1, p2).norm() <= 1e-6f * longestEdgeSquared;
+}
+
+static bool faceHas(const Face3& face, int vertex)
+{
+    return face[0] == vertex || face[1] == vertex || face[2] == vertex;
+}
+
+namespace {
+
+/* The area-weighted sum of squared distances to a set of planes, as x'Ax + 2b'x + c, along with
+ * the total area of the faces the planes came from */
+struct Quadric {
+    Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d b = Eigen::Vector3d::Zero();
+    double c = 0;
+    double area = 0;
+    
+    Quadric& operator+=(const Quadric& other)
+    {
+        A += other.A;
+        b += other.b;
+        c += other.c;
+        area += other.area;
+        return *this;
+    }
+    
+    /* The area-weighted mean squared distance of x from the planes. Dividing by the area makes
+     * this a squared distance, independent of how finely the mesh is tessellated. */
+    double error(const Eigen::Vector3d& x) const
+    {
+        if (area <= 0) return 0;
+        return (x.dot(A * x) + 2.0 * b.dot(x) + c) / area;
+    }
+};
+
+/* Merging removedVertex into keptVertex, which moves to position. The stamps are those of the
+ * two vertices when this was planned; if either has changed since, the plan is stale. */
+struct Collapse {
+    double error;
+    int keptVertex;
+    int removedVertex;
+    int keptStamp;
+    int removedStamp;
+    Vec3 position;
+    
+    // How far position lies from the kept vertex toward the removed one, for interpolating
+    float t;
+};
+
+/* Orders the queue with the cheapest collapse on top, breaking ties by vertex */
+struct CollapseIsCheaper {
+    bool operator()(const Collapse& lhs, const Collapse& rhs) const
+    {
+        if (lhs.error != rhs.error) return lhs.error > rhs.error;
+        if (lhs.keptVertex != rhs.keptVertex) return lhs.keptVertex > rhs.keptVertex;
+        return lhs.removedVertex > rhs.removedVertex;
+    }
+};
+
+class MeshDecimator {
+public:
+    MeshDecimator(const Geometry& mesh, const DecimateMeshParameters& parameters) :
+        _parameters(parameters),
+        _positions(mesh.getPositions()),
+        _normals(mesh.getNormals()),
+        _colors(mesh.getColors()),
+        _texCoords(mesh.getTexCoords()),
+        _faces(mesh.getFaces()),
+        _faceIsLive(_faces.size(), 1),
+        _liveFaceCount((int)_faces.size())
+    {
+        int vertexCount = (int)_positions.size();
+        _vertexFaces.resize(vertexCount);
+        _stamps.assign(vertexCount, 0);
+        _isRemoved.assign(vertexCount, 0);
+        _isPinned.assign(vertexCount, 0);
+        _isOnBoundary.assign(vertexCount, 0);
+        
+        for (int face = 0; face < (int)_faces.size(); face++) {
+            for (int corner = 0; corner < 3; corner++) {
+                _vertexFaces[_faces[face][corner]].push_back(face);
+            }
+        }
+        
+        // The input is unedited, so its cached topology describes _faces
+        std::shared_ptr<const sc3d::MeshTopology::MeshTopology> topology = mesh.getTopology();
+        const std::vector<sc3d::MeshTopology::Edge>& edges = topology->getEdges();
+        
+        // Boundary edges have a single face
+        for (const sc3d::MeshTopology::Edge& edge : edges) {
+            if (edge.face1 != -1) continue;
+            
+            _isOnBoundary[edge.vertex0] = _isOnBoundary[edge.vertex1] = 1;
+            if (parameters.preserveBoundaries) {
+                _isPinned[edge.vertex0] = _isPinned[edge.vertex1] = 1;
+            }
+        }
+        
+        // A collapse across a non-manifold edge can't be checked by the link condition
+        for (int edgeIndex : topology->getNonManifoldEdges()) {
+            _isPinned[edges[edgeIndex].vertex0] = _isPinned[edges[edgeIndex].vertex1] = 1;
+        }
+        
+        computeQuadrics();
+        queueInitialCollapses(edges);
+    }
+    
+    void run()
+    {
+        while (_liveFaceCount > _parameters.targetFaceCount && !_queue.empty()) {
+            Collapse collapse = _queue.top();
+            _queue.pop();
+            
+            // Lazy deletion: skip plans made before either vertex last changed
+            if (_isRemoved[collapse.keptVertex] || _isRemoved[collapse.removedVertex]) continue;
+            if (_stamps[collapse.keptVertex] != collapse.keptStamp) continue;
+            if (_stamps[collapse.removedVertex] != collapse.removedStamp) continue;
+            
+            if (collapse.error > _parameters.maxError) break;
+            
+            if (!isValid(collapse)) continue;
+            
+            apply(collapse);
+        }
+    }
+    
+    std::unique_ptr<Geometry> toGeometry(const Geometry& mesh) const
+    {
+        // Keep the vertices live faces still use, in their original order
+        std::vector<int> newIndices(_positions.size(), -1);
+        int newVertexCount = 0;
+        for (int face = 0; face < (int)_faces.size(); face++) {
+            if (!_faceIsLive[face]) continue;
+            for (int corner = 0; corner < 3; corner++) {
+                newIndices[_faces[face][corner]] = 0;
+            }
+        }
+        for (int& newIndex : newIndices) {
+            if (newIndex == 0) newIndex = newVertexCount++;
+        }
+        
+        std::vector<Vec3> positions(newVertexCount);
+        std::vector<Vec3> normals(_normals.empty() ? 0 : newVertexCount);
+        std::vector<Vec3> colors(_colors.empty() ? 0 : newVertexCount);
+        std::vector<Vec2> texCoords(_texCoords.empty() ? 0 : newVertexCount);
+        for (int vertex = 0; vertex < (int)newIndices.size(); vertex++) {
+            int newIndex = newIndices[vertex];
+            if (newIndex == -1) continue;
+            
+            positions[newIndex] = _positions[vertex];
+            if (!normals.empty()) normals[newIndex] = _normals[vertex];
+            if (!colors.empty()) colors[newIndex] = _colors[vertex];
+            if (!texCoords.empty()) texCoords[newIndex] = _texCoords[vertex];
+        }
+        
+        std::vector<Face3> faces;
+        faces.reserve(_liveFaceCount);
+        for (int face = 0; face < (int)_faces.size(); face++) {
+            if (!_faceIsLive[face]) continue;
+            const Face3& f = _faces[face];
+            faces.push_back(Face3(newIndices[f[0]], newIndices[f[1]], newIndices[f[2]]));
+        }
+        
+        auto geometry = std::make_unique<Geometry>(std::move(positions), std::move(normals), std::move(colors), std::move(faces));
+        if (!texCoords.empty()) geometry->setTexCoords(std::move(texCoords));
+        if (mesh.hasTexture()) geometry->setTexture(mesh.getTexture());
+        
+        return geometry;
+    }
+    
+private:
+    void computeQuadrics()
+    {
+        // Each vertex sums the planes of its own faces, so vertices can be done in parallel
+        _quadrics.resize(_positions.size());
+        parallelFor((int)_positions.size(), [&](int begin, int end, int threadIndex) {
+            for (int vertex = begin; vertex < end; vertex++) {
+                Quadric& quadric = _quadrics[vertex];
+                
+                for (int face : _vertexFaces[vertex]) {
+                    const Face3& f = _faces[face];
+                    Vec3 normal = faceNormal(_positions[f[0]], _positions[f[1]], _positions[f[2]]);
+                    float doubleArea = normal.norm();
+                    if (doubleArea == 0.0f) continue;
+                    
+                    Eigen::Vector3d unitNormal = toEigen(normal / doubleArea);
+                    double offset = -unitNormal.dot(toEigen(_positions[f[0]]));
+                    double area = 0.5 * doubleArea;
+                    
+                    quadric.A += area * unitNormal * unitNormal.transpose();
+                    quadric.b += area * offset * unitNormal;
+                    quadric.c += area * offset * offset;
+                    quadric.area += area;
+                }
+            }
+        }, 1024);
+    }
+    
+    void queueInitialCollapses(const std::vector<sc3d::MeshTopology::Edge>& edges)
+    {
+        std::vector<Collapse> collapses(edges.size());
+        std::vector<uint8_t> isPlanned(edges.size(), 0);
+        
+        parallelFor((int)edges.size(), [&](int begin, int end, int threadIndex) {
+            for (int edge = begin; edge < end; edge++) {
+                isPlanned[edge] = plan(edges[edge].vertex0, edges[edge].vertex1, collapses[edge]);
+            }
+        }, 1024);
+        
+        std::vector<Collapse> planned;
+        planned.reserve(edges.size());
+        for (int edge = 0; edge < (int)edges.size(); edge++) {
+            if (isPlanned[edge]) planned.push_back(collapses[edge]);
+        }
+        
+        _queue = std::priority_queue<Collapse, std::vector<Collapse>, CollapseIsCheaper>(CollapseIsCheaper(), std::move(planned));
+    }
+    
+    /* Choose which vertex of edge (a, b) survives and where it goes. False if neither may move. */
+    bool plan(int a, int b, Collapse& collapse) const
+    {
+        if (_isPinned[a] && _isPinned[b]) return false;
+        
+        // A pinned vertex stays put and absorbs the other
+        if (_isPinned[b]) std::swap(a, b);
+        
+        Quadric quadric = _quadrics[a];
+        quadric += _quadrics[b];
+        
+        Eigen::Vector3d pa = toEigen(_positions[a]);
+        Eigen::Vector3d pb = toEigen(_positions[b]);
+        Eigen::Vector3d best = pa;
+        double bestError = quadric.error(pa);
+        
+        if (!_isPinned[a]) {
+            auto consider = [&](const Eigen::Vector3d& candidate) {
+                double candidateError = quadric.error(candidate);
+                if (candidateError < bestError) {
+                    best = candidate;
+                    bestError = candidateError;
+                }
+            };
+            
+            consider(pb);
+            consider(0.5 * (pa + pb));
+            
+            // The minimum of the quadric, unless its planes are too close to parallel to pin one down
+            Eigen::Matrix3d inverse;
+            double determinant;
+            bool isInvertible;
+            double scale = quadric.A.trace();
+            quadric.A.computeInverseAndDetWithCheck(inverse, determinant, isInvertible, 1e-6 * scale * scale * scale);
+            if (isInvertible && scale > 0) consider(-inverse * quadric.b);
+        }
+        
+        Eigen::Vector3d edge = pb - pa;
+        double edgeLengthSquared = edge.squaredNorm();
+        double t = edgeLengthSquared > 0 ? (best - pa).dot(edge) / edgeLengthSquared : 0;
+        
+        collapse.error = std::max(0.0, bestError);
+        collapse.keptVertex = a;
+        collapse.removedVertex = b;
+        collapse.keptStamp = _stamps[a];
+        collapse.removedStamp = _stamps[b];
+        collapse.position = Vec3((float)best.x(), (float)best.y(), (float)best.z());
+        collapse.t = (float)std::min(1.0, std::max(0.0, t));
+        
+        return true;
+    }
+    
+    /* The vertices sharing a live face with vertex, sorted */
+    void collectNeighbors(int vertex, std::vector<int>& neighbors) const
+    {
+        neighbors.clear();
+        for (int face : _vertexFaces[vertex]) {
+            if (!_faceIsLive[face]) continue;
+            for (int corner = 0; corner < 3; corner++) {
+                if (_faces[face][corner] != vertex) neighbors.push_back(_faces[face][corner]);
+            }
+        }
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    }
+    
+    bool isValid(const Collapse& collapse)
+    {
+        int kept = collapse.keptVertex;
+        int removed = collapse.removedVertex;
+        
+        // Joining two boundaries through the interior would pinch the surface
+        int sharedFaceCount = 0;
+        for (int face : _vertexFaces[kept]) {
+            if (_faceIsLive[face] && faceHas(_faces[face], removed)) sharedFaceCount++;
+        }
+        if (sharedFaceCount == 0) return false;
+        bool isBoundaryEdge = sharedFaceCount == 1;
+        if (_isOnBoundary[kept] && _isOnBoundary[removed] && !isBoundaryEdge) return false;
+        
+        // Link condition: the only vertices both ends share are those opposite the edge. Otherwise
+        // the collapse would fold two faces onto each other or leave a non-manifold edge.
+        collectNeighbors(kept, _keptNeighbors);
+        collectNeighbors(removed, _removedNeighbors);
+        _sharedNeighbors.clear();
+        std::set_intersection(_keptNeighbors.begin(), _keptNeighbors.end(),
+                              _removedNeighbors.begin(), _removedNeighbors.end(),
+                              std::back_inserter(_sharedNeighbors));
+        if ((int)_sharedNeighbors.size() != sharedFaceCount) return false;
+        
+        // Don't collapse a closed mesh below a tetrahedron, or a lone triangle to nothing
+        if ((int)(_keptNeighbors.size() + _removedNeighbors.size()) - sharedFaceCount - 2 < 3) return false;
+        
+        // No face that survives may turn over
+        for (int vertex : {kept, removed}) {
+            for (int face : _vertexFaces[vertex]) {
+                if (!_faceIsLive[face]) continue;
+                const Face3& f = _faces[face];
+                if (faceHas(f, kept) && faceHas(f, removed)) continue;
+                
+                Vec3 corners[3];
+                for (int corner = 0; corner < 3; corner++) {
+                    corners[corner] = f[corner] == vertex ? collapse.position : _positions[f[corner]];
+                }
+                
+                // A face that was already degenerate has no orientation to lose, but one that
+                // would become degenerate is as bad as one turned over
+                if (isDegenerate(_positions[f[0]], _positions[f[1]], _positions[f[2]])) continue;
+                if (isDegenerate(corners[0], corners[1], corners[2])) return false;
+                
+                Vec3 before = faceNormal(_positions[f[0]], _positions[f[1]], _positions[f[2]]);
+                Vec3 after = faceNormal(corners[0], corners[1], corners[2]);
+                if (Vec3::dot(before, after) <= 0.0f) return false;
+            }
+        }
+        
+        return true;
+    }
+    
+    void apply(const Collapse& collapse)
+    {
+        int kept = collapse.keptVertex;
+        int removed = collapse.removedVertex;
+        float t = collapse.t;
+        
+        _positions[kept] = collapse.position;
+        if (!_colors.empty()) {
+            _colors[kept] = (1.0f - t) * _colors[kept] + t * _colors[removed];
+        }
+        if (!_texCoords.empty()) {
+            _texCoords[kept] = (1.0f - t) * _texCoords[kept] + t * _texCoords[removed];
+        }
+        if (!_normals.empty()) {
+            Vec3 normal = (1.0f - t) * _normals[kept] + t * _normals[removed];
+            float length = normal.norm();
+            if (length > 0) _normals[kept] = normal / length;
+        }
+        
+        _quadrics[kept] += _quadrics[removed];
+        _isOnBoundary[kept] = _isOnBoundary[kept] || _isOnBoundary[removed];
+        _isRemoved[removed] = 1;
+        _stamps[kept]++;
+        
+        // Faces across the edge go; the rest of the removed vertex's faces move to the kept one
+        std::vector<int> keptFaces;
+        keptFaces.reserve(_vertexFaces[kept].size() + _vertexFaces[removed].size());
+        for (int face : _vertexFaces[kept]) {
+            if (!_faceIsLive[face]) continue;
+            if (faceHas(_faces[face], removed)) {
+                _faceIsLive[face] = 0;
+                _liveFaceCount--;
+                continue;
+            }
+            keptFaces.push_back(face);
+        }
+        for (int face : _vertexFaces[removed]) {
+            if (!_faceIsLive[face]) continue;
+            Face3& f = _faces[face];
+            for (int corner = 0; corner < 3; corner++) {
+                if (f[corner] == removed) f[corner] = kept;
+            }
+            keptFaces.push_back(face);
+        }
+        _vertexFaces[kept] = std::move(keptFaces);
+        _vertexFaces[removed].clear();
+        _vertexFaces[removed].shrink_to_fit();
+        
+        // Every edge at the kept vertex now costs something different
+        collectNeighbors(kept, _keptNeighbors);
+        for (int neighbor : _keptNeighbors) {
+            Collapse next;
+            if (plan(kept, neighbor, next)) _queue.push(next);
+        }
+    }
+    
+    const DecimateMeshParameters& _parameters;
+    
+    std::vector<Vec3> _positions;
+    std::vector<Vec3> _normals;
+    std::vector<Vec3> _colors;
+    std::vector<Vec2> _texCoords;
+    std::vector<Face3> _faces;
+    std::vector<uint8_t> _faceIsLive;
+    int _liveFaceCount;
+    
+    std::vector<std::vector<int>> _vertexFaces;
+    std::vector<Quadric> _quadrics;
+    std::vector<int> _stamps;
+    std::vector<uint8_t> _isRemoved;
+    std::vector<uint8_t> _isPinned;
+    std::vector<uint8_t> _isOnBoundary;
+    
+    std::priority_queue<Collapse, std::vector<Collapse>, CollapseIsCheaper> _queue;
+    
+    // Scratch space for isValid() and apply()
+    std::vector<int> _keptNeighbors;
+    std::vector<int> _removedNeighbors;
+    std::vector<int> _sharedNeighbors;
+};
+
+} // namespace
+
+std::unique_ptr<Geometry> decimateMesh(const Geometry& mesh, const DecimateMeshParameters& parameters)
+{
+    MeshDecimator decimator(mesh, parameters);
+    decimator.run();
+    return decimator.toGeometry(mesh);
+}
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
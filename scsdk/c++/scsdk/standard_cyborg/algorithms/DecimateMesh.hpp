@@ -0,0 +1,58 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <limits>
+#include <memory>
+
+namespace standard_cyborg {
+
+namespace sc3d {
+class Geometry;
+}
+
+namespace algorithms {
+
+struct DecimateMeshParameters {
+    /* Stop once the mesh has no more than this many faces */
+    int targetFaceCount = 0;
+    
+    /* Stop before any collapse that would move the surface further than this from the original
+     * faces around it. This is a squared distance, in the mesh's units squared: the mean of the
+     * squared distances from the merged vertex to the planes of those faces, weighted by their
+     * areas. */
+    float maxError = std::numeric_limits<float>::max();
+    
+    /* Keep the vertices of the mesh's boundary edges, those with a single face, in place, so
+     * holes and the seams of texture charts keep their shape */
+    bool preserveBoundaries = true;
+};
+
+/* Simplify a triangle mesh by repeatedly collapsing the edge whose merged vertex is closest to
+ * the planes of the original faces around it (Garland and Heckbert's quadric error metric),
+ * until the mesh is down to parameters.targetFaceCount faces or the next collapse would exceed
+ * parameters.maxError. At least one of them should be set.
+ *
+ * Colors, texture coordinates and normals of a merged vertex are interpolated along the
+ * collapsed edge. Collapses that would make the mesh non-manifold or flip a face are skipped.
+ * Unreferenced vertices are dropped from the result, which keeps the input's texture. */
+std::unique_ptr<sc3d::Geometry> decimateMesh(const sc3d::Geometry& mesh,
+                                             const DecimateMeshParameters& parameters = DecimateMeshParameters());
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
@@ -18,47 +18,57 @@ limitations under the License.
 
 #include "standard_cyborg/sc3d/Geometry.hpp"
 
-#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 
-struct Edge {
-    int i0, i1;
-    
-    Edge(int i0_, int i1_)
-    {
-        i0 = i0_;
-        i1 = i1_;
-    }
-};
+namespace {
 
-struct EdgeEqualUnordered {
-    bool operator()(const Edge& lhs, const Edge& rhs) const
-    {
-        return (lhs.i0 == rhs.i0 && lhs.i1 == rhs.i1) || (lhs.i0 == rhs.i1 && lhs.i1 == rhs.i0);
-    }
+// A half-edge under its undirected key: the lower vertex in the high 32 bits, the higher in the
+// low. Half-edge h runs from corner h % 3 of face h / 3 to the next corner.
+struct HalfEdgeKey {
+    uint64_t key;
+    int halfEdge;
 };
 
-struct EdgeEqualOrdered {
-    bool operator()(const Edge& lhs, const Edge& rhs) const
-    {
-        return (lhs.i0 == rhs.i0 && lhs.i1 == rhs.i1);
-    }
-};
+} // namespace
 
-struct EdgeHash {
-    std::size_t operator()(const Edge& k) const
-    {
-        // clang-format off
-        if (k.i0 < k.i1) {
-            return ((std::hash<int>()(k.i0)
-                  ^ (std::hash<int>()(k.i1) << 1)) >> 1);
+/* Stable LSD radix sort by key, 16 bits at a time. Digits that every key shares are skipped,
+ * which is most of them for meshes with fewer than 2^16 vertices. */
+static void radixSortByKey(std::vector<HalfEdgeKey>& entries)
+{
+    uint64_t anyBits = 0;
+    uint64_t allBits = ~(uint64_t)0;
+    for (const HalfEdgeKey& entry : entries) {
+        anyBits |= entry.key;
+        allBits &= entry.key;
+    }
+    uint64_t varyingBits = anyBits ^ allBits;
+    
+    std::vector<HalfEdgeKey> scratch(entries.size());
+    std::vector<int> digitStarts(1 << 16);
+    
+    for (int shift = 0; shift < 64; shift += 16) {
+        if (((varyingBits >> shift) & 0xffff) == 0) continue;
+        
+        std::fill(digitStarts.begin(), digitStarts.end(), 0);
+        for (const HalfEdgeKey& entry : entries) {
+            digitStarts[(entry.key >> shift) & 0xffff]++;
         }
-        else {
-            return ((std::hash<int>()(k.i1)
-                  ^ (std::hash<int>()(k.i0) << 1)) >> 1);
+        
+        int start = 0;
+        for (int& digitStart : digitStarts) {
+            int count = digitStart;
+            digitStart = start;
+            start += count;
+        }
+        
+        for (const HalfEdgeKey& entry : entries) {
+            scratch[digitStarts[(entry.key >> shift) & 0xffff]++] = entry;
         }
-        // clang-format on
+        
+        entries.swap(scratch);
     }
-};
+}
 
 namespace standard_cyborg {
 
@@ -71,80 +81,77 @@ namespace algorithms {
 
 std::vector<std::vector<std::pair<int, int>>> findEdgeLoops(const standard_cyborg::sc3d::Geometry& geometry)
 {
-    // counts how many times each edge can be found in the geometry.
-    std::unordered_map<Edge, int, EdgeHash, EdgeEqualUnordered> edgeCounts;
+    const std::vector<Face3>& faces = geometry.getFaces();
+    int halfEdgeCount = (int)faces.size() * 3;
+    
+    auto halfEdgeVertex = [&faces](int halfEdge, int offset) {
+        return faces[halfEdge / 3][(halfEdge % 3 + offset) % 3];
+    };
     
-    std::vector<std::set<int>> adjacencies;
-    for (int ii = 0; ii < geometry.vertexCount(); ++ii) {
-        adjacencies.push_back(std::set<int>());
+    // Sort the half-edges by undirected key. Boundary edges are those whose key appears once.
+    std::vector<HalfEdgeKey> keys(halfEdgeCount);
+    int vertexCount = 0;
+    for (int halfEdge = 0; halfEdge < halfEdgeCount; ++halfEdge) {
+        uint32_t a = (uint32_t)halfEdgeVertex(halfEdge, 0);
+        uint32_t b = (uint32_t)halfEdgeVertex(halfEdge, 1);
+        keys[halfEdge] = {(uint64_t)std::min(a, b) << 32 | std::max(a, b), halfEdge};
+        vertexCount = std::max(vertexCount, (int)std::max(a, b) + 1);
     }
     
-    for (int iface = 0; iface < geometry.getFaces().size(); ++iface) {
-        
-        Face3 f = geometry.getFaces()[iface];
+    radixSortByKey(keys);
+    
+    std::vector<uint8_t> isRemainingBoundary(halfEdgeCount, 0);
+    for (int run = 0; run < halfEdgeCount;) {
+        int runEnd = run + 1;
+        while (runEnd < halfEdgeCount && keys[runEnd].key == keys[run].key) { ++runEnd; }
         
-        int* faceIndices = (int*)((void*)&f);
+        if (runEnd - run == 1) isRemainingBoundary[keys[run].halfEdge] = 1;
         
-        for (int iedge = 0; iedge < 3; ++iedge) {
-            Edge edge(faceIndices[(iedge + 0) % 3], faceIndices[(iedge + 1) % 3]);
-            
-            edgeCounts[edge]++;
-            
-            adjacencies[edge.i0].insert(edge.i1);
-            adjacencies[edge.i1].insert(edge.i0);
-        }
+        run = runEnd;
     }
+    keys = std::vector<HalfEdgeKey>();
     
-    std::unordered_map<Edge, bool, EdgeHash, EdgeEqualOrdered> remainingEdges;
-    
-    for (const auto& it : edgeCounts) {
-        if (it.second == 1) {
-            remainingEdges.insert({it.first, true});
-        }
+    // Chain the boundary half-edges leaving each vertex, lowest first. A vertex only has more than
+    // one where separate loops touch.
+    std::vector<int> firstOutgoing(vertexCount, -1);
+    std::vector<int> nextOutgoing(halfEdgeCount, -1);
+    for (int halfEdge = halfEdgeCount - 1; halfEdge >= 0; --halfEdge) {
+        if (!isRemainingBoundary[halfEdge]) continue;
+        
+        int vertex = halfEdgeVertex(halfEdge, 0);
+        nextOutgoing[halfEdge] = firstOutgoing[vertex];
+        firstOutgoing[vertex] = halfEdge;
     }
     
-    std::vector<std::vector<Edge>> loops;
+    // Boundary edges run the way their face winds. Seeding loops in half-edge order lists them
+    // in the order the faces first reach them.
+    std::vector<std::vector<std::pair<int, int>>> result;
     
-    while (remainingEdges.size() > 0) {
-        std::vector<Edge> loop;
+    for (int seedHalfEdge = 0; seedHalfEdge < halfEdgeCount; ++seedHalfEdge) {
+        if (!isRemainingBoundary[seedHalfEdge]) continue;
         
-        const Edge seedEdge = remainingEdges.begin()->first;
-        remainingEdges.erase(remainingEdges.begin());
-        loop.push_back(seedEdge);
+        std::vector<std::pair<int, int>> loop;
         
-        Edge latestEdge = seedEdge;
-        while (seedEdge.i0 != latestEdge.i1) {
+        int seedVertex = halfEdgeVertex(seedHalfEdge, 0);
+        int latestVertex = halfEdgeVertex(seedHalfEdge, 1);
+        isRemainingBoundary[seedHalfEdge] = 0;
+        loop.push_back(std::pair<int, int>(seedVertex, latestVertex));
+        
+        while (seedVertex != latestVertex) {
+            // Drop walked half-edges from the front of the chain and take the first remaining
+            int& nextHalfEdge = firstOutgoing[latestVertex];
+            while (nextHalfEdge != -1 && !isRemainingBoundary[nextHalfEdge]) { nextHalfEdge = nextOutgoing[nextHalfEdge]; }
             
-            std::set<int> adjs = adjacencies[latestEdge.i1];
+            // Inconsistently wound faces can leave a boundary that doesn't close
+            if (nextHalfEdge == -1) break;
             
-            for (int adj : adjs) {
-                Edge attemptEdge(latestEdge.i1, adj);
-                
-                if (remainingEdges.count(attemptEdge) == 1) {
-                    auto iter = remainingEdges.find(attemptEdge);
-                    
-                    remainingEdges.erase(iter);
-                    loop.push_back(attemptEdge);
-                    latestEdge = attemptEdge;
-                    
-                    break;
-                }
-            }
-        }
-        
-        loops.push_back(loop);
-    }
-    
-    std::vector<std::vector<std::pair<int, int>>> result;
-    
-    for (const std::vector<Edge>& loop : loops) {
-        std::vector<std::pair<int, int>> convertedLoop;
-        
-        for (const Edge& edge : loop) {
-            convertedLoop.push_back(std::pair<int, int>(edge.i0, edge.i1));
+            int nextVertex = halfEdgeVertex(nextHalfEdge, 1);
+            isRemainingBoundary[nextHalfEdge] = 0;
+            loop.push_back(std::pair<int, int>(latestVertex, nextVertex));
+            latestVertex = nextVertex;
         }
         
-        result.push_back(convertedLoop);
+        result.push_back(loop);
     }
     
     return result;
@@ -36,6 +36,10 @@ class Geometry;
  std::pair<int,int> is an edge, which is represented
  as two index values, where the indexes refer to vertices in the passed in geometry.
  
+ Edges follow the winding of the faces they border. Loops are listed in the order the faces
+ first reach them, and each starts at its first edge in that order. Runs in time linear in the
+ number of faces, without building the geometry's topology.
+ 
  */
 
 namespace algorithms {
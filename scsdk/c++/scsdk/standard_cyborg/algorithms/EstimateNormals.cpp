@@ -0,0 +1,247 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "standard_cyborg/algorithms/EstimateNormals.hpp"
+
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/ColorImage.hpp"
+#include "standard_cyborg/sc3d/DepthImage.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/sc3d/PerspectiveCamera.hpp"
+#include "standard_cyborg/util/IncludeEigen.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdocumentation"
+#include <Eigen/Eigenvalues>
+#pragma clang diagnostic pop
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::ColorImage;
+using standard_cyborg::sc3d::DepthImage;
+using standard_cyborg::sc3d::Geometry;
+using standard_cyborg::sc3d::NeighborQueryResult;
+using standard_cyborg::sc3d::PerspectiveCamera;
+
+namespace standard_cyborg {
+
+namespace algorithms {
+
+// Neighbors are queried this many vertices at a time, to bound the size of the results
+static const int kQueryBlockSize = 65536;
+
+// The radius of a disk covering a square of unit side
+static const float kSquareCoveringRadius = 0.5f * std::sqrt(2.0f);
+
+/* The unit vector from position toward viewpoint, or +z if they coincide */
+static Vec3 directionToward(const Vec3& position, const Vec3& viewpoint)
+{
+    Vec3 direction = viewpoint - position;
+    float length = direction.norm();
+    return length > 0.0f ? direction / length : Vec3(0, 0, 1);
+}
+
+void estimateNormals(Geometry& geometry, const Vec3& viewpoint, int neighborCount, bool encodeSurfelRadius)
+{
+    int vertexCount = geometry.vertexCount();
+    const std::vector<Vec3>& positions = geometry.getPositions();
+    std::vector<Vec3> normals(vertexCount);
+    
+    std::vector<Vec3> queryPositions;
+    NeighborQueryResult neighbors;
+    
+    for (int blockBegin = 0; blockBegin < vertexCount; blockBegin += kQueryBlockSize) {
+        int blockEnd = std::min(vertexCount, blockBegin + kQueryBlockSize);
+        queryPositions.assign(positions.begin() + blockBegin, positions.begin() + blockEnd);
+        geometry.getNClosestVertexIndices(queryPositions, neighborCount, neighbors);
+        
+        parallelFor(blockEnd - blockBegin, [&](int begin, int end, int threadIndex) {
+            for (int query = begin; query < end; query++) {
+                int vertex = blockBegin + query;
+                const Vec3& position = positions[vertex];
+                int count = neighbors.neighborCount(query);
+                const int* indices = neighbors.indices.data() + neighbors.offsets[query];
+                const float* squaredDistances = neighbors.squaredDistances.data() + neighbors.offsets[query];
+                
+                Vec3 towardViewpoint = directionToward(position, viewpoint);
+                Vec3 normal = towardViewpoint;
+                float farthestSquaredDistance = 0.0f;
+                
+                if (count >= 3) {
+                    // Principal axes of the neighbors, relative to this vertex to keep precision
+                    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+                    Eigen::Matrix3d moments = Eigen::Matrix3d::Zero();
+                    for (int k = 0; k < count; k++) {
+                        Vec3 offset = positions[indices[k]] - position;
+                        Eigen::Vector3d d(offset.x, offset.y, offset.z);
+                        sum += d;
+                        moments.selfadjointView<Eigen::Lower>().rankUpdate(d);
+                        farthestSquaredDistance = std::max(farthestSquaredDistance, squaredDistances[k]);
+                    }
+                    
+                    Eigen::Vector3d mean = sum / count;
+                    Eigen::Matrix3d covariance = moments.selfadjointView<Eigen::Lower>();
+                    covariance -= count * mean * mean.transpose();
+                    
+                    // The normal is the direction of least spread
+                    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+                    solver.computeDirect(covariance);
+                    Eigen::Vector3d smallest = solver.eigenvectors().col(0);
+                    
+                    Vec3 estimate((float)smallest.x(), (float)smallest.y(), (float)smallest.z());
+                    float length = estimate.norm();
+                    if (length > 0.0f && std::isfinite(length)) {
+                        normal = estimate / length;
+                        if (Vec3::dot(normal, towardViewpoint) < 0.0f) normal = -normal;
+                    }
+                }
+                
+                if (encodeSurfelRadius) {
+                    // The neighbors share a disk out to the farthest of them, so a disk with
+                    // 1 / count of its area covers this vertex's share
+                    normal *= std::sqrt(farthestSquaredDistance / std::max(count, 1));
+                }
+                
+                normals[vertex] = normal;
+            }
+        }, 1024);
+    }
+    
+    geometry.setNormals(std::move(normals));
+    geometry.setNormalsEncodeSurfelRadius(encodeSurfelRadius);
+}
+
+Geometry unprojectFrameWithNormals(const PerspectiveCamera& camera,
+                                   const DepthImage& depth,
+                                   const ColorImage& color,
+                                   float minDepth,
+                                   float maxDepth,
+                                   bool encodeSurfelRadius,
+                                   float maxRelativeDepthDifference)
+{
+    int width = depth.getWidth();
+    int height = depth.getHeight();
+    const std::vector<float>& depths = depth.getData();
+    
+    auto isValid = [&](int index) {
+        float value = depths[index];
+        return !std::isnan(value) && value >= minDepth && value <= maxDepth;
+    };
+    
+    // Number the valid pixels in the order unprojectFrame emits them
+    std::vector<int> pointIndices(width * height, -1);
+    int pointCount = 0;
+    for (int index = 0; index < width * height; index++) {
+        if (isValid(index)) pointIndices[index] = pointCount++;
+    }
+    
+    std::vector<Vec3> positions(pointCount);
+    std::vector<Vec3> normals(pointCount);
+    std::vector<Vec3> colors(pointCount);
+    
+    parallelFor(height, [&](int beginRow, int endRow, int threadIndex) {
+        for (int row = beginRow; row < endRow; row++) {
+            for (int col = 0; col < width; col++) {
+                int pointIndex = pointIndices[row * width + col];
+                if (pointIndex == -1) continue;
+                
+                positions[pointIndex] = camera.unprojectDepthSample(width, height, col, row, depths[row * width + col]);
+                colors[pointIndex] = color.getPixelAtColRow(col, row).xyz();
+            }
+        }
+    }, 8);
+    
+    Vec3 cameraPosition = camera.getViewMatrixInverse() * Vec3(0, 0, 0);
+    
+    parallelFor(height, [&](int beginRow, int endRow, int threadIndex) {
+        for (int row = beginRow; row < endRow; row++) {
+            for (int col = 0; col < width; col++) {
+                int pixelIndex = row * width + col;
+                int pointIndex = pointIndices[pixelIndex];
+                if (pointIndex == -1) continue;
+                
+                float pixelDepth = depths[pixelIndex];
+                float maxDepthDifference = maxRelativeDepthDifference * std::abs(pixelDepth);
+                const Vec3& position = positions[pointIndex];
+                
+                // The point of the neighboring pixel, if it's on the same surface
+                auto neighborPoint = [&](int neighborCol, int neighborRow) -> const Vec3* {
+                    if (neighborCol < 0 || neighborCol >= width || neighborRow < 0 || neighborRow >= height) return nullptr;
+                    int neighborIndex = neighborRow * width + neighborCol;
+                    int neighborPointIndex = pointIndices[neighborIndex];
+                    if (neighborPointIndex == -1) return nullptr;
+                    if (std::abs(depths[neighborIndex] - pixelDepth) > maxDepthDifference) return nullptr;
+                    return &positions[neighborPointIndex];
+                };
+                
+                // The surface's step across one pixel, by central differences where both neighbors
+                // are usable and one-sided ones otherwise
+                auto tangent = [&](const Vec3* previous, const Vec3* next, Vec3& step) {
+                    if (previous && next) {
+                        step = 0.5f * (*next - *previous);
+                    } else if (next) {
+                        step = *next - position;
+                    } else if (previous) {
+                        step = position - *previous;
+                    } else {
+                        return false;
+                    }
+                    return true;
+                };
+                
+                Vec3 towardCamera = directionToward(position, cameraPosition);
+                Vec3 normal = towardCamera;
+                Vec3 colStep, rowStep;
+                bool hasColStep = tangent(neighborPoint(col - 1, row), neighborPoint(col + 1, row), colStep);
+                bool hasRowStep = tangent(neighborPoint(col, row - 1), neighborPoint(col, row + 1), rowStep);
+                
+                if (hasColStep && hasRowStep) {
+                    Vec3 estimate = Vec3::cross(colStep, rowStep);
+                    float length = estimate.norm();
+                    if (length > 0.0f) {
+                        normal = estimate / length;
+                        if (Vec3::dot(normal, towardCamera) < 0.0f) normal = -normal;
+                    }
+                }
+                
+                if (encodeSurfelRadius) {
+                    // Cover the pixel's footprint, from its neighbors where it has them and from
+                    // the spacing of pixels at its depth where it doesn't
+                    float spacing = std::max(hasColStep ? colStep.norm() : 0.0f, hasRowStep ? rowStep.norm() : 0.0f);
+                    if (spacing == 0.0f) {
+                        Vec3 adjacent = camera.unprojectDepthSample(width, height, col + 1, row, pixelDepth);
+                        spacing = Vec3::distanceBetween(adjacent, position);
+                    }
+                    normal *= kSquareCoveringRadius * spacing;
+                }
+                
+                normals[pointIndex] = normal;
+            }
+        }
+    }, 8);
+    
+    Geometry geometryOut(std::move(positions), std::move(normals), std::move(colors));
+    geometryOut.setNormalsEncodeSurfelRadius(encodeSurfelRadius);
+    return geometryOut;
+}
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
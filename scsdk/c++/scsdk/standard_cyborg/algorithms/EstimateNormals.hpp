@@ -0,0 +1,65 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <limits>
+
+namespace standard_cyborg {
+
+namespace math {
+struct Vec3;
+}
+
+namespace sc3d {
+class ColorImage;
+class DepthImage;
+class Geometry;
+class PerspectiveCamera;
+}
+
+namespace algorithms {
+
+/* Estimate a normal for every vertex of a point cloud from the principal axes of its
+ * neighborCount nearest vertices, found in parallel through the geometry's kd-tree. Normals are
+ * flipped to face viewpoint, such as the position of the camera that captured the cloud. Vertices
+ * with fewer than three neighbors get the direction toward viewpoint.
+ *
+ * If encodeSurfelRadius, each normal's length is the radius of a disk covering the vertex's share
+ * of the surface around it, and geometry's normalsEncodeSurfelRadius() is set to match;
+ * otherwise normals are unit length and it is cleared. */
+void estimateNormals(sc3d::Geometry& geometry,
+                     const math::Vec3& viewpoint,
+                     int neighborCount = 16,
+                     bool encodeSurfelRadius = false);
+
+/* Unproject depth and color into a point cloud exactly as PerspectiveCamera::unprojectFrame does,
+ * with a normal for each point estimated from the points of the neighboring pixels, which is far
+ * cheaper than searching for neighbors in space. A neighbor whose depth differs from the pixel's
+ * own by more than maxRelativeDepthDifference of it lies across an edge and is left out. Normals
+ * face the camera, and encodeSurfelRadius works as for estimateNormals, with radii covering each
+ * pixel's footprint on the surface. */
+sc3d::Geometry unprojectFrameWithNormals(const sc3d::PerspectiveCamera& camera,
+                                         const sc3d::DepthImage& depth,
+                                         const sc3d::ColorImage& color,
+                                         float minDepth = 0,
+                                         float maxDepth = std::numeric_limits<float>::max(),
+                                         bool encodeSurfelRadius = false,
+                                         float maxRelativeDepthDifference = 0.05f);
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
@@ -16,16 +16,21 @@ limitations under the License.
 
 #include "standard_cyborg/algorithms/EstimatePlane.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
-
-#include <map>
-#include <queue>
+#include <random>
 
 #include "standard_cyborg/util/DataUtils.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
 #include "standard_cyborg/math/Vec3.hpp"
 #include "standard_cyborg/sc3d/VertexSelection.hpp"
 
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdocumentation"
+#include <Eigen/Eigenvalues>
+#pragma clang diagnostic pop
+
 using standard_cyborg::sc3d::Face3;
 using standard_cyborg::sc3d::Plane;
 using standard_cyborg::math::Vec3;
@@ -35,6 +40,75 @@ namespace standard_cyborg {
 
 namespace algorithms {
 
+/* The least-squares plane through a set of points */
+struct PlaneFit {
+    int count = 0;
+    Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+    Eigen::Vector3f normal = Eigen::Vector3f::UnitZ();
+    
+    /* Sum of the squared distances of the points from the plane */
+    double squaredDistanceSum = 0.0;
+};
+
+/* Fit a plane to the positions selected by mask from their 3x3 scatter matrix, which is
+ * accumulated in parallel relative to reference so that far-off clouds don't lose precision */
+static PlaneFit fitPlane(const std::vector<Vec3>& positions, const std::vector<uint8_t>& mask, const Vec3& reference)
+{
+    // The count, the sums of x, y and z, and the sums of xx, xy, xz, yy, yz and zz
+    typedef Eigen::Matrix<double, 10, 1> Sums;
+    
+    Sums sums = parallelSum((int)positions.size(), Sums::Zero().eval(), [&](int begin, int end) {
+        Sums chunkSums = Sums::Zero();
+        for (int i = begin; i < end; i++) {
+            if (!mask[i]) continue;
+            
+            double x = positions[i].x - reference.x;
+            double y = positions[i].y - reference.y;
+            double z = positions[i].z - reference.z;
+            chunkSums(0) += 1.0;
+            chunkSums(1) += x;
+            chunkSums(2) += y;
+            chunkSums(3) += z;
+            chunkSums(4) += x * x;
+            chunkSums(5) += x * y;
+            chunkSums(6) += x * z;
+            chunkSums(7) += y * y;
+            chunkSums(8) += y * z;
+            chunkSums(9) += z * z;
+        }
+        return chunkSums;
+    });
+    
+    PlaneFit fit;
+    fit.count = (int)sums(0);
+    if (fit.count == 0) return fit;
+    
+    Eigen::Vector3d mean = sums.segment<3>(1) / sums(0);
+    Eigen::Matrix3d scatter;
+    scatter <<
+        sums(4), sums(5), sums(6),
+        sums(5), sums(7), sums(8),
+        sums(6), sums(8), sums(9);
+    scatter -= sums(0) * mean * mean.transpose();
+    
+    // The normal is the direction of least spread, the eigenvector of the smallest eigenvalue
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(scatter);
+    
+    fit.centroid = (mean + Eigen::Vector3d(reference.x, reference.y, reference.z)).cast<float>();
+    fit.normal = solver.eigenvectors().col(0).cast<float>();
+    fit.squaredDistanceSum = std::max(0.0, solver.eigenvalues()(0));
+    
+    return fit;
+}
+
+/* EstimatePlaneResult::rmsProjectedDistance for a fit. The smallest eigenvalue is the sum of the
+ * inliers' squared distances from the plane, and this takes its RMS over all three coordinates of
+ * each inlier, the scale estimatePlane's threshold and tolerances have always been tuned against. */
+static float rmsProjectedDistanceOf(const PlaneFit& fit)
+{
+    return (float)std::sqrt(fit.squaredDistanceSum / (3.0 * fit.count));
+}
+
 EstimatePlaneResult estimatePlane(const std::vector<Vec3>& positions,
                                   const VertexSelection& initialVertexSet,
                                   int maxIterations,
@@ -46,22 +120,26 @@ EstimatePlaneResult estimatePlane(const std::vector<Vec3>& positions,
     
     EstimatePlaneResult result;
 
-    std::unique_ptr<VertexSelection> currentVertexSet = std::make_unique<VertexSelection>();
-    currentVertexSet->copy(initialVertexSet);
+    // The current inlier subset, one flag per vertex
+    std::vector<uint8_t> inliers(vertexCount, 0);
 
     // If an initial set is provided this is unnecessary, but we'll elect to make seeding the RNG
     // not conditional.
     std::srand(0);
     
-    if (currentVertexSet->size() == 0) {
+    if (initialVertexSet.size() == 0) {
         // If no initial set of vertices is provided, seed it with 1/3 of the vertices, randomly selected.
         // In general this does not work very well, so it's highly advised to use gravity or some sort of
         // heuristic to make an educated initial guess
         for (int i = 0; i < vertexCount; i++) {
             if (std::rand() % 3 == 1) {
-                currentVertexSet->insertValue(i);
+                inliers[i] = 1;
             }
         }
+    } else {
+        for (int index : initialVertexSet) {
+            if (index >= 0 && index < vertexCount) inliers[index] = 1;
+        }
     }
     
     Plane bestFit;
@@ -69,42 +147,26 @@ EstimatePlaneResult estimatePlane(const std::vector<Vec3>& positions,
     float previousRMS = 1e-10;
     float rmsProjectedDistance = 1e10;
 
-
-    auto positionsMatrix(toMatrix3Xf(positions));
-    Eigen::Matrix3Xf debiasedPositions = Eigen::Matrix3Xf(3, vertexCount);
-
-    Eigen::Vector3f normal;
-    Eigen::Vector3f centroid;
+    Eigen::Vector3f normal = Eigen::Vector3f::UnitZ();
+    Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+    Vec3 reference = vertexCount > 0 ? positions[0] : Vec3();
     
-    // This algorithm works by computing the singular vector corresponding to the smallest
-    // singular value of a set of vertices. The first two singular vectors lie in the desired
-    // plane, so the third singular vector is by definition then normal to the estimated plane.
+    // This algorithm works by computing the eigenvector corresponding to the smallest eigenvalue
+    // of the scatter matrix of a set of vertices, which is the direction in which they spread
+    // least and so by definition normal to the estimated plane. The scatter matrix is summed in
+    // one parallel pass over the inlier mask, without gathering the inliers anywhere.
     //
     // After each plane estimation, the RMS projected distance for all inlier points is computed.
     // All points of the original point cloud are compared against this value, new inlier/outliers
     // are selected, and we return to fitting.
 
     for (int iteration = 0; iteration < maxIterations; iteration++) {
-        // Extract the current inlier subset into a Matrix3Xf.
-        int subsetSize = (int)currentVertexSet->size();
-        Eigen::Matrix3Xf subsetPositions(3, subsetSize);
-        int j = 0;
-        
-        for (auto index : *currentVertexSet) {
-            subsetPositions.col(j++) = positionsMatrix.col(index);
-        }
-        
-        // Compute the centroid of the inlier subset
-        centroid = subsetPositions.rowwise().mean();
-
-        // Subtract off the centroid from the inlier subset
-        subsetPositions.colwise() -= centroid;
+        PlaneFit fit = fitPlane(positions, inliers, reference);
+        if (fit.count == 0) break;
         
-        // Compute the plane
-        Eigen::BDCSVD<Eigen::Matrix3Xf> svd = subsetPositions.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV);
-        
-        // The normal is the smallest left singular vector
-        normal = svd.matrixU().col(2);
+        centroid = fit.centroid;
+        normal = fit.normal;
+        reference = standard_cyborg::toVec3(centroid);
         
         // To determine convergence, the remaining section below computes the out-of-plane projected distance
         // for each vertex and from that computes the aggregate RMS out-of-plane distance (roughly speaking,
@@ -112,11 +174,7 @@ EstimatePlaneResult estimatePlane(const std::vector<Vec3>& positions,
         // points of the original point cloud and tags anything within, say five standard deviations as being an
         // inlier. That becomes the new set of vertices to which it fits a plane in the next iteration.
         
-        // Subtract the current centroid from the subset positions and compute the RMS projected distance.
-        // This could be optimized by looping and adding without storing the intermediate result.
-        rmsProjectedDistance = (normal.transpose() * subsetPositions).norm() / std::sqrt(subsetPositions.size());
-
-        Eigen::VectorXf projectedDistanceFactor = (normal.transpose() * (positionsMatrix.colwise() - centroid) / rmsProjectedDistance).cwiseAbs();
+        rmsProjectedDistance = rmsProjectedDistanceOf(fit);
 
         bestFit.position = standard_cyborg::toVec3(centroid);
         bestFit.normal = standard_cyborg::toVec3(normal);
@@ -128,17 +186,22 @@ EstimatePlaneResult estimatePlane(const std::vector<Vec3>& positions,
         float relativeRMSDistance = std::abs(rmsProjectedDistance - previousRMS) / std::max(rmsProjectedDistance, previousRMS);
         if (relativeRMSDistance < relativeConvergenceTolerance) break;
 
-        // Recompute the subset indices
-        currentVertexSet->clear();
-        for (int j = 0; j < vertexCount; j++) {
-            if (projectedDistanceFactor[j] < outlierStandardDeviationThreshold) currentVertexSet->insertValue(j);
-        }
+        // Recompute the subset
+        float maxProjectedDistance = outlierStandardDeviationThreshold * rmsProjectedDistance;
+        Vec3 planePosition = bestFit.position;
+        Vec3 planeNormal = bestFit.normal;
+        
+        parallelFor(vertexCount, [&](int begin, int end, int threadIndex) {
+            for (int j = begin; j < end; j++) {
+                inliers[j] = std::abs(Vec3::dot(planeNormal, positions[j] - planePosition)) < maxProjectedDistance;
+            }
+        }, 4096);
         
         previousRMS = rmsProjectedDistance;
     }
     
     result.rmsProjectedDistance = rmsProjectedDistance;
-    result.planeVertices->copy(*currentVertexSet);
+    result.planeVertices = VertexSelection::fromMask(inliers);
     result.plane.position = standard_cyborg::toVec3(centroid);
     result.plane.normal = standard_cyborg::toVec3(normal);
     result.converged = true;
@@ -146,6 +209,131 @@ EstimatePlaneResult estimatePlane(const std::vector<Vec3>& positions,
     return result;
 }
 
+/* Flag the remaining points within maxDistance of the plane through point with unit normal
+ * normal as inliers, and return how many there are */
+static int findPlaneInliers(const std::vector<Vec3>& positions,
+                            const std::vector<uint8_t>& remaining,
+                            const Vec3& point,
+                            const Vec3& normal,
+                            float maxDistance,
+                            std::vector<uint8_t>& inliers)
+{
+    return parallelSum((int)positions.size(), 0, [&](int begin, int end) {
+        int count = 0;
+        for (int i = begin; i < end; i++) {
+            inliers[i] = remaining[i] && std::abs(Vec3::dot(normal, positions[i] - point)) < maxDistance;
+            count += inliers[i];
+        }
+        return count;
+    });
+}
+
+std::vector<EstimatePlaneResult> extractPlanes(const std::vector<Vec3>& positions, const ExtractPlanesParameters& parameters)
+{
+    std::vector<EstimatePlaneResult> planes;
+    
+    int vertexCount = static_cast<int>(positions.size());
+    int minInlierCount = std::max(3, parameters.minInlierCount);
+    
+    std::mt19937 prng(parameters.seed);
+    std::vector<uint8_t> remaining(vertexCount, 1);
+    std::vector<uint8_t> inliers(vertexCount, 0);
+    std::vector<int> remainingIndices;
+    std::vector<Vec3> sample;
+    int remainingCount = vertexCount;
+    
+    while ((int)planes.size() < parameters.maxPlanes && remainingCount >= minInlierCount) {
+        // Score hypotheses against a random sample of the points no plane has claimed yet
+        remainingIndices.clear();
+        for (int i = 0; i < vertexCount; i++) {
+            if (remaining[i]) remainingIndices.push_back(i);
+        }
+        
+        int sampleSize = std::min(std::max(3, parameters.scoringSampleSize), remainingCount);
+        std::uniform_int_distribution<int> randomRemaining(0, remainingCount - 1);
+        sample.resize(sampleSize);
+        for (Vec3& samplePosition : sample) {
+            samplePosition = positions[remainingIndices[randomRemaining(prng)]];
+        }
+        
+        std::uniform_int_distribution<int> randomSample(0, sampleSize - 1);
+        int bestScore = 0;
+        Vec3 bestPoint;
+        Vec3 bestNormal;
+        int hypothesisLimit = parameters.maxHypotheses;
+        
+        for (int hypothesis = 0; hypothesis < hypothesisLimit; hypothesis++) {
+            const Vec3& a = sample[randomSample(prng)];
+            const Vec3& b = sample[randomSample(prng)];
+            const Vec3& c = sample[randomSample(prng)];
+            
+            Vec3 ab = b - a;
+            Vec3 ac = c - a;
+            Vec3 normal = Vec3::cross(ab, ac);
+            
+            // Skip repeated and collinear triples
+            float normalLengthSquared = normal.squaredNorm();
+            if (!(normalLengthSquared > 1e-12f * ab.squaredNorm() * ac.squaredNorm())) continue;
+            normal /= std::sqrt(normalLengthSquared);
+            
+            int score = 0;
+            for (const Vec3& samplePosition : sample) {
+                score += std::abs(Vec3::dot(normal, samplePosition - a)) < parameters.inlierDistance;
+            }
+            
+            if (score > bestScore) {
+                bestScore = score;
+                bestPoint = a;
+                bestNormal = normal;
+                
+                // Stop once a hypothesis at least this good would have turned up with the requested
+                // confidence, given the chance of drawing three of its inliers
+                double allInliersProbability = std::pow((double)score / sampleSize, 3.0);
+                if (allInliersProbability >= 1.0) break;
+                
+                double requiredHypotheses = std::log(1.0 - parameters.confidence) / std::log(1.0 - allInliersProbability);
+                hypothesisLimit = (int)std::min<double>(hypothesisLimit, std::ceil(requiredHypotheses));
+            }
+        }
+        
+        if (bestScore < 3) break;
+        
+        // Refit the winner to all of its inliers, then once more to the inliers of the refit
+        Vec3 planePosition = bestPoint;
+        Vec3 planeNormal = bestNormal;
+        PlaneFit fit;
+        
+        for (int refinement = 0; refinement < 2; refinement++) {
+            int inlierCount = findPlaneInliers(positions, remaining, planePosition, planeNormal, parameters.inlierDistance, inliers);
+            if (inlierCount < minInlierCount) {
+                fit = PlaneFit();
+                break;
+            }
+            
+            fit = fitPlane(positions, inliers, planePosition);
+            planePosition = standard_cyborg::toVec3(fit.centroid);
+            planeNormal = standard_cyborg::toVec3(fit.normal);
+        }
+        
+        if (fit.count < minInlierCount) break;
+        
+        EstimatePlaneResult result;
+        result.plane.position = planePosition;
+        result.plane.normal = planeNormal;
+        result.rmsProjectedDistance = rmsProjectedDistanceOf(fit);
+        result.planeVertices = VertexSelection::fromMask(inliers);
+        result.converged = true;
+        planes.push_back(std::move(result));
+        
+        for (int i = 0; i < vertexCount; i++) {
+            if (inliers[i]) remaining[i] = 0;
+        }
+        remainingCount -= fit.count;
+    }
+    
+    return planes;
+}
+
 }
 
 } // namespace StandardCyborg
@@ -33,10 +33,19 @@ namespace algorithms {
 struct EstimatePlaneResult {
     standard_cyborg::sc3d::Plane plane;
     bool converged = false;
+    
+    /* The RMS distance of planeVertices from plane, taken over all three coordinates of each
+     * vertex: the RMS point-to-plane distance divided by sqrt(3) */
     float rmsProjectedDistance = 0.0;
     std::unique_ptr<standard_cyborg::sc3d::VertexSelection> planeVertices = std::make_unique<standard_cyborg::sc3d::VertexSelection>();
 };
 
+/* Fit a plane to positions by repeatedly refitting it to its inliers. Starting from initialVertexSet,
+ * or a random third of positions if it is empty, each iteration fits a plane to the current inliers
+ * and then takes as inliers every point within outlierStandardDeviationThreshold times
+ * rmsProjectedDistance of it. Stops after maxIterations, once rmsProjectedDistance falls below
+ * absoluteConvergenceTolerance, or once it changes by less than relativeConvergenceTolerance of
+ * itself. The threshold and absoluteConvergenceTolerance are both on rmsProjectedDistance's scale. */
 EstimatePlaneResult estimatePlane(const std::vector<standard_cyborg::math::Vec3>& positions,
                                   const standard_cyborg::sc3d::VertexSelection& initialVertexSet = standard_cyborg::sc3d::VertexSelection(),
                                   int maxIterations = 20,
@@ -44,6 +53,36 @@ EstimatePlaneResult estimatePlane(const std::vector<standard_cyborg::math::Vec3>
                                   float relativeConvergenceTolerance = 1e-4,
                                   float absoluteConvergenceTolerance = 1e-7);
 
+struct ExtractPlanesParameters {
+    /* Stop after finding this many planes */
+    int maxPlanes = 3;
+    
+    /* Points within this distance of a plane are its inliers */
+    float inlierDistance = 0.01f;
+    
+    /* Stop once the best remaining plane has fewer inliers than this */
+    int minInlierCount = 1000;
+    
+    /* Hypotheses per plane stop once one with at least the best inlier ratio so far would have
+     * been drawn with this probability */
+    float confidence = 0.999f;
+    
+    /* The most hypotheses to try per plane */
+    int maxHypotheses = 1000;
+    
+    /* Hypotheses are scored against a random sample of this many remaining points rather than
+     * against all of them; the winner is then refit to all of its inliers */
+    int scoringSampleSize = 4096;
+    
+    int seed = 0;
+};
+
+/* Find up to parameters.maxPlanes planes in positions by RANSAC, largest first, such as a floor,
+ * walls and a table top. Each plane's inliers are removed before searching for the next, so no
+ * point belongs to two planes. Each plane is a least-squares fit to its inliers. */
+std::vector<EstimatePlaneResult> extractPlanes(const std::vector<standard_cyborg::math::Vec3>& positions,
+                                               const ExtractPlanesParameters& parameters = ExtractPlanesParameters());
+
 
 }
 
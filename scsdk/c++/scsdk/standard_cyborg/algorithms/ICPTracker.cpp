@@ -0,0 +1,224 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "standard_cyborg/algorithms/ICPTracker.hpp"
+
+#include "standard_cyborg/sc3d/Float3View.hpp"
+#include "standard_cyborg/util/AssertHelper.hpp"
+#include "standard_cyborg/util/IncludeEigen.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdocumentation"
+#include <Eigen/Cholesky>
+#pragma clang diagnostic pop
+
+#include <algorithm>
+#include <cmath>
+
+using standard_cyborg::math::Mat3x4;
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Float3View;
+using standard_cyborg::sc3d::Geometry;
+
+namespace standard_cyborg {
+
+namespace algorithms {
+
+// The normal equations are summed in fixed-size chunks of points, and the chunks in order, so
+// that the pose doesn't depend on the number of threads. Each chunk's sums are stored as the
+// 6x6 Gauss-Newton matrix, the right-hand side, the squared residual and the inlier count.
+static const int kChunkSize = 2048;
+static const int kChunkSumCount = 6 * 6 + 6 + 2;
+
+static Eigen::Affine3d toAffine(const Mat3x4& m)
+{
+    Eigen::Affine3d affine = Eigen::Affine3d::Identity();
+    affine.matrix().topRows<3>() <<
+        m.m00, m.m01, m.m02, m.m03,
+        m.m10, m.m11, m.m12, m.m13,
+        m.m20, m.m21, m.m22, m.m23;
+    return affine;
+}
+
+static Mat3x4 toMat3x4(const Eigen::Affine3d& t)
+{
+    return Mat3x4{
+        (float)t(0, 0), (float)t(0, 1), (float)t(0, 2), (float)t(0, 3),
+        (float)t(1, 0), (float)t(1, 1), (float)t(1, 2), (float)t(1, 3),
+        (float)t(2, 0), (float)t(2, 1), (float)t(2, 2), (float)t(2, 3)
+    };
+}
+
+ICPTracker::ICPTracker(const Geometry& model, const ICPTrackerParameters& parameters, const Mat3x4& initialPose) :
+    _parameters(parameters),
+    _pose(initialPose)
+{
+    setModel(model);
+}
+
+void ICPTracker::setModel(const Geometry& model)
+{
+    SCASSERT(model.hasNormals(), "ICPTracker requires a model with normals");
+    
+    _model.copy(model);
+    
+    // Build the kd-tree now rather than during the first frame
+    if (_model.vertexCount() > 0) {
+        _model.getClosestVertexIndex(Vec3(0, 0, 0));
+    }
+}
+
+const Geometry& ICPTracker::getModel() const
+{
+    return _model;
+}
+
+Mat3x4 ICPTracker::getPose() const
+{
+    return _pose;
+}
+
+void ICPTracker::setPose(const Mat3x4& pose)
+{
+    _pose = pose;
+}
+
+const ICPTrackerParameters& ICPTracker::getParameters() const
+{
+    return _parameters;
+}
+
+void ICPTracker::setParameters(const ICPTrackerParameters& parameters)
+{
+    _parameters = parameters;
+}
+
+ICPTrackingResult ICPTracker::track(const Geometry& frame)
+{
+    ICPTrackingResult result;
+    result.pose = _pose;
+    
+    int stride = std::max(1, _parameters.sampleStride);
+    int sampleCount = (frame.vertexCount() + stride - 1) / stride;
+    if (sampleCount == 0 || _model.vertexCount() == 0) return result;
+    
+    Float3View framePositions = frame.getPositionsView();
+    Float3View modelPositions = _model.getPositionsView();
+    Float3View modelNormals = _model.getNormalsView();
+    
+    int chunkCount = (sampleCount + kChunkSize - 1) / kChunkSize;
+    _chunkSums.resize((size_t)chunkCount * kChunkSumCount);
+    
+    const float maxDistanceSquared = _parameters.maxCorrespondenceDistance * _parameters.maxCorrespondenceDistance;
+    Eigen::Affine3d pose = toAffine(_pose);
+    
+    while (result.iterations < _parameters.maxIterations) {
+        result.iterations++;
+        
+        Eigen::Matrix3f rotation = pose.linear().cast<float>();
+        Eigen::Vector3f translation = pose.translation().cast<float>();
+        
+        parallelFor(chunkCount, [&](int beginChunk, int endChunk, int threadIndex) {
+            for (int chunk = beginChunk; chunk < endChunk; chunk++) {
+                Eigen::Matrix<double, 6, 6> lhs = Eigen::Matrix<double, 6, 6>::Zero();
+                Eigen::Matrix<double, 6, 1> rhs = Eigen::Matrix<double, 6, 1>::Zero();
+                double squaredError = 0.0;
+                int inlierCount = 0;
+                
+                int end = std::min(sampleCount, (chunk + 1) * kChunkSize);
+                for (int i = chunk * kChunkSize; i < end; i++) {
+                    const float* frameElement = framePositions.data + (size_t)i * stride * framePositions.stride;
+                    Eigen::Vector3f p = rotation * Eigen::Map<const Eigen::Vector3f>(frameElement) + translation;
+                    Vec3 point(p.x(), p.y(), p.z());
+                    
+                    int id = _model.getClosestVertexIndex(point);
+                    Vec3 modelPoint = modelPositions[id];
+                    if (Vec3::squaredDistanceBetween(point, modelPoint) > maxDistanceSquared) continue;
+                    
+                    // Linearize the distance to the model point's tangent plane in a small
+                    // rotation (about the origin) and translation of the frame point
+                    Vec3 normal = modelNormals[id];
+                    double residual = Vec3::dot(normal, point - modelPoint);
+                    Vec3 moment = Vec3::cross(point, normal);
+                    
+                    Eigen::Matrix<double, 6, 1> jacobian;
+                    jacobian << moment.x, moment.y, moment.z, normal.x, normal.y, normal.z;
+                    
+                    lhs.selfadjointView<Eigen::Upper>().rankUpdate(jacobian);
+                    rhs -= jacobian * residual;
+                    squaredError += residual * residual;
+                    inlierCount++;
+                }
+                
+                double* sums = &_chunkSums[(size_t)chunk * kChunkSumCount];
+                Eigen::Map<Eigen::Matrix<double, 6, 6>> chunkLhs(sums);
+                Eigen::Map<Eigen::Matrix<double, 6, 1>> chunkRhs(sums + 36);
+                chunkLhs = lhs;
+                chunkRhs = rhs;
+                sums[42] = squaredError;
+                sums[43] = inlierCount;
+            }
+        }, 1);
+        
+        Eigen::Matrix<double, 6, 6> lhs = Eigen::Matrix<double, 6, 6>::Zero();
+        Eigen::Matrix<double, 6, 1> rhs = Eigen::Matrix<double, 6, 1>::Zero();
+        double squaredError = 0.0;
+        int inlierCount = 0;
+        
+        for (int chunk = 0; chunk < chunkCount; chunk++) {
+            const double* sums = &_chunkSums[(size_t)chunk * kChunkSumCount];
+            lhs += Eigen::Map<const Eigen::Matrix<double, 6, 6>>(sums);
+            rhs += Eigen::Map<const Eigen::Matrix<double, 6, 1>>(sums + 36);
+            squaredError += sums[42];
+            inlierCount += (int)sums[43];
+        }
+        
+        result.inlierCount = inlierCount;
+        result.rmsError = inlierCount > 0 ? (float)std::sqrt(squaredError / inlierCount) : 0.0f;
+        
+        if (inlierCount < std::max(6.0f, _parameters.minInlierFraction * sampleCount)) {
+            result.succeeded = false;
+            return result;
+        }
+        
+        Eigen::Matrix<double, 6, 1> update = lhs.selfadjointView<Eigen::Upper>().ldlt().solve(rhs);
+        Eigen::Vector3d rotationUpdate = update.head<3>();
+        Eigen::Vector3d translationUpdate = update.tail<3>();
+        double angle = rotationUpdate.norm();
+        
+        Eigen::Affine3d step = Eigen::Affine3d(Eigen::Translation3d(translationUpdate));
+        if (angle > 0.0) {
+            step.rotate(Eigen::AngleAxisd(angle, rotationUpdate / angle));
+        }
+        pose = step * pose;
+        
+        if (angle < _parameters.stop && translationUpdate.norm() < _parameters.stop) {
+            result.converged = true;
+            break;
+        }
+    }
+    
+    result.pose = toMat3x4(pose);
+    result.succeeded = true;
+    _pose = result.pose;
+    
+    return result;
+}
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
@@ -0,0 +1,107 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "standard_cyborg/math/Mat3x4.hpp"
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+
+namespace standard_cyborg {
+
+namespace algorithms {
+
+struct ICPTrackerParameters {
+    /* Gauss-Newton iterations per frame */
+    int maxIterations = 15;
+    
+    /* Frame points farther than this from their nearest model point are left out, in meters */
+    float maxCorrespondenceDistance = 0.02f;
+    
+    /* Use every sampleStride'th frame point */
+    int sampleStride = 1;
+    
+    /* Iterations stop once an update rotates by less than this many radians and translates by
+     * less than this many meters */
+    float stop = 1e-5f;
+    
+    /* Tracking fails, leaving the pose where it was, when fewer than this fraction of the
+     * sampled frame points find a correspondence */
+    float minInlierFraction = 0.25f;
+};
+
+struct ICPTrackingResult {
+    /* The frame's pose, mapping its points into the model's coordinates */
+    math::Mat3x4 pose;
+    
+    int iterations = 0;
+    
+    /* Number of frame points with a correspondence in the last iteration */
+    int inlierCount = 0;
+    
+    /* Root mean square point-to-plane distance over those correspondences, in meters */
+    float rmsError = 0;
+    
+    /* Whether the updates fell below ICPTrackerParameters::stop before maxIterations */
+    bool converged = false;
+    
+    /* Whether enough correspondences were found to trust pose */
+    bool succeeded = false;
+};
+
+/*
+ * Tracks a sequence of depth frames, such as PerspectiveCamera::unprojectFrame clouds, against a
+ * fixed model by point-to-plane ICP. Each frame starts from the previous frame's pose, pairs its
+ * points with their nearest model points through the model's kd-tree, which is built once up
+ * front, and refines the pose by Gauss-Newton. Frames are read in place and scratch space is kept
+ * between frames, so a steady stream of similarly sized frames allocates nothing after the first.
+ *
+ * Not safe to track from several threads at once; each call already runs in parallel.
+ */
+class ICPTracker {
+public:
+    /* The model must have normals. It is shared with, not copied from, the caller's Geometry. */
+    explicit ICPTracker(const sc3d::Geometry& model,
+                        const ICPTrackerParameters& parameters = ICPTrackerParameters(),
+                        const math::Mat3x4& initialPose = math::Mat3x4());
+    
+    /* Replace the model, e.g. after fusing more frames into it, keeping the current pose */
+    void setModel(const sc3d::Geometry& model);
+    const sc3d::Geometry& getModel() const;
+    
+    /* Align frame to the model, starting from getPose(). On success the pose becomes the result's. */
+    ICPTrackingResult track(const sc3d::Geometry& frame);
+    
+    math::Mat3x4 getPose() const;
+    void setPose(const math::Mat3x4& pose);
+    
+    const ICPTrackerParameters& getParameters() const;
+    void setParameters(const ICPTrackerParameters& parameters);
+    
+private:
+    sc3d::Geometry _model;
+    ICPTrackerParameters _parameters;
+    math::Mat3x4 _pose;
+    
+    // Per-chunk sums of the normal equations, kept to avoid reallocating them for every frame
+    std::vector<double> _chunkSums;
+};
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
@@ -17,13 +17,28 @@ limitations under the License.
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <vector>
 
+#include "standard_cyborg/util/ParallelFor.hpp"
+
 namespace standard_cyborg {
 namespace algorithms {
 
+/*
+ * k-means clustering over any point type, described by an adaptor providing:
+ *
+ *     typedef ... DistanceType;
+ *     typedef ... PointType;      // default-constructs to zero and supports += and *= DistanceType
+ *     static DistanceType distanceComparisonMetric(const PointType&, const PointType&);
+ *     static DistanceType distanceMetric(const PointType&, const PointType&);
+ *
+ * distanceMetric must be a true metric, since the triangle inequality is what lets Lloyd's
+ * iterations skip most of the distance computations once clusters settle down.
+ */
 template <typename PointTypeAdaptor>
 class KMeans {
     typedef typename PointTypeAdaptor::DistanceType DistanceType;
@@ -54,57 +69,381 @@ public:
      * References:
      *     Lloyd's algorithm: https://en.wikipedia.org/wiki/Lloyd%27s_algorithm
      *     k-means++ initialization: https://en.wikipedia.org/wiki/K-means%2B%2B
+     *     Hamerly, "Making k-means even faster", SDM 2010
      */
-    static Result compute(const std::vector<PointType> points, size_t k = 0, size_t maxIterations = 200, int seed = 0)
+    static Result compute(const std::vector<PointType>& points, size_t k = 0, size_t maxIterations = 200, int seed = 0)
+    {
+        return compute(points.data(), points.size(), k, maxIterations, seed);
+    }
+    
+    /* As above, over pointCount points read in place from the given array */
+    static Result compute(const PointType* points, size_t pointCount, size_t k = 0, size_t maxIterations = 200, int seed = 0)
     {
-        int n = static_cast<int>(points.size());
+        int n = static_cast<int>(pointCount);
+        
+        Result result;
+        result.iterations = 0;
+        result.converged = false;
+        if (n == 0) return result;
         
         if (k == 0) {
             k = std::sqrt(0.5 * n);
         }
-
+        k = std::max<size_t>(1, std::min<size_t>(k, n));
+        
         // Create a random number generator
         std::mt19937 prng(seed);
-        std::uniform_int_distribution<int> randint(0, n);
-        std::uniform_real_distribution<float> randfloat(0.0f, 1.0f);
-
+        
         // Allocate results storage
-        Result result;
         std::vector<PointType>& centroids = result.centroids;
         std::vector<int>& counts = result.counts;
         std::vector<int>& assignments = result.assignments;
-        result.converged = false;
-
+        
         // Set output sizes
         centroids.resize(k);
         counts.resize(k);
         assignments.resize(n);
         
         std::fill(assignments.begin(), assignments.end(), -1);
-
+        
+        initializeCentroids(points, n, static_cast<int>(k), prng, centroids.data());
+        for (int i = 0; i < k; i++) {
+            assignments[i] = i;
+        }
+        
+        //
+        // Iterate using Lloyd's algorithm.
+        // See: https://en.wikipedia.org/wiki/Lloyd%27s_algorithm
+        //
+        // Each point carries an upper bound on the distance to its assigned centroid and a lower
+        // bound on the distance to every other one. When the centroids move, the bounds loosen by
+        // as much as they moved, and a point only needs its distances recomputed once its upper
+        // bound exceeds either its lower bound or half the distance from its centroid to the
+        // next nearest centroid (Hamerly's algorithm).
         //
-        // Perform k-means++ initialization.
-        // See: https://en.wikipedia.org/wiki/K-means%2B%2B
+        // Points are processed in fixed slices, each accumulating its own centroid sums, which are
+        // then added up in slice order so the result doesn't depend on the thread count.
         //
+        int sliceCount = std::min(kMaxSliceCount, (n + kMinSliceSize - 1) / kMinSliceSize);
+        std::vector<PointType> sliceSums(static_cast<size_t>(sliceCount) * k);
+        std::vector<int> sliceCounts(static_cast<size_t>(sliceCount) * k);
+        std::vector<char> sliceChanged(sliceCount);
+        
+        std::vector<DistanceType> upperBounds(n);
+        std::vector<DistanceType> lowerBounds(n);
+        std::vector<DistanceType> halfSeparations(k);
+        std::vector<DistanceType> movements(k, 0);
+        std::vector<PointType> previousCentroids(k);
+        DistanceType largestMovement = 0;
+        DistanceType secondLargestMovement = 0;
+        int largestMovementIndex = -1;
+        
+        bool converged = false;
+        int iteration = 0;
+        while (!converged && iteration++ < maxIterations) {
+            bool firstIteration = iteration == 1;
+            
+            if (!firstIteration) {
+                parallelFor(static_cast<int>(k), [&](int begin, int end, int threadIndex) {
+                    for (int j = begin; j < end; j++) {
+                        DistanceType separation = std::numeric_limits<DistanceType>::max();
+                        for (int m = 0; m < k; m++) {
+                            if (m == j) continue;
+                            separation = std::min(separation, PointTypeAdaptor::distanceMetric(centroids[j], centroids[m]));
+                        }
+                        halfSeparations[j] = static_cast<DistanceType>(0.5) * separation;
+                    }
+                }, 16);
+            }
+            
+            parallelFor(sliceCount, [&](int beginSlice, int endSlice, int threadIndex) {
+                for (int slice = beginSlice; slice < endSlice; slice++) {
+                    PointType* sums = &sliceSums[static_cast<size_t>(slice) * k];
+                    int* sliceCountsForSlice = &sliceCounts[static_cast<size_t>(slice) * k];
+                    std::fill(sums, sums + k, PointType{});
+                    std::fill(sliceCountsForSlice, sliceCountsForSlice + k, 0);
+                    
+                    bool changed = false;
+                    int begin = static_cast<int>(static_cast<int64_t>(n) * slice / sliceCount);
+                    int end = static_cast<int>(static_cast<int64_t>(n) * (slice + 1) / sliceCount);
+                    
+                    for (int i = begin; i < end; i++) {
+                        int assignment = assignments[i];
+                        bool needsSearch = firstIteration;
+                        
+                        if (!firstIteration) {
+                            upperBounds[i] += movements[assignment];
+                            lowerBounds[i] -= assignment == largestMovementIndex ? secondLargestMovement : largestMovement;
+                            
+                            DistanceType bound = std::max(halfSeparations[assignment], lowerBounds[i]);
+                            if (upperBounds[i] > bound) {
+                                upperBounds[i] = PointTypeAdaptor::distanceMetric(centroids[assignment], points[i]);
+                                needsSearch = upperBounds[i] > bound;
+                            }
+                        }
+                        
+                        if (needsSearch) {
+                            int bestIndex = 0;
+                            int secondBestIndex = -1;
+                            DistanceType minDist = PointTypeAdaptor::distanceComparisonMetric(centroids[0], points[i]);
+                            DistanceType secondMinDist = std::numeric_limits<DistanceType>::max();
+                            
+                            for (int j = 1; j < k; j++) {
+                                DistanceType dist = PointTypeAdaptor::distanceComparisonMetric(centroids[j], points[i]);
+                                if (dist < minDist) {
+                                    secondMinDist = minDist;
+                                    secondBestIndex = bestIndex;
+                                    minDist = dist;
+                                    bestIndex = j;
+                                } else if (dist < secondMinDist) {
+                                    secondMinDist = dist;
+                                    secondBestIndex = j;
+                                }
+                            }
+                            
+                            upperBounds[i] = PointTypeAdaptor::distanceMetric(centroids[bestIndex], points[i]);
+                            lowerBounds[i] = secondBestIndex == -1
+                                ? std::numeric_limits<DistanceType>::max()
+                                : PointTypeAdaptor::distanceMetric(centroids[secondBestIndex], points[i]);
+                            
+                            // If assignment has changed, then it has not converged
+                            if (assignment != bestIndex) {
+                                changed = true;
+                            }
+                            
+                            assignment = bestIndex;
+                            assignments[i] = bestIndex;
+                        }
+                        
+                        sums[assignment] += points[i];
+                        sliceCountsForSlice[assignment]++;
+                    }
+                    
+                    sliceChanged[slice] = changed;
+                }
+            }, 1);
+            
+            converged = std::find(sliceChanged.begin(), sliceChanged.end(), true) == sliceChanged.end();
+            
+            previousCentroids = centroids;
+            
+            parallelFor(static_cast<int>(k), [&](int begin, int end, int threadIndex) {
+                for (int j = begin; j < end; j++) {
+                    PointType sum{};
+                    int count = 0;
+                    for (int slice = 0; slice < sliceCount; slice++) {
+                        sum += sliceSums[static_cast<size_t>(slice) * k + j];
+                        count += sliceCounts[static_cast<size_t>(slice) * k + j];
+                    }
+                    
+                    counts[j] = count;
+                    
+                    // An emptied cluster keeps its previous center
+                    if (count > 0) {
+                        sum *= static_cast<DistanceType>(1.0 / count);
+                        centroids[j] = sum;
+                    }
+                    
+                    movements[j] = PointTypeAdaptor::distanceMetric(previousCentroids[j], centroids[j]);
+                }
+            }, 16);
+            
+            largestMovement = secondLargestMovement = 0;
+            largestMovementIndex = -1;
+            for (int j = 0; j < k; j++) {
+                if (movements[j] > largestMovement) {
+                    secondLargestMovement = largestMovement;
+                    largestMovement = movements[j];
+                    largestMovementIndex = j;
+                } else if (movements[j] > secondLargestMovement) {
+                    secondLargestMovement = movements[j];
+                }
+            }
+        }
+        
+        result.iterations = iteration;
+        result.converged = iteration < maxIterations;
+        
+        return result;
+    }
+    
+    /*
+     * Perform mini-batch k-means, for inputs too large to sweep on every iteration. Each iteration
+     * assigns a random batch of batchSize points and pulls each one's centroid toward it with a
+     * learning rate of one over the number of points that centroid has seen so far. Centroids are
+     * seeded by k-means++ over a random sample, and a final pass assigns every point. Stops early
+     * once a batch moves no centroid farther than tolerance, in the points' own units.
+     * Reference:
+     *     Sculley, "Web-Scale K-Means Clustering", WWW 2010
+     */
+    static Result computeMiniBatch(const std::vector<PointType>& points,
+                                   size_t k = 0,
+                                   size_t batchSize = 1024,
+                                   size_t maxIterations = 100,
+                                   DistanceType tolerance = 1e-4,
+                                   int seed = 0)
+    {
+        return computeMiniBatch(points.data(), points.size(), k, batchSize, maxIterations, tolerance, seed);
+    }
+    
+    /* As above, over pointCount points read in place from the given array */
+    static Result computeMiniBatch(const PointType* points,
+                                   size_t pointCount,
+                                   size_t k = 0,
+                                   size_t batchSize = 1024,
+                                   size_t maxIterations = 100,
+                                   DistanceType tolerance = 1e-4,
+                                   int seed = 0)
+    {
+        int n = static_cast<int>(pointCount);
+        
+        Result result;
+        result.iterations = 0;
+        result.converged = false;
+        if (n == 0) return result;
+        
+        if (k == 0) {
+            k = std::sqrt(0.5 * n);
+        }
+        k = std::max<size_t>(1, std::min<size_t>(k, n));
+        batchSize = std::max<size_t>(1, batchSize);
+        
+        std::mt19937 prng(seed);
+        std::uniform_int_distribution<int> randindex(0, n - 1);
+        
+        std::vector<PointType>& centroids = result.centroids;
+        std::vector<int>& counts = result.counts;
+        std::vector<int>& assignments = result.assignments;
+        centroids.resize(k);
+        counts.resize(k);
+        assignments.resize(n);
+        
+        // Seed from a sample a few times larger than k, rather than from all n points
+        size_t sampleSize = std::max(batchSize, kMiniBatchSeedSamplesPerCluster * k);
+        if (sampleSize >= n) {
+            initializeCentroids(points, n, static_cast<int>(k), prng, centroids.data());
+        } else {
+            std::vector<PointType> sample(sampleSize);
+            for (PointType& samplePoint : sample) {
+                samplePoint = points[randindex(prng)];
+            }
+            initializeCentroids(sample.data(), static_cast<int>(sampleSize), static_cast<int>(k), prng, centroids.data());
+        }
+        
+        std::vector<int> batch(batchSize);
+        std::vector<int> batchAssignments(batchSize);
+        std::vector<int> centroidSampleCounts(k, 0);
+        std::vector<PointType> previousCentroids(k);
+        
+        bool converged = false;
+        int iteration = 0;
+        while (!converged && iteration < maxIterations) {
+            iteration++;
+            
+            for (int& index : batch) {
+                index = randindex(prng);
+            }
+            
+            parallelFor(static_cast<int>(batchSize), [&](int begin, int end, int threadIndex) {
+                for (int b = begin; b < end; b++) {
+                    batchAssignments[b] = nearestCentroid(points[batch[b]], centroids);
+                }
+            });
+            
+            previousCentroids = centroids;
+            
+            for (int b = 0; b < batchSize; b++) {
+                int j = batchAssignments[b];
+                DistanceType learningRate = static_cast<DistanceType>(1.0 / ++centroidSampleCounts[j]);
+                
+                PointType step(points[batch[b]]);
+                step *= learningRate;
+                centroids[j] *= static_cast<DistanceType>(1.0) - learningRate;
+                centroids[j] += step;
+            }
+            
+            converged = true;
+            for (int j = 0; j < k; j++) {
+                if (PointTypeAdaptor::distanceMetric(previousCentroids[j], centroids[j]) > tolerance) {
+                    converged = false;
+                    break;
+                }
+            }
+        }
+        
+        parallelFor(n, [&](int begin, int end, int threadIndex) {
+            for (int i = begin; i < end; i++) {
+                assignments[i] = nearestCentroid(points[i], centroids);
+            }
+        });
+        
+        std::fill(counts.begin(), counts.end(), 0);
+        for (int assignment : assignments) {
+            counts[assignment]++;
+        }
+        
+        result.iterations = iteration;
+        result.converged = converged;
+        
+        return result;
+    }
+    
+private:
+    /* Points per slice of the Lloyd iterations, and the most slices to split the points into */
+    static constexpr int kMinSliceSize = 1024;
+    static constexpr int kMaxSliceCount = 64;
+    
+    /* Mini-batch k-means seeds from at least this many random samples per cluster */
+    static constexpr size_t kMiniBatchSeedSamplesPerCluster = 32;
+    
+    /* The index of the centroid nearest to point, preferring the lowest index on ties */
+    static int nearestCentroid(const PointType& point, const std::vector<PointType>& centroids)
+    {
+        int bestIndex = 0;
+        DistanceType minDist = PointTypeAdaptor::distanceComparisonMetric(centroids[0], point);
+        
+        for (int j = 1; j < centroids.size(); j++) {
+            DistanceType dist = PointTypeAdaptor::distanceComparisonMetric(centroids[j], point);
+            if (dist < minDist) {
+                minDist = dist;
+                bestIndex = j;
+            }
+        }
+        
+        return bestIndex;
+    }
+    
+    /*
+     * Choose k of the n points as initial centroids via k-means++.
+     * See: https://en.wikipedia.org/wiki/K-means%2B%2B
+     */
+    static void initializeCentroids(const PointType* points, int n, int k, std::mt19937& prng, PointType* centroids)
+    {
+        std::uniform_int_distribution<int> randint(0, n);
+        std::uniform_real_distribution<float> randfloat(0.0f, 1.0f);
+        
         int tries = 2 + static_cast<int>(std::logf(n) + 0.5);
         std::vector<DistanceType> distances(n);
         std::vector<DistanceType> tmpDistances(n);
-
+        
         //
         // 1. Choose one center uniformly at random from the data points.
         //
-        PointType p = centroids[0] = points[randint(prng)];
-        assignments[0] = 0;
-
+        PointType p = centroids[0] = points[std::min(randint(prng), n - 1)];
+        
         //
         // 2. For each data point x, compute D(x), the distance between x and
         //    the nearest center that has already been chosen.
         //
+        parallelFor(n, [&](int begin, int end, int threadIndex) {
+            for (int i = begin; i < end; i++) {
+                distances[i] = PointTypeAdaptor::distanceMetric(p, points[i]);
+            }
+        }, 4096);
+        
         DistanceType distanceSum = 0.0;
         for (int i = 0; i < n; i++) {
-            float distance = PointTypeAdaptor::distanceMetric(p, points[i]);
-            distances[i] = distance;
-            distanceSum += distance;
+            distanceSum += distances[i];
         }
         
         //
@@ -114,9 +453,6 @@ public:
         //    have been chosen.)
         //
         for (int i = 1; i < k; i++) {
-            float bestDistanceSum = INFINITY;
-            int bestIndex = -1;
-            
             int l = 0;
             for (int j = 0; j < tries; j++) {
                 DistanceType randomValue = randfloat(prng) * distanceSum;
@@ -129,82 +465,28 @@ public:
                 }
             }
             
-            DistanceType tmpDistanceSum = 0.0;
-            PointType referencePoint(points[l]);
-            for (int m = 0; m < n; m++) {
-                DistanceType cmp1 = distances[m];
-                DistanceType cmp2 = PointTypeAdaptor::distanceMetric(points[m], referencePoint);
-                tmpDistances[m] = cmp1 > cmp2 ? cmp2 : cmp1;
-                tmpDistanceSum += tmpDistances[m];
-            }
+            // Rounding can carry the search off the end
+            l = std::min(l, n - 1);
             
-            if (tmpDistanceSum < bestDistanceSum) {
-                bestDistanceSum = tmpDistanceSum;
-                bestIndex = l;
-            }
-            
-            distanceSum = bestDistanceSum;
-            
-            centroids[i] = points[bestIndex];
-            assignments[i] = i;
-
-            for (int j = 0; j < n; j++) {
-                DistanceType cmp2 = PointTypeAdaptor::distanceMetric(points[bestIndex], points[j]);
-                if (distances[j] > cmp2) {
-                    distances[j] = cmp2;
+            PointType referencePoint(points[l]);
+            parallelFor(n, [&](int begin, int end, int threadIndex) {
+                for (int m = begin; m < end; m++) {
+                    DistanceType cmp1 = distances[m];
+                    DistanceType cmp2 = PointTypeAdaptor::distanceMetric(points[m], referencePoint);
+                    tmpDistances[m] = cmp1 > cmp2 ? cmp2 : cmp1;
                 }
-            }
-        }
-        
-        // Iterate using Lloyd's algorithm.
-        // See: https://en.wikipedia.org/wiki/Lloyd%27s_algorithm
-        //
-        bool converged = false;
-        int iteration = 0;
-        while (!converged && iteration++ < maxIterations) {
-            converged = true;
-            
-            std::fill(counts.begin(), counts.end(), 0);
+            }, 4096);
             
-            for (int i = 0; i < n; i++) {
-                int bestIndex = 0;
-                DistanceType minDist = PointTypeAdaptor::distanceComparisonMetric(centroids[0], points[i]);
-                
-                for (int j = 1; j < k; j++) {
-                    DistanceType dist = PointTypeAdaptor::distanceComparisonMetric(centroids[j], points[i]);
-                    if (dist < minDist) {
-                        minDist = dist;
-                        bestIndex = j;
-                    }
-                }
-                
-                // If assignment has changed, then it has not converged
-                if (assignments[i] == -1 || assignments[i] != bestIndex) {
-                    converged = false;
-                }
-                
-                assignments[i] = bestIndex;
-                counts[bestIndex]++;
+            DistanceType tmpDistanceSum = 0.0;
+            for (int m = 0; m < n; m++) {
+                tmpDistanceSum += tmpDistances[m];
             }
             
-            std::fill(centroids.begin(), centroids.end(), PointType{});
-            
-            for (int i = 0; i < n; i++) {
-                int index = assignments[i];
-                centroids[index] += points[i];
-            }
+            distanceSum = tmpDistanceSum;
+            distances.swap(tmpDistances);
             
-            for (int i = 0; i < k; i++) {
-                if (counts[i] > 0) {
-                    centroids[i] *= static_cast<DistanceType>(1.0 / counts[i]);
-                }
-            }
+            centroids[i] = referencePoint;
         }
-        
-        result.iterations = iteration;
-        result.converged = iteration < maxIterations;
-
-        return result;
     }
 };
 
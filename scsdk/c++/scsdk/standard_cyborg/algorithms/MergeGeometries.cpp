@@ -17,6 +17,9 @@ limitations under the License.
 #include "standard_cyborg/algorithms/MergeGeometries.hpp"
 
 #include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
+
+#include <algorithm>
 
 using standard_cyborg::math::Vec3;
 using standard_cyborg::sc3d::Geometry;
@@ -54,48 +57,51 @@ std::unique_ptr<Geometry> mergeGeometries(const Geometry& first,
 {
     const float maxMergeDistanceSquared = maxMergeDistance * maxMergeDistance;
     
-    auto firstPositions = first.getPositions();
-    auto firstNormals = first.getNormals();
-    auto firstColors = first.getColors();
+    const std::vector<Vec3>& firstPositions = first.getPositions();
+    const std::vector<Vec3>& firstNormals = first.getNormals();
+    const std::vector<Vec3>& firstColors = first.getColors();
     
-    auto secondVertexCount = second.vertexCount();
-    auto secondPositions = second.getPositions();
-    auto secondNormals = second.getNormals();
-    auto secondColors = second.getColors();
+    int firstVertexCount = first.vertexCount();
+    int secondVertexCount = second.vertexCount();
+    const std::vector<Vec3>& secondPositions = second.getPositions();
+    const std::vector<Vec3>& secondNormals = second.getNormals();
+    const std::vector<Vec3>& secondColors = second.getColors();
     
     // Since we're merging the second into the first, we start by adding the first to the result
-    std::vector<Vec3> resultPositions = firstPositions;
-    std::vector<Vec3> resultNormals = firstNormals;
-    std::vector<Vec3> resultColors = firstColors;
-    
+    std::vector<Vec3> resultPositions(firstVertexCount + secondVertexCount);
+    std::vector<Vec3> resultNormals(firstVertexCount + secondVertexCount);
+    std::vector<Vec3> resultColors(firstVertexCount + secondVertexCount);
+    std::copy(firstPositions.begin(), firstPositions.end(), resultPositions.begin());
+    std::copy(firstNormals.begin(), firstNormals.end(), resultNormals.begin());
+    std::copy(firstColors.begin(), firstColors.end(), resultColors.begin());
     
-    for (int secondVertexIndex = 0; secondVertexIndex < secondVertexCount; ++secondVertexIndex) {
-        Vec3 secondPosition = secondPositions[secondVertexIndex];
-        Vec3 secondNormal = secondNormals[secondVertexIndex];
-        Vec3 secondColor = secondColors[secondVertexIndex];
-        
-        int firstVertexIndex = first.getClosestVertexIndex(secondPosition);
-        Vec3 firstPosition = firstPositions[firstVertexIndex];
-        
-        if (Vec3::squaredDistanceBetween(firstPosition, secondPosition) > maxMergeDistanceSquared) {
-            resultPositions.push_back(secondPosition);
-            resultNormals.push_back(secondNormal);
-            resultColors.push_back(secondColor);
-        } else {
-            Vec3 firstNormal = firstNormals[firstVertexIndex];
-            Vec3 firstColor = firstColors[firstVertexIndex];
+    // Every point of second lands in its own slot, so the kd-tree queries can run in parallel
+    parallelFor(secondVertexCount, [&](int begin, int end, int threadIndex) {
+        for (int secondVertexIndex = begin; secondVertexIndex < end; ++secondVertexIndex) {
+            int resultIndex = firstVertexCount + secondVertexIndex;
+            Vec3 secondPosition = secondPositions[secondVertexIndex];
+            Vec3 secondNormal = secondNormals[secondVertexIndex];
+            Vec3 secondColor = secondColors[secondVertexIndex];
             
-            Vec3 mergedPosition = 0.5 * (firstPosition + secondPosition);
-            Vec3 mergedNormal = mergeNormals(firstNormal, secondNormal);
-            Vec3 mergedColor = 0.5 * (firstColor + secondColor);
+            int firstVertexIndex = first.getClosestVertexIndex(secondPosition);
+            Vec3 firstPosition = firstPositions[firstVertexIndex];
             
-            resultPositions.push_back(mergedPosition);
-            resultNormals.push_back(mergedNormal);
-            resultColors.push_back(mergedColor);
+            if (Vec3::squaredDistanceBetween(firstPosition, secondPosition) > maxMergeDistanceSquared) {
+                resultPositions[resultIndex] = secondPosition;
+                resultNormals[resultIndex] = secondNormal;
+                resultColors[resultIndex] = secondColor;
+            } else {
+                Vec3 firstNormal = firstNormals[firstVertexIndex];
+                Vec3 firstColor = firstColors[firstVertexIndex];
+                
+                resultPositions[resultIndex] = 0.5 * (firstPosition + secondPosition);
+                resultNormals[resultIndex] = mergeNormals(firstNormal, secondNormal);
+                resultColors[resultIndex] = 0.5 * (firstColor + secondColor);
+            }
         }
-    }
+    }, 1024);
     
-    return std::make_unique<Geometry>(resultPositions, resultNormals, resultColors);
+    return std::make_unique<Geometry>(std::move(resultPositions), std::move(resultNormals), std::move(resultColors));
 }
 
 }
@@ -32,7 +32,10 @@ namespace algorithms {
     otherwise they will be added without modification.
  
     Only works on point clouds, i.e. only the position, normal, and color attributes
-    of the incoming Geometry instances. */
+    of the incoming Geometry instances.
+ 
+    To fuse a long sequence of point clouds, accumulate them into a SurfelMap instead, which
+    avoids copying and re-indexing the merged result for every one. */
 std::unique_ptr<standard_cyborg::sc3d::Geometry> mergeGeometries(const standard_cyborg::sc3d::Geometry& first,
                                           const standard_cyborg::sc3d::Geometry& second,
                                           float maxMergeDistanceMeters);
@@ -20,11 +20,13 @@ limitations under the License.
 #include "standard_cyborg/sc3d/Plane.hpp"
 #include "standard_cyborg/sc3d/Polyline.hpp"
 #include "standard_cyborg/sc3d/MeshTopology.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
 
 #include <unordered_map>
 
 #include <list>
 #include <algorithm>
+#include <cstdint>
 #include <set>
 #include <unordered_map>
 
@@ -57,23 +59,21 @@ std::vector<sc3d::Polyline> sliceMesh(const sc3d::Geometry& geometry,
                                 const std::function<float(int index, math::Vec3 position)>& isolevelFunction,
                                 const sc3d::MeshTopology::MeshTopology& topology)
 {
-    const std::vector<Vec3> positions = geometry.getPositions();
+    const std::vector<Vec3>& positions = geometry.getPositions();
     const std::vector<sc3d::Face3>& faces = geometry.getFaces();
     
     // Convert lists of positions to Polylines (std::vector)
     std::vector<Polyline> outputPolylines;
     
-    // Not ideal but I don't know how to make topology an optional argument without making it const.
-    // The only case where we'd modify the topology is if it's not provided at all so that if you
-    // provide topology, it does in fact remain const. Improvements here are welcomed.
-    sc3d::MeshTopology::MeshTopology& nonConstTopology = const_cast<sc3d::MeshTopology::MeshTopology&>(topology);
-    
-    if (topology.getVertexEdges().size() != geometry.vertexCount()) {
-        nonConstTopology.compute(geometry.getFaces());
+    // Without a topology for these faces, use the one the geometry caches
+    std::shared_ptr<const sc3d::MeshTopology::MeshTopology> cachedTopology;
+    if (topology.getNumFaceEdges() != geometry.faceCount()) {
+        cachedTopology = geometry.getTopology();
     }
+    const sc3d::MeshTopology::MeshTopology& activeTopology = cachedTopology ? *cachedTopology : topology;
     
-    const std::vector<sc3d::MeshTopology::Edge>& edges = nonConstTopology.getEdges();
-    const std::vector<sc3d::MeshTopology::FaceEdges>& faceEdges = nonConstTopology.getFaceEdges();
+    const std::vector<sc3d::MeshTopology::Edge>& edges = activeTopology.getEdges();
+    const std::vector<sc3d::MeshTopology::FaceEdges>& faceEdges = activeTopology.getFaceEdges();
     
     int numEdges = static_cast<int>(edges.size());
     
@@ -192,6 +192,247 @@ std::vector<sc3d::Polyline> sliceMesh(const sc3d::Geometry& geometry,
     return outputPolylines;
 }
 
+sc3d::Polyline MeshSliceStack::getContour(int contourIndex) const
+{
+    return Polyline(std::vector<Vec3>(points.begin() + contourOffsets[contourIndex],
+                                      points.begin() + contourOffsets[contourIndex + 1]));
+}
+
+namespace {
+
+// The contours of one plane, before they're packed into the stack
+struct PlaneContours {
+    std::vector<Vec3> points;
+    std::vector<int> contourSizes;
+};
+
+} // namespace
+
+/* Trace the contours where vertexValues crosses offset, seeding only from crossingEdges, the
+ * edges it crosses, in increasing order. Marches as sliceMesh does. edgeWasVisited is all zero
+ * on entry and is left that way. */
+static void traceContours(const sc3d::Geometry& geometry,
+                          const sc3d::MeshTopology::MeshTopology& topology,
+                          const std::vector<float>& vertexValues,
+                          float offset,
+                          const int* crossingEdges,
+                          int crossingEdgeCount,
+                          std::vector<uint8_t>& edgeWasVisited,
+                          PlaneContours& contours)
+{
+    sc3d::Float3View positions = geometry.getPositionsView();
+    const std::vector<sc3d::Face3>& faces = geometry.getFaces();
+    const std::vector<sc3d::MeshTopology::Edge>& edges = topology.getEdges();
+    const std::vector<sc3d::MeshTopology::FaceEdges>& faceEdges = topology.getFaceEdges();
+    
+    std::vector<int> visitedEdges;
+    std::vector<Vec3> forwardPoints;
+    std::vector<Vec3> backwardPoints;
+    
+    auto visit = [&](int edgeIndex) {
+        if (!edgeWasVisited[edgeIndex]) {
+            edgeWasVisited[edgeIndex] = 1;
+            visitedEdges.push_back(edgeIndex);
+        }
+    };
+    
+    for (int crossing = 0; crossing < crossingEdgeCount; crossing++) {
+        int seedEdgeIndex = crossingEdges[crossing];
+        if (edgeWasVisited[seedEdgeIndex]) continue;
+        
+        forwardPoints.clear();
+        backwardPoints.clear();
+        bool closedCurveFound = false;
+        
+        for (int startingDirection = 0; startingDirection < 2 && !closedCurveFound; startingDirection++) {
+            const sc3d::MeshTopology::Edge& edge = edges[seedEdgeIndex];
+            
+            int edgeIndex0 = startingDirection == 0 ? edge.vertex0 : edge.vertex1;
+            int edgeIndex1 = startingDirection == 0 ? edge.vertex1 : edge.vertex0;
+            
+            Vec3 position0 = positions[edgeIndex0];
+            Vec3 position1 = positions[edgeIndex1];
+            float value0 = vertexValues[edgeIndex0] - offset;
+            float value1 = vertexValues[edgeIndex1] - offset;
+            int currentEdgeIndex = seedEdgeIndex;
+            int previousFaceIndex = startingDirection == 0 ? edge.face1 : edge.face0;
+            
+            if (startingDirection == 0) {
+                forwardPoints.push_back(Vec3::lerp(position0, position1, value0 / (value0 - value1)));
+            }
+            
+            int step = 0;
+            while (step++ < MAX_EDGE_MARCH_STEPS) {
+                visit(currentEdgeIndex);
+                const sc3d::MeshTopology::Edge& currentEdge = edges[currentEdgeIndex];
+                
+                int currentFaceIndex = currentEdge.face0 == previousFaceIndex ? currentEdge.face1 : currentEdge.face0;
+                if (currentFaceIndex < 0) break;
+                
+                const sc3d::Face3& currentFace = faces[currentFaceIndex];
+                const sc3d::MeshTopology::FaceEdges& currentFaceEdges = faceEdges[currentFaceIndex];
+                
+                int vertexIndex2 = currentFace[(currentFaceEdges.offsetOf(currentEdgeIndex) + 2) % 3];
+                Vec3 position2 = positions[vertexIndex2];
+                float value2 = vertexValues[vertexIndex2] - offset;
+                
+                bool candidateEdge12InteriorHit = value1 * value2 < 0.0f;
+                bool candidateEdge02InteriorHit = value0 * value2 < 0.0f;
+                if (candidateEdge12InteriorHit == candidateEdge02InteriorHit) break;
+                
+                if (candidateEdge12InteriorHit) {
+                    value0 = value2;
+                    position0 = position2;
+                    currentEdgeIndex = currentFaceEdges.edgeIndexAfter(currentEdgeIndex);
+                } else {
+                    value1 = value2;
+                    position1 = position2;
+                    currentEdgeIndex = currentFaceEdges.edgeIndexBefore(currentEdgeIndex);
+                }
+                previousFaceIndex = currentFaceIndex;
+                
+                Vec3 newPosition(Vec3::lerp(position0, position1, value0 / (value0 - value1)));
+                (startingDirection == 0 ? forwardPoints : backwardPoints).push_back(newPosition);
+                
+                if (currentEdgeIndex == seedEdgeIndex) {
+                    closedCurveFound = true;
+                    break;
+                }
+            }
+        }
+        
+        // Points found marching backward come first, nearest the seed last
+        contours.points.insert(contours.points.end(), backwardPoints.rbegin(), backwardPoints.rend());
+        contours.points.insert(contours.points.end(), forwardPoints.begin(), forwardPoints.end());
+        contours.contourSizes.push_back((int)(backwardPoints.size() + forwardPoints.size()));
+    }
+    
+    for (int edgeIndex : visitedEdges) {
+        edgeWasVisited[edgeIndex] = 0;
+    }
+}
+
+MeshSliceStack sliceMeshStack(const sc3d::Geometry& geometry,
+                              math::Vec3 normal,
+                              const std::vector<float>& offsets)
+{
+    MeshSliceStack stack;
+    int planeCount = (int)offsets.size();
+    stack.planeContourOffsets.assign(planeCount + 1, 0);
+    stack.contourOffsets.assign(1, 0);
+    
+    if (planeCount == 0 || !geometry.hasFaces()) return stack;
+    
+    std::shared_ptr<const sc3d::MeshTopology::MeshTopology> topology = geometry.getTopology();
+    const std::vector<sc3d::MeshTopology::Edge>& edges = topology->getEdges();
+    int edgeCount = (int)edges.size();
+    
+    // Every plane's isolevel is the same per-vertex value, less the plane's offset
+    sc3d::Float3View positions = geometry.getPositionsView();
+    std::vector<float> vertexValues(positions.size());
+    parallelFor(positions.size(), [&](int begin, int end, int threadIndex) {
+        for (int vertex = begin; vertex < end; vertex++) {
+            vertexValues[vertex] = Vec3::dot(positions[vertex], normal);
+        }
+    }, 4096);
+    
+    std::vector<int> planesByOffset(planeCount);
+    for (int plane = 0; plane < planeCount; plane++) planesByOffset[plane] = plane;
+    std::sort(planesByOffset.begin(), planesByOffset.end(), [&offsets](int lhs, int rhs) {
+        return offsets[lhs] < offsets[rhs];
+    });
+    
+    std::vector<float> sortedOffsets(planeCount);
+    for (int rank = 0; rank < planeCount; rank++) sortedOffsets[rank] = offsets[planesByOffset[rank]];
+    
+    // Each edge crosses the planes, by rank of offset, from edgeFirstRank up to edgeEndRank,
+    // those strictly between its endpoints' values
+    std::vector<int> edgeFirstRank(edgeCount);
+    std::vector<int> edgeEndRank(edgeCount);
+    parallelFor(edgeCount, [&](int begin, int end, int threadIndex) {
+        for (int edgeIndex = begin; edgeIndex < end; edgeIndex++) {
+            float value0 = vertexValues[edges[edgeIndex].vertex0];
+            float value1 = vertexValues[edges[edgeIndex].vertex1];
+            float low = std::min(value0, value1);
+            float high = std::max(value0, value1);
+            
+            edgeFirstRank[edgeIndex] = (int)(std::upper_bound(sortedOffsets.begin(), sortedOffsets.end(), low) - sortedOffsets.begin());
+            edgeEndRank[edgeIndex] = std::max(edgeFirstRank[edgeIndex],
+                                              (int)(std::lower_bound(sortedOffsets.begin(), sortedOffsets.end(), high) - sortedOffsets.begin()));
+        }
+    }, 4096);
+    
+    // Bucket the edges by the planes they cross. Filling in edge order keeps each bucket sorted,
+    // so each plane seeds its contours in the order sliceMesh would.
+    std::vector<int> bucketOffsets(planeCount + 1, 0);
+    for (int edgeIndex = 0; edgeIndex < edgeCount; edgeIndex++) {
+        for (int rank = edgeFirstRank[edgeIndex]; rank < edgeEndRank[edgeIndex]; rank++) {
+            bucketOffsets[rank + 1]++;
+        }
+    }
+    for (int rank = 0; rank < planeCount; rank++) bucketOffsets[rank + 1] += bucketOffsets[rank];
+    
+    std::vector<int> crossingEdges(bucketOffsets.back());
+    {
+        std::vector<int> bucketFill(bucketOffsets.begin(), bucketOffsets.end() - 1);
+        for (int edgeIndex = 0; edgeIndex < edgeCount; edgeIndex++) {
+            for (int rank = edgeFirstRank[edgeIndex]; rank < edgeEndRank[edgeIndex]; rank++) {
+                crossingEdges[bucketFill[rank]++] = edgeIndex;
+            }
+        }
+    }
+    
+    std::vector<PlaneContours> planeContours(planeCount);
+    std::vector<std::vector<uint8_t>> edgeWasVisited(parallelThreadCount());
+    parallelFor(planeCount, [&](int begin, int end, int threadIndex) {
+        std::vector<uint8_t>& visited = edgeWasVisited[threadIndex];
+        visited.assign(edgeCount, 0);
+        
+        for (int rank = begin; rank < end; rank++) {
+            traceContours(geometry, *topology, vertexValues, sortedOffsets[rank],
+                          crossingEdges.data() + bucketOffsets[rank], bucketOffsets[rank + 1] - bucketOffsets[rank],
+                          visited, planeContours[planesByOffset[rank]]);
+        }
+    }, 1);
+    
+    // Pack the planes' contours, in the caller's plane order
+    int pointCount = 0;
+    int contourCount = 0;
+    for (int plane = 0; plane < planeCount; plane++) {
+        pointCount += (int)planeContours[plane].points.size();
+        contourCount += (int)planeContours[plane].contourSizes.size();
+        stack.planeContourOffsets[plane + 1] = contourCount;
+    }
+    
+    stack.points.reserve(pointCount);
+    stack.contourOffsets.reserve(contourCount + 1);
+    for (PlaneContours& contours : planeContours) {
+        stack.points.insert(stack.points.end(), contours.points.begin(), contours.points.end());
+        for (int contourSize : contours.contourSizes) {
+            stack.contourOffsets.push_back(stack.contourOffsets.back() + contourSize);
+        }
+        contours = PlaneContours();
+    }
+    
+    return stack;
+}
+
+MeshSliceStack sliceMeshStack(const sc3d::Geometry& geometry,
+                              const sc3d::Plane& firstPlane,
+                              float planeSpacing,
+                              int planeCount)
+{
+    Vec3 normal = Vec3::normalize(firstPlane.normal);
+    float firstOffset = Vec3::dot(firstPlane.position, normal);
+    
+    std::vector<float> offsets(std::max(0, planeCount));
+    for (int plane = 0; plane < (int)offsets.size(); plane++) {
+        offsets[plane] = firstOffset + plane * planeSpacing;
+    }
+    
+    return sliceMeshStack(geometry, normal, offsets);
+}
+
 }
 
 } // namespace StandardCyborg
@@ -30,6 +30,8 @@ class Polyline;
 
 namespace algorithms {
 
+/* Trace the curves where the isolevel crosses zero over the mesh. Unless optionalTopology
+ * describes the geometry's faces, the geometry's cached topology is used. */
 std::vector<sc3d::Polyline> sliceMesh(const sc3d::Geometry& geometry,
                                 const std::function<float(int index, math::Vec3 position)>& isolevelFunction,
                                 const sc3d::MeshTopology::MeshTopology& optionalTopology = sc3d::MeshTopology::MeshTopology());
@@ -38,6 +40,36 @@ std::vector<sc3d::Polyline> sliceMesh(const sc3d::Geometry& geometry,
                                 const sc3d::Plane& plane,
                                 const sc3d::MeshTopology::MeshTopology& optionalTopology = sc3d::MeshTopology::MeshTopology());
 
+/* The contours of a mesh cut by a family of parallel planes, packed into flat buffers. Contour i
+ * is points[contourOffsets[i]] up to, but not including, points[contourOffsets[i + 1]]. The
+ * contours of plane p are those from planeContourOffsets[p] up to planeContourOffsets[p + 1]. A
+ * closed contour repeats its first point at its end, as sliceMesh's polylines do. */
+struct MeshSliceStack {
+    std::vector<math::Vec3> points;
+    std::vector<int> contourOffsets;
+    std::vector<int> planeContourOffsets;
+    
+    int planeCount() const { return planeContourOffsets.empty() ? 0 : (int)planeContourOffsets.size() - 1; }
+    int contourCount() const { return contourOffsets.empty() ? 0 : (int)contourOffsets.size() - 1; }
+    int contourPointCount(int contourIndex) const { return contourOffsets[contourIndex + 1] - contourOffsets[contourIndex]; }
+    
+    /* A copy of one contour */
+    sc3d::Polyline getContour(int contourIndex) const;
+};
+
+/* Slice the mesh with the planes dot(x, normal) == offsets[p], in one pass over the vertices
+ * and edges. Contours trace the same paths sliceMesh would for each plane alone, and planes are
+ * traced in parallel. Uses the geometry's cached topology. */
+MeshSliceStack sliceMeshStack(const sc3d::Geometry& geometry,
+                              math::Vec3 normal,
+                              const std::vector<float>& offsets);
+
+/* As above, for planeCount planes spaced planeSpacing apart along the normal of firstPlane */
+MeshSliceStack sliceMeshStack(const sc3d::Geometry& geometry,
+                              const sc3d::Plane& firstPlane,
+                              float planeSpacing,
+                              int planeCount);
+
 }
 
 } // namespace StandardCyborg
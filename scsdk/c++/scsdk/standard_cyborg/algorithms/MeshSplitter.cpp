@@ -14,13 +14,15 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
-#include "standard_cyborg/algorithms/MeshSlice.hpp"
+#include "standard_cyborg/algorithms/MeshSplitter.hpp"
 
-#include <map>
-#include <queue>
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
 
 #include "standard_cyborg/sc3d/Geometry.hpp"
-#include "standard_cyborg/algorithms/PrincipalAxes.hpp"
+#include "standard_cyborg/util/ConcurrentUnionFind.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
 
 using standard_cyborg::sc3d::Geometry;
 using standard_cyborg::sc3d::Face3;
@@ -29,162 +31,191 @@ namespace standard_cyborg {
 
 namespace algorithms {
 
-// See header for documentation
-// Original implementation by Eric Arneback
-std::vector<std::shared_ptr<Geometry>> splitMeshIntoPieces(const Geometry& geometry)
+// Below this many faces or vertices per thread, the parallel passes aren't worth splitting
+static const int kComponentRangeSize = 16384;
+
+MeshComponents findMeshComponents(const Geometry& geometry)
 {
-    using math::Vec3;
-    
-    if (geometry.vertexCount() == 0 || !geometry.hasFaces()) {
-        return std::vector<std::shared_ptr<Geometry>>();
-    }
+    MeshComponents components;
     
-    std::vector<std::set<int>> adjacencies;
+    int vertexCount = geometry.vertexCount();
+    const std::vector<Face3>& faces = geometry.getFaces();
+    int faceCount = (int)faces.size();
     
-    for (int ii = 0; ii < geometry.getPositions().size(); ++ii) {
-        adjacencies.push_back(std::set<int>());
+    std::vector<uint8_t> vertexIsUsed(vertexCount, 0);
+    for (const Face3& face : faces) {
+        vertexIsUsed[face[0]] = vertexIsUsed[face[1]] = vertexIsUsed[face[2]] = 1;
     }
     
-    for (int it = 0; it < geometry.getFaces().size(); ++it) {
-        standard_cyborg::sc3d::Face3 f = geometry.getFaces()[it];
-        
-        adjacencies[f[0]].insert(f[1]);
-        adjacencies[f[1]].insert(f[0]);
-        
-        adjacencies[f[1]].insert(f[2]);
-        adjacencies[f[2]].insert(f[1]);
-        
-        adjacencies[f[2]].insert(f[0]);
-        adjacencies[f[0]].insert(f[2]);
-    }
-    
-    std::vector<bool> traversed;
-    
-    for (int jj = 0; jj < geometry.getPositions().size(); ++jj) {
-        traversed.push_back(false);
+    ConcurrentUnionFind vertexSets(vertexCount);
+    parallelFor(faceCount, [&](int begin, int end, int threadIndex) {
+        for (int faceIndex = begin; faceIndex < end; faceIndex++) {
+            const Face3& face = faces[faceIndex];
+            vertexSets.unite(face[0], face[1]);
+            vertexSets.unite(face[1], face[2]);
+        }
+    }, kComponentRangeSize);
+    
+    // A set's root is its lowest vertex, so numbering the roots in order numbers the components
+    // by their lowest vertex
+    std::vector<int> rootComponent(vertexCount, -1);
+    int componentCount = 0;
+    for (int vertex = 0; vertex < vertexCount; vertex++) {
+        if (vertexIsUsed[vertex] && vertexSets.find(vertex) == vertex) {
+            rootComponent[vertex] = componentCount++;
+        }
     }
-    int countTraversed = 0;
     
-    std::vector<std::vector<int>> splittedIndices;
+    components.vertexComponents.resize(vertexCount);
+    components.faceComponents.resize(faceCount);
     
-    while (countTraversed != geometry.getPositions().size()) {
-        std::queue<int> queue;
-        
-        // find one seed vertex that hasnt been traversed yet.
-        for (int ii = 0; ii < geometry.getPositions().size(); ++ii) {
-            if (traversed[ii] == false) {
-                queue.push(ii);
-                break;
-            }
-        }
-        
-        std::vector<int> island;
-        
-        while (queue.size() > 0) {
-            int elem = queue.front(); queue.pop();
-            
-            if (traversed[elem] == true) {
-                continue;
-            }
-            
-            island.push_back(elem);
-            traversed[elem] = true;
-            countTraversed++;
-            
-            for (int neighbour : adjacencies[elem]) {
-                if (traversed[neighbour] == false) {
-                    queue.push(neighbour);
-                }
-            }
+    parallelFor(vertexCount, [&](int begin, int end, int threadIndex) {
+        for (int vertex = begin; vertex < end; vertex++) {
+            components.vertexComponents[vertex] = vertexIsUsed[vertex] ? rootComponent[vertexSets.find(vertex)] : -1;
         }
-        
-        // dont include single points
-        if (island.size() > 1) {
-            splittedIndices.push_back(island);
+    }, kComponentRangeSize);
+    
+    parallelFor(faceCount, [&](int begin, int end, int threadIndex) {
+        for (int faceIndex = begin; faceIndex < end; faceIndex++) {
+            components.faceComponents[faceIndex] = components.vertexComponents[faces[faceIndex][0]];
         }
+    }, kComponentRangeSize);
+    
+    components.componentVertexCounts.assign(componentCount, 0);
+    components.componentFaceCounts.assign(componentCount, 0);
+    for (int component : components.vertexComponents) {
+        if (component >= 0) components.componentVertexCounts[component]++;
+    }
+    for (int component : components.faceComponents) {
+        components.componentFaceCounts[component]++;
     }
     
-    std::vector<int> indexToSubmeshMapping;
+    return components;
+}
+
+/* Build one mesh for each component with a non-negative output index, in one pass over the faces.
+ * Vertices keep the order in which the faces first reach them. */
+static std::vector<std::shared_ptr<Geometry>> extractComponents(const Geometry& geometry,
+                                                                const MeshComponents& components,
+                                                                const std::vector<int>& outputOfComponent,
+                                                                int outputCount)
+{
+    using math::Vec3;
+    using math::Vec2;
     
-    for (int ii = 0; ii < geometry.vertexCount(); ++ii) {
-        indexToSubmeshMapping.push_back(-1);
-    }
+    std::vector<std::vector<Vec3>> subPositions(outputCount);
+    std::vector<std::vector<Vec3>> subNormals(outputCount);
+    std::vector<std::vector<Vec3>> subColors(outputCount);
+    std::vector<std::vector<Vec2>> subTexCoords(outputCount);
+    std::vector<std::vector<Face3>> subFaces(outputCount);
     
-    int iSubmesh = 0;
-    for (std::vector<int> submesh : splittedIndices) {
-        for (int index : submesh) {
-            indexToSubmeshMapping[index] = iSubmesh;
-        }
+    for (int component = 0; component < components.componentCount(); component++) {
+        int output = outputOfComponent[component];
+        if (output < 0) continue;
         
-        ++iSubmesh;
+        int componentVertexCount = components.componentVertexCounts[component];
+        if (geometry.hasPositions()) subPositions[output].reserve(componentVertexCount);
+        if (geometry.hasNormals()) subNormals[output].reserve(componentVertexCount);
+        if (geometry.hasColors()) subColors[output].reserve(componentVertexCount);
+        if (geometry.hasTexCoords()) subTexCoords[output].reserve(componentVertexCount);
+        subFaces[output].reserve(components.componentFaceCounts[component]);
     }
     
-    std::vector<std::vector<Vec3>> subPositions;
-    std::vector<std::vector<Vec3>> subNormals;
-    std::vector<std::vector<Vec3>> subColors;
-    std::vector<std::vector<Face3>> subFaces;
-    std::vector<int> freeIndex;
-    
-    for (int ii = 0; ii < splittedIndices.size(); ++ii) {
-        // std::shared_ptr<Geometry> geo(new Geometry());
-        subPositions.push_back(std::vector<Vec3>());
-        subNormals.push_back(std::vector<Vec3>());
-        subColors.push_back(std::vector<Vec3>());
-        subFaces.push_back(std::vector<Face3>());
-        
-        freeIndex.push_back(0);
-    }
+    const std::vector<Vec3>& positions = geometry.getPositions();
+    const std::vector<Vec3>& normals = geometry.getNormals();
+    const std::vector<Vec3>& colors = geometry.getColors();
+    const std::vector<Vec2>& texCoords = geometry.getTexCoords();
     
-    std::map<int, int> indexMapping;
-
-    for (Face3 face : geometry.getFaces()) {
-        int iSubmesh = indexToSubmeshMapping[face[0]];
+    // Each vertex belongs to a single component, so one renumbering serves them all
+    std::vector<int> newVertexIndex(geometry.vertexCount(), -1);
+    std::vector<int> nextVertexIndex(outputCount, 0);
+    
+    const std::vector<Face3>& faces = geometry.getFaces();
+    int faceCount = (int)faces.size();
+    for (int faceIndex = 0; faceIndex < faceCount; faceIndex++) {
+        int output = outputOfComponent[components.faceComponents[faceIndex]];
+        if (output < 0) continue;
         
+        const Face3& face = faces[faceIndex];
         Face3 newFace;
         
         for (int iCorner = 0; iCorner < 3; ++iCorner) {
-        
-            // if an index is unencoutered, then add to list of positions in mesh.
-            if (indexMapping.count(face[iCorner]) != 0) {
-                newFace[iCorner] = indexMapping[face[iCorner]];
-            } else {
-                int newIndex = freeIndex[iSubmesh]++;
-                
-                if (geometry.hasPositions()) {
-                    Vec3 position = geometry.getPositions()[face[iCorner]];
-                    subPositions[iSubmesh].push_back(position);
-                }
-                if (geometry.hasNormals()) {
-                    Vec3 normal = geometry.getNormals()[face[iCorner]];
-                    subNormals[iSubmesh].push_back(normal);
-                }
-                
-                if (geometry.hasColors()) {
-                    Vec3 color = geometry.getColors()[face[iCorner]];
-                    subColors[iSubmesh].push_back(color);
-                }
-                
-                newFace[iCorner] = newIndex;
+            int vertex = face[iCorner];
+            
+            if (newVertexIndex[vertex] == -1) {
+                newVertexIndex[vertex] = nextVertexIndex[output]++;
                 
-                indexMapping[face[iCorner]] = newIndex;
+                if (geometry.hasPositions()) subPositions[output].push_back(positions[vertex]);
+                if (geometry.hasNormals()) subNormals[output].push_back(normals[vertex]);
+                if (geometry.hasColors()) subColors[output].push_back(colors[vertex]);
+                if (geometry.hasTexCoords()) subTexCoords[output].push_back(texCoords[vertex]);
             }
+            
+            newFace[iCorner] = newVertexIndex[vertex];
         }
         
-        subFaces[iSubmesh].push_back(newFace);
+        subFaces[output].push_back(newFace);
     }
     
-    std::vector<std::shared_ptr<Geometry>> splittedMeshes;
+    std::vector<std::shared_ptr<Geometry>> meshes;
+    meshes.reserve(outputCount);
     
-    for (int iSubmesh = 0; iSubmesh < splittedIndices.size(); ++iSubmesh) {
-        std::shared_ptr<Geometry> geo(new Geometry(subPositions[iSubmesh],
-                                                   subNormals[iSubmesh],
-                                                   subColors[iSubmesh],
-                                                   subFaces[iSubmesh]));
+    for (int output = 0; output < outputCount; output++) {
+        std::shared_ptr<Geometry> mesh(new Geometry(std::move(subPositions[output]),
+                                                    std::move(subNormals[output]),
+                                                    std::move(subColors[output]),
+                                                    std::move(subFaces[output])));
+        if (geometry.hasTexCoords()) mesh->setTexCoords(std::move(subTexCoords[output]));
         
-        splittedMeshes.push_back(geo);
+        meshes.push_back(mesh);
+    }
+    
+    return meshes;
+}
+
+// See header for documentation
+// Original implementation by Eric Arneback
+std::vector<std::shared_ptr<Geometry>> splitMeshIntoPieces(const Geometry& geometry)
+{
+    if (geometry.vertexCount() == 0 || !geometry.hasFaces()) {
+        return std::vector<std::shared_ptr<Geometry>>();
+    }
+    
+    MeshComponents components = findMeshComponents(geometry);
+    
+    // Keep every piece, in order, except those collapsed to a single point
+    std::vector<int> outputOfComponent(components.componentCount(), -1);
+    int outputCount = 0;
+    for (int component = 0; component < components.componentCount(); component++) {
+        if (components.componentVertexCounts[component] > 1) {
+            outputOfComponent[component] = outputCount++;
+        }
+    }
+    
+    return extractComponents(geometry, components, outputOfComponent, outputCount);
+}
+
+std::vector<std::shared_ptr<Geometry>> extractLargestComponents(const Geometry& geometry,
+                                                                const MeshComponents& components,
+                                                                int maxComponentCount)
+{
+    int outputCount = std::max(0, std::min(maxComponentCount, components.componentCount()));
+    
+    std::vector<int> componentsBySize(components.componentCount());
+    std::iota(componentsBySize.begin(), componentsBySize.end(), 0);
+    std::partial_sort(componentsBySize.begin(), componentsBySize.begin() + outputCount, componentsBySize.end(),
+                      [&components](int lhs, int rhs) {
+        int lhsFaceCount = components.componentFaceCounts[lhs];
+        int rhsFaceCount = components.componentFaceCounts[rhs];
+        return lhsFaceCount > rhsFaceCount || (lhsFaceCount == rhsFaceCount && lhs < rhs);
+    });
+    
+    std::vector<int> outputOfComponent(components.componentCount(), -1);
+    for (int output = 0; output < outputCount; output++) {
+        outputOfComponent[componentsBySize[output]] = output;
     }
     
-    return splittedMeshes;
+    return extractComponents(geometry, components, outputOfComponent, outputCount);
 }
 
 }
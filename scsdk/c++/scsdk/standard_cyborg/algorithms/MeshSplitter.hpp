@@ -16,8 +16,8 @@ limitations under the License.
 
 #pragma once
 
-#include <vector>
 #include <memory>
+#include <vector>
 
 /*
  Find all pieces of geometry,
@@ -45,6 +45,30 @@ namespace algorithms {
 
 std::vector<std::shared_ptr<sc3d::Geometry>> splitMeshIntoPieces(const sc3d::Geometry& geometry);
 
+/* The connected components of a mesh, as labels rather than meshes. Two faces are connected if
+ * they share a vertex. Components are numbered in the order of their lowest vertex index. */
+struct MeshComponents {
+    // The component of each vertex, or -1 for vertices no face uses
+    std::vector<int> vertexComponents;
+    
+    // The component of each face
+    std::vector<int> faceComponents;
+    
+    std::vector<int> componentVertexCounts;
+    std::vector<int> componentFaceCounts;
+    
+    int componentCount() const { return (int)componentVertexCounts.size(); }
+};
+
+/* Label the connected components of the geometry's faces, uniting faces in parallel */
+MeshComponents findMeshComponents(const sc3d::Geometry& geometry);
+
+/* Extract the maxComponentCount components with the most faces as separate meshes, largest
+ * first, in a single pass over the faces. Ties go to the lower numbered component. */
+std::vector<std::shared_ptr<sc3d::Geometry>> extractLargestComponents(const sc3d::Geometry& geometry,
+                                                                      const MeshComponents& components,
+                                                                      int maxComponentCount);
+
 }
 
 } // namespace StandardCyborg
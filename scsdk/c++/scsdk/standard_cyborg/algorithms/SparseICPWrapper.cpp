@@ -16,18 +16,33 @@ limitations under the License.
 
 #include "standard_cyborg/algorithms/SparseICPWrapper.hpp"
 
+#include "standard_cyborg/sc3d/Float3View.hpp"
 #include "standard_cyborg/sc3d/Geometry.hpp"
 #include "standard_cyborg/math/Vec3.hpp"
 #include "standard_cyborg/math/Mat3x4.hpp"
+#include "standard_cyborg/util/AssertHelper.hpp"
+#include "standard_cyborg/util/DataUtils.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wconversion"
 #include <SparseICP.h>
 #pragma clang diagnostic pop
 
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdocumentation"
+#include <Eigen/Cholesky>
+#pragma clang diagnostic pop
+
 using standard_cyborg::math::Mat3x4;
 using standard_cyborg::math::Vec3;
 
+using standard_cyborg::sc3d::Float3View;
 using standard_cyborg::sc3d::Geometry;
 
 namespace standard_cyborg {
@@ -38,26 +53,35 @@ namespace algorithms {
 // 3 rows.
 typedef Eigen::Matrix<double, 3, Eigen::Dynamic> Vertices;
 
-Vertices toEigen(const std::vector<Vec3> vs)
+Vertices toEigen(const Float3View& vs)
 {
     Vertices vertices;
     
     vertices.resize(Eigen::NoChange, vs.size());
     
     for (int ii = 0; ii < vs.size(); ++ii) {
-        vertices(0, ii) = vs[ii].x;
-        vertices(1, ii) = vs[ii].y;
-        vertices(2, ii) = vs[ii].z;
+        vertices(0, ii) = vs.component(ii, 0);
+        vertices(1, ii) = vs.component(ii, 1);
+        vertices(2, ii) = vs.component(ii, 2);
     }
     
     return vertices;
 }
 
+static Mat3x4 toMat3x4(const Eigen::Affine3d& t)
+{
+    return Mat3x4{
+        (float)t(0, 0), (float)t(0, 1), (float)t(0, 2), (float)t(0, 3),
+        (float)t(1, 0), (float)t(1, 1), (float)t(1, 2), (float)t(1, 3),
+        (float)t(2, 0), (float)t(2, 1), (float)t(2, 2), (float)t(2, 3)
+    };
+}
+
 Mat3x4 SparseICPPointToPlane(const Geometry& source, const Geometry& target, const SparseICPParameters& pars)
 {
-    Vertices sourceVertices = toEigen(source.getPositions());
-    Vertices targetVertices = toEigen(target.getPositions());
-    Vertices targetNormals = toEigen(target.getNormals());
+    Vertices sourceVertices = toEigen(source.getPositionsView());
+    Vertices targetVertices = toEigen(target.getPositionsView());
+    Vertices targetNormals = toEigen(target.getNormalsView());
     
     SICP::Parameters pars_;
     
@@ -75,13 +99,279 @@ Mat3x4 SparseICPPointToPlane(const Geometry& source, const Geometry& target, con
     
     Eigen::Affine3d t = SICP::point_to_plane(sourceVertices, targetVertices, targetNormals, pars_);
     
-    Mat3x4 m{
-        (float)t(0, 0), (float)t(0, 1), (float)t(0, 2), (float)t(0, 3),
-        (float)t(1, 0), (float)t(1, 1), (float)t(1, 2), (float)t(1, 3),
-        (float)t(2, 0), (float)t(2, 1), (float)t(2, 2), (float)t(2, 3)
-    };
+    return toMat3x4(t);
+}
+
+// MARK: Single-precision sparse ICP
+
+typedef Eigen::Ref<const Eigen::Matrix3Xf> ConstMatrix3XfRef;
+
+// Coarse levels with fewer source points than this are skipped
+static const int kMinLevelPointCount = 64;
+
+/* The largest of rangeFn(begin, end) over a partition of [0, count) */
+template <typename RangeFunction>
+static float maxOverRanges(int count, const RangeFunction& rangeFn)
+{
+    std::vector<float> maxima(parallelThreadCount(), 0.0f);
+    
+    parallelFor(count, [&](int begin, int end, int threadIndex) {
+        maxima[threadIndex] = rangeFn(begin, end);
+    }, 1024);
+    
+    return *std::max_element(maxima.begin(), maxima.end());
+}
+
+/* The p-norm shrinkage operator of Bouaziz et al., "Sparse Iterative Closest Point", applied to
+ * a scalar, with ba and ha precomputed for the current mu */
+static float shrink(float value, double mu, double p, double ba, double ha)
+{
+    double n = std::abs(value);
+    if (n <= ha) return 0.0f;
+    
+    double s = (ba / n + 1.0) / 2.0;
+    for (int i = 0; i < 3; i++) {
+        s = 1.0 - (p / mu) * std::pow(n, p - 2.0) * std::pow(s, p - 1.0);
+    }
+    
+    return (float)(value * s);
+}
+
+/* Weight 1 for correspondences within thresholdDeviations standard deviations above the mean
+ * distance, 0 for the rest. A non-positive threshold keeps everything. */
+static void computeInlierWeights(const Eigen::VectorXf& distances, double thresholdDeviations, Eigen::VectorXf& weights)
+{
+    int count = (int)distances.size();
+    weights.setOnes(count);
+    if (thresholdDeviations <= 0.0 || count == 0) return;
+    
+    Eigen::Vector2d sums = parallelSum(count, Eigen::Vector2d::Zero().eval(), [&](int begin, int end) {
+        Eigen::Vector2d chunkSums = Eigen::Vector2d::Zero();
+        for (int i = begin; i < end; i++) {
+            chunkSums(0) += distances(i);
+            chunkSums(1) += (double)distances(i) * distances(i);
+        }
+        return chunkSums;
+    });
+    
+    double mean = sums(0) / count;
+    double deviation = std::sqrt(std::max(0.0, sums(1) / count - mean * mean));
+    float threshold = (float)(mean + thresholdDeviations * deviation);
+    
+    for (int i = 0; i < count; i++) {
+        if (distances(i) > threshold) weights(i) = 0.0f;
+    }
+}
+
+/*
+ * One linearized point-to-plane step: the small rigid motion of X that best moves each point's
+ * signed distance to its correspondence's plane toward u, weighted by weights. Applies it to X,
+ * composes it onto transform, and returns the farthest any point moved.
+ */
+static float rigidPointToPlaneStep(Eigen::Matrix3Xf& X,
+                                   const Eigen::Matrix3Xf& Qp,
+                                   const Eigen::Matrix3Xf& Qn,
+                                   const Eigen::VectorXf& weights,
+                                   const Eigen::VectorXf& u,
+                                   Eigen::Affine3d& transform)
+{
+    int count = (int)X.cols();
+    
+    Eigen::Vector4d weightedSum = parallelSum(count, Eigen::Vector4d::Zero().eval(), [&](int begin, int end) {
+        Eigen::Vector4d chunkSum = Eigen::Vector4d::Zero();
+        for (int i = begin; i < end; i++) {
+            chunkSum.head<3>() += weights(i) * X.col(i).cast<double>();
+            chunkSum(3) += weights(i);
+        }
+        return chunkSum;
+    });
+    
+    // No inliers left to align with
+    if (weightedSum(3) <= 0.0) return 0.0f;
+    
+    Eigen::Vector3d mean = weightedSum.head<3>() / weightedSum(3);
+    Eigen::Vector3f meanf = mean.cast<float>();
+    
+    // The normal equations [LHS | RHS], accumulated together
+    typedef Eigen::Matrix<double, 6, 7> NormalEquations;
+    NormalEquations system = parallelSum(count, NormalEquations::Zero().eval(), [&](int begin, int end) {
+        NormalEquations chunkSystem = NormalEquations::Zero();
+        for (int i = begin; i < end; i++) {
+            if (weights(i) == 0.0f) continue;
+            
+            Eigen::Matrix<double, 6, 1> jacobian;
+            jacobian.head<3>() = (X.col(i) - meanf).cross(Qn.col(i)).cast<double>();
+            jacobian.tail<3>() = Qn.col(i).cast<double>();
+            
+            double distanceToPlane = -((X.col(i) - Qp.col(i)).dot(Qn.col(i)) - u(i));
+            chunkSystem.leftCols<6>().selfadjointView<Eigen::Upper>().rankUpdate(jacobian, weights(i));
+            chunkSystem.col(6) += jacobian * (weights(i) * distanceToPlane);
+        }
+        return chunkSystem;
+    });
+    
+    Eigen::Matrix<double, 6, 6> lhs = system.leftCols<6>().selfadjointView<Eigen::Upper>();
+    Eigen::Matrix<double, 6, 1> solution = lhs.ldlt().solve(system.col(6));
+    
+    // Rotate about the mean, then translate
+    Eigen::Affine3d step(Eigen::Translation3d(mean + solution.tail<3>()) *
+                         Eigen::AngleAxisd(solution(0), Eigen::Vector3d::UnitX()) *
+                         Eigen::AngleAxisd(solution(1), Eigen::Vector3d::UnitY()) *
+                         Eigen::AngleAxisd(solution(2), Eigen::Vector3d::UnitZ()) *
+                         Eigen::Translation3d(-mean));
+    
+    transform = step * transform;
+    
+    Eigen::Matrix3f rotation = step.linear().cast<float>();
+    Eigen::Vector3f translation = step.translation().cast<float>();
+    
+    return maxOverRanges(count, [&](int begin, int end) {
+        float maxMovement = 0.0f;
+        for (int i = begin; i < end; i++) {
+            Eigen::Vector3f moved = rotation * X.col(i) + translation;
+            maxMovement = std::max(maxMovement, (moved - X.col(i)).norm());
+            X.col(i) = moved;
+        }
+        return maxMovement;
+    });
+}
+
+/* Sparse point-to-plane ICP of X, which holds the current level's already transformed source
+ * points, against the target. Mirrors SICP::point_to_plane, composing each step onto transform. */
+static void alignLevel(Eigen::Matrix3Xf& X,
+                       const Geometry& target,
+                       const ConstMatrix3XfRef& targetPositions,
+                       const ConstMatrix3XfRef& targetNormals,
+                       const SparseICPParameters& pars,
+                       Eigen::Affine3d& transform)
+{
+    int count = (int)X.cols();
+    
+    Eigen::Matrix3Xf Qp(3, count);
+    Eigen::Matrix3Xf Qn(3, count);
+    Eigen::VectorXf distances(count);
+    Eigen::VectorXf weights(count);
+    Eigen::VectorXf Z = Eigen::VectorXf::Zero(count);
+    Eigen::VectorXf C = Eigen::VectorXf::Zero(count);
+    Eigen::VectorXf U(count);
+    Eigen::Matrix3Xf Xo2;
+    double mu = pars.mu;
+    
+    for (int icp = 0; icp < pars.max_icp; ++icp) {
+        if (pars.print_icpn) std::cout << "Iteration " << icp << std::endl;
+        
+        // Find closest points
+        parallelFor(count, [&](int begin, int end, int threadIndex) {
+            for (int i = begin; i < end; i++) {
+                int id = target.getClosestVertexIndex(Vec3(X(0, i), X(1, i), X(2, i)));
+                Qp.col(i) = targetPositions.col(id);
+                Qn.col(i) = targetNormals.col(id);
+                distances(i) = (X.col(i) - Qp.col(i)).norm();
+            }
+        }, 256);
+        
+        computeInlierWeights(distances, pars.outlierDeviationsThreshold, weights);
+        
+        Xo2 = X;
+        
+        // Compute rotation and translation
+        for (int outer = 0; outer < pars.max_outer; ++outer) {
+            double ba = std::pow((2.0 / mu) * (1.0 - pars.p), 1.0 / (2.0 - pars.p));
+            double ha = ba + (pars.p / mu) * std::pow(ba, pars.p - 1.0);
+            float dual = 0.0f;
+            
+            for (int inner = 0; inner < pars.max_inner; ++inner) {
+                // Z update (shrinkage)
+                parallelFor(count, [&](int begin, int end, int threadIndex) {
+                    for (int i = begin; i < end; i++) {
+                        float residual = Qn.col(i).dot(X.col(i) - Qp.col(i));
+                        Z(i) = shrink(residual + (float)(C(i) / mu), mu, pars.p, ba, ha);
+                        U(i) = Z(i) - (float)(C(i) / mu);
+                    }
+                }, 1024);
+                
+                // Rotation and translation update
+                dual = rigidPointToPlaneStep(X, Qp, Qn, weights, U, transform);
+                if (dual < pars.stop) break;
+            }
+            
+            // C update (Lagrange multipliers)
+            float primal = maxOverRanges(count, [&](int begin, int end) {
+                float maxResidual = 0.0f;
+                for (int i = begin; i < end; i++) {
+                    float P = Qn.col(i).dot(X.col(i) - Qp.col(i)) - Z(i);
+                    if (!pars.use_penalty) C(i) += (float)(mu * P);
+                    maxResidual = std::max(maxResidual, std::abs(P));
+                }
+                return maxResidual;
+            });
+            
+            // mu update (penalty)
+            if (mu < pars.max_mu) mu *= pars.alpha;
+            
+            if (primal < pars.stop && dual < pars.stop) break;
+        }
+        
+        float stop = maxOverRanges(count, [&](int begin, int end) {
+            float maxMovement = 0.0f;
+            for (int i = begin; i < end; i++) {
+                maxMovement = std::max(maxMovement, (X.col(i) - Xo2.col(i)).norm());
+            }
+            return maxMovement;
+        });
+        
+        if (stop < pars.stop) break;
+    }
+}
+
+SparseICPTarget::SparseICPTarget(const Geometry& target) :
+    _target(target)
+{
+    SCASSERT(target.hasNormals(), "SparseICPTarget requires a target with normals");
+    
+    // Build the kd-tree now rather than during the first alignment
+    if (target.vertexCount() > 0) {
+        target.getClosestVertexIndex(Vec3(0, 0, 0));
+    }
+}
+
+Mat3x4 SparseICPPointToPlane(const Geometry& source, const SparseICPTarget& target, const SparseICPParameters& pars)
+{
+    const Geometry& targetGeometry = target.getGeometry();
+    Eigen::Affine3d transform = Eigen::Affine3d::Identity();
+    
+    int sourceCount = source.vertexCount();
+    if (sourceCount == 0 || targetGeometry.vertexCount() == 0) return toMat3x4(transform);
+    
+    auto sourcePositions(toMatrix3Xf(source.getPositionsView()));
+    auto targetPositions(toMatrix3Xf(targetGeometry.getPositionsView()));
+    auto targetNormals(toMatrix3Xf(targetGeometry.getNormalsView()));
+    
+    int levels = std::max(1, pars.levels);
+    int subsampleFactor = std::max(1, pars.subsampleFactor);
+    
+    for (int level = levels - 1; level >= 0; level--) {
+        int step = 1;
+        for (int l = 0; l < level && step <= sourceCount; l++) {
+            step *= subsampleFactor;
+        }
+        
+        int count = (sourceCount + step - 1) / step;
+        if (level > 0 && count < kMinLevelPointCount) continue;
+        
+        // The level's source points, moved by the alignment so far
+        Eigen::Matrix3Xf X(3, count);
+        Eigen::Affine3f transformf = transform.cast<float>();
+        parallelFor(count, [&](int begin, int end, int threadIndex) {
+            for (int i = begin; i < end; i++) {
+                X.col(i) = transformf * sourcePositions.col((Eigen::Index)i * step);
+            }
+        }, 4096);
+        
+        alignLevel(X, targetGeometry, targetPositions, targetNormals, pars, transform);
+    }
     
-    return m;
+    return toMat3x4(transform);
 }
     
 }
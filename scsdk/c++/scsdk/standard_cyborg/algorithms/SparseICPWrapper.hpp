@@ -40,9 +40,32 @@ struct SparseICPParameters {
     double stop = 1e-5;       /// stopping criteria
     bool print_icpn = false;  /// (debug) print ICP iteration
     double outlierDeviationsThreshold = 1.0f; // The number of standard deviations outside of which a depth value being aligned is coinsidered an outlier
+    int levels = 3;           /// (SparseICPTarget only) coarse-to-fine levels; level l aligns every subsampleFactor^l'th source point
+    int subsampleFactor = 4;  /// (SparseICPTarget only) source subsampling between consecutive levels
 };
     
 standard_cyborg::math::Mat3x4 SparseICPPointToPlane(const standard_cyborg::sc3d::Geometry& source, const standard_cyborg::sc3d::Geometry& target, const SparseICPParameters& pars);
+
+/* A target prepared for aligning any number of sources against it. Builds the target's kd-tree
+ * up front, so each alignment only pays for its own source. The target must have normals, and
+ * must outlive this and stay unchanged while it is in use. Sources may be aligned against one
+ * SparseICPTarget from several threads at once. */
+class SparseICPTarget {
+public:
+    explicit SparseICPTarget(const standard_cyborg::sc3d::Geometry& target);
+    
+    const standard_cyborg::sc3d::Geometry& getGeometry() const { return _target; }
+    
+private:
+    const standard_cyborg::sc3d::Geometry& _target;
+};
+
+/* As above, but in single precision, reading source and target in place rather than copying them
+ * into double-precision matrices. Aligns subsampled copies of the source first, coarse to fine
+ * as given by pars.levels and pars.subsampleFactor, and finds correspondences in parallel.
+ * Correspondences farther than pars.outlierDeviationsThreshold standard deviations beyond the
+ * mean distance are left out of each iteration's alignment. */
+standard_cyborg::math::Mat3x4 SparseICPPointToPlane(const standard_cyborg::sc3d::Geometry& source, const SparseICPTarget& target, const SparseICPParameters& pars);
     
 }
 }
@@ -0,0 +1,162 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "standard_cyborg/algorithms/SurfelMap.hpp"
+
+#include "standard_cyborg/sc3d/Float3View.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
+#include "standard_cyborg/util/VoxelKey.hpp"
+
+#include <cmath>
+
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Float3View;
+using standard_cyborg::sc3d::Geometry;
+
+
+namespace standard_cyborg {
+
+namespace algorithms {
+
+SurfelMap::SurfelMap(float voxelSize) :
+    _voxelSize(voxelSize)
+{}
+
+int SurfelMap::integrate(const Geometry& pointCloud)
+{
+    int pointCount = pointCloud.vertexCount();
+    if (pointCount == 0) return 0;
+    
+    Float3View positions = pointCloud.getPositionsView();
+    Float3View normals = pointCloud.hasNormals() ? pointCloud.getNormalsView() : Float3View();
+    Float3View colors = pointCloud.hasColors() ? pointCloud.getColorsView() : Float3View();
+    
+    const float inverseVoxelSize = 1.0f / _voxelSize;
+    std::vector<uint64_t> keys(pointCount);
+    std::vector<int> surfelIndices(pointCount);
+    
+    // Look up every point's voxel at once; the map is only read here, so threads can share it
+    parallelFor(pointCount, [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            uint64_t key = voxelKey(positions[i], inverseVoxelSize);
+            keys[i] = key;
+            
+            auto found = key == kInvalidVoxelKey ? _surfelIndices.end() : _surfelIndices.find(key);
+            surfelIndices[i] = found == _surfelIndices.end() ? -1 : found->second;
+        }
+    }, 4096);
+    
+    // Then occupy the voxels that were new to this frame
+    for (int i = 0; i < pointCount; i++) {
+        if (surfelIndices[i] != -1 || keys[i] == kInvalidVoxelKey) continue;
+        
+        auto inserted = _surfelIndices.emplace(keys[i], (int)_surfels.size());
+        if (inserted.second) {
+            _surfels.emplace_back();
+        }
+        surfelIndices[i] = inserted.first->second;
+    }
+    
+    int integratedCount = 0;
+    
+    for (int i = 0; i < pointCount; i++) {
+        int surfelIndex = surfelIndices[i];
+        if (surfelIndex == -1) continue;
+        
+        Surfel& surfel = _surfels[surfelIndex];
+        surfel.positionSum += positions[i];
+        surfel.weight++;
+        integratedCount++;
+        
+        if (!normals.empty()) {
+            Vec3 normal = normals[i];
+            float length = normal.norm();
+            
+            if (length > 0) {
+                surfel.normalDirectionSum += normal / length;
+            }
+            surfel.normalLengthSum += length;
+            surfel.normalWeight++;
+        }
+        
+        if (!colors.empty()) {
+            surfel.colorSum += colors[i];
+            surfel.colorWeight++;
+        }
+    }
+    
+    _hasNormals = _hasNormals || !normals.empty();
+    _hasColors = _hasColors || !colors.empty();
+    
+    return integratedCount;
+}
+
+std::unique_ptr<Geometry> SurfelMap::toGeometry() const
+{
+    int count = surfelCount();
+    std::vector<Vec3> positions(count);
+    std::vector<Vec3> normals(_hasNormals ? count : 0);
+    std::vector<Vec3> colors(_hasColors ? count : 0);
+    
+    parallelFor(count, [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            const Surfel& surfel = _surfels[i];
+            positions[i] = surfel.positionSum / (float)surfel.weight;
+            
+            // Average the directions, but keep the average of the original lengths
+            if (_hasNormals && surfel.normalWeight > 0) {
+                float directionLength = surfel.normalDirectionSum.norm();
+                if (directionLength > 0) {
+                    normals[i] = surfel.normalDirectionSum * (surfel.normalLengthSum / (surfel.normalWeight * directionLength));
+                }
+            }
+            
+            if (_hasColors && surfel.colorWeight > 0) {
+                colors[i] = surfel.colorSum / (float)surfel.colorWeight;
+            }
+        }
+    }, 4096);
+    
+    return std::make_unique<Geometry>(std::move(positions), std::move(normals), std::move(colors));
+}
+
+int SurfelMap::surfelCount() const
+{
+    return (int)_surfels.size();
+}
+
+float SurfelMap::getVoxelSize() const
+{
+    return _voxelSize;
+}
+
+int SurfelMap::getSurfelWeight(int index) const
+{
+    return _surfels[index].weight;
+}
+
+void SurfelMap::clear()
+{
+    _surfels.clear();
+    _surfelIndices.clear();
+    _hasNormals = false;
+    _hasColors = false;
+}
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
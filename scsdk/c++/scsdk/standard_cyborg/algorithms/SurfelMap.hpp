@@ -0,0 +1,86 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "standard_cyborg/math/Vec3.hpp"
+
+namespace standard_cyborg {
+
+namespace sc3d {
+class Geometry;
+}
+
+namespace algorithms {
+
+/*
+ * Accumulates any number of point clouds into one set of surfels, one per occupied cell of a
+ * voxel grid. Each surfel keeps running sums of the positions, normals and colors that landed in
+ * its cell, so integrating a frame costs one hash lookup per point and memory grows with the
+ * volume the frames cover rather than with how many frames there are.
+ *
+ * This replaces repeatedly calling mergeGeometries, which copies and re-indexes the whole
+ * accumulated cloud for every frame.
+ */
+class SurfelMap {
+public:
+    /* voxelSize plays the role of mergeGeometries' maxMergeDistance */
+    explicit SurfelMap(float voxelSize);
+    
+    /* Fuse a point cloud into the map, reading its attributes in place. Normals and colors are
+     * optional; a surfel averages only the ones it received. Points with non-finite positions or
+     * outside the map's range of about a million voxels from the origin per axis are skipped.
+     * Returns the number of points integrated. */
+    int integrate(const sc3d::Geometry& pointCloud);
+    
+    /* The map's surfels as a point cloud, with normals and colors if any integrated cloud had
+     * them. Surfels come out in the order their voxels were first occupied. */
+    std::unique_ptr<sc3d::Geometry> toGeometry() const;
+    
+    int surfelCount() const;
+    float getVoxelSize() const;
+    
+    /* Number of points integrated into the index'th surfel */
+    int getSurfelWeight(int index) const;
+    
+    void clear();
+    
+private:
+    struct Surfel {
+        math::Vec3 positionSum;
+        math::Vec3 normalDirectionSum;
+        math::Vec3 colorSum;
+        float normalLengthSum = 0;
+        int weight = 0;
+        int normalWeight = 0;
+        int colorWeight = 0;
+    };
+    
+    float _voxelSize;
+    bool _hasNormals = false;
+    bool _hasColors = false;
+    std::vector<Surfel> _surfels;
+    std::unordered_map<uint64_t, int> _surfelIndices;
+};
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
@@ -0,0 +1,291 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "standard_cyborg/algorithms/VoxelDownsample.hpp"
+
+#include "standard_cyborg/sc3d/Float3View.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/util/AssertHelper.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
+#include "standard_cyborg/util/VoxelKey.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Float3View;
+using standard_cyborg::sc3d::Geometry;
+
+namespace standard_cyborg {
+
+namespace algorithms {
+
+// Keys are sorted 11 bits at a time, in fixed chunks so the passes are deterministic
+static const int kRadixBits = 11;
+static const int kRadixSize = 1 << kRadixBits;
+static const int kChunkSize = 1 << 16;
+
+/* Stable sort of keys, permuting indices alongside. Only the low keyBits bits of the keys are
+ * compared, and passes over a digit every key shares are skipped. */
+static void radixSortByKey(std::vector<uint64_t>& keys, std::vector<int>& indices, int keyBits)
+{
+    int count = (int)keys.size();
+    int chunkCount = (count + kChunkSize - 1) / kChunkSize;
+    std::vector<uint64_t> sortedKeys(count);
+    std::vector<int> sortedIndices(count);
+    std::vector<int> offsets((size_t)chunkCount * kRadixSize);
+    
+    for (int shift = 0; shift < keyBits; shift += kRadixBits) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        
+        parallelFor(chunkCount, [&](int beginChunk, int endChunk, int threadIndex) {
+            for (int chunk = beginChunk; chunk < endChunk; chunk++) {
+                int* histogram = offsets.data() + (size_t)chunk * kRadixSize;
+                int end = std::min(count, (chunk + 1) * kChunkSize);
+                
+                for (int i = chunk * kChunkSize; i < end; i++) {
+                    histogram[(keys[i] >> shift) & (kRadixSize - 1)]++;
+                }
+            }
+        }, 1);
+        
+        // Turn the counts into where each chunk's run of each digit starts, digits outermost
+        int total = 0;
+        bool sharedDigit = false;
+        for (int digit = 0; digit < kRadixSize && !sharedDigit; digit++) {
+            int digitStart = total;
+            
+            for (int chunk = 0; chunk < chunkCount; chunk++) {
+                int& offset = offsets[(size_t)chunk * kRadixSize + digit];
+                int digitCount = offset;
+                offset = total;
+                total += digitCount;
+            }
+            
+            sharedDigit = total - digitStart == count;
+        }
+        
+        if (sharedDigit) continue;
+        
+        parallelFor(chunkCount, [&](int beginChunk, int endChunk, int threadIndex) {
+            for (int chunk = beginChunk; chunk < endChunk; chunk++) {
+                int* nextOffsets = offsets.data() + (size_t)chunk * kRadixSize;
+                int end = std::min(count, (chunk + 1) * kChunkSize);
+                
+                for (int i = chunk * kChunkSize; i < end; i++) {
+                    int destination = nextOffsets[(keys[i] >> shift) & (kRadixSize - 1)]++;
+                    sortedKeys[destination] = keys[i];
+                    sortedIndices[destination] = indices[i];
+                }
+            }
+        }, 1);
+        
+        keys.swap(sortedKeys);
+        indices.swap(sortedIndices);
+    }
+}
+
+/* Repack voxel keys relative to the lowest occupied voxel on each axis, using only as many bits
+ * per axis as the occupied range needs, so there are fewer digits to sort. The order of the keys
+ * is unchanged and skipped points keep kInvalidVoxelKey. Returns the number of bits in use. */
+static int compactKeys(std::vector<uint64_t>& keys)
+{
+    const uint64_t axisMask = ((uint64_t)1 << kVoxelKeyBitsPerAxis) - 1;
+    int count = (int)keys.size();
+    int chunkCount = (count + kChunkSize - 1) / kChunkSize;
+    
+    // Occupied range of each axis, per chunk and then overall
+    std::vector<uint64_t> chunkBounds((size_t)chunkCount * 6);
+    parallelFor(chunkCount, [&](int beginChunk, int endChunk, int threadIndex) {
+        for (int chunk = beginChunk; chunk < endChunk; chunk++) {
+            uint64_t* bounds = chunkBounds.data() + (size_t)chunk * 6;
+            for (int axis = 0; axis < 3; axis++) {
+                bounds[axis] = axisMask;
+                bounds[3 + axis] = 0;
+            }
+            
+            int end = std::min(count, (chunk + 1) * kChunkSize);
+            for (int i = chunk * kChunkSize; i < end; i++) {
+                if (keys[i] == kInvalidVoxelKey) continue;
+                for (int axis = 0; axis < 3; axis++) {
+                    uint64_t coordinate = (keys[i] >> (axis * kVoxelKeyBitsPerAxis)) & axisMask;
+                    bounds[axis] = std::min(bounds[axis], coordinate);
+                    bounds[3 + axis] = std::max(bounds[3 + axis], coordinate);
+                }
+            }
+        }
+    }, 1);
+    
+    uint64_t lowest[3] = {axisMask, axisMask, axisMask};
+    uint64_t highest[3] = {0, 0, 0};
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        for (int axis = 0; axis < 3; axis++) {
+            lowest[axis] = std::min(lowest[axis], chunkBounds[(size_t)chunk * 6 + axis]);
+            highest[axis] = std::max(highest[axis], chunkBounds[(size_t)chunk * 6 + 3 + axis]);
+        }
+    }
+    
+    int shifts[3];
+    int keyBits = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        shifts[axis] = keyBits;
+        uint64_t range = highest[axis] > lowest[axis] ? highest[axis] - lowest[axis] : 0;
+        while (range >> (keyBits - shifts[axis])) keyBits++;
+    }
+    
+    parallelFor(count, [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            if (keys[i] == kInvalidVoxelKey) continue;
+            uint64_t key = 0;
+            for (int axis = 0; axis < 3; axis++) {
+                uint64_t coordinate = (keys[i] >> (axis * kVoxelKeyBitsPerAxis)) & axisMask;
+                key |= (coordinate - lowest[axis]) << shifts[axis];
+            }
+            keys[i] = key;
+        }
+    }, 4096);
+    
+    // Skipped points must still sort after the rest
+    return std::min(64, keyBits + 1);
+}
+
+/* The offsets in sorted keys where each run of equal keys begins, plus a final one at the end */
+static std::vector<int> runOffsets(const std::vector<uint64_t>& sortedKeys, int count)
+{
+    int chunkCount = (count + kChunkSize - 1) / kChunkSize;
+    std::vector<int> chunkRunStarts(chunkCount + 1, 0);
+    
+    auto isRunStart = [&](int i) { return i == 0 || sortedKeys[i] != sortedKeys[i - 1]; };
+    
+    parallelFor(chunkCount, [&](int beginChunk, int endChunk, int threadIndex) {
+        for (int chunk = beginChunk; chunk < endChunk; chunk++) {
+            int end = std::min(count, (chunk + 1) * kChunkSize);
+            for (int i = chunk * kChunkSize; i < end; i++) {
+                chunkRunStarts[chunk + 1] += isRunStart(i);
+            }
+        }
+    }, 1);
+    
+    for (int chunk = 0; chunk < chunkCount; chunk++) {
+        chunkRunStarts[chunk + 1] += chunkRunStarts[chunk];
+    }
+    
+    std::vector<int> offsets(chunkRunStarts[chunkCount] + 1);
+    offsets.back() = count;
+    
+    parallelFor(chunkCount, [&](int beginChunk, int endChunk, int threadIndex) {
+        for (int chunk = beginChunk; chunk < endChunk; chunk++) {
+            int run = chunkRunStarts[chunk];
+            int end = std::min(count, (chunk + 1) * kChunkSize);
+            for (int i = chunk * kChunkSize; i < end; i++) {
+                if (isRunStart(i)) offsets[run++] = i;
+            }
+        }
+    }, 1);
+    
+    return offsets;
+}
+
+VoxelDownsampleResult voxelDownsample(const Geometry& pointCloud, float voxelSize, const std::vector<float>& weights)
+{
+    int vertexCount = pointCloud.vertexCount();
+    SCASSERT(voxelSize > 0, "Voxel size must be positive");
+    SCASSERT(weights.empty() || (int)weights.size() == vertexCount, "Weights must be empty or one per vertex");
+    
+    Float3View positions = pointCloud.getPositionsView();
+    Float3View normals = pointCloud.hasNormals() ? pointCloud.getNormalsView() : Float3View();
+    Float3View colors = pointCloud.hasColors() ? pointCloud.getColorsView() : Float3View();
+    
+    const float inverseVoxelSize = 1.0f / voxelSize;
+    std::vector<uint64_t> keys(vertexCount);
+    std::vector<int> indices(vertexCount);
+    
+    parallelFor(vertexCount, [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            keys[i] = voxelKey(positions[i], inverseVoxelSize);
+            indices[i] = i;
+        }
+    }, 4096);
+    
+    int keyBits = compactKeys(keys);
+    radixSortByKey(keys, indices, keyBits);
+    
+    // Skipped vertices have the largest key, so they all sort to the end
+    int bucketedCount = (int)(std::lower_bound(keys.begin(), keys.end(), kInvalidVoxelKey) - keys.begin());
+    std::vector<int> cellOffsets = runOffsets(keys, bucketedCount);
+    int cellCount = (int)cellOffsets.size() - 1;
+    
+    VoxelDownsampleResult result;
+    result.sourceToCell.assign(vertexCount, -1);
+    
+    std::vector<Vec3> cellPositions(cellCount);
+    std::vector<Vec3> cellNormals(normals.empty() ? 0 : cellCount);
+    std::vector<Vec3> cellColors(colors.empty() ? 0 : cellCount);
+    
+    parallelFor(cellCount, [&](int beginCell, int endCell, int threadIndex) {
+        for (int cell = beginCell; cell < endCell; cell++) {
+            // Sum positions relative to the first in the voxel, to keep precision far from the origin
+            Vec3 origin = positions[indices[cellOffsets[cell]]];
+            Vec3 positionSum, normalDirectionSum, colorSum;
+            float normalLengthSum = 0;
+            float weightSum = 0;
+            
+            for (int j = cellOffsets[cell]; j < cellOffsets[cell + 1]; j++) {
+                int index = indices[j];
+                float weight = weights.empty() ? 1.0f : weights[index];
+                result.sourceToCell[index] = cell;
+                
+                positionSum += weight * (positions[index] - origin);
+                weightSum += weight;
+                
+                if (!normals.empty()) {
+                    Vec3 normal = normals[index];
+                    float length = normal.norm();
+                    if (length > 0) {
+                        normalDirectionSum += (weight / length) * normal;
+                    }
+                    normalLengthSum += weight * length;
+                }
+                
+                if (!colors.empty()) {
+                    colorSum += weight * colors[index];
+                }
+            }
+            
+            cellPositions[cell] = origin + positionSum / weightSum;
+            
+            if (!normals.empty()) {
+                float directionLength = normalDirectionSum.norm();
+                if (directionLength > 0) {
+                    cellNormals[cell] = normalDirectionSum * (normalLengthSum / (weightSum * directionLength));
+                }
+            }
+            
+            if (!colors.empty()) {
+                cellColors[cell] = colorSum / weightSum;
+            }
+        }
+    }, 1024);
+    
+    result.geometry = std::make_unique<Geometry>(std::move(cellPositions), std::move(cellNormals), std::move(cellColors));
+    result.geometry->setNormalsEncodeSurfelRadius(pointCloud.normalsEncodeSurfelRadius());
+    
+    return result;
+}
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
@@ -0,0 +1,55 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+namespace standard_cyborg {
+
+namespace sc3d {
+class Geometry;
+}
+
+namespace algorithms {
+
+struct VoxelDownsampleResult {
+    /* One vertex per occupied voxel, ordered by voxel coordinates with z varying slowest */
+    std::unique_ptr<sc3d::Geometry> geometry;
+    
+    /* For each source vertex, the index of the output vertex its voxel became, or -1 if its
+     * position was skipped for not being finite or being out of range */
+    std::vector<int> sourceToCell;
+};
+
+/* Reduce a point cloud to at most one vertex per cubic voxel of side voxelSize, averaging the
+ * positions, normals and colors of the vertices in each. Normal directions are averaged
+ * separately from their lengths, so encoded surfel radii survive. Voxels span about a million
+ * voxelSizes either side of the origin per axis, as for SurfelMap.
+ *
+ * If weights is non-empty it must hold a positive weight per vertex, such as a depth confidence,
+ * and each voxel takes the weighted average of its vertices instead.
+ *
+ * Vertices are bucketed by a parallel radix sort of their voxel keys, so the cost is linear in
+ * the vertex count and the result doesn't depend on the number of threads. */
+VoxelDownsampleResult voxelDownsample(const sc3d::Geometry& pointCloud,
+                                      float voxelSize,
+                                      const std::vector<float>& weights = std::vector<float>());
+
+} // namespace algorithms
+
+} // namespace standard_cyborg
@@ -43,13 +43,14 @@ Result<std::vector<math::Vec3>> TensorToPositions(const Tensor &inTensor) {
   }
 
   std::vector<math::Vec3> outPositions;
+  outPositions.reserve(vertexCount);
   for (int iVertex = 0; iVertex < vertexCount; ++iVertex) {
     const size_t p =  (iVertex * 3);
     math::Vec3 v(floatvs[p + 0], floatvs[p + 1],floatvs[p + 2]);
     outPositions.push_back(v);        
   }
 
-  return { .value = outPositions };
+  return { .value = std::move(outPositions) };
 } 
 
 Result<std::vector<math::Vec3>> TensorToNormals(const Tensor &inTensor) {
@@ -73,6 +74,7 @@ Result<std::vector<math::Vec3>> TensorToNormals(const Tensor &inTensor) {
   }
 
   std::vector<math::Vec3> outNormals;
+  outNormals.reserve(vertexCount);
 
   for (int iVertex = 0; iVertex < vertexCount; ++iVertex) {
     const size_t p =  (iVertex * 3);
@@ -80,7 +82,7 @@ Result<std::vector<math::Vec3>> TensorToNormals(const Tensor &inTensor) {
     outNormals.push_back(v);        
   }
 
-  return { .value = outNormals };
+  return { .value = std::move(outNormals) };
 } 
 
 Result<std::vector<math::Vec3>> TensorToColors(const Tensor &inTensor) {
@@ -104,6 +106,7 @@ Result<std::vector<math::Vec3>> TensorToColors(const Tensor &inTensor) {
   }
 
   std::vector<math::Vec3> outColors;
+  outColors.reserve(vertexCount);
 
   for (int iVertex = 0; iVertex < vertexCount; ++iVertex) {
     const size_t p =  (iVertex * 3);
@@ -111,7 +114,7 @@ Result<std::vector<math::Vec3>> TensorToColors(const Tensor &inTensor) {
     outColors.push_back(v);        
   }
 
-  return { .value = outColors };
+  return { .value = std::move(outColors) };
 }
 
 extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::TriangleMesh &msg) {
@@ -125,7 +128,7 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::Triangl
     if(!result.IsOk()) {
         return {.error = result.error };
     } else {
-      geoPositions = *result.value;
+      geoPositions = std::move(*result.value);
     }
   }
 
@@ -138,7 +141,7 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::Triangl
     if(!result.IsOk()) {
       return { .error = result.error };
     } else {
-      geoNormals = *result.value;
+      geoNormals = std::move(*result.value);
     }
   }
 
@@ -151,7 +154,7 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::Triangl
     if(!result.IsOk()) {
       return { .error = result.error };
     } else {
-      geoColors = *result.value;
+      geoColors = std::move(*result.value);
     }
   }
 
@@ -181,6 +184,7 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::Triangl
       };
     }
     
+    geoTexCoords.reserve(vertexCount);
     for (int iVertex = 0; iVertex < vertexCount; ++iVertex) {
       const size_t p =  (iVertex * 2);
       math::Vec2 v(floatvs[p + 0], floatvs[p + 1]);
@@ -213,6 +217,7 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::Triangl
       };
     }
     
+    geoFaces.reserve(faceCount);
     for (int iFace = 0; iFace < faceCount; ++iFace) {
       const size_t p =  (iFace* 3);
       sc3d::Face3 v(intvs[p + 0], intvs[p + 1], intvs[p + 2]);
@@ -237,26 +242,26 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::Triangl
   }
 
   if(geoPositions.size() > 0) {
-    geometry.setPositions(geoPositions);
+    geometry.setPositions(std::move(geoPositions));
   }
   
   if(geoNormals.size() > 0) {
-    geometry.setNormals(geoNormals);
+    geometry.setNormals(std::move(geoNormals));
   }
   
   if(geoColors.size() > 0) {
-    geometry.setColors(geoColors);
+    geometry.setColors(std::move(geoColors));
   }
   
   if(geoTexCoords.size() > 0) {
-    geometry.setTexCoords(geoTexCoords);
+    geometry.setTexCoords(std::move(geoTexCoords));
   }
 
   if(geoFaces.size() > 0) {
-    geometry.setFaces(geoFaces);
+    geometry.setFaces(std::move(geoFaces));
   }
 
-  return {.value = geometry};
+  return {.value = std::move(geometry)};
 }
 
 extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::PointCloud &msg) {
@@ -270,7 +275,7 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::PointCl
     if(!result.IsOk()) {
     return {.error = result.error };;
     } else {
-        geoPositions = *result.value;
+        geoPositions = std::move(*result.value);
     }
   }
 
@@ -283,7 +288,7 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::PointCl
     if(!result.IsOk()) {
       return { .error = result.error };
     } else {
-      geoNormals = *result.value;
+      geoNormals = std::move(*result.value);
     }
   }
 
@@ -296,25 +301,25 @@ extern Result<sc3d::Geometry> FromPB(const standard_cyborg::proto::sc3d::PointCl
     if(!result.IsOk()) {
       return { .error = result.error };
     } else {
-      geoColors = *result.value;
+      geoColors = std::move(*result.value);
     }
   }
 
   sc3d::Geometry geometry;
 
   if(geoPositions.size() > 0) {
-    geometry.setPositions(geoPositions);
+    geometry.setPositions(std::move(geoPositions));
   }
   
   if(geoNormals.size() > 0) {
-    geometry.setNormals(geoNormals);
+    geometry.setNormals(std::move(geoNormals));
   }
   
   if(geoColors.size() > 0) {
-    geometry.setColors(geoColors);
+    geometry.setColors(std::move(geoColors));
   }
 
-  return {.value = geometry};
+  return {.value = std::move(geometry)};
 }
 
 void NormalsToTensor(const std::vector<math::Vec3>& inNormals, Tensor &outTensor) 
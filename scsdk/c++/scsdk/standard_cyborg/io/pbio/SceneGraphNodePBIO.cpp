@@ -83,9 +83,8 @@ extern Result<std::shared_ptr<scene_graph::Node>> FromPB(const standard_cyborg::
             return { .error = maybeGeometry.error };
         }
         
-        sc3d::Geometry geometry = *maybeGeometry.value;
         std::shared_ptr<scene_graph::GeometryNode> geometryNode(std::make_shared<scene_graph::GeometryNode>());
-        geometryNode->setGeometry(geometry);
+        geometryNode->setGeometry(std::make_shared<sc3d::Geometry>(std::move(*maybeGeometry.value)));
         
         resultNode = geometryNode;
     } else if(msg.has_trianglemesh()) {
@@ -95,9 +94,8 @@ extern Result<std::shared_ptr<scene_graph::Node>> FromPB(const standard_cyborg::
             return { .error = maybeGeometry.error };
         }
         
-        sc3d::Geometry geometry = *maybeGeometry.value;
         std::shared_ptr<scene_graph::GeometryNode> geometryNode(std::make_shared<scene_graph::GeometryNode>());
-        geometryNode->setGeometry(geometry);
+        geometryNode->setGeometry(std::make_shared<sc3d::Geometry>(std::move(*maybeGeometry.value)));
         resultNode = geometryNode;
     } else if(msg.has_pinholecamera()) {
         auto maybePinholeCamera = FromPB(msg.pinholecamera());
@@ -114,7 +114,7 @@ bool ReadGeometryFromPLYStream(Geometry& geometry, std::istream& inStream)
                 vertexZ[i]);
         }
 
-        geometry.setPositions(positions);
+        geometry.setPositions(std::move(positions));
     }
 
     if (plyIn.getElement("vertex").hasProperty("s") && plyIn.getElement("vertex").hasProperty("t")) {
@@ -129,7 +129,7 @@ bool ReadGeometryFromPLYStream(Geometry& geometry, std::istream& inStream)
                 vertexT[i]);
         }
 
-        geometry.setTexCoords(texCoords);
+        geometry.setTexCoords(std::move(texCoords));
     }
 
     if (plyIn.getElement("vertex").hasProperty("nx") && plyIn.getElement("vertex").hasProperty("ny") && plyIn.getElement("vertex").hasProperty("nz")) {
@@ -155,7 +155,7 @@ bool ReadGeometryFromPLYStream(Geometry& geometry, std::istream& inStream)
             geometry.setNormalsEncodeSurfelRadius(false);
         }
 
-        geometry.setNormals(normals);
+        geometry.setNormals(std::move(normals));
     }
 
     if (plyIn.getElement("vertex").hasProperty("red") && plyIn.getElement("vertex").hasProperty("green") && plyIn.getElement("vertex").hasProperty("blue")) {
@@ -188,17 +188,17 @@ bool ReadGeometryFromPLYStream(Geometry& geometry, std::istream& inStream)
             }
         }
 
-        geometry.setColors(colors);
+        geometry.setColors(std::move(colors));
     }
 
     if (plyIn.hasElement("face")) {
         std::vector<std::vector<int>> faceData(plyIn.getFaceIndices<int>());
         std::vector<Face3> faces;
         faces.reserve(faceData.size());
-        for (auto faceList : faceData) {
+        for (const std::vector<int>& faceList : faceData) {
             faces.push_back(Face3({faceList[0], faceList[1], faceList[2]}));
         }
-        geometry.setFaces(faces);
+        geometry.setFaces(std::move(faces));
     }
 
     return true;
@@ -442,10 +442,10 @@ bool FragileReadGeometryFromPLYFile(Geometry& geometryOut, std::string filename)
 
     fclose(fileHandle);
 
-    geometryOut.setPositions(positions);
-    geometryOut.setNormals(normals);
-    geometryOut.setColors(colors);
-    geometryOut.setFaces(faces);
+    geometryOut.setPositions(std::move(positions));
+    geometryOut.setNormals(std::move(normals));
+    geometryOut.setColors(std::move(colors));
+    geometryOut.setFaces(std::move(faces));
 
     return true;
 }
@@ -0,0 +1,69 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "standard_cyborg/math/Vec3.hpp"
+
+namespace standard_cyborg {
+namespace sc3d {
+
+/* A non-owning, read-only view of an array of float triples. It spans both padded math::Vec3
+ * arrays, whose elements are four floats apart, and tightly packed arrays of three floats per
+ * element, so consumers like kd-trees, nanort, Eigen and numpy can read either without a copy. */
+struct Float3View {
+    const float* data = nullptr;
+
+    /* Number of triples */
+    int count = 0;
+
+    /* Distance in floats from one triple to the next */
+    int stride = 3;
+
+    Float3View() {}
+
+    Float3View(const float* data_, int count_, int stride_ = 3) :
+        data(data_),
+        count(count_),
+        stride(stride_)
+    {}
+
+    explicit Float3View(const std::vector<math::Vec3>& vectors) :
+        data((const float*)vectors.data()),
+        count((int)vectors.size()),
+        stride(sizeof(math::Vec3) / sizeof(float))
+    {}
+
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    size_t strideInBytes() const { return stride * sizeof(float); }
+
+    /* The dim'th component of the index'th triple */
+    float component(int index, int dim) const { return data[(size_t)index * stride + dim]; }
+
+    math::Vec3 operator[](int index) const
+    {
+        const float* element = data + (size_t)index * stride;
+        return math::Vec3(element[0], element[1], element[2]);
+    }
+};
+
+} // namespace sc3d
+} // namespace standard_cyborg
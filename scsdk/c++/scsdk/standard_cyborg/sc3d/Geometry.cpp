@@ -15,8 +15,10 @@ limitations under the License.
 */
 
 #include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/sc3d/MeshTopology.hpp"
 
 #include "standard_cyborg/util/DataUtils.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
 #include "standard_cyborg/util/nanort.h"
 
 #pragma clang diagnostic push
@@ -25,9 +27,14 @@ limitations under the License.
 #pragma clang diagnostic pop
 
 #define _USE_MATH_DEFINES
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cassert>
+#include <mutex>
+#include <numeric>
 #include <stack>
+#include <unordered_map>
 #include <iostream>
 
 using standard_cyborg::math::Vec2;
@@ -39,8 +46,15 @@ namespace sc3d {
 
 
 static int serialIdCounter;
+static std::atomic<uint64_t> facesVersionCounter{0};
 std::set<int> Geometry::_allocatedIds;
 
+/* A view of whichever of the padded or packed attribute vectors holds the data */
+static Float3View attributeView(const SharedVector<Vec3>& padded, const SharedVector<float>& packed, bool compactStorage)
+{
+    return compactStorage ? Float3View(packed.data(), (int)packed.size() / 3) : Float3View(padded.get());
+}
+
 template <class VectorOfVectorsType, int DIM = -1, class Distance = nanoflann::metric_L2, typename IndexType = size_t>
 struct KDTreeVectorOfVectorsAdaptor {
     typedef KDTreeVectorOfVectorsAdaptor<VectorOfVectorsType, DIM, Distance> self_t;
@@ -63,7 +77,10 @@ struct KDTreeVectorOfVectorsAdaptor {
         delete index;
     }
 
-    const VectorOfVectorsType& m_data;
+    // Held by value, so VectorOfVectorsType should be a cheap view such as Float3View. The
+    // structures hold on to the buffer rather than the Geometry, since writing out a deferred
+    // transform may move the Geometry's positions to a new buffer while they keep the old one.
+    const VectorOfVectorsType m_data;
 
     /** Query for the \a num_closest closest points to a given point (entered as query_point[0:dim-1]).
      *  Note that this is a short-cut method for index->findNeighbors().
@@ -86,18 +103,13 @@ struct KDTreeVectorOfVectorsAdaptor {
     // Must return the number of data points
     inline size_t kdtree_get_point_count() const
     {
-        return m_data.vertexCount();
+        return m_data.size();
     }
 
     // Returns the dim'th component of the idx'th point in the class:
     inline float kdtree_get_pt(const size_t idx, const size_t dim) const
     {
-        Vec3 v = m_data.getPositions()[idx];
-
-        // cast to float array.
-        float* floatArray = (float*)&v;
-
-        return floatArray[dim];
+        return m_data.component((int)idx, (int)dim);
     }
 
     // Optional bounding-box computation: return false to default to a standard bbox computation loop.
@@ -111,13 +123,176 @@ struct KDTreeVectorOfVectorsAdaptor {
 }; // end of KDTreeVectorOfVectorsAdaptor
 
 
-typedef KDTreeVectorOfVectorsAdaptor<Geometry> KdTree;
+typedef KDTreeVectorOfVectorsAdaptor<Float3View> KdTree;
+
+/* Indexes the subset of a geometry's vertices that moved since its main kd-tree was built.
+ * Result indices are positions within vertexIndices, not vertex indices. */
+struct MovedVertexKdTree {
+    typedef nanoflann::metric_L2::traits<float, MovedVertexKdTree>::distance_t metric_t;
+    typedef nanoflann::KDTreeSingleIndexAdaptor<metric_t, MovedVertexKdTree, 3, size_t> index_t;
+
+    MovedVertexKdTree(const Float3View& positions, const std::vector<int>& vertexIndices) :
+        m_positions(positions),
+        m_vertexIndices(vertexIndices)
+    {
+        index.reset(new index_t(3, *this, nanoflann::KDTreeSingleIndexAdaptorParams(10)));
+        index->buildIndex();
+    }
+
+    const Float3View m_positions;
+    const std::vector<int>& m_vertexIndices;
+    std::unique_ptr<index_t> index;
+
+    inline size_t kdtree_get_point_count() const
+    {
+        return m_vertexIndices.size();
+    }
+
+    inline float kdtree_get_pt(const size_t idx, const size_t dim) const
+    {
+        return m_positions.component(m_vertexIndices[idx], (int)dim);
+    }
+
+    template <class BBOX>
+    bool kdtree_get_bbox(BBOX& /*bb*/) const { return false; }
+};
+
+/* Forwards matches to a nanoflann result set, dropping vertices flagged in `excluded` */
+template <typename ResultSet>
+struct ExcludingResultSet {
+    ResultSet& resultSet;
+    const std::vector<uint8_t>& excluded;
+
+    inline bool full() const { return resultSet.full(); }
+    inline float worstDist() const { return resultSet.worstDist(); }
+    inline bool addPoint(float dist, size_t index)
+    {
+        if (excluded[index]) return true;
+        return resultSet.addPoint(dist, (typename ResultSet::IndexType)index);
+    }
+};
+
+/* Forwards matches to a nanoflann result set, mapping subset positions to vertex indices */
+template <typename ResultSet>
+struct RemappingResultSet {
+    ResultSet& resultSet;
+    const std::vector<int>& vertexIndices;
+
+    inline bool full() const { return resultSet.full(); }
+    inline float worstDist() const { return resultSet.worstDist(); }
+    inline bool addPoint(float dist, size_t index)
+    {
+        return resultSet.addPoint(dist, (typename ResultSet::IndexType)vertexIndices[index]);
+    }
+};
 
 struct Geometry::Impl {
 public:
+    enum UpdateState {
+        kUpToDate,
+        kVerticesMoved, // Some positions changed but the faces did not
+        kInvalid
+    };
+
+    // Each acceleration structure is built independently and guarded by its own mutex, so that a
+    // nearest-neighbor query never pays for a BVH build and vice versa. The atomic states allow
+    // the common already-built case to proceed without taking a lock.
+    std::mutex _kdTreeMutex;
+    std::atomic<int> _kdTreeState{kInvalid};
     std::unique_ptr<KdTree> _kdTree;
 
+    // Vertices moved since _kdTree was built. _kdTree's splits still reflect their old positions,
+    // so they're dropped from its results and searched in the much smaller _movedKdTree instead.
+    std::vector<int> _movedVertices;
+    std::vector<uint8_t> _isMovedVertex;
+    std::unique_ptr<MovedVertexKdTree> _movedKdTree;
+
+    std::mutex _rtAccelMutex;
+    std::atomic<int> _rtAccelState{kInvalid};
     std::unique_ptr<nanort::BVHAccel<float>> _rtAccel;
+    Float3View _rtAccelPositions;
+
+    // Vertex moves absorbed by refitting _rtAccel since it was last built
+    int _rtAccelMovedVertexCount = 0;
+
+    // A similarity transform applied by transform() but not yet written to the positions and
+    // normals. See Geometry::materializeTransform().
+    std::mutex _transformMutex;
+    std::atomic<bool> _hasPendingTransform{false};
+    math::Mat3x4 _pendingTransform;
+    float _pendingTransformScale = 1.0f;
+
+    // Maps the positions the acceleration structures were built from to world space. It's the
+    // pending transform, composed with any transform written out since the structures were
+    // built, in which case _retainedPositions or _retainedCompactPositions holds the positions
+    // they were built from. It only changes in non-const methods, so queries read it freely.
+    SharedVector<Vec3> _retainedPositions;
+    SharedVector<float> _retainedCompactPositions;
+    math::Mat3x4 _indexToWorld;
+    math::Mat3x4 _worldToIndex;
+    float _indexToWorldScale = 1.0f;
+    bool _indexFrameIsWorld = true;
+
+    void setIndexToWorld(const math::Mat3x4& indexToWorld, float scale)
+    {
+        _indexToWorld = indexToWorld;
+        _worldToIndex = indexToWorld.inverse();
+        _indexToWorldScale = scale;
+        _indexFrameIsWorld = indexToWorld == math::Mat3x4::Identity();
+    }
+
+    /* The positions a structure built now should use: those the other may have already been
+     * built from, if they've been retained, otherwise the geometry's own */
+    Float3View indexedPositions(const Float3View& positions) const
+    {
+        if (!_retainedPositions.empty()) {
+            return Float3View(_retainedPositions.get());
+        } else if (!_retainedCompactPositions.empty()) {
+            return Float3View(_retainedCompactPositions.data(), (int)_retainedCompactPositions.size() / 3);
+        } else {
+            return positions;
+        }
+    }
+
+    // Connectivity of the faces as of _topologyFacesVersion. Built on demand by getTopology().
+    std::mutex _topologyMutex;
+    std::shared_ptr<const MeshTopology::MeshTopology> _topology;
+    uint64_t _topologyFacesVersion = 0;
+
+    // In compact storage, whether the padded attribute vectors hold a current copy
+    std::mutex _paddedAttributesMutex;
+    std::atomic<bool> _paddedAttributesAreCurrent{false};
+
+    Vec3 pointToIndexFrame(const Vec3& point) const
+    {
+        return _indexFrameIsWorld ? point : _worldToIndex * point;
+    }
+
+    Vec3 directionToIndexFrame(const Vec3& direction) const
+    {
+        if (_indexFrameIsWorld) return direction;
+
+        const math::Mat3x4& m = _worldToIndex;
+        return Vec3(m.m00 * direction.x + m.m01 * direction.y + m.m02 * direction.z,
+                    m.m10 * direction.x + m.m11 * direction.y + m.m12 * direction.z,
+                    m.m20 * direction.x + m.m21 * direction.y + m.m22 * direction.z);
+    }
+
+    /* Run a nanoflann search over all vertices. The kd-tree must be up to date. */
+    template <typename ResultSet>
+    void findNeighbors(ResultSet& resultSet, const float* queryPoint, const nanoflann::SearchParams& params) const
+    {
+        if (_movedVertices.empty()) {
+            _kdTree->index->findNeighbors(resultSet, queryPoint, params);
+            return;
+        }
+
+        ExcludingResultSet<ResultSet> unmoved{resultSet, _isMovedVertex};
+        _kdTree->index->findNeighbors(unmoved, queryPoint, params);
+
+        RemappingResultSet<ResultSet> moved{resultSet, _movedVertices};
+        _movedKdTree->index->findNeighbors(moved, queryPoint, params);
+    }
 
     ~Impl() = default;
 };
@@ -137,10 +312,75 @@ Geometry::Geometry(const std::vector<Vec3>& positions,
     _faces = faces;
 }
 
-Geometry::Geometry(Geometry const& other) {
+Geometry::Geometry(std::vector<Vec3>&& positions,
+                   std::vector<Vec3>&& normals,
+                   std::vector<Vec3>&& colors,
+                   std::vector<Face3>&& faces) :
+    Geometry()
+{
+    _positions = std::move(positions);
+    _normals = std::move(normals);
+    _colors = std::move(colors);
+    _faces = std::move(faces);
+}
+
+Geometry::Geometry(std::vector<Vec3>&& positions, std::vector<Face3>&& faces) :
+    Geometry()
+{
+    _positions = std::move(positions);
+    _faces = std::move(faces);
+}
+
+Geometry::Geometry(Geometry const& other) :
+    Geometry()
+{
     this->copy(other);
 }
 
+Geometry::Geometry(Geometry&& other) :
+    Geometry()
+{
+    *this = std::move(other);
+}
+
+Geometry& Geometry::operator=(Geometry&& other)
+{
+    if (this == &other) return *this;
+
+    _positions = std::move(other._positions);
+    _normals = std::move(other._normals);
+    _colors = std::move(other._colors);
+    _compactPositions = std::move(other._compactPositions);
+    _compactNormals = std::move(other._compactNormals);
+    _compactColors = std::move(other._compactColors);
+    _compactStorage = other._compactStorage;
+    _texCoords = std::move(other._texCoords);
+    _faces = std::move(other._faces);
+    _facesVersion = other._facesVersion;
+    _texture = std::move(other._texture);
+    _frame = std::move(other._frame);
+    _normalsEncodeSurfelRadius = other._normalsEncodeSurfelRadius;
+    _incrementalUpdateFraction = other._incrementalUpdateFraction;
+
+    // Moving a vector keeps its buffer, so the acceleration structures, which index into the
+    // buffers, and any pending transform stay valid and come along too
+    pImpl = std::move(other.pImpl);
+
+    other.pImpl.reset(new Impl());
+    other._positions.clear();
+    other._normals.clear();
+    other._colors.clear();
+    other._compactPositions.clear();
+    other._compactNormals.clear();
+    other._compactColors.clear();
+    other._compactStorage = false;
+    other._texCoords.clear();
+    other._faces.clear();
+    other.didChangeFaces();
+
+    return *this;
+}
+
 bool operator==(const Geometry& lhs, const Geometry& rhs) {
     bool b =  
         lhs.getPositions() == rhs.getPositions() && 
@@ -175,6 +415,8 @@ Geometry::Geometry()
 
     _id = serialIdCounter++;
     _allocatedIds.insert(_id);
+
+    _facesVersion = ++facesVersionCounter;
 }
 
 void Geometry::resetIdCounter() { serialIdCounter = 0; }
@@ -197,31 +439,191 @@ Geometry::~Geometry()
 }
 
 // clang-format off
-const std::vector<Vec3>&  Geometry::getPositions() const { return _positions; }
-const std::vector<Vec3>&  Geometry::getNormals()   const { return _normals; }
-const std::vector<Vec3>&  Geometry::getColors()    const { return _colors; }
+const std::vector<Vec3>&  Geometry::getPositions() const { materializeTransform(); expandCompactAttributes(); return _positions; }
+const std::vector<Vec3>&  Geometry::getNormals()   const { materializeTransform(); expandCompactAttributes(); return _normals; }
+const std::vector<Vec3>&  Geometry::getColors()    const { expandCompactAttributes(); return _colors; }
 const std::vector<Vec2>&  Geometry::getTexCoords() const { return _texCoords; }
 const std::vector<Face3>& Geometry::getFaces()     const { return _faces; }
 
-bool Geometry::hasPositions() const { return _positions.size() > 0; }
-bool Geometry::hasNormals()   const { return _normals.size()   > 0; }
-bool Geometry::hasColors()    const { return _colors.size()    > 0; }
+Float3View Geometry::getPositionsView() const { materializeTransform(); return attributeView(_positions, _compactPositions, _compactStorage); }
+Float3View Geometry::getNormalsView()   const { materializeTransform(); return attributeView(_normals, _compactNormals, _compactStorage); }
+Float3View Geometry::getColorsView()    const { return attributeView(_colors, _compactColors, _compactStorage); }
+
+bool Geometry::hasPositions() const { return (_compactStorage ? _compactPositions.size() : _positions.size()) > 0; }
+bool Geometry::hasNormals()   const { return (_compactStorage ? _compactNormals.size()   : _normals.size())   > 0; }
+bool Geometry::hasColors()    const { return (_compactStorage ? _compactColors.size()    : _colors.size())    > 0; }
 bool Geometry::hasTexCoords() const { return _texCoords.size() > 0; }
 bool Geometry::hasFaces()     const { return _faces.size()     > 0; }
 // clang-format on
 
+/* Every change to positions, normals or colors is made on the padded vectors. In compact storage,
+ * an AttributeEdit expands them for the duration of its scope and packs them again at the end, so
+ * mutators can return early without leaving the geometry half-converted. It also writes out any
+ * pending transform first. */
+class Geometry::AttributeEdit {
+public:
+    AttributeEdit(Geometry& geometry) :
+        _geometry(geometry),
+        _wasCompact(geometry._compactStorage)
+    {
+        _geometry.materializeTransform();
+
+        if (_wasCompact) {
+            _geometry.expandCompactAttributes();
+            _geometry._compactStorage = false;
+        }
+    }
+
+    ~AttributeEdit()
+    {
+        if (_wasCompact) {
+            _geometry._compactStorage = true;
+            _geometry.packCompactAttributes();
+        }
+
+        // Writing to positions shared with a copy of this geometry moves them to a buffer of
+        // their own, which the acceleration structures don't read from
+        Impl& impl = *_geometry.pImpl;
+        const Float3View positions = impl.indexedPositions(attributeView(_geometry._positions, _geometry._compactPositions, _geometry._compactStorage));
+
+        bool kdTreeIsDetached = impl._kdTreeState.load() != Impl::kInvalid && impl._kdTree && impl._kdTree->m_data.data != positions.data;
+        bool rtAccelIsDetached = impl._rtAccelState.load() != Impl::kInvalid && impl._rtAccelPositions.data != positions.data;
+
+        if (kdTreeIsDetached || rtAccelIsDetached) _geometry.invalidateDataStructures();
+    }
+
+private:
+    Geometry& _geometry;
+    bool _wasCompact;
+};
+
+static bool packedEquals(const std::vector<Vec3>& vectors, const std::vector<float>& packed)
+{
+    if (packed.size() != vectors.size() * 3) return false;
+
+    for (size_t i = 0; i < vectors.size(); i++) {
+        if (vectors[i].x != packed[3 * i + 0] || vectors[i].y != packed[3 * i + 1] || vectors[i].z != packed[3 * i + 2]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void packFloat3s(const std::vector<Vec3>& vectors, SharedVector<float>& sharedPacked)
+{
+    // Leave attributes the edit didn't touch alone, so that buffers shared with copies of this
+    // geometry aren't cloned
+    if (packedEquals(vectors, sharedPacked)) return;
+
+    // Same-sized vectors keep their buffer, which structures built from it may still be reading
+    std::vector<float>& packed = sharedPacked.mutate();
+    packed.resize(vectors.size() * 3);
+
+    parallelFor((int)vectors.size(), [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            packed[3 * i + 0] = vectors[i].x;
+            packed[3 * i + 1] = vectors[i].y;
+            packed[3 * i + 2] = vectors[i].z;
+        }
+    }, 4096);
+}
+
+static void unpackFloat3s(const std::vector<float>& packed, std::vector<Vec3>& vectors)
+{
+    vectors.resize(packed.size() / 3);
+
+    parallelFor((int)vectors.size(), [&](int begin, int end, int threadIndex) {
+        for (int i = begin; i < end; i++) {
+            vectors[i] = Vec3(packed[3 * i + 0], packed[3 * i + 1], packed[3 * i + 2]);
+        }
+    }, 4096);
+}
+
+void Geometry::expandCompactAttributes() const
+{
+    if (!_compactStorage) return;
+
+    // The cache must never hold positions from before a transform
+    materializeTransform();
+
+    Impl& impl = *pImpl;
+    if (impl._paddedAttributesAreCurrent.load(std::memory_order_acquire)) return;
+
+    std::lock_guard<std::mutex> lock(impl._paddedAttributesMutex);
+    if (impl._paddedAttributesAreCurrent.load(std::memory_order_relaxed)) return;
+
+    unpackFloat3s(_compactPositions, _positions.mutate());
+    unpackFloat3s(_compactNormals, _normals.mutate());
+    unpackFloat3s(_compactColors, _colors.mutate());
+
+    impl._paddedAttributesAreCurrent.store(true, std::memory_order_release);
+}
+
+void Geometry::packCompactAttributes()
+{
+    if (!_compactStorage) return;
+
+    packFloat3s(_positions, _compactPositions);
+    packFloat3s(_normals, _compactNormals);
+    packFloat3s(_colors, _compactColors);
+
+    // The padded copies are only a cache, so release them
+    releasePaddedAttributes();
+}
+
+void Geometry::releasePaddedAttributes()
+{
+    _positions.clear();
+    _normals.clear();
+    _colors.clear();
+    pImpl->_paddedAttributesAreCurrent.store(false, std::memory_order_release);
+}
+
+void Geometry::setCompactStorage(bool compactStorage)
+{
+    if (compactStorage == _compactStorage) return;
+
+    materializeTransform();
+    invalidateDataStructures();
+
+    if (compactStorage) {
+        _compactStorage = true;
+        packCompactAttributes();
+    } else {
+        expandCompactAttributes();
+        _compactStorage = false;
+        pImpl->_paddedAttributesAreCurrent.store(false, std::memory_order_release);
+
+        _compactPositions.clear();
+        _compactNormals.clear();
+        _compactColors.clear();
+    }
+}
+
+bool Geometry::hasCompactStorage() const
+{
+    return _compactStorage;
+}
+
 void Geometry::setColor(const Vec3& color, float alpha)
 {
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& colors = _colors.mutate();
+
     int numVertices = vertexCount();
     for (int i = 0; i < numVertices; i++) {
-        _colors[i] = alpha * color + (1.0 - alpha) * _colors[i];
+        colors[i] = alpha * color + (1.0 - alpha) * colors[i];
     }
 }
 
 void Geometry::setColor(const Vec3& color, float alpha, const VertexSelection& vertexIndices)
 {
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& colors = _colors.mutate();
+
     for (auto index : vertexIndices) {
-        _colors[index] = alpha * color + (1.0 - alpha) * _colors[index];
+        colors[index] = alpha * color + (1.0 - alpha) * colors[index];
     }
 }
 
@@ -229,7 +631,15 @@ bool Geometry::setVertexData(const std::vector<Vec3>& positions,
                              const std::vector<Vec3>& normals,
                              const std::vector<Vec3>& colors)
 {
-    _isDirty = true;
+    return setVertexData(std::vector<Vec3>(positions), std::vector<Vec3>(normals), std::vector<Vec3>(colors));
+}
+
+bool Geometry::setVertexData(std::vector<Vec3>&& positions,
+                             std::vector<Vec3>&& normals,
+                             std::vector<Vec3>&& colors)
+{
+    AttributeEdit edit(*this);
+    invalidateDataStructures();
 
     if (normals.size() != 0 && normals.size() != positions.size()) {
         return false;
@@ -239,24 +649,121 @@ bool Geometry::setVertexData(const std::vector<Vec3>& positions,
         return false;
     }
 
-    _positions = positions;
-    _normals = normals;
-    _colors = colors;
+    _positions = std::move(positions);
+    _normals = std::move(normals);
+    _colors = std::move(colors);
 
     return true;
 }
 
 void Geometry::didMutateExternally() const
 {
-    _isDirty = true;
+    invalidateDataStructures();
+}
+
+void Geometry::invalidateDataStructures() const
+{
+    Impl& impl = *pImpl;
+    impl._kdTreeState.store(Impl::kInvalid, std::memory_order_release);
+    impl._rtAccelState.store(Impl::kInvalid, std::memory_order_release);
+
+    // The structures will be rebuilt from the current positions, which any pending transform
+    // still maps to world space
+    impl._retainedPositions.clear();
+    impl._retainedCompactPositions.clear();
+    if (impl._hasPendingTransform.load(std::memory_order_relaxed)) {
+        impl.setIndexToWorld(impl._pendingTransform, impl._pendingTransformScale);
+    } else {
+        impl.setIndexToWorld(math::Mat3x4(), 1.0f);
+    }
+}
+
+void Geometry::didMovePositions(const std::vector<int>& movedVertexIndices)
+{
+    if (movedVertexIndices.empty()) return;
+
+    Impl& impl = *pImpl;
+
+    if (!impl._retainedPositions.empty() || !impl._retainedCompactPositions.empty()) {
+        // The structures were built from positions that have since been transformed
+        invalidateDataStructures();
+        return;
+    }
+    int maxMovedVertexCount = (int)(_incrementalUpdateFraction * vertexCount());
+
+    if (impl._kdTreeState.load(std::memory_order_relaxed) != Impl::kInvalid) {
+        if (impl._isMovedVertex.empty()) {
+            impl._isMovedVertex.assign(vertexCount(), 0);
+        }
+
+        for (int index : movedVertexIndices) {
+            if (impl._isMovedVertex[index]) continue;
+            impl._isMovedVertex[index] = 1;
+            impl._movedVertices.push_back(index);
+        }
+
+        bool shouldRebuild = (int)impl._movedVertices.size() > maxMovedVertexCount;
+        impl._kdTreeState.store(shouldRebuild ? Impl::kInvalid : Impl::kVerticesMoved, std::memory_order_release);
+    }
+
+    if (impl._rtAccelState.load(std::memory_order_relaxed) != Impl::kInvalid) {
+        // Unlike the kd-tree, each refit loosens the bounds further, so repeated moves of the
+        // same vertices count against the limit each time
+        impl._rtAccelMovedVertexCount += (int)movedVertexIndices.size();
+
+        bool shouldRebuild = impl._rtAccelMovedVertexCount > maxMovedVertexCount;
+        impl._rtAccelState.store(shouldRebuild ? Impl::kInvalid : Impl::kVerticesMoved, std::memory_order_release);
+    }
+}
+
+void Geometry::setIncrementalUpdateFraction(float fraction)
+{
+    _incrementalUpdateFraction = std::max(0.0f, fraction);
+}
+
+float Geometry::getIncrementalUpdateFraction() const
+{
+    return _incrementalUpdateFraction;
 }
 
 bool Geometry::setPositions(const std::vector<Vec3>& positions)
 {
-    _isDirty = true;
+    if (positions.size() == 0 || positions.size() != (size_t)vertexCount()) {
+        return setPositions(std::vector<Vec3>(positions));
+    }
+
+    AttributeEdit edit(*this);
+
+    // The faces still apply, so only the vertices that actually moved need updating. The other
+    // attributes already match this vertex count.
+    std::vector<int> movedVertexIndices;
+    for (int index = 0; index < (int)positions.size(); index++) {
+        if (positions[index] != _positions[index]) {
+            movedVertexIndices.push_back(index);
+        }
+    }
+
+    // Copy in place, as the kd-tree keeps reading the unmoved vertices from this buffer
+    if (!movedVertexIndices.empty()) {
+        std::copy(positions.begin(), positions.end(), _positions.mutate().begin());
+        didMovePositions(movedVertexIndices);
+    }
+
+    return true;
+}
+
+bool Geometry::setPositions(std::vector<Vec3>&& positions)
+{
+    if (positions.size() != 0 && positions.size() == (size_t)vertexCount()) {
+        return setPositions(static_cast<const std::vector<Vec3>&>(positions));
+    }
+
+    AttributeEdit edit(*this);
+
     // If positions are empty, unset entirely
     if (positions.size() == 0) {
-        _positions = positions;
+        invalidateDataStructures();
+        _positions = std::move(positions);
         return true;
     }
 
@@ -271,16 +778,24 @@ bool Geometry::setPositions(const std::vector<Vec3>& positions)
         return false;
     }
 
-    _positions = positions;
+    invalidateDataStructures();
+    _positions = std::move(positions);
 
     return true;
 }
 
 bool Geometry::setNormals(const std::vector<Vec3>& normals)
 {
+    return setNormals(std::vector<Vec3>(normals));
+}
+
+bool Geometry::setNormals(std::vector<Vec3>&& normals)
+{
+    AttributeEdit edit(*this);
+
     // If normals are empty, unset entirely
     if (normals.size() == 0) {
-        _normals = normals;
+        _normals = std::move(normals);
         return true;
     }
 
@@ -295,16 +810,23 @@ bool Geometry::setNormals(const std::vector<Vec3>& normals)
         return false;
     }
 
-    _normals = normals;
+    _normals = std::move(normals);
 
     return true;
 }
 
 bool Geometry::setColors(const std::vector<Vec3>& colors)
 {
+    return setColors(std::vector<Vec3>(colors));
+}
+
+bool Geometry::setColors(std::vector<Vec3>&& colors)
+{
+    AttributeEdit edit(*this);
+
     // If colors are empty, unset entirely
     if (colors.size() == 0) {
-        _colors = colors;
+        _colors = std::move(colors);
         return true;
     }
 
@@ -319,41 +841,57 @@ bool Geometry::setColors(const std::vector<Vec3>& colors)
     if (_texCoords.size() != 0 && _texCoords.size() != colors.size()) {
         return false;
     }
-    _colors = colors;
+    _colors = std::move(colors);
 
     return true;
 }
 
 bool Geometry::setTexCoords(const std::vector<Vec2>& texCoords)
+{
+    return setTexCoords(std::vector<Vec2>(texCoords));
+}
+
+bool Geometry::setTexCoords(std::vector<Vec2>&& texCoords)
 {
     // If colors are empty, unset entirely
     if (texCoords.size() == 0) {
-        _texCoords = texCoords;
+        _texCoords = std::move(texCoords);
         return true;
     }
 
-    // Assert consistency with normals and positions
-    if (_normals.size() != 0 && _normals.size() != texCoords.size()) {
+    // Assert consistency with normals and positions. Texture coordinates are never packed, so
+    // rather than expanding the other attributes with an AttributeEdit, compare against the
+    // sizes of whichever storage holds them.
+    int normalCount = attributeView(_normals, _compactNormals, _compactStorage).count;
+    if (normalCount != 0 && normalCount != (int)texCoords.size()) {
         return false;
     }
 
-    if (_positions.size() != 0 && _positions.size() != texCoords.size()) {
+    if (vertexCount() != 0 && vertexCount() != (int)texCoords.size()) {
         return false;
     }
-    if (_colors.size() != 0 && _colors.size() != texCoords.size()) {
+    
+    int colorCount = attributeView(_colors, _compactColors, _compactStorage).count;
+    if (colorCount != 0 && colorCount != (int)texCoords.size()) {
         return false;
     }
-    _texCoords = texCoords;
+    _texCoords = std::move(texCoords);
 
     return true;
 }
 
 bool Geometry::setFaces(const std::vector<Face3>& faces)
 {
-    _isDirty = true;
+    return setFaces(std::vector<Face3>(faces));
+}
+
+bool Geometry::setFaces(std::vector<Face3>&& faces)
+{
+    invalidateDataStructures();
     // We may want to iterate through the face data and ensure there are
     // no out-of-bounds indices.
-    _faces = faces;
+    _faces = std::move(faces);
+    didChangeFaces();
 
     return true;
 }
@@ -386,7 +924,7 @@ ColorImage* Geometry::getTexturePtr()
 
 int Geometry::vertexCount() const
 {
-    return (int)_positions.size();
+    return (int)(_compactStorage ? _compactPositions.size() / 3 : _positions.size());
 }
 
 int Geometry::faceCount() const
@@ -394,78 +932,134 @@ int Geometry::faceCount() const
     return (int)_faces.size();
 }
 
-void Geometry::deleteVertices(const VertexSelection& verticesToDelete)
+// Work per element is tiny when deleting vertices, so only split large ranges across threads
+static const int kDeleteVerticesRangeSize = 16384;
+
+/* Number the entries whose keep flag is set consecutively from zero, in order, and the others -1.
+ * Each thread counts the entries it keeps first, so that every range knows where its numbering
+ * starts. Returns the number kept. */
+static int renumberKeptEntries(const std::vector<uint8_t>& keep, std::vector<int>& renumbering)
 {
-    _isDirty = true;
+    int count = (int)keep.size();
+    renumbering.resize(count);
 
-    if (hasFaces()) {
-        std::set<int> faceIndicesToDelete;
+    std::vector<int> rangeStarts(parallelThreadCount() + 1, 0);
 
-        for (int faceIndex = 0; faceIndex < _faces.size(); ++faceIndex) {
-            Face3 face = _faces[faceIndex];
-            // Delete if any vertex that the face touches is in the selection to delete
-            if (verticesToDelete.contains(face[0]) || verticesToDelete.contains(face[1]) || verticesToDelete.contains(face[2])) {
-                faceIndicesToDelete.insert(faceIndex);
-            }
-        }
+    parallelFor(count, [&](int begin, int end, int threadIndex) {
+        int keptCount = 0;
+        for (int i = begin; i < end; i++) keptCount += keep[i];
+        rangeStarts[threadIndex + 1] = keptCount;
+    }, kDeleteVerticesRangeSize);
 
-        // Renumber the faces in-place by keeping a running counter of the compressed index.
-        int faceRenumbering = -1;
-        for (int originalFaceIndex = 0; originalFaceIndex < _faces.size(); ++originalFaceIndex) {
-            if (faceIndicesToDelete.count(originalFaceIndex) == 1) continue;
-            faceRenumbering++;
-            _faces[faceRenumbering] = _faces[originalFaceIndex];
-        }
-        _faces.resize(faceRenumbering + 1);
-
-        // Construct a temporary array of vertex renumberings since we don't know anything a priori
-        // about the order in which they'll show up in the faces
-        std::vector<int> vertexRenumbering(vertexCount());
-        int cumulativeCount = -1;
-        for (int vertexIndex = 0; vertexIndex < vertexCount(); vertexIndex++) {
-            cumulativeCount += verticesToDelete.contains(vertexIndex) ? 0 : 1;
-            vertexRenumbering[vertexIndex] = cumulativeCount;
+    std::partial_sum(rangeStarts.begin(), rangeStarts.end(), rangeStarts.begin());
+
+    parallelFor(count, [&](int begin, int end, int threadIndex) {
+        int next = rangeStarts[threadIndex];
+        for (int i = begin; i < end; i++) {
+            renumbering[i] = keep[i] ? next++ : -1;
         }
+    }, kDeleteVerticesRangeSize);
+
+    return rangeStarts.back();
+}
+
+void Geometry::deleteVertices(const VertexSelection& verticesToDelete)
+{
+    if (verticesToDelete.size() == 0) return;
+
+    AttributeEdit edit(*this);
 
-        // Finally, step through the compressed faces and update their vertex indices
-        for (int faceIndex = 0; faceIndex < _faces.size(); faceIndex++) {
-            Face3& face = _faces[faceIndex];
-            face[0] = vertexRenumbering[face[0]];
-            face[1] = vertexRenumbering[face[1]];
-            face[2] = vertexRenumbering[face[2]];
+    int oldVertexCount = vertexCount();
+
+    std::vector<uint8_t> keepVertex(oldVertexCount, 1);
+    bool deletesAnything = false;
+    for (int vertexIndex : verticesToDelete) {
+        if (vertexIndex >= 0 && vertexIndex < oldVertexCount) {
+            keepVertex[vertexIndex] = 0;
+            deletesAnything = true;
         }
     }
+    if (!deletesAnything) return;
 
-    if (hasPositions()) {
-        deleteEntriesFromVector(_positions, verticesToDelete);
-    }
+    invalidateDataStructures();
 
-    if (hasNormals()) {
-        deleteEntriesFromVector(_normals, verticesToDelete);
-    }
+    std::vector<int> vertexRenumbering;
+    int newVertexCount = renumberKeptEntries(keepVertex, vertexRenumbering);
 
-    if (hasColors()) {
-        deleteEntriesFromVector(_colors, verticesToDelete);
-    }
+    if (hasFaces()) {
+        const std::vector<Face3>& oldFaces = _faces;
+
+        // Delete any face that touches a deleted vertex
+        std::vector<uint8_t> keepFace(oldFaces.size());
+        parallelFor((int)oldFaces.size(), [&](int begin, int end, int threadIndex) {
+            for (int faceIndex = begin; faceIndex < end; faceIndex++) {
+                const Face3& face = oldFaces[faceIndex];
+                keepFace[faceIndex] = keepVertex[face[0]] & keepVertex[face[1]] & keepVertex[face[2]];
+            }
+        }, kDeleteVerticesRangeSize);
+
+        std::vector<int> faceRenumbering;
+        int newFaceCount = renumberKeptEntries(keepFace, faceRenumbering);
 
-    if (hasTexCoords()) {
-        deleteEntriesFromVector(_texCoords, verticesToDelete);
+        std::vector<Face3> faces(newFaceCount);
+        parallelFor((int)oldFaces.size(), [&](int begin, int end, int threadIndex) {
+            for (int faceIndex = begin; faceIndex < end; faceIndex++) {
+                int newFaceIndex = faceRenumbering[faceIndex];
+                if (newFaceIndex < 0) continue;
+
+                const Face3& face = oldFaces[faceIndex];
+                faces[newFaceIndex] = Face3(vertexRenumbering[face[0]], vertexRenumbering[face[1]], vertexRenumbering[face[2]]);
+            }
+        }, kDeleteVerticesRangeSize);
+
+        _faces = std::move(faces);
+        didChangeFaces();
     }
+
+    // Compact every vertex attribute in one pass, into new buffers so that ranges can be written
+    // in parallel and buffers shared with copies of this geometry are left alone
+    std::vector<Vec3> positions(hasPositions() ? newVertexCount : 0);
+    std::vector<Vec3> normals(hasNormals() ? newVertexCount : 0);
+    std::vector<Vec3> colors(hasColors() ? newVertexCount : 0);
+    std::vector<Vec2> texCoords(hasTexCoords() ? newVertexCount : 0);
+
+    const std::vector<Vec3>& oldPositions = _positions;
+    const std::vector<Vec3>& oldNormals = _normals;
+    const std::vector<Vec3>& oldColors = _colors;
+    const std::vector<Vec2>& oldTexCoords = _texCoords;
+
+    parallelFor(oldVertexCount, [&](int begin, int end, int threadIndex) {
+        for (int vertexIndex = begin; vertexIndex < end; vertexIndex++) {
+            int newVertexIndex = vertexRenumbering[vertexIndex];
+            if (newVertexIndex < 0) continue;
+
+            if (!positions.empty()) positions[newVertexIndex] = oldPositions[vertexIndex];
+            if (!normals.empty()) normals[newVertexIndex] = oldNormals[vertexIndex];
+            if (!colors.empty()) colors[newVertexIndex] = oldColors[vertexIndex];
+            if (!texCoords.empty()) texCoords[newVertexIndex] = oldTexCoords[vertexIndex];
+        }
+    }, kDeleteVerticesRangeSize);
+
+    _positions = std::move(positions);
+    _normals = std::move(normals);
+    _colors = std::move(colors);
+    _texCoords = std::move(texCoords);
 }
 
 int Geometry::getClosestVertexIndex(const Vec3& queryPoint) const
 {
-    updateDataStructures();
+    updateKdTree();
 
     size_t retIndex;
     float retDistSquared;
 
     nanoflann::KNNResultSet<float> resultSet(1);
 
-    float pt[3] = {queryPoint.x, queryPoint.y, queryPoint.z};
+    Vec3 indexQueryPoint = pImpl->pointToIndexFrame(queryPoint);
+    float pt[3] = {indexQueryPoint.x, indexQueryPoint.y, indexQueryPoint.z};
 
     resultSet.init(&retIndex, &retDistSquared);
-    pImpl->_kdTree->index->findNeighbors(resultSet, pt, nanoflann::SearchParams(10));
+    pImpl->findNeighbors(resultSet, pt, nanoflann::SearchParams(10));
 
     return (int)retIndex;
 }
@@ -474,14 +1068,14 @@ Vec3 Geometry::getClosestVertexPosition(const Vec3& queryPoint) const
 {
     int index = getClosestVertexIndex(queryPoint);
 
-    return _positions[index];
+    return getPositionsView()[index];
 }
 
 std::vector<int> Geometry::getNClosestVertexIndices(const Vec3& queryPosition, int n) const
 {
     std::vector<int> results;
 
-    updateDataStructures();
+    updateKdTree();
 
     {
         std::vector<float> retDistsSquared;
@@ -493,10 +1087,11 @@ std::vector<int> Geometry::getNClosestVertexIndices(const Vec3& queryPosition, i
 
         nanoflann::KNNResultSet<float, int> resultSet(n);
 
-        float pt[3] = {queryPosition.x, queryPosition.y, queryPosition.z};
+        Vec3 indexQueryPosition = pImpl->pointToIndexFrame(queryPosition);
+        float pt[3] = {indexQueryPosition.x, indexQueryPosition.y, indexQueryPosition.z};
 
         resultSet.init(results.data(), retDistsSquared.data());
-        pImpl->_kdTree->index->findNeighbors(resultSet, pt, nanoflann::SearchParams(10));
+        pImpl->findNeighbors(resultSet, pt, nanoflann::SearchParams(10));
     }
 
     return results;
@@ -504,15 +1099,18 @@ std::vector<int> Geometry::getNClosestVertexIndices(const Vec3& queryPosition, i
 
 std::vector<int> Geometry::getVertexIndicesInRadius(const Vec3& queryPosition, float radius) const
 {
-    updateDataStructures();
+    updateKdTree();
 
-    float position[3] = {queryPosition.x, queryPosition.y, queryPosition.z};
-    float squaredRadius = radius * radius;
-    std::vector<std::pair<unsigned long, float>> resultIndicesAndSquaredDistances;
+    Vec3 indexQueryPosition = pImpl->pointToIndexFrame(queryPosition);
+    float position[3] = {indexQueryPosition.x, indexQueryPosition.y, indexQueryPosition.z};
+    float indexRadius = radius / pImpl->_indexToWorldScale;
+    float squaredRadius = indexRadius * indexRadius;
+    std::vector<std::pair<size_t, float>> resultIndicesAndSquaredDistances;
     nanoflann::SearchParams params;
     params.sorted = false;
 
-    pImpl->_kdTree->index->radiusSearch(&position[0], squaredRadius, resultIndicesAndSquaredDistances, params);
+    nanoflann::RadiusResultSet<float, size_t> resultSet(squaredRadius, resultIndicesAndSquaredDistances);
+    pImpl->findNeighbors(resultSet, &position[0], params);
 
     std::vector<int> results;
     for (auto result : resultIndicesAndSquaredDistances) {
@@ -522,6 +1120,122 @@ std::vector<int> Geometry::getVertexIndicesInRadius(const Vec3& queryPosition, f
     return results;
 }
 
+void Geometry::getNClosestVertexIndices(const std::vector<Vec3>& queryPositions, int n, NeighborQueryResult& result) const
+{
+    int queryCount = (int)queryPositions.size();
+    int neighborCount = std::max(0, std::min(n, vertexCount()));
+
+    // Every query returns the same number of neighbors, so offsets are known up front and each
+    // query writes straight into its slot of the output.
+    result.offsets.resize(queryCount + 1);
+    result.indices.resize((size_t)queryCount * neighborCount);
+    result.squaredDistances.resize((size_t)queryCount * neighborCount);
+
+    for (int i = 0; i <= queryCount; i++) {
+        result.offsets[i] = i * neighborCount;
+    }
+
+    if (queryCount == 0 || neighborCount == 0) return;
+
+    updateKdTree();
+    const Impl& impl = *pImpl;
+
+    // Distances in the frame the kd-tree was built in scale uniformly to world space
+    float squaredScale = impl._indexToWorldScale * impl._indexToWorldScale;
+
+    parallelFor(queryCount, [&](int begin, int end, int threadIndex) {
+        nanoflann::SearchParams params(10);
+
+        for (int i = begin; i < end; i++) {
+            Vec3 queryPosition = impl.pointToIndexFrame(queryPositions[i]);
+            float pt[3] = {queryPosition.x, queryPosition.y, queryPosition.z};
+
+            float* squaredDistances = result.squaredDistances.data() + result.offsets[i];
+
+            nanoflann::KNNResultSet<float, int> resultSet(neighborCount);
+            resultSet.init(result.indices.data() + result.offsets[i], squaredDistances);
+            impl.findNeighbors(resultSet, pt, params);
+
+            if (!impl._indexFrameIsWorld) {
+                for (int k = 0; k < neighborCount; k++) {
+                    squaredDistances[k] *= squaredScale;
+                }
+            }
+        }
+    });
+}
+
+void Geometry::getVertexIndicesInRadius(const std::vector<Vec3>& queryPositions, float radius, NeighborQueryResult& result) const
+{
+    int queryCount = (int)queryPositions.size();
+
+    result.offsets.assign(queryCount + 1, 0);
+    result.indices.clear();
+    result.squaredDistances.clear();
+
+    if (queryCount == 0 || vertexCount() == 0) return;
+
+    updateKdTree();
+    const Impl& impl = *pImpl;
+
+    float indexRadius = radius / impl._indexToWorldScale;
+    float squaredRadius = indexRadius * indexRadius;
+    float squaredScale = impl._indexToWorldScale * impl._indexToWorldScale;
+
+    // Each thread gathers the neighbors of its contiguous range of queries into its own buffers,
+    // recording per-query counts in offsets[i + 1]. A prefix sum over the counts then gives each
+    // range's position in the flat output, into which the ranges are copied in parallel.
+    struct ThreadScratch {
+        int begin = 0;
+        int end = 0;
+        std::vector<std::pair<size_t, float>> matches;
+        std::vector<int> indices;
+        std::vector<float> squaredDistances;
+    };
+    std::vector<ThreadScratch> scratch(parallelThreadCount());
+
+    parallelFor(queryCount, [&](int begin, int end, int threadIndex) {
+        ThreadScratch& local = scratch[threadIndex];
+        local.begin = begin;
+        local.end = end;
+
+        nanoflann::SearchParams params;
+        params.sorted = false;
+
+        for (int i = begin; i < end; i++) {
+            Vec3 queryPosition = impl.pointToIndexFrame(queryPositions[i]);
+            float pt[3] = {queryPosition.x, queryPosition.y, queryPosition.z};
+
+            nanoflann::RadiusResultSet<float, size_t> resultSet(squaredRadius, local.matches);
+            impl.findNeighbors(resultSet, &pt[0], params);
+
+            for (const auto& match : local.matches) {
+                local.indices.push_back((int)match.first);
+                local.squaredDistances.push_back(match.second * squaredScale);
+            }
+            result.offsets[i + 1] = (int)local.matches.size();
+        }
+    });
+
+    for (int i = 0; i < queryCount; i++) {
+        result.offsets[i + 1] += result.offsets[i];
+    }
+
+    result.indices.resize(result.offsets[queryCount]);
+    result.squaredDistances.resize(result.offsets[queryCount]);
+
+    parallelFor((int)scratch.size(), [&](int begin, int end, int threadIndex) {
+        for (int t = begin; t < end; t++) {
+            const ThreadScratch& local = scratch[t];
+            if (local.begin == local.end) continue;
+
+            int offset = result.offsets[local.begin];
+            std::copy(local.indices.begin(), local.indices.end(), result.indices.begin() + offset);
+            std::copy(local.squaredDistances.begin(), local.squaredDistances.end(), result.squaredDistances.begin() + offset);
+        }
+    }, 1);
+}
+
 RayTraceResult Geometry::rayTrace(Vec3 rayOrigin, Vec3 rayDirection, float rayMin, float rayMax) const
 {
     if (_faces.size() == 0) {
@@ -533,22 +1247,26 @@ RayTraceResult Geometry::rayTrace(Vec3 rayOrigin, Vec3 rayDirection, float rayMi
         return result;
     }
 
-    updateDataStructures();
+    updateRayTraceAccel();
+
+    // Affine maps preserve the ray parameter, so t needs no conversion back to world space
+    Vec3 indexRayOrigin = pImpl->pointToIndexFrame(rayOrigin);
+    Vec3 indexRayDirection = pImpl->directionToIndexFrame(rayDirection);
 
     nanort::Ray<float> ray;
     ray.min_t = rayMin;
     ray.max_t = rayMax;
 
-    ray.dir[0] = rayDirection.x;
-    ray.dir[1] = rayDirection.y;
-    ray.dir[2] = rayDirection.z;
-    ray.org[0] = rayOrigin.x;
-    ray.org[1] = rayOrigin.y;
-    ray.org[2] = rayOrigin.z;
+    ray.dir[0] = indexRayDirection.x;
+    ray.dir[1] = indexRayDirection.y;
+    ray.dir[2] = indexRayDirection.z;
+    ray.org[0] = indexRayOrigin.x;
+    ray.org[1] = indexRayOrigin.y;
+    ray.org[2] = indexRayOrigin.z;
 
     nanort::TriangleIntersection<> intersection;
 
-    nanort::TriangleIntersector<> triangle_intersector((float*)this->_positions.data(), (unsigned int*)_faces.data(), sizeof(Vec3));
+    nanort::TriangleIntersector<> triangle_intersector(pImpl->_rtAccelPositions.data, (unsigned int*)_faces.data(), pImpl->_rtAccelPositions.strideInBytes());
 
     bool hit = pImpl->_rtAccel->Traverse(ray, triangle_intersector, &intersection);
 
@@ -563,34 +1281,521 @@ RayTraceResult Geometry::rayTrace(Vec3 rayOrigin, Vec3 rayDirection, float rayMi
 }
 
 
-void Geometry::updateDataStructures() const
+// Number of consecutive rays traversed together by rayTraceBatch. Must fit in the bits of
+// the packet's active-ray mask.
+static const int kRayPacketSize = 16;
+
+void Geometry::rayTraceBatch(const std::vector<Vec3>& rayOrigins,
+                             const std::vector<Vec3>& rayDirections,
+                             std::vector<RayTraceResult>& results,
+                             float rayMin,
+                             float rayMax) const
+{
+    int rayCount = (int)rayDirections.size();
+    bool sharedOrigin = rayOrigins.size() == 1;
+
+    SCASSERT(sharedOrigin || rayOrigins.size() == rayDirections.size(), "rayTraceBatch requires a single origin or one origin per ray direction");
+
+    results.resize(rayCount);
+
+    if (!hasFaces() || rayOrigins.size() == 0) {
+        // Report point clouds the same way rayTrace does
+        RayTraceResult miss;
+        miss.t = 0.0f;
+        std::fill(results.begin(), results.end(), miss);
+        return;
+    }
+
+    updateRayTraceAccel();
+
+    const Impl& impl = *pImpl;
+    const std::vector<nanort::BVHNode<float>>& nodes = impl._rtAccel->GetNodes();
+    const std::vector<unsigned int>& primitiveIndices = impl._rtAccel->GetIndices();
+
+    struct PacketRay {
+        nanort::real3<float> origin;
+        nanort::real3<float> inverseDirection;
+        int directionSign[3];
+        float hitT;
+        int hitIndex;
+    };
+
+    parallelFor(rayCount, [&](int begin, int end, int threadIndex) {
+        typedef nanort::TriangleIntersector<> Intersector;
+
+        // The intersectors hold the per-ray watertight intersection coefficients. They're
+        // allocated once per thread and re-prepared for each packet.
+        std::vector<Intersector> intersectors(kRayPacketSize, Intersector(impl._rtAccelPositions.data, (const unsigned int*)_faces.data(), impl._rtAccelPositions.strideInBytes()));
+        nanort::BVHTraceOptions traceOptions;
+        PacketRay packet[kRayPacketSize];
+
+        // Matches nanort's own maximum traversal stack depth
+        unsigned int nodeStack[512];
+
+        for (int packetStart = begin; packetStart < end; packetStart += kRayPacketSize) {
+            int packetSize = std::min(kRayPacketSize, end - packetStart);
+
+            for (int r = 0; r < packetSize; r++) {
+                int rayIndex = packetStart + r;
+                Vec3 origin = impl.pointToIndexFrame(sharedOrigin ? rayOrigins[0] : rayOrigins[rayIndex]);
+                Vec3 direction = impl.directionToIndexFrame(rayDirections[rayIndex]);
+
+                nanort::Ray<float> ray;
+                ray.min_t = rayMin;
+                ray.max_t = rayMax;
+                ray.org[0] = origin.x;
+                ray.org[1] = origin.y;
+                ray.org[2] = origin.z;
+                ray.dir[0] = direction.x;
+                ray.dir[1] = direction.y;
+                ray.dir[2] = direction.z;
+
+                intersectors[r].PrepareTraversal(ray, traceOptions);
+
+                PacketRay& packetRay = packet[r];
+                packetRay.origin = nanort::real3<float>(origin.x, origin.y, origin.z);
+                packetRay.inverseDirection = nanort::vsafe_inverse(nanort::real3<float>(direction.x, direction.y, direction.z));
+                packetRay.directionSign[0] = direction.x < 0.0f ? 1 : 0;
+                packetRay.directionSign[1] = direction.y < 0.0f ? 1 : 0;
+                packetRay.directionSign[2] = direction.z < 0.0f ? 1 : 0;
+                packetRay.hitT = rayMax;
+                packetRay.hitIndex = -1;
+            }
+
+            // Walk the BVH once for the whole packet, descending into any node that at least one
+            // ray overlaps within its current closest-hit interval.
+            int stackIndex = 0;
+            nodeStack[0] = 0;
+
+            while (stackIndex >= 0) {
+                const nanort::BVHNode<float>& node = nodes[nodeStack[stackIndex--]];
+
+                uint32_t activeRays = 0;
+                for (int r = 0; r < packetSize; r++) {
+                    PacketRay& packetRay = packet[r];
+                    float tMin, tMax;
+                    if (nanort::IntersectRayAABB(&tMin, &tMax, rayMin, packetRay.hitT, node.bmin, node.bmax,
+                                                 packetRay.origin, packetRay.inverseDirection, packetRay.directionSign)) {
+                        activeRays |= 1u << r;
+                    }
+                }
+
+                if (activeRays == 0) continue;
+
+                if (node.flag == 0) {
+                    // Order children by the first active ray; for a coherent packet this is the
+                    // near-first order for (nearly) every ray.
+                    int leadRay = 0;
+                    while ((activeRays & (1u << leadRay)) == 0) leadRay++;
+
+                    int orderNear = packet[leadRay].directionSign[node.axis];
+                    nodeStack[++stackIndex] = node.data[1 - orderNear];
+                    nodeStack[++stackIndex] = node.data[orderNear];
+                } else {
+                    unsigned int primitiveCount = node.data[0];
+                    unsigned int primitiveOffset = node.data[1];
+
+                    for (int r = 0; r < packetSize; r++) {
+                        if ((activeRays & (1u << r)) == 0) continue;
+
+                        PacketRay& packetRay = packet[r];
+                        for (unsigned int i = 0; i < primitiveCount; i++) {
+                            unsigned int primitiveIndex = primitiveIndices[primitiveOffset + i];
+                            float t = packetRay.hitT;
+                            if (intersectors[r].Intersect(&t, primitiveIndex)) {
+                                packetRay.hitT = t;
+                                packetRay.hitIndex = (int)primitiveIndex;
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (int r = 0; r < packetSize; r++) {
+                int rayIndex = packetStart + r;
+                const PacketRay& packetRay = packet[r];
+                RayTraceResult& result = results[rayIndex];
+
+                result = RayTraceResult();
+                if (packetRay.hitIndex >= 0 && packetRay.hitT < rayMax) {
+                    const Vec3& origin = sharedOrigin ? rayOrigins[0] : rayOrigins[rayIndex];
+                    result.t = packetRay.hitT;
+                    result.index = packetRay.hitIndex;
+                    result.hitPoint = origin + result.t * rayDirections[rayIndex];
+                }
+            }
+        }
+    }, 1024);
+}
+
+/* The point of triangle abc closest to p, after Ericson, "Real-Time Collision Detection", 5.1.5.
+ * Writes the weights of a, b and c that give it, which are exactly zero for the vertices not
+ * involved when the point lies on an edge or a vertex. */
+static Vec3 closestPointOnTriangle(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c, Vec3& barycentrics)
+{
+    Vec3 ab = b - a;
+    Vec3 ac = c - a;
+
+    Vec3 ap = p - a;
+    float d1 = Vec3::dot(ab, ap);
+    float d2 = Vec3::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        barycentrics = Vec3(1.0f, 0.0f, 0.0f);
+        return a;
+    }
+
+    Vec3 bp = p - b;
+    float d3 = Vec3::dot(ab, bp);
+    float d4 = Vec3::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        barycentrics = Vec3(0.0f, 1.0f, 0.0f);
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        float v = d1 - d3 > 0.0f ? d1 / (d1 - d3) : 0.0f;
+        barycentrics = Vec3(1.0f - v, v, 0.0f);
+        return a + v * ab;
+    }
+
+    Vec3 cp = p - c;
+    float d5 = Vec3::dot(ab, cp);
+    float d6 = Vec3::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        barycentrics = Vec3(0.0f, 0.0f, 1.0f);
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        float w = d2 - d6 > 0.0f ? d2 / (d2 - d6) : 0.0f;
+        barycentrics = Vec3(1.0f - w, 0.0f, w);
+        return a + w * ac;
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        float denominator = (d4 - d3) + (d5 - d6);
+        float w = denominator > 0.0f ? (d4 - d3) / denominator : 0.0f;
+        barycentrics = Vec3(0.0f, 1.0f - w, w);
+        return b + w * (c - b);
+    }
+
+    float denominator = va + vb + vc;
+    if (denominator <= 0.0f) {
+        // Degenerate, and not caught by the edge tests above due to rounding
+        barycentrics = Vec3(1.0f, 0.0f, 0.0f);
+        return a;
+    }
+
+    float v = vb / denominator;
+    float w = vc / denominator;
+    barycentrics = Vec3(1.0f - v - w, v, w);
+    return a + v * ab + w * ac;
+}
+
+/* Angle-weighted pseudo-normals, after Baerentzen and Aanaes, "Signed distance computation using
+ * the angle weighted pseudonormal". Whether a point lies inside a closed mesh is the sign of its
+ * offset from the closest surface point along the pseudo-normal of the face, edge or vertex that
+ * the closest point lies on; plain face normals get this wrong near edges and vertices. */
+struct SurfacePseudoNormals {
+    std::vector<Vec3> faceNormals;
+    std::vector<Vec3> vertexNormals;
+    std::unordered_map<uint64_t, Vec3> edgeNormals;
+
+    static uint64_t edgeKey(int vertex0, int vertex1)
+    {
+        if (vertex0 > vertex1) std::swap(vertex0, vertex1);
+        return ((uint64_t)vertex0 << 32) | (uint32_t)vertex1;
+    }
+
+    SurfacePseudoNormals(const Float3View& positions, const std::vector<Face3>& faces) :
+        faceNormals(faces.size()),
+        vertexNormals(positions.size(), Vec3(0.0f, 0.0f, 0.0f))
+    {
+        edgeNormals.reserve(faces.size() * 3 / 2);
+
+        for (size_t faceIndex = 0; faceIndex < faces.size(); faceIndex++) {
+            const Face3& face = faces[faceIndex];
+            Vec3 corners[3] = {positions[face[0]], positions[face[1]], positions[face[2]]};
+
+            Vec3 normal = Vec3::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            float length = normal.norm();
+            if (length == 0.0f) continue;
+            normal = normal / length;
+
+            faceNormals[faceIndex] = normal;
+
+            for (int corner = 0; corner < 3; corner++) {
+                const Vec3& position = corners[corner];
+                float angle = Vec3::angleBetween(corners[(corner + 1) % 3] - position, corners[(corner + 2) % 3] - position);
+                vertexNormals[face[corner]] += angle * normal;
+
+                edgeNormals[edgeKey(face[corner], face[(corner + 1) % 3])] += normal;
+            }
+        }
+    }
+
+    /* The pseudo-normal at a point of the face with the given barycentric coordinates */
+    Vec3 normalAt(int faceIndex, const Face3& face, const Vec3& barycentrics) const
+    {
+        float weights[3] = {barycentrics.x, barycentrics.y, barycentrics.z};
+
+        int zeroCount = 0;
+        int zeroCorner = 0;
+        int nonzeroCorner = 0;
+        for (int corner = 0; corner < 3; corner++) {
+            if (weights[corner] == 0.0f) {
+                zeroCount++;
+                zeroCorner = corner;
+            } else {
+                nonzeroCorner = corner;
+            }
+        }
+
+        if (zeroCount >= 2) {
+            return vertexNormals[face[nonzeroCorner]];
+        } else if (zeroCount == 1) {
+            auto edgeNormal = edgeNormals.find(edgeKey(face[(zeroCorner + 1) % 3], face[(zeroCorner + 2) % 3]));
+            if (edgeNormal != edgeNormals.end()) return edgeNormal->second;
+        }
+
+        return faceNormals[faceIndex];
+    }
+};
+
+static float squaredDistanceToBox(const nanort::BVHNode<float>& node, const Vec3& point)
+{
+    float dx = std::max(0.0f, std::max(node.bmin[0] - point.x, point.x - node.bmax[0]));
+    float dy = std::max(0.0f, std::max(node.bmin[1] - point.y, point.y - node.bmax[1]));
+    float dz = std::max(0.0f, std::max(node.bmin[2] - point.z, point.z - node.bmax[2]));
+    return dx * dx + dy * dy + dz * dz;
+}
+
+SurfacePointResult Geometry::getClosestSurfacePoint(const Vec3& queryPosition, bool signedDistance, float maxDistance) const
+{
+    std::vector<SurfacePointResult> results;
+    getClosestSurfacePoints({queryPosition}, results, signedDistance, maxDistance);
+    return results[0];
+}
+
+void Geometry::getClosestSurfacePoints(const std::vector<Vec3>& queryPositions,
+                                       std::vector<SurfacePointResult>& results,
+                                       bool signedDistance,
+                                       float maxDistance) const
+{
+    int queryCount = (int)queryPositions.size();
+    results.resize(queryCount);
+
+    if (!hasFaces()) {
+        std::fill(results.begin(), results.end(), SurfacePointResult());
+        return;
+    }
+
+    updateRayTraceAccel();
+
+    // Search in the frame the BVH was built in, where distances are scaled by 1 / scale
+    const Impl& impl = *pImpl;
+    const std::vector<nanort::BVHNode<float>>& nodes = impl._rtAccel->GetNodes();
+    const std::vector<unsigned int>& primitiveIndices = impl._rtAccel->GetIndices();
+    const Float3View& positions = impl._rtAccelPositions;
+    const std::vector<Face3>& faces = _faces;
+
+    float scale = impl._indexToWorldScale;
+    float maxIndexDistance = maxDistance / scale;
+    float maxSquaredIndexDistance = maxIndexDistance * maxIndexDistance;
+
+    std::unique_ptr<SurfacePseudoNormals> pseudoNormals;
+    bool flipsOrientation = false;
+    if (signedDistance) {
+        pseudoNormals.reset(new SurfacePseudoNormals(positions, faces));
+
+        // A reflection into world space turns the surface inside out
+        const math::Mat3x4& m = impl._indexToWorld;
+        float determinant = m.m00 * (m.m11 * m.m22 - m.m12 * m.m21) -
+                            m.m01 * (m.m10 * m.m22 - m.m12 * m.m20) +
+                            m.m02 * (m.m10 * m.m21 - m.m11 * m.m20);
+        flipsOrientation = determinant < 0.0f;
+    }
+
+    parallelFor(queryCount, [&](int begin, int end, int threadIndex) {
+        // Matches nanort's own maximum traversal stack depth
+        unsigned int nodeStack[512];
+
+        for (int queryIndex = begin; queryIndex < end; queryIndex++) {
+            Vec3 point = impl.pointToIndexFrame(queryPositions[queryIndex]);
+
+            float bestSquaredDistance = maxSquaredIndexDistance;
+            int bestFace = -1;
+            Vec3 bestPoint;
+            Vec3 bestBarycentrics;
+
+            int stackSize = 0;
+            nodeStack[stackSize++] = 0;
+
+            while (stackSize > 0) {
+                const nanort::BVHNode<float>& node = nodes[nodeStack[--stackSize]];
+                if (squaredDistanceToBox(node, point) >= bestSquaredDistance) continue;
+
+                if (node.flag == 1) {
+                    unsigned int primitiveEnd = node.data[1] + node.data[0];
+                    for (unsigned int i = node.data[1]; i < primitiveEnd; i++) {
+                        int faceIndex = (int)primitiveIndices[i];
+                        const Face3& face = faces[faceIndex];
+
+                        Vec3 barycentrics;
+                        Vec3 closestPoint = closestPointOnTriangle(point, positions[face[0]], positions[face[1]], positions[face[2]], barycentrics);
+                        float squaredDistance = Vec3::squaredDistanceBetween(point, closestPoint);
+
+                        if (squaredDistance < bestSquaredDistance) {
+                            bestSquaredDistance = squaredDistance;
+                            bestFace = faceIndex;
+                            bestPoint = closestPoint;
+                            bestBarycentrics = barycentrics;
+                        }
+                    }
+                } else {
+                    // Push the nearer child last so that it's searched first, which shrinks the
+                    // search radius soonest
+                    unsigned int nearChild = node.data[0];
+                    unsigned int farChild = node.data[1];
+                    float nearSquaredDistance = squaredDistanceToBox(nodes[nearChild], point);
+                    float farSquaredDistance = squaredDistanceToBox(nodes[farChild], point);
+                    if (farSquaredDistance < nearSquaredDistance) {
+                        std::swap(nearChild, farChild);
+                        std::swap(nearSquaredDistance, farSquaredDistance);
+                    }
+
+                    if (farSquaredDistance < bestSquaredDistance) nodeStack[stackSize++] = farChild;
+                    if (nearSquaredDistance < bestSquaredDistance) nodeStack[stackSize++] = nearChild;
+                }
+            }
+
+            SurfacePointResult& result = results[queryIndex];
+            result = SurfacePointResult();
+            if (bestFace < 0) continue;
+
+            result.faceIndex = bestFace;
+            result.barycentrics = bestBarycentrics;
+            result.point = impl._indexFrameIsWorld ? bestPoint : impl._indexToWorld * bestPoint;
+            result.distance = std::sqrt(bestSquaredDistance) * scale;
+
+            if (pseudoNormals) {
+                Vec3 normal = pseudoNormals->normalAt(bestFace, faces[bestFace], bestBarycentrics);
+                bool isInside = Vec3::dot(point - bestPoint, normal) < 0.0f;
+                if (isInside != flipsOrientation) result.distance = -result.distance;
+            }
+        }
+    }, 64);
+}
+
+void Geometry::updateKdTree() const
 {
-    if ((!pImpl->_rtAccel || _isDirty) && hasFaces()) {
+    // Double-checked so that queries against an up-to-date tree never contend for the lock
+    if (pImpl->_kdTreeState.load(std::memory_order_acquire) == Impl::kUpToDate) return;
+
+    std::lock_guard<std::mutex> lock(pImpl->_kdTreeMutex);
+    int state = pImpl->_kdTreeState.load(std::memory_order_relaxed);
+    if (state == Impl::kUpToDate) return;
+
+    Float3View positions = pImpl->indexedPositions(attributeView(_positions, _compactPositions, _compactStorage));
+
+    if (state == Impl::kVerticesMoved && pImpl->_kdTree) {
+        // Only the moved vertices need re-indexing
+        pImpl->_movedKdTree.reset(new MovedVertexKdTree(positions, pImpl->_movedVertices));
+    } else {
+        // The adaptor builds its index on construction
+        pImpl->_kdTree.reset(new KdTree(positions, 10));
+
+        pImpl->_movedKdTree.reset();
+        pImpl->_movedVertices.clear();
+        pImpl->_isMovedVertex.clear();
+    }
+
+    pImpl->_kdTreeState.store(Impl::kUpToDate, std::memory_order_release);
+}
+
+void Geometry::updateRayTraceAccel() const
+{
+    if (pImpl->_rtAccelState.load(std::memory_order_acquire) == Impl::kUpToDate) return;
+
+    std::lock_guard<std::mutex> lock(pImpl->_rtAccelMutex);
+    int state = pImpl->_rtAccelState.load(std::memory_order_relaxed);
+    if (state == Impl::kUpToDate) return;
+
+    Float3View positions = pImpl->indexedPositions(attributeView(_positions, _compactPositions, _compactStorage));
+    pImpl->_rtAccelPositions = positions;
+
+    if (state == Impl::kVerticesMoved && pImpl->_rtAccel) {
+        // Same triangles, so keep the tree and just grow or shrink its bounds to fit
+        nanort::TriangleMesh<float> triangle_mesh(positions.data, (unsigned int*)_faces.data(), positions.strideInBytes());
+        pImpl->_rtAccel->Refit(triangle_mesh);
+    } else if (hasFaces()) {
         nanort::BVHBuildOptions<float> options; // Use default option
-        nanort::TriangleMesh<float> triangle_mesh((float*)this->_positions.data(), (unsigned int*)_faces.data(), sizeof(Vec3));
-        nanort::TriangleSAHPred<float> triangle_pred((float*)this->_positions.data(), (unsigned int*)_faces.data(), sizeof(Vec3));
+        nanort::TriangleMesh<float> triangle_mesh(positions.data, (unsigned int*)_faces.data(), positions.strideInBytes());
+        nanort::TriangleSAHPred<float> triangle_pred(positions.data, (unsigned int*)_faces.data(), positions.strideInBytes());
 
-        pImpl->_rtAccel.reset(new nanort::BVHAccel<float>());
+        std::unique_ptr<nanort::BVHAccel<float>> rtAccel(new nanort::BVHAccel<float>());
 
-        bool ret = pImpl->_rtAccel->Build((int)_faces.size(), triangle_mesh, triangle_pred, options);
+        bool ret = rtAccel->Build((int)_faces.size(), triangle_mesh, triangle_pred, options);
         assert(ret);
-    }
 
-    if (!pImpl->_kdTree || _isDirty) { // lazily build kd tree.
-        pImpl->_kdTree.reset(new KdTree(*this, 10));
-        pImpl->_kdTree->index->buildIndex();
+        pImpl->_rtAccel = std::move(rtAccel);
+        pImpl->_rtAccelMovedVertexCount = 0;
+    } else {
+        pImpl->_rtAccel.reset();
     }
 
-    _isDirty = false;
+    pImpl->_rtAccelState.store(Impl::kUpToDate, std::memory_order_release);
+}
+
+void Geometry::updateDataStructures() const
+{
+    updateKdTree();
+    updateRayTraceAccel();
 }
 
 void Geometry::copy(const Geometry& that)
 {
-    _positions = that.getPositions();
-    _normals = that.getNormals();
-    _colors = that.getColors();
-    _texCoords = that.getTexCoords();
-    _faces = that.getFaces();
+    materializeTransform();
+    invalidateDataStructures();
+
+    _compactStorage = that._compactStorage;
+    pImpl->_paddedAttributesAreCurrent.store(false, std::memory_order_release);
+
+    // Share the buffers rather than copying them; whichever geometry is edited first clones them
+    that.materializeTransform();
+
+    if (that._compactStorage) {
+        _compactPositions = that._compactPositions;
+        _compactNormals = that._compactNormals;
+        _compactColors = that._compactColors;
+
+        releasePaddedAttributes();
+    } else {
+        _positions = that._positions;
+        _normals = that._normals;
+        _colors = that._colors;
+
+        _compactPositions.clear();
+        _compactNormals.clear();
+        _compactColors.clear();
+    }
+    _texCoords = that._texCoords;
+    _faces = that._faces;
+    _facesVersion = that._facesVersion;
+
+    // The faces are shared, so the topology can be too
+    {
+        std::lock_guard<std::mutex> lock(that.pImpl->_topologyMutex);
+        if (that.pImpl->_topologyFacesVersion == _facesVersion) {
+            pImpl->_topology = that.pImpl->_topology;
+            pImpl->_topologyFacesVersion = _facesVersion;
+        } else {
+            pImpl->_topology.reset();
+        }
+    }
     
     this->_frame = that._frame;
 
@@ -599,111 +1804,316 @@ void Geometry::copy(const Geometry& that)
     }
 }
 
+/* If the linear part of m is a uniform scale times a rotation (possibly with a reflection), return
+ * true and write the scale. Such transforms scale all distances equally, so they preserve
+ * nearest-neighbor order and can be undone on the query instead of applied to the data. */
+static bool getSimilarityScale(const math::Mat3x4& m, float* scale)
+{
+    Vec3 x(m.m00, m.m10, m.m20);
+    Vec3 y(m.m01, m.m11, m.m21);
+    Vec3 z(m.m02, m.m12, m.m22);
+
+    float squaredScale = (Vec3::dot(x, x) + Vec3::dot(y, y) + Vec3::dot(z, z)) / 3.0f;
+    if (!(squaredScale > 0.0f) || !std::isfinite(squaredScale)) return false;
+
+    float tolerance = 1e-4f * squaredScale;
+    if (std::abs(Vec3::dot(x, x) - squaredScale) > tolerance ||
+        std::abs(Vec3::dot(y, y) - squaredScale) > tolerance ||
+        std::abs(Vec3::dot(z, z) - squaredScale) > tolerance ||
+        std::abs(Vec3::dot(x, y)) > tolerance ||
+        std::abs(Vec3::dot(x, z)) > tolerance ||
+        std::abs(Vec3::dot(y, z)) > tolerance) {
+        return false;
+    }
+
+    *scale = std::sqrt(squaredScale);
+    return true;
+}
+
+/* Write m applied to count float triples of source into destination, which may be the same
+ * buffer. Both are laid out `stride` floats apart. Directions, such as normals, get only the
+ * linear part of m. */
+static void transformFloat3s(const math::Mat3x4& m,
+                             const float* source,
+                             float* destination,
+                             int count,
+                             int stride,
+                             bool areDirections)
+{
+    double w = areDirections ? 0.0 : 1.0;
+
+    parallelFor(count, [&](int begin, int end, int threadIndex) {
+        for (int ii = begin; ii < end; ++ii) {
+            const float* p = source + (size_t)ii * stride;
+            float x = p[0], y = p[1], z = p[2];
+
+            // clang-format off
+            float* out = destination + (size_t)ii * stride;
+            out[0] = x * m.m00 + y * m.m01 + z * m.m02 + w * m.m03;
+            out[1] = x * m.m10 + y * m.m11 + z * m.m12 + w * m.m13;
+            out[2] = x * m.m20 + y * m.m21 + z * m.m22 + w * m.m23;
+            // clang-format on
+        }
+    }, 4096);
+}
+
+/* Apply m to the float triples in buffer, `stride` floats apart. A buffer shared with copies of
+ * this geometry is written to a new buffer rather than cloned first, as is one the acceleration
+ * structures still read from, which is handed over to `retained`. */
+template <typename T>
+static void transformFloat3Buffer(const math::Mat3x4& m,
+                                  SharedVector<T>& buffer,
+                                  int stride,
+                                  bool areDirections,
+                                  SharedVector<T>* retained = nullptr)
+{
+    int count = (int)(buffer.size() * sizeof(T) / (stride * sizeof(float)));
+
+    if (retained != nullptr || buffer.isShared()) {
+        SharedVector<T> source = std::move(buffer);
+        buffer = std::vector<T>(source.size());
+        transformFloat3s(m, (const float*)source.data(), (float*)buffer.mutate().data(), count, stride, areDirections);
+
+        if (retained != nullptr) *retained = std::move(source);
+    } else {
+        std::vector<T>& data = buffer.mutate();
+        transformFloat3s(m, (const float*)data.data(), (float*)data.data(), count, stride, areDirections);
+    }
+}
+
 void Geometry::transform(const math::Mat3x4& mat)
 {
-    _isDirty = true;
-
-    const math::Mat3x4& m = mat;
-
-    for (int ii = 0; ii < _positions.size(); ++ii) {
-        Vec3 p = _positions[ii];
-
-        // clang-format off
-        _positions[ii] =
-        Vec3(p.x * m.m00 + p.y * m.m01 + p.z * m.m02 + 1.0 * m.m03,
-             p.x * m.m10 + p.y * m.m11 + p.z * m.m12 + 1.0 * m.m13,
-             p.x * m.m20 + p.y * m.m21 + p.z * m.m22 + 1.0 * m.m23);
-        
-        if (_normals.size() != 0) {
-            Vec3 n = _normals[ii];
-            
-            _normals[ii] =
-            Vec3(n.x * m.m00 + n.y * m.m01 + n.z * m.m02,
-                 n.x * m.m10 + n.y * m.m11 + n.z * m.m12,
-                 n.x * m.m20 + n.y * m.m21 + n.z * m.m22);
+    float scale;
+    if (!getSimilarityScale(mat, &scale)) {
+        materializeTransform();
+        invalidateDataStructures();
+
+        if (_compactStorage) {
+            releasePaddedAttributes();
+            transformFloat3Buffer(mat, _compactPositions, 3, false);
+            transformFloat3Buffer(mat, _compactNormals, 3, true);
+        } else {
+            transformFloat3Buffer(mat, _positions, 4, false);
+            transformFloat3Buffer(mat, _normals, 4, true);
+        }
+        return;
+    }
+
+    Impl& impl = *pImpl;
+
+    // The padded copies will be expanded again from the transformed positions when next read
+    if (_compactStorage) releasePaddedAttributes();
+
+    if (impl._hasPendingTransform.load(std::memory_order_relaxed)) {
+        impl._pendingTransform = mat * impl._pendingTransform;
+        impl._pendingTransformScale *= scale;
+    } else {
+        impl._pendingTransform = mat;
+        impl._pendingTransformScale = scale;
+    }
+    impl._hasPendingTransform.store(true, std::memory_order_release);
+
+    impl.setIndexToWorld(mat * impl._indexToWorld, scale * impl._indexToWorldScale);
+}
+
+void Geometry::materializeTransform() const
+{
+    Impl& impl = *pImpl;
+
+    // Double-checked so that reads without a pending transform never contend for the lock
+    if (!impl._hasPendingTransform.load(std::memory_order_acquire)) return;
+
+    std::lock_guard<std::mutex> transformLock(impl._transformMutex);
+    if (!impl._hasPendingTransform.load(std::memory_order_relaxed)) return;
+
+    {
+        // Hold off concurrent builds while deciding which positions the structures use
+        std::lock(impl._kdTreeMutex, impl._rtAccelMutex);
+        std::lock_guard<std::mutex> kdTreeLock(impl._kdTreeMutex, std::adopt_lock);
+        std::lock_guard<std::mutex> rtAccelLock(impl._rtAccelMutex, std::adopt_lock);
+
+        bool structuresAreBuilt = impl._kdTreeState.load(std::memory_order_relaxed) != Impl::kInvalid ||
+                                  impl._rtAccelState.load(std::memory_order_relaxed) != Impl::kInvalid;
+
+        bool positionsAreRetained = !impl._retainedPositions.empty() || !impl._retainedCompactPositions.empty();
+        const math::Mat3x4& m = impl._pendingTransform;
+
+        // Hand the buffer the structures were built from over to them, and write the
+        // transformed positions to a new one
+        bool retainPositions = structuresAreBuilt && !positionsAreRetained;
+
+        if (_compactStorage) {
+            transformFloat3Buffer(m, _compactPositions, 3, false, retainPositions ? &impl._retainedCompactPositions : nullptr);
+            transformFloat3Buffer(m, _compactNormals, 3, true);
+        } else {
+            transformFloat3Buffer(m, _positions, 4, false, retainPositions ? &impl._retainedPositions : nullptr);
+            transformFloat3Buffer(m, _normals, 4, true);
+        }
+
+        if (!structuresAreBuilt) {
+            // They'll be built from the world-space positions
+            impl.setIndexToWorld(math::Mat3x4(), 1.0f);
         }
-        // clang-format on
     }
+
+    impl._pendingTransform = math::Mat3x4();
+    impl._pendingTransformScale = 1.0f;
+    impl._hasPendingTransform.store(false, std::memory_order_release);
 }
 
 void Geometry::normalizeNormals()
 {
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& normals = _normals.mutate();
+
     int numVertices = vertexCount();
     for (int i = 0; i < numVertices; i++) {
-        Vec3 normal = _normals[i];
+        Vec3 normal = normals[i];
         float l = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
-        _normals[i].x /= l;
-        _normals[i].y /= l;
-        _normals[i].z /= l;
+        normals[i].x /= l;
+        normals[i].y /= l;
+        normals[i].z /= l;
     }
 }
 
 void Geometry::mutatePositionsWithFunction(const std::function<Vec3(int index, Vec3 position, Vec3 normal, Vec3 color)>& mapFn)
 {
-    _isDirty = true;
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& positions = _positions.mutate();
+
+    std::vector<int> movedVertexIndices;
 
     int numVertices = vertexCount();
     for (int index = 0; index < numVertices; index++) {
-        _positions[index] = mapFn(index, _positions[index], _normals[index], _colors[index]);
+        Vec3 position = mapFn(index, positions[index], _normals[index], _colors[index]);
+        if (position != positions[index]) {
+            positions[index] = position;
+            movedVertexIndices.push_back(index);
+        }
     }
+
+    didMovePositions(movedVertexIndices);
 }
 
 void Geometry::mutateNormalsWithFunction(const std::function<Vec3(int index, Vec3 position, Vec3 normal, Vec3 color)>& mapFn)
 {
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& normals = _normals.mutate();
+
     int numVertices = vertexCount();
     for (int index = 0; index < numVertices; index++) {
-        _normals[index] = mapFn(index, _positions[index], _normals[index], _colors[index]);
+        normals[index] = mapFn(index, _positions[index], normals[index], _colors[index]);
     }
 }
 
 void Geometry::mutateColorsWithFunction(const std::function<Vec3(int index, Vec3 position, Vec3 normal, Vec3 color)>& mapFn)
 {
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& colors = _colors.mutate();
+
     int numVertices = vertexCount();
     for (int index = 0; index < numVertices; index++) {
-        _colors[index] = mapFn(index, _positions[index], _normals[index], _colors[index]);
+        colors[index] = mapFn(index, _positions[index], _normals[index], colors[index]);
     }
 }
 
 void Geometry::mutatePositionsWithFunction(const std::function<Vec3(int index, Vec3 position, Vec3 normal, Vec3 color)>& mapFn, const VertexSelection& vertexIndices)
 {
-    _isDirty = true;
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& positions = _positions.mutate();
+
+    std::vector<int> movedVertexIndices;
 
     for (auto index : vertexIndices) {
-        _positions[index] = mapFn(index, _positions[index], _normals[index], _colors[index]);
+        Vec3 position = mapFn(index, positions[index], _normals[index], _colors[index]);
+        if (position != positions[index]) {
+            positions[index] = position;
+            movedVertexIndices.push_back(index);
+        }
     }
+
+    didMovePositions(movedVertexIndices);
 }
 
 void Geometry::mutateNormalsWithFunction(const std::function<Vec3(int index, Vec3 position, Vec3 normal, Vec3 color)>& mapFn, const VertexSelection& vertexIndices)
 {
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& normals = _normals.mutate();
+
     for (auto index : vertexIndices) {
-        _normals[index] = mapFn(index, _positions[index], _normals[index], _colors[index]);
+        normals[index] = mapFn(index, _positions[index], normals[index], _colors[index]);
     }
 }
 
 void Geometry::mutateColorsWithFunction(const std::function<Vec3(int index, Vec3 position, Vec3 normal, Vec3 color)>& mapFn, const VertexSelection& vertexIndices)
 {
+    AttributeEdit edit(*this);
+    std::vector<Vec3>& colors = _colors.mutate();
+
     for (auto index : vertexIndices) {
-        _colors[index] = mapFn(index, _positions[index], _normals[index], _colors[index]);
+        colors[index] = mapFn(index, _positions[index], _normals[index], colors[index]);
     }
 }
 
 Vec3 Geometry::getFaceCenter(int faceIndex) const
 {
-    if (faceIndex >= _faces.size()) return Vec3(NAN);
+    if (faceIndex < 0 || faceIndex >= (int)_faces.size()) return Vec3(NAN);
 
+    Float3View positions = getPositionsView();
     Face3 face = _faces[faceIndex];
-    return (_positions[face[0]] + _positions[face[1]] + _positions[face[2]]) * (1.0 / 3.0);
+    return (positions[face[0]] + positions[face[1]] + positions[face[2]]) * (1.0 / 3.0);
+}
+
+std::shared_ptr<const MeshTopology::MeshTopology> Geometry::getTopology() const
+{
+    Impl& impl = *pImpl;
+    std::lock_guard<std::mutex> lock(impl._topologyMutex);
+
+    if (!impl._topology || impl._topologyFacesVersion != _facesVersion) {
+        impl._topology = std::make_shared<const MeshTopology::MeshTopology>(_faces.get());
+        impl._topologyFacesVersion = _facesVersion;
+    }
+
+    return impl._topology;
+}
+
+uint64_t Geometry::getFacesVersion() const
+{
+    return _facesVersion;
+}
+
+void Geometry::didChangeFaces()
+{
+    _facesVersion = ++facesVersionCounter;
+
+    std::lock_guard<std::mutex> lock(pImpl->_topologyMutex);
+    pImpl->_topology.reset();
 }
 
 int Geometry::getSize()
+{
+    std::set<const void*> countedBuffers;
+    return getSize(countedBuffers);
+}
+
+int Geometry::getSize(std::set<const void*>& countedBuffers)
 {
     int totalSize = 0;
 
-    totalSize += _positions.size() == 0 ? 0 : sizeof(_positions[0]) * _positions.size();
-    totalSize += _normals.size() == 0 ? 0 : sizeof(_normals[0]) * _normals.size();
-    totalSize += _colors.size() == 0 ? 0 : sizeof(_colors[0]) * _colors.size();
-    totalSize += _texCoords.size() == 0 ? 0 : sizeof(_texCoords[0]) * _texCoords.size();
-    totalSize += _faces.size() == 0 ? 0 : sizeof(_faces[0]) * _faces.size();
+    auto addBuffer = [&](const auto& buffer) {
+        if (!buffer.empty() && countedBuffers.insert(buffer.bufferId()).second) {
+            totalSize += (int)buffer.sizeInBytes();
+        }
+    };
+
+    addBuffer(_compactPositions);
+    addBuffer(_compactNormals);
+    addBuffer(_compactColors);
+    addBuffer(_positions);
+    addBuffer(_normals);
+    addBuffer(_colors);
+    addBuffer(_texCoords);
+    addBuffer(_faces);
 
     updateDataStructures(); // the data structure are lazy initialized, so initialize them explicitly if necessary.
 
@@ -717,6 +2127,14 @@ int Geometry::getSize()
 
     totalSize += pImpl->_kdTree->index->usedMemory(*(pImpl->_kdTree->index));
 
+    addBuffer(pImpl->_retainedPositions);
+    addBuffer(pImpl->_retainedCompactPositions);
+
+    if (pImpl->_movedKdTree) {
+        totalSize += pImpl->_movedKdTree->index->usedMemory(*(pImpl->_movedKdTree->index));
+        totalSize += sizeof(pImpl->_movedVertices[0]) * pImpl->_movedVertices.size() + pImpl->_isMovedVertex.size();
+    }
+
     return totalSize;
 }
 
@@ -17,12 +17,17 @@ limitations under the License.
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include "standard_cyborg/sc3d/Face3.hpp"
+#include "standard_cyborg/sc3d/Float3View.hpp"
 #include "standard_cyborg/math/Mat3x4.hpp"
 #include "standard_cyborg/math/Vec3.hpp"
 #include "standard_cyborg/sc3d/VertexSelection.hpp"
+#include "standard_cyborg/util/SharedVector.hpp"
 #include "standard_cyborg/sc3d/ColorImage.hpp"
 
 #include "standard_cyborg/util/Pybind11Defs.hpp"
@@ -30,12 +35,37 @@ limitations under the License.
 namespace standard_cyborg {
 namespace sc3d {
 
+namespace MeshTopology {
+class MeshTopology;
+}
+
 struct RayTraceResult {
     float t = INFINITY;
     int index = -1; // index of hit triangle. -1 if no triangle was hit.
     math::Vec3 hitPoint;
 };
 
+/* The point of a mesh's surface closest to a query position */
+struct SurfacePointResult {
+    math::Vec3 point;
+    int faceIndex = -1; // index of the closest triangle. -1 if none is within range.
+    math::Vec3 barycentrics; // weights of the triangle's three vertices that sum to point
+    float distance = INFINITY; // negative inside the surface, if computed as a signed distance
+};
+
+/* Flat (CSR-style) results of a batched neighbor query. The neighbors of query i are
+ * indices[offsets[i]] through indices[offsets[i + 1] - 1], with the matching squared
+ * distances at the same positions of squaredDistances. offsets has one entry more than
+ * the number of queries. Pass the same instance to successive queries to reuse its storage. */
+struct NeighborQueryResult {
+    std::vector<int> offsets;
+    std::vector<int> indices;
+    std::vector<float> squaredDistances;
+    
+    int queryCount() const { return offsets.empty() ? 0 : (int)offsets.size() - 1; }
+    int neighborCount(int queryIndex) const { return offsets[queryIndex + 1] - offsets[queryIndex]; }
+};
+
 class Geometry {
 public:
     // A comment noting that at one point the function on the line below constructed from std::vector of Vec3
@@ -47,11 +77,21 @@ public:
     
     Geometry(const std::vector<math::Vec3>& positions, const std::vector<Face3>& faces);
     
+    /* As above, but adopting the caller's buffers instead of copying them */
+    Geometry(std::vector<math::Vec3>&& positions,
+             std::vector<math::Vec3>&& normals = std::vector<math::Vec3>(),
+             std::vector<math::Vec3>&& colors = std::vector<math::Vec3>(),
+             std::vector<Face3>&& faces = std::vector<Face3>()
+    );
+    
+    Geometry(std::vector<math::Vec3>&& positions, std::vector<Face3>&& faces);
+    
     Geometry();
     Geometry(Geometry const& other);
 
-    Geometry(Geometry&&) = delete;
-    Geometry& operator=(Geometry&&) = delete;
+    /* Take over other's data and acceleration structures without copying, leaving it empty */
+    Geometry(Geometry&& other);
+    Geometry& operator=(Geometry&& other);
     Geometry& operator=(Geometry const& other) = delete;
     
     /* Construct Geometry with points and triangle faces. */
@@ -62,7 +102,8 @@ public:
     
     ~Geometry();
     
-    /* Makes this Geometry into a deep copy of 'that'*/
+    /* Makes this Geometry into a copy of 'that'. The copy shares the attribute buffers of 'that'
+     * until either edits them, so this is cheap regardless of size. */
     void copy(const Geometry& that);
     
     /* Return the index of the vertex that is closest to queryPosition, in terms of the Euclidean distance. */
@@ -77,10 +118,50 @@ public:
     /* Return the indices of all vertices that are within the radius of queryPosition, in terms of the Euclidean distance. Unsorted. */
     std::vector<int> getVertexIndicesInRadius(const math::Vec3& queryPosition, float radius) const;
     
+    /* Batched, multi-threaded version of getNClosestVertexIndices. For each query, writes the
+     * indices of the min(n, vertexCount()) closest vertices, sorted by increasing distance. */
+    void getNClosestVertexIndices(const std::vector<math::Vec3>& queryPositions, int n, NeighborQueryResult& result) const;
+    
+    /* Batched, multi-threaded version of getVertexIndicesInRadius. For each query, writes the
+     * indices of all vertices within the radius. Unsorted. */
+    void getVertexIndicesInRadius(const std::vector<math::Vec3>& queryPositions, float radius, NeighborQueryResult& result) const;
+    
     RayTraceResult rayTrace(math::Vec3 rayOrigin, math::Vec3 rayDirection, float rayMin = 0.001f, float rayMax = 1.0e+30f) const;
     
+    /* Trace many rays at once, e.g. one per pixel of an image. rayOrigins holds either one
+     * origin per direction or a single origin shared by all rays, as for a pinhole camera.
+     * results is resized to the number of rays; reusing it across calls avoids reallocation.
+     * Consecutive rays are traced together as packets, so ordering rays so that neighbors are
+     * coherent (e.g. row-major pixels) speeds up traversal. Each result is what rayTrace would
+     * return for the same ray: point clouds never report a hit, and give t = 0 like rayTrace. */
+    void rayTraceBatch(const std::vector<math::Vec3>& rayOrigins,
+                       const std::vector<math::Vec3>& rayDirections,
+                       std::vector<RayTraceResult>& results,
+                       float rayMin = 0.001f,
+                       float rayMax = 1.0e+30f) const;
+    
+    /* Return the point of the triangle surface closest to queryPosition, searching no further than
+     * maxDistance. If signedDistance, the distance is negative when queryPosition lies inside
+     * the surface, which is only meaningful for closed, consistently wound meshes. */
+    SurfacePointResult getClosestSurfacePoint(const math::Vec3& queryPosition,
+                                              bool signedDistance = false,
+                                              float maxDistance = INFINITY) const;
+    
+    /* Batched, multi-threaded version of getClosestSurfacePoint. results is resized to the number
+     * of queries. Signed queries first compute a pseudo-normal for every vertex and edge, which
+     * takes time linear in the face count, so prefer one large batch to many small ones. Point
+     * clouds never report a surface point. */
+    void getClosestSurfacePoints(const std::vector<math::Vec3>& queryPositions,
+                                 std::vector<SurfacePointResult>& results,
+                                 bool signedDistance = false,
+                                 float maxDistance = INFINITY) const;
+    
     void deleteVertices(const VertexSelection& vertexIndices);
     
+    /* Apply mat to positions and normals. Rigid and similarity transforms (rotation, translation,
+     * uniform scale) are deferred: queries map into the frame the acceleration structures were
+     * built in rather than rebuilding them, and the positions and normals are only rewritten the
+     * next time they're read or edited. Other transforms are applied immediately. */
     void transform(const math::Mat3x4& mat);
     
     const std::vector<math::Vec3>& getPositions() const;
@@ -90,6 +171,20 @@ public:
     const std::vector<Face3>& getFaces() const;
     const ColorImage& getTexture() const;
     
+    /* Zero-copy views of the positions, normals and colors, in either storage mode. Valid until
+     * the next non-const call. */
+    Float3View getPositionsView() const;
+    Float3View getNormalsView() const;
+    Float3View getColorsView() const;
+    
+    /* Compact storage keeps positions, normals and colors as packed float triples, 12 bytes per
+     * element rather than the 16 of a padded math::Vec3. The acceleration structures and the
+     * views above read the packed data directly. getPositions(), getNormals() and getColors()
+     * still work, but build and cache a padded copy on first use, and edits briefly expand the
+     * attributes to padded storage, so large compact geometries are best read through views. */
+    void setCompactStorage(bool compactStorage);
+    bool hasCompactStorage() const;
+    
     #ifdef EMBIND_ONLY
         ColorImage* getTexturePtr();
     #endif // EMBIND_ONLY
@@ -120,6 +215,19 @@ public:
     bool setFaces(const std::vector<Face3>& faces);
     bool setTexture(const ColorImage& texture);
     
+    /* Rvalue versions of the setters adopt the caller's buffers instead of copying them. The
+     * exception is positions of the current vertex count, which are copied in place so that
+     * the acceleration structures can be updated incrementally. */
+    bool setVertexData(std::vector<math::Vec3>&& positions,
+                       std::vector<math::Vec3>&& normals = std::vector<math::Vec3>(),
+                       std::vector<math::Vec3>&& colors = std::vector<math::Vec3>());
+    
+    bool setPositions(std::vector<math::Vec3>&& positions);
+    bool setNormals(std::vector<math::Vec3>&& normals);
+    bool setColors(std::vector<math::Vec3>&& colors);
+    bool setTexCoords(std::vector<math::Vec2>&& texCoords);
+    bool setFaces(std::vector<Face3>&& faces);
+    
     void setColor(const math::Vec3& color, float alpha);
     void setColor(const math::Vec3& color, float alpha, const VertexSelection& vertexIndices);
     
@@ -133,8 +241,21 @@ public:
     
     math::Vec3 getFaceCenter(int faceIndex) const;
     
+    /* The edge connectivity of the faces, built on first use and kept until the faces change.
+     * Copies of this geometry share it for as long as they share faces. The returned topology
+     * stays valid, though possibly stale, after this geometry is edited. sliceMesh and decimateMesh
+     * walk it; splitMeshIntoPieces and findEdgeLoops need no adjacency and work from the faces. */
+    std::shared_ptr<const MeshTopology::MeshTopology> getTopology() const;
+    
+    /* Changes whenever the faces do, so that data derived from them can tell when it's stale */
+    uint64_t getFacesVersion() const;
+    
     int getSize();
     
+    /* As getSize(), but skipping attribute buffers whose ids are already in countedBuffers, and
+     * adding the rest, so that buffers shared between copies are only counted once */
+    int getSize(std::set<const void*>& countedBuffers);
+    
     static std::set<int> getAllocatedIds();
     static int getNumAllocatedIds();
     static void resetAllocatedIds();
@@ -142,27 +263,76 @@ public:
     
     void didMutateExternally() const;
     
+    /* Edits that move only a few vertices without changing the faces update the acceleration
+     * structures incrementally: the BVH bounds are refit in place and the moved vertices are
+     * indexed separately from the kd-tree. Once the vertices moved since the last full build
+     * exceed this fraction of vertexCount(), the next query rebuilds from scratch instead.
+     * Defaults to 0.1; 0 always rebuilds. */
+    void setIncrementalUpdateFraction(float fraction);
+    float getIncrementalUpdateFraction() const;
+    
     std::string getFrame() const { return _frame; }
     void setFrame(const std::string &f) { _frame = f; }
     
 private:
+    /* Lazily (re)build a single acceleration structure. Each is built at most once per mutation,
+     * and only when a query actually needs it. */
+    void updateKdTree() const;
+    void updateRayTraceAccel() const;
+    
+    /* Build both acceleration structures, e.g. to report their memory usage */
     void updateDataStructures() const;
     
+    /* Mark both acceleration structures stale after positions or faces change */
+    void invalidateDataStructures() const;
+    
+    /* Record that the given vertices moved while the faces stayed the same, so that the
+     * acceleration structures may be updated rather than rebuilt */
+    void didMovePositions(const std::vector<int>& movedVertexIndices);
+    
+    /* Give the faces a new version, dropping the cached topology */
+    void didChangeFaces();
+    
+    /* Write any transform deferred by transform() out to the positions and normals */
+    void materializeTransform() const;
+    
+    /* In compact storage, fill the padded attribute vectors from the packed ones */
+    void expandCompactAttributes() const;
+    
+    /* In compact storage, pack the padded attribute vectors and release them */
+    void packCompactAttributes();
+    
+    /* In compact storage, release the padded cache of the packed attributes */
+    void releasePaddedAttributes();
+    
+    /* Scope of an edit through the padded attribute vectors; see Geometry.cpp */
+    class AttributeEdit;
+    
     std::string _frame;
     
-    // These variables are marked mutable since pImpl is strictly a cache of the acceleration
-    // data structure that does not affect the externally visible state of this object. In specific
+    // pImpl is marked mutable since it is strictly a cache of the acceleration data structures
+    // that does not affect the externally visible state of this object. Each structure is guarded
+    // by its own lock so that concurrent const queries from multiple threads are safe; mutating a
+    // Geometry while another thread queries it is not. The first read of positions or normals
+    // after a deferred transform() counts as a mutation, since it writes them out. In specific
     // cases like JS-interop where it's conceivable that data may be mutated directly outside of
     // C++ const-correctness, you may call `didMutateExternally()` to explicitly trigger updates.
     struct Impl;
     mutable std::unique_ptr<Impl> pImpl;
-    mutable bool _isDirty = true;
     
-    std::vector<math::Vec3> _positions;
-    std::vector<math::Vec3> _normals;
-    std::vector<math::Vec3> _colors;
-    std::vector<math::Vec2> _texCoords;
-    std::vector<Face3> _faces;
+    // Attributes are copy-on-write, so that copies of a Geometry share them until one is edited.
+    // Mutable so that a deferred transform may be written out, and compact attributes expanded,
+    // on first read. In compact storage the padded vectors are only a cache of the packed ones.
+    mutable SharedVector<math::Vec3> _positions;
+    mutable SharedVector<math::Vec3> _normals;
+    mutable SharedVector<math::Vec3> _colors;
+    mutable SharedVector<float> _compactPositions;
+    mutable SharedVector<float> _compactNormals;
+    SharedVector<float> _compactColors;
+    bool _compactStorage = false;
+    SharedVector<math::Vec2> _texCoords;
+    SharedVector<Face3> _faces;
+    uint64_t _facesVersion = 0;
     
     std::shared_ptr<ColorImage> _texture;
     
@@ -170,6 +340,7 @@ private:
     
     int _id;
     bool _normalsEncodeSurfelRadius = false;
+    float _incrementalUpdateFraction = 0.1f;
 };
 
 bool operator==(const Geometry& lhs, const Geometry& rhs);
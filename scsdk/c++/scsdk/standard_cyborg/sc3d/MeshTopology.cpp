@@ -14,9 +14,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
 
 #include "standard_cyborg/sc3d/MeshTopology.hpp"
-#include "standard_cyborg/util/AssertHelper.hpp"
+#include "standard_cyborg/util/ParallelFor.hpp"
 
 namespace standard_cyborg {
 namespace sc3d {
@@ -26,9 +29,33 @@ MeshTopology::MeshTopology(const std::vector<Edge>& edges,
                            const std::vector<FaceEdges>& faceEdges,
                            const std::vector<VertexEdges>& vertexEdges) :
     _edges(edges),
-    _faceEdges(faceEdges),
-    _vertexEdges(vertexEdges)
-{}
+    _faceEdges(faceEdges)
+{
+    int numVertices = static_cast<int>(vertexEdges.size());
+    _vertexEdgeOffsets.resize(numVertices + 1, 0);
+    for (int vertex = 0; vertex < numVertices; vertex++) {
+        _vertexEdgeOffsets[vertex + 1] = _vertexEdgeOffsets[vertex] + static_cast<int>(vertexEdges[vertex].size());
+    }
+    
+    _vertexEdgeIndices.reserve(_vertexEdgeOffsets.back());
+    for (const VertexEdges& edgesAtVertex : vertexEdges) {
+        _vertexEdgeIndices.insert(_vertexEdgeIndices.end(), edgesAtVertex.begin(), edgesAtVertex.end());
+    }
+    
+    // Edges only record two faces, so count how many faces refer to each
+    int numEdges = static_cast<int>(edges.size());
+    std::vector<int> edgeFaceCounts(numEdges, 0);
+    for (const FaceEdges& edgesOfFace : faceEdges) {
+        for (int corner = 0; corner < 3; corner++) {
+            int edgeIndex = edgesOfFace[corner];
+            if (edgeIndex >= 0 && edgeIndex < numEdges) { edgeFaceCounts[edgeIndex]++; }
+        }
+    }
+    
+    for (int edgeIndex = 0; edgeIndex < numEdges; edgeIndex++) {
+        if (edgeFaceCounts[edgeIndex] > 2) { _nonManifoldEdges.push_back(edgeIndex); }
+    }
+}
 
 
 MeshTopology::MeshTopology(const std::vector<Face3>& faces)
@@ -36,135 +63,190 @@ MeshTopology::MeshTopology(const std::vector<Face3>& faces)
     compute(faces);
 }
 
+// Below this many vertices or faces per thread, the parallel passes aren't worth splitting
+static const int kTopologyRangeSize = 4096;
+
+namespace {
+
+// A half-edge, filed under its lower-numbered vertex. Half-edge h runs from corner h % 3 of
+// face h / 3 to the next corner.
+struct HalfEdgeEntry {
+    int otherVertex;
+    int halfEdge;
+    
+    bool operator<(const HalfEdgeEntry& other) const
+    {
+        return otherVertex < other.otherVertex || (otherVertex == other.otherVertex && halfEdge < other.halfEdge);
+    }
+};
+
+} // namespace
+
 void MeshTopology::compute(const std::vector<Face3>& faces)
 {
     int numFaces = static_cast<int>(faces.size());
+    int numHalfEdges = numFaces * 3;
     
-    // We don't know in advance how many vertices there will be. Instead, we assume vertex
-    // numbering starts at zero and check as we iterate through the face data.
-    //
-    // We reserve a reasonable amount of space for per-vertex edges lists to reduce incremental
-    // resizing. The Euler characteristic of a surface relates the number of faces to the number
-    // of edges and vertices. For a triangular mesh (see:
-    // https://math.stackexchange.com/questions/425968/eulers-formula-for-triangle-mesh ):
-    //
-    //   > The number of triangles is twice the number of vertices F ~ 2V
-    //
-    // Since it's not *exactly* half, we overestimate just a little to prevent resizing a large
-    // array of vertex data right before we're done.
-    _vertexEdges.reserve(static_cast<int>(numFaces * 0.52));
-    
-    //std::cout<<"topology estimated capcity = "<<_vertexEdges.capacity()<<std::endl;
-    
-    // We know exactly the required length here
-    _faceEdges.resize(numFaces);
+    _edges.clear();
+    _faceEdges.clear();
+    _vertexEdgeOffsets.clear();
+    _vertexEdgeIndices.clear();
+    _nonManifoldEdges.clear();
     
-    for (int faceId = 0; faceId < numFaces; faceId++) {
-        Face3 face = faces[faceId];
-
-        int vertexA = face[0];
-        int vertexB = face[1];
-        int vertexC = face[2];
-        
-        // Resize vertexEdges, if necessary
-        int maxVertexId = vertexA > vertexB ? (vertexA > vertexC ? vertexA : vertexC) : (vertexC > vertexB ? vertexC : vertexB);
-        if (maxVertexId >= _vertexEdges.size()) {
-            _vertexEdges.resize(maxVertexId + 1);
+    // We assume vertex numbering starts at zero and size the per-vertex data to the largest
+    // index any face uses
+    std::vector<int> maxVertexPerThread(parallelThreadCount(), -1);
+    parallelFor(numFaces, [&](int begin, int end, int threadIndex) {
+        int maxVertex = -1;
+        for (int faceId = begin; faceId < end; faceId++) {
+            const Face3& face = faces[faceId];
+            maxVertex = std::max(maxVertex, std::max(face[0], std::max(face[1], face[2])));
         }
-        
-        // The main task in this code is to find the edge indices:
-        int edgeAB = -1;
-        int edgeBC = -1;
-        int edgeCA = -1;
-
-        // Trace from vertex A to its edges and look for an existing edge with
-        // either vertex B or vertex C as the other vertices.
-        for (auto edgeIndex : _vertexEdges[vertexA]) {
-            Edge& edge = _edges[edgeIndex];
-
-            // Check for an edge that matches either AB or BA
-            if ((edge.vertex0 == vertexA && edge.vertex1 == vertexB) || (edge.vertex0 == vertexB && edge.vertex1 == vertexA)) {
-                edgeAB = edgeIndex;
-                if (edgeCA != -1) break;
-            }
+        maxVertexPerThread[threadIndex] = std::max(maxVertexPerThread[threadIndex], maxVertex);
+    }, kTopologyRangeSize);
+    
+    int numVertices = *std::max_element(maxVertexPerThread.begin(), maxVertexPerThread.end()) + 1;
+    
+    auto halfEdgeVertex = [&](int halfEdge, int offset) {
+        return faces[halfEdge / 3][(halfEdge % 3 + offset) % 3];
+    };
+    
+    // Sort the half-edges by their undirected key (lower vertex, higher vertex). The lower vertex
+    // is a counting sort into one bucket per vertex; buckets hold only a handful of half-edges,
+    // so each is finished with a small sort of its own. Filling in half-edge order means the
+    // buckets only need sorting by the other vertex, but sorting by half-edge as well is free.
+    std::vector<int> bucketOffsets(numVertices + 1, 0);
+    for (int halfEdge = 0; halfEdge < numHalfEdges; halfEdge++) {
+        bucketOffsets[std::min(halfEdgeVertex(halfEdge, 0), halfEdgeVertex(halfEdge, 1)) + 1]++;
+    }
+    std::partial_sum(bucketOffsets.begin(), bucketOffsets.end(), bucketOffsets.begin());
+    
+    std::vector<HalfEdgeEntry> buckets(numHalfEdges);
+    {
+        std::vector<int> bucketFill(bucketOffsets.begin(), bucketOffsets.end() - 1);
+        for (int halfEdge = 0; halfEdge < numHalfEdges; halfEdge++) {
+            int a = halfEdgeVertex(halfEdge, 0);
+            int b = halfEdgeVertex(halfEdge, 1);
+            buckets[bucketFill[std::min(a, b)]++] = {std::max(a, b), halfEdge};
+        }
+    }
+    
+    // Each run of equal keys is one edge. Its first half-edge, the lowest numbered, leads it,
+    // and the next one belongs to its second face.
+    std::vector<int> leaderOfHalfEdge(numHalfEdges);
+    std::vector<int> secondHalfEdge(numHalfEdges, -1);
+    std::vector<uint8_t> isNonManifold(numHalfEdges, 0);
+    
+    parallelFor(numVertices, [&](int begin, int end, int threadIndex) {
+        for (int vertex = begin; vertex < end; vertex++) {
+            auto bucketBegin = buckets.begin() + bucketOffsets[vertex];
+            auto bucketEnd = buckets.begin() + bucketOffsets[vertex + 1];
+            std::sort(bucketBegin, bucketEnd);
             
-            // Similarly, check for an edge matching AC or CA
-            if ((edge.vertex0 == vertexA && edge.vertex1 == vertexC) || (edge.vertex0 == vertexC && edge.vertex0 == vertexA)) {
-                edgeCA = edgeIndex;
-                if (edgeAB != -1) break;
+            for (auto run = bucketBegin; run != bucketEnd;) {
+                auto runEnd = run + 1;
+                while (runEnd != bucketEnd && runEnd->otherVertex == run->otherVertex) { runEnd++; }
+                
+                int leader = run->halfEdge;
+                for (auto entry = run; entry != runEnd; entry++) {
+                    leaderOfHalfEdge[entry->halfEdge] = leader;
+                }
+                if (runEnd - run > 1) { secondHalfEdge[leader] = (run + 1)->halfEdge; }
+                if (runEnd - run > 2) { isNonManifold[leader] = 1; }
+                
+                run = runEnd;
             }
         }
-        
-        for (auto edgeIndex : _vertexEdges[vertexB]) {
-            Edge& edge = _edges[edgeIndex];
-
-            // The procedure for vertex B's edges is slightly different. Since we've checked
-            // A-C and A-B. we now only need to check for matches with edge B-C.
-            if ((edge.vertex0 == vertexB && edge.vertex1 == vertexC) || (edge.vertex0 == vertexC && edge.vertex1 == vertexB)) {
-                edgeBC = edgeIndex;
-                break;
+    }, kTopologyRangeSize);
+    
+    // Number the edges in the order their leaders appear, which is the order faces first reach them
+    std::vector<int> edgeOfLeader(numHalfEdges, -1);
+    int numEdges = 0;
+    for (int halfEdge = 0; halfEdge < numHalfEdges; halfEdge++) {
+        if (leaderOfHalfEdge[halfEdge] == halfEdge) { edgeOfLeader[halfEdge] = numEdges++; }
+    }
+    
+    _edges.resize(numEdges);
+    _faceEdges.resize(numFaces);
+    
+    parallelFor(numFaces, [&](int begin, int end, int threadIndex) {
+        for (int faceId = begin; faceId < end; faceId++) {
+            for (int corner = 0; corner < 3; corner++) {
+                int halfEdge = faceId * 3 + corner;
+                int leader = leaderOfHalfEdge[halfEdge];
+                int edgeIndex = edgeOfLeader[leader];
+                _faceEdges[faceId][corner] = edgeIndex;
+                
+                if (leader == halfEdge) {
+                    Edge& edge = _edges[edgeIndex];
+                    edge.vertex0 = halfEdgeVertex(halfEdge, 0);
+                    edge.vertex1 = halfEdgeVertex(halfEdge, 1);
+                    edge.face0 = faceId;
+                    edge.face1 = secondHalfEdge[halfEdge] == -1 ? -1 : secondHalfEdge[halfEdge] / 3;
+                }
             }
         }
-        
-        // Either create new edges or set the second face of an existing edge based on what was found
-        if (edgeAB == -1) {
-            edgeAB = static_cast<int>(_edges.size());
-            _edges.push_back({vertexA, vertexB, faceId, -1});
-        } else {
-
-            SCASSERT(_edges[edgeAB].face1 == -1, "Non-manifold edge found in mesh topology");
-            _edges[edgeAB].face1 = faceId;
-        
-        }
-        
-        if (edgeBC == -1) {
-            edgeBC = static_cast<int>(_edges.size());
-            _edges.push_back({vertexB, vertexC, faceId, -1});
-        } else {
-            SCASSERT(_edges[edgeBC].face1 == -1, "Non-manifold edge found in mesh topology");
-            _edges[edgeBC].face1 = faceId;
-        }
-        
-        if (edgeCA == -1) {
-            edgeCA = static_cast<int>(_edges.size());
-            _edges.push_back({vertexC, vertexA, faceId, -1});
-        } else {
-            SCASSERT(_edges[edgeCA].face1 == -1, "Non-manifold edge found in mesh topology");
-            _edges[edgeCA].face1 = faceId;
-        }
-        
-        // Set the three edges for this face
-        _faceEdges[faceId][0] = edgeAB;
-        _faceEdges[faceId][1] = edgeBC;
-        _faceEdges[faceId][2] = edgeCA;
-        
-        // Add (if not already added) these edges to vertexEdges' adjacency lists
-        _vertexEdges[vertexA].insert(edgeCA);
-        _vertexEdges[vertexA].insert(edgeAB);
-        
-        _vertexEdges[vertexB].insert(edgeAB);
-        _vertexEdges[vertexB].insert(edgeBC);
-        
-        _vertexEdges[vertexC].insert(edgeBC);
-        _vertexEdges[vertexC].insert(edgeCA);
+    }, kTopologyRangeSize);
+    
+    for (int halfEdge = 0; halfEdge < numHalfEdges; halfEdge++) {
+        if (isNonManifold[halfEdge]) { _nonManifoldEdges.push_back(edgeOfLeader[halfEdge]); }
+    }
+    std::sort(_nonManifoldEdges.begin(), _nonManifoldEdges.end());
+    
+    // Gather each vertex's edges. Filling in edge order leaves every vertex's run sorted.
+    _vertexEdgeOffsets.assign(numVertices + 1, 0);
+    for (const Edge& edge : _edges) {
+        _vertexEdgeOffsets[edge.vertex0 + 1]++;
+        if (edge.vertex1 != edge.vertex0) { _vertexEdgeOffsets[edge.vertex1 + 1]++; }
     }
+    std::partial_sum(_vertexEdgeOffsets.begin(), _vertexEdgeOffsets.end(), _vertexEdgeOffsets.begin());
     
-    //std::cout<<"topology actual size = "<<_vertexEdges.size()<<std::endl;
+    _vertexEdgeIndices.resize(_vertexEdgeOffsets.back());
+    std::vector<int> vertexFill(_vertexEdgeOffsets.begin(), _vertexEdgeOffsets.end() - 1);
+    for (int edgeIndex = 0; edgeIndex < numEdges; edgeIndex++) {
+        const Edge& edge = _edges[edgeIndex];
+        _vertexEdgeIndices[vertexFill[edge.vertex0]++] = edgeIndex;
+        if (edge.vertex1 != edge.vertex0) { _vertexEdgeIndices[vertexFill[edge.vertex1]++] = edgeIndex; }
+    }
 }
 
-const std::vector<Edge> MeshTopology::getEdges() const
+const std::vector<Edge>& MeshTopology::getEdges() const
 {
     return _edges;
 }
 
-const std::vector<FaceEdges> MeshTopology::getFaceEdges() const
+const std::vector<FaceEdges>& MeshTopology::getFaceEdges() const
 {
     return _faceEdges;
 }
 
-const std::vector<VertexEdges> MeshTopology::getVertexEdges() const
+EdgeIndexSpan MeshTopology::getEdgesAtVertex(int vertexIndex) const
+{
+    EdgeIndexSpan span;
+    span.first = _vertexEdgeIndices.data() + _vertexEdgeOffsets[vertexIndex];
+    span.last = _vertexEdgeIndices.data() + _vertexEdgeOffsets[vertexIndex + 1];
+    return span;
+}
+
+std::vector<VertexEdges> MeshTopology::getVertexEdges() const
+{
+    int numVertices = getNumVertexEdges();
+    std::vector<VertexEdges> vertexEdges(numVertices);
+    for (int vertex = 0; vertex < numVertices; vertex++) {
+        EdgeIndexSpan edgesAtVertex = getEdgesAtVertex(vertex);
+        vertexEdges[vertex].insert(edgesAtVertex.begin(), edgesAtVertex.end());
+    }
+    return vertexEdges;
+}
+
+const std::vector<int>& MeshTopology::getNonManifoldEdges() const
+{
+    return _nonManifoldEdges;
+}
+
+bool MeshTopology::isManifold() const
 {
-    return _vertexEdges;
+    return _nonManifoldEdges.empty();
 }
 
 int MeshTopology::getNumEdges() const
@@ -179,7 +261,7 @@ int MeshTopology::getNumFaceEdges() const
 
 int MeshTopology::getNumVertexEdges() const
 {
-    return static_cast<int>(_vertexEdges.size());
+    return _vertexEdgeOffsets.empty() ? 0 : static_cast<int>(_vertexEdgeOffsets.size()) - 1;
 }
 
 } // namespace standard_cyborg::MeshTopology
@@ -54,6 +54,22 @@ struct FaceEdges {
 
 typedef std::set<int> VertexEdges;
 
+/* A non-owning view of the indices of the edges that meet at one vertex, in increasing order */
+struct EdgeIndexSpan {
+    const int* first = nullptr;
+    const int* last = nullptr;
+    
+    const int* begin() const { return first; }
+    const int* end() const { return last; }
+    int size() const { return (int)(last - first); }
+    bool empty() const { return first == last; }
+    int operator[](int i) const { return first[i]; }
+};
+
+/* Edge connectivity of a triangle mesh. Edges are numbered in the order faces first reach them,
+ * and the edges meeting at each vertex are stored flat, one run per vertex (CSR). An edge
+ * shared by more than two faces is non-manifold: it links only the first two, and is listed in
+ * getNonManifoldEdges(). */
 class MeshTopology {
 public:
     MeshTopology(const std::vector<Edge>& edges,
@@ -64,11 +80,21 @@ public:
     
     MeshTopology() {}
     
+    /* Build the topology by sorting the faces' edges by vertex, in parallel */
     void compute(const std::vector<Face3>& faces);
     
-    const std::vector<Edge> getEdges() const;
-    const std::vector<FaceEdges> getFaceEdges() const;
-    const std::vector<VertexEdges> getVertexEdges() const;
+    const std::vector<Edge>& getEdges() const;
+    const std::vector<FaceEdges>& getFaceEdges() const;
+    
+    /* The edges that meet at vertexIndex. getNumVertexEdges() is the number of vertices. */
+    EdgeIndexSpan getEdgesAtVertex(int vertexIndex) const;
+    
+    /* Copies the edges at every vertex into sets. Prefer getEdgesAtVertex(), which doesn't copy. */
+    std::vector<VertexEdges> getVertexEdges() const;
+    
+    /* Indices of edges shared by more than two faces, in increasing order */
+    const std::vector<int>& getNonManifoldEdges() const;
+    bool isManifold() const;
     
     int getNumEdges() const;
     int getNumFaceEdges() const;
@@ -82,7 +108,13 @@ public:
 private:
     std::vector<Edge> _edges;
     std::vector<FaceEdges> _faceEdges;
-    std::vector<VertexEdges> _vertexEdges;
+    
+    // The edges at vertex i are _vertexEdgeIndices[_vertexEdgeOffsets[i]] up to, but not
+    // including, _vertexEdgeIndices[_vertexEdgeOffsets[i + 1]]
+    std::vector<int> _vertexEdgeOffsets;
+    std::vector<int> _vertexEdgeIndices;
+    
+    std::vector<int> _nonManifoldEdges;
 };
 
 /* Return true if two faces are identical */
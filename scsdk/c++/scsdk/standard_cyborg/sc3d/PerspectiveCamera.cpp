@@ -296,8 +296,6 @@ Geometry PerspectiveCamera::unprojectFrame(
       float minDepth,
       float maxDepth) const {
 
-    std::vector<float> depthData = depth.getData();
-    
     std::vector<math::Vec3> positions;
     std::vector<math::Vec3> colors;
     
@@ -310,13 +308,8 @@ Geometry PerspectiveCamera::unprojectFrame(
         positions.push_back(unprojectDepthSample(w, h, col, row, depth));
     });
     
-    Geometry geometryOut;
-    geometryOut.setNormals({});
-    geometryOut.setFaces({});
-    geometryOut.setTexCoords({});
+    Geometry geometryOut(std::move(positions), std::vector<math::Vec3>(), std::move(colors));
     geometryOut.setNormalsEncodeSurfelRadius(false);
-    geometryOut.setPositions(positions);
-    geometryOut.setColors(colors);
     return geometryOut;
 }
 
@@ -23,38 +23,143 @@ limitations under the License.
 namespace standard_cyborg {
 namespace sc3d {
 
+// A std::set node costs a few hundred bits, so a selection goes dense once more than one index
+// in kDenseFactor is selected, and back to sparse below one in kSparseFactor. The gap between
+// the two keeps selections near the threshold from converting back and forth.
+static const int64_t kDenseFactor = 256;
+static const int64_t kSparseFactor = 1024;
+
+static inline int popCount(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word != 0; count++) word &= word - 1;
+    return count;
+#endif
+}
+
+/* The position of the lowest set bit of a nonzero word */
+static inline int lowestSetBit(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    for (; (word & 1) == 0; bit++) word >>= 1;
+    return bit;
+#endif
+}
+
+static int countBits(const std::vector<uint64_t>& bits)
+{
+    int count = 0;
+    for (uint64_t word : bits) count += popCount(word);
+    return count;
+}
+
 VertexSelection::VertexSelection()
 {}
 
 VertexSelection::VertexSelection(const Geometry& geometry, std::vector<int> initialSelectedVertices) :
     _vertexIndices(std::set<int>(initialSelectedVertices.begin(), initialSelectedVertices.end())),
     _totalVertexCount(geometry.vertexCount())
-{}
+{
+    updateRepresentation();
+}
 
 VertexSelection::VertexSelection(const Polyline& polyline, std::vector<int> initialSelectedVertices) :
     _vertexIndices(std::set<int>(initialSelectedVertices.begin(), initialSelectedVertices.end())),
     _totalVertexCount(polyline.vertexCount())
-{}
+{
+    updateRepresentation();
+}
 
 VertexSelection::VertexSelection(int totalVertexCount, std::vector<int> initialSelectedVertices) :
     _vertexIndices(std::set<int>(initialSelectedVertices.begin(), initialSelectedVertices.end())),
     _totalVertexCount(totalVertexCount)
-{}
+{
+    updateRepresentation();
+}
+
+VertexSelection::const_iterator& VertexSelection::const_iterator::operator++()
+{
+    if (!_isDense) {
+        ++_setIterator;
+        return *this;
+    }
+
+    // Skip to the next set bit, a word at a time
+    const std::vector<uint64_t>& bits = *_bits;
+    int bitCount = (int)bits.size() * 64;
+    int next = _bitIndex + 1;
+    if (next >= bitCount) {
+        _bitIndex = bitCount;
+        return *this;
+    }
+
+    size_t wordIndex = next >> 6;
+    uint64_t word = bits[wordIndex] & (~0ULL << (next & 63));
+    while (word == 0) {
+        if (++wordIndex == bits.size()) {
+            _bitIndex = bitCount;
+            return *this;
+        }
+        word = bits[wordIndex];
+    }
+
+    _bitIndex = (int)wordIndex * 64 + lowestSetBit(word);
+    return *this;
+}
+
+VertexSelection::const_iterator VertexSelection::const_iterator::operator++(int)
+{
+    const_iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+bool VertexSelection::const_iterator::operator==(const const_iterator& other) const
+{
+    return _isDense ? _bitIndex == other._bitIndex : _setIterator == other._setIterator;
+}
 
 VertexSelection::const_iterator VertexSelection::begin() const
 {
-    return _vertexIndices.begin();
+    const_iterator iterator;
+    iterator._isDense = _isDense;
+
+    if (_isDense) {
+        iterator._bits = &_bits;
+        iterator._bitIndex = -1;
+        ++iterator;
+    } else {
+        iterator._setIterator = _vertexIndices.begin();
+    }
+
+    return iterator;
 }
 
 VertexSelection::const_iterator VertexSelection::end() const
 {
-    return _vertexIndices.end();
-}
+    const_iterator iterator;
+    iterator._isDense = _isDense;
 
+    if (_isDense) {
+        iterator._bits = &_bits;
+        iterator._bitIndex = (int)_bits.size() * 64;
+    } else {
+        iterator._setIterator = _vertexIndices.end();
+    }
+
+    return iterator;
+}
 
 std::vector<int> VertexSelection::toVector() const
 {
     std::vector<int> indices;
+    indices.reserve(size());
     for (auto it = begin(); it != end(); ++it) {
         indices.push_back(*it);
     }
@@ -64,7 +169,7 @@ std::vector<int> VertexSelection::toVector() const
 
 int VertexSelection::size() const
 {
-    return (int)_vertexIndices.size();
+    return _isDense ? _denseCount : (int)_vertexIndices.size();
 }
 
 int VertexSelection::getTotalVertexCount() const
@@ -72,76 +177,230 @@ int VertexSelection::getTotalVertexCount() const
     return _totalVertexCount;
 }
 
+bool VertexSelection::isDense() const
+{
+    return _isDense;
+}
+
 void VertexSelection::copy(const VertexSelection& that)
 {
-    _vertexIndices.clear();
-    _vertexIndices.insert(that.begin(), that.end());
+    _isDense = that._isDense;
+    _vertexIndices = that._vertexIndices;
+    _bits = that._bits;
+    _denseCount = that._denseCount;
     _totalVertexCount = that._totalVertexCount;
 }
 
+int64_t VertexSelection::universeSize() const
+{
+    int64_t indexCapacity = 0;
+    if (_isDense) {
+        indexCapacity = (int64_t)_bits.size() * 64;
+    } else if (!_vertexIndices.empty()) {
+        indexCapacity = (int64_t)*_vertexIndices.rbegin() + 1;
+    }
+
+    return std::max((int64_t)_totalVertexCount, indexCapacity);
+}
+
+void VertexSelection::reserveBit(int index)
+{
+    size_t wordIndex = (size_t)index >> 6;
+    if (wordIndex >= _bits.size()) _bits.resize(wordIndex + 1, 0);
+}
+
+void VertexSelection::convertToDense()
+{
+    if (_isDense) return;
+
+    _bits.assign((size_t)((universeSize() + 63) / 64), 0);
+    for (int index : _vertexIndices) {
+        _bits[index >> 6] |= 1ULL << (index & 63);
+    }
+
+    _denseCount = (int)_vertexIndices.size();
+    _isDense = true;
+    std::set<int>().swap(_vertexIndices);
+}
+
+void VertexSelection::convertToSparse()
+{
+    if (!_isDense) return;
+
+    // Indices come out in order, so each one is inserted at the end in constant time
+    std::set<int> indices;
+    for (int index : *this) {
+        indices.insert(indices.end(), index);
+    }
+
+    _vertexIndices.swap(indices);
+    _isDense = false;
+    std::vector<uint64_t>().swap(_bits);
+    _denseCount = 0;
+}
+
+void VertexSelection::updateRepresentation()
+{
+    int64_t count = size();
+    int64_t universe = universeSize();
+
+    if (_isDense) {
+        if (count == 0 || count * kSparseFactor < universe) convertToSparse();
+    } else if (count > 0 && count * kDenseFactor > universe && *_vertexIndices.begin() >= 0) {
+        // Bitsets can't hold negative indices, so those keep a selection sparse
+        convertToDense();
+    }
+}
+
 void VertexSelection::insertValue(const int index)
 {
+    if (_isDense) {
+        // Rather than grow the bitset to a far-off index, go back to a set if that'd be smaller
+        bool fitsBitset = (size_t)index >> 6 < _bits.size();
+        if (index < 0 || (!fitsBitset && (int64_t)(_denseCount + 1) * kSparseFactor < (int64_t)index + 1)) {
+            convertToSparse();
+        } else {
+            if (!fitsBitset) reserveBit(index);
+
+            uint64_t& word = _bits[index >> 6];
+            uint64_t mask = 1ULL << (index & 63);
+            if ((word & mask) == 0) {
+                word |= mask;
+                _denseCount++;
+            }
+            return;
+        }
+    }
+
     _vertexIndices.insert(index);
+    updateRepresentation();
 }
 
 void VertexSelection::removeValue(const int index)
 {
-    _vertexIndices.erase(index);
+    if (_isDense) {
+        if (contains(index)) {
+            _bits[index >> 6] &= ~(1ULL << (index & 63));
+            _denseCount--;
+        }
+    } else {
+        _vertexIndices.erase(index);
+    }
+
+    updateRepresentation();
 }
 
 bool VertexSelection::contains(int index) const
 {
+    if (_isDense) {
+        return index >= 0 && ((size_t)index >> 6) < _bits.size() && (_bits[index >> 6] & (1ULL << (index & 63))) != 0;
+    }
+
     return _vertexIndices.find(index) != _vertexIndices.end();
 }
 
 void VertexSelection::unionWith(const VertexSelection& other)
 {
-    _vertexIndices.insert(other.begin(), other.end());
+    // The union is at least as dense as other
+    if (other._isDense && (_vertexIndices.empty() || *_vertexIndices.begin() >= 0)) convertToDense();
+
+    if (_isDense && other._isDense) {
+        if (other._bits.size() > _bits.size()) _bits.resize(other._bits.size(), 0);
+
+        const uint64_t* otherBits = other._bits.data();
+        uint64_t* bits = _bits.data();
+        size_t wordCount = other._bits.size();
+        for (size_t i = 0; i < wordCount; i++) {
+            bits[i] |= otherBits[i];
+        }
+
+        _denseCount = countBits(_bits);
+    } else if (_isDense) {
+        for (int index : other._vertexIndices) {
+            insertValue(index);
+        }
+    } else {
+        for (int index : other) {
+            _vertexIndices.insert(_vertexIndices.end(), index);
+        }
+    }
+
+    updateRepresentation();
 }
 
 void VertexSelection::differenceWith(const VertexSelection& other)
 {
-    auto end = other.end();
-    for (auto iter = other.begin(); iter != end; iter++) {
-        _vertexIndices.erase(*iter);
+    if (_isDense && other._isDense) {
+        const uint64_t* otherBits = other._bits.data();
+        uint64_t* bits = _bits.data();
+        size_t wordCount = std::min(_bits.size(), other._bits.size());
+        for (size_t i = 0; i < wordCount; i++) {
+            bits[i] &= ~otherBits[i];
+        }
+
+        _denseCount = countBits(_bits);
+    } else if (_isDense) {
+        for (int index : other._vertexIndices) {
+            if (contains(index)) {
+                _bits[index >> 6] &= ~(1ULL << (index & 63));
+                _denseCount--;
+            }
+        }
+    } else if (other.size() < size()) {
+        for (int index : other) {
+            _vertexIndices.erase(index);
+        }
+    } else {
+        for (auto it = _vertexIndices.begin(); it != _vertexIndices.end();) {
+            it = other.contains(*it) ? _vertexIndices.erase(it) : std::next(it);
+        }
     }
+
+    updateRepresentation();
 }
 
 void VertexSelection::intersectWith(const VertexSelection& other)
 {
-    auto first = begin();
-    auto last = end();
-    auto otherFirst = other.begin();
-    auto otherLast = other.end();
-    
-    // This is a slight modification of the algorithm from
-    // https://en.cppreference.com/w/cpp/algorithm/set_intersection
-    // It has been modified to mutate in place rather than writing
-    // values into a new selection
-    while (first != last && otherFirst != otherLast) {
-        if (*otherFirst < *first) {
-            // First2 catches up to first
-            ++otherFirst;
-        } else {
-            if (!(*first < *otherFirst)) {
-                // If equal, increment both pointers
-                ++otherFirst;
-                ++first;
-            } else {
-                // Otherwise otherFirst is already caught up so we delete first
-                first = _vertexIndices.erase(first);
-            }
+    if (_isDense && other._isDense) {
+        size_t wordCount = std::min(_bits.size(), other._bits.size());
+        const uint64_t* otherBits = other._bits.data();
+        uint64_t* bits = _bits.data();
+        for (size_t i = 0; i < wordCount; i++) {
+            bits[i] &= otherBits[i];
+        }
+        _bits.resize(wordCount);
+
+        _denseCount = countBits(_bits);
+    } else if (_isDense) {
+        // The intersection is the part of the sparse selection that this one contains
+        std::set<int> indices;
+        for (int index : other._vertexIndices) {
+            if (contains(index)) indices.insert(indices.end(), index);
+        }
+
+        _vertexIndices.swap(indices);
+        _isDense = false;
+        std::vector<uint64_t>().swap(_bits);
+        _denseCount = 0;
+    } else {
+        for (auto it = _vertexIndices.begin(); it != _vertexIndices.end();) {
+            it = other.contains(*it) ? std::next(it) : _vertexIndices.erase(it);
         }
     }
-    
-    // Cleanup. If we didn't get to the end of vertex indices, then they're
-    // not in the intersection set and we erase to the end.
-    _vertexIndices.erase(first, last);
+
+    updateRepresentation();
 }
 
 bool VertexSelection::operator==(const VertexSelection& other) const
 {
     if (size() != other.size()) return false;
+
+    if (_isDense && other._isDense) {
+        // Equal sizes, so the words past the shorter bitset are zero if the rest match
+        size_t wordCount = std::min(_bits.size(), other._bits.size());
+        return std::equal(_bits.begin(), _bits.begin() + wordCount, other._bits.begin());
+    }
+
     return std::equal(begin(), end(), other.begin());
 }
 
@@ -153,6 +412,9 @@ bool VertexSelection::operator!=(const VertexSelection& other) const
 void VertexSelection::clear()
 {
     _vertexIndices.clear();
+    std::vector<uint64_t>().swap(_bits);
+    _denseCount = 0;
+    _isDense = false;
 }
 
 std::unique_ptr<VertexSelection> VertexSelection::fromGeometryVertices(
@@ -175,29 +437,49 @@ std::unique_ptr<VertexSelection> VertexSelection::fromGeometryVertices(
     return selection;
 }
 
-void VertexSelection::invert()
+std::unique_ptr<VertexSelection> VertexSelection::fromMask(const std::vector<uint8_t>& mask)
 {
-    // Note: we proceed by constructing a new inverse selection and then
-    // overwriting the original. This could be done in-place, but that
-    // operation is about 50% trickier, so we won't, for now.
-    std::set<int> newSelection;
+    std::unique_ptr<VertexSelection> selection = std::make_unique<VertexSelection>((int)mask.size());
     
-    // Iterate through the indices and add any gaps to the new selection
-    int previous = -1;
-    for (auto index : _vertexIndices) {
-        for (int i = previous + 1; i < index; i++) {
-            if (i < _totalVertexCount) newSelection.insert(i);
-        }
-        previous = index;
+    // Pack the mask straight into a bitset rather than inserting one index at a time
+    std::vector<uint64_t> bits((mask.size() + 63) / 64, 0);
+    for (size_t index = 0; index < mask.size(); index++) {
+        if (mask[index]) bits[index >> 6] |= 1ULL << (index & 63);
     }
     
-    // Iterate from the last index up to the end
-    for (int i = previous + 1; i < _totalVertexCount; i++) {
-        newSelection.insert(i);
-    }
+    selection->_bits.swap(bits);
+    selection->_denseCount = countBits(selection->_bits);
+    selection->_isDense = true;
+    selection->updateRepresentation();
     
-    // Transfer the new selection into the existing
-    _vertexIndices = newSelection;
+    return selection;
+}
+
+void VertexSelection::invert()
+{
+    // Indices at or past the total vertex count drop out, and the inverse of a sparse selection
+    // is dense, so build it as a bitset directly
+    int totalVertexCount = std::max(0, _totalVertexCount);
+    std::vector<uint64_t> bits((totalVertexCount + 63) / 64, ~0ULL);
+    if (totalVertexCount % 64 != 0) bits.back() = (1ULL << (totalVertexCount % 64)) - 1;
+
+    if (_isDense) {
+        size_t wordCount = std::min(bits.size(), _bits.size());
+        for (size_t i = 0; i < wordCount; i++) {
+            bits[i] &= ~_bits[i];
+        }
+    } else {
+        for (int index : _vertexIndices) {
+            if (index >= 0 && index < totalVertexCount) bits[index >> 6] &= ~(1ULL << (index & 63));
+        }
+    }
+
+    _bits.swap(bits);
+    _denseCount = countBits(_bits);
+    _isDense = true;
+    std::set<int>().swap(_vertexIndices);
+
+    updateRepresentation();
 }
 
 } // namespace sc3d
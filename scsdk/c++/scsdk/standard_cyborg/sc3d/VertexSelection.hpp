@@ -17,8 +17,11 @@ limitations under the License.
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <initializer_list>
+#include <iterator>
 #include <set>
 #include <vector>
 #include <memory>
@@ -31,6 +34,10 @@ namespace sc3d {
 class Geometry;
 class Polyline;
 
+/* A set of vertex indices. Sparse selections are kept in a std::set; once a selection covers
+ * enough of the vertices that the set's nodes would outweigh one bit per vertex, it switches to
+ * a dense bitset, whose boolean operations work a 64-bit word at a time. The switch is
+ * automatic and invisible to callers, and iteration is in increasing order either way. */
 class VertexSelection {
 public:
     /* Empty selection constructor */
@@ -62,12 +69,39 @@ public:
     void differenceWith(const VertexSelection& other);
     void intersectWith(const VertexSelection& other);
     
-    /* Const iterators.
+    /* Const iterators, visiting the selected indices in increasing order.
      * Note: non-const iterators are not implemented since they're fairly strongly
      * discouraged for sets, which will break if you start modifying values and
      * messing with the guarantee that entries are sorted.
      */
-    typedef std::set<int>::const_iterator const_iterator;
+    class const_iterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef int value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const int* pointer;
+        typedef const int& reference;
+        
+        const_iterator() {}
+        
+        const int& operator*() const { return _isDense ? _bitIndex : *_setIterator; }
+        const int* operator->() const { return &**this; }
+        
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+        
+    private:
+        friend class VertexSelection;
+        
+        bool _isDense = false;
+        std::set<int>::const_iterator _setIterator;
+        const std::vector<uint64_t>* _bits = nullptr;
+        int _bitIndex = 0;
+    };
+    
     const_iterator begin() const;
     const_iterator end() const;
     
@@ -80,14 +114,38 @@ public:
     bool operator==(const VertexSelection& other) const;
     bool operator!=(const VertexSelection& other) const;
     
+    /* Whether the selection is currently stored as a bitset. For testing and diagnostics. */
+    bool isDense() const;
+    
     /* Selects all vertices from the given geometry where filterFn returns true */
     static std::unique_ptr<VertexSelection> fromGeometryVertices(
         const Geometry& geometry,
         const std::function<bool(int index, math::Vec3 position, math::Vec3 normal, math::Vec3 color)>& filterFn);
     
+    /* Selects the indices whose entries in mask are nonzero, out of mask.size() vertices */
+    static std::unique_ptr<VertexSelection> fromMask(const std::vector<uint8_t>& mask);
+    
 private:
+    /* Switch between the set and the bitset if the density calls for it */
+    void updateRepresentation();
+    void convertToDense();
+    void convertToSparse();
+    
+    /* One more than the largest index the selection could hold without growing */
+    int64_t universeSize() const;
+    
+    /* Grow the bitset to hold index */
+    void reserveBit(int index);
+    
+    bool _isDense = false;
+    
+    // The selected indices while sparse
     std::set<int> _vertexIndices;
     
+    // One bit per index while dense, and the number of bits set
+    std::vector<uint64_t> _bits;
+    int _denseCount = 0;
+    
     // This class maintains a subset of the vertices of the geometry or polyline it was instantiated with
     // Maintaining the original count allows us to invert the selection and make correctness assertions
     int _totalVertexCount = 0;
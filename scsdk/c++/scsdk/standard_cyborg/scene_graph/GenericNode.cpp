@@ -32,6 +32,11 @@ int Node::approximateSizeInBytes() const
     return 0;
 }
 
+int Node::approximateUniqueSizeInBytes(std::set<const void*>& countedBuffers) const
+{
+    return approximateSizeInBytes();
+}
+
 Node* Node::copy() const
 {
     Node* node = new Node();
@@ -62,6 +62,11 @@ int GeometryNode::approximateSizeInBytes() const
     return totalSize;
 }
 
+int GeometryNode::approximateUniqueSizeInBytes(std::set<const void*>& countedBuffers) const
+{
+    return geometry->getSize(countedBuffers);
+}
+
 GeometryNode* GeometryNode::copy() const
 {
     GeometryNode* geoNode = new GeometryNode();
@@ -216,6 +216,9 @@ int Node::calculateHistorySizeInBytes(const std::vector<std::shared_ptr<Node>>&
     // we wanna use this set, to prevent us from calculating the size of the same node twice.
     std::set<Uuid> traversedIds;
 
+    // and this one to count geometry buffers shared between copies of a node only once.
+    std::set<const void*> countedBuffers;
+
     int totalSize = 0;
 
     for (std::shared_ptr<Node> rootNode : history) {
@@ -230,7 +233,7 @@ int Node::calculateHistorySizeInBytes(const std::vector<std::shared_ptr<Node>>&
             stack.pop();
 
             if (traversedIds.count(node->getId()) == 0) {
-                totalSize += node->approximateSizeInBytes();
+                totalSize += node->approximateUniqueSizeInBytes(countedBuffers);
                 traversedIds.insert(node->getId());
             }
 
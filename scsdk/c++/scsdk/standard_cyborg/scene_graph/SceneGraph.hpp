@@ -117,6 +117,10 @@ public:
     /** Gets the memory size of the contents of this Node. NB: this doesnt include the children of this node. */
     virtual int approximateSizeInBytes() const;
 
+    /** As approximateSizeInBytes(), but skipping data buffers whose ids are already in countedBuffers, and adding
+     this node's buffers to it, so that buffers shared between nodes are only counted once. */
+    virtual int approximateUniqueSizeInBytes(std::set<const void*>& countedBuffers) const;
+
     /** Copies only this node (and not any of its children), without assigning a new id to the copy. */
     virtual Node* copy() const;
 
@@ -337,6 +341,7 @@ private:
 public:
     virtual SGNodeType getType() const;
     virtual int approximateSizeInBytes() const;
+    virtual int approximateUniqueSizeInBytes(std::set<const void*>& countedBuffers) const;
     virtual GeometryNode* copy() const;
     virtual GeometryNode* deepCopy() const;
 
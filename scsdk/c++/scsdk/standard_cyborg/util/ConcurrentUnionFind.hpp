@@ -0,0 +1,79 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace standard_cyborg {
+
+/*
+ * Disjoint sets over the elements [0, count), which any number of threads may unite at once
+ * without locking. The root of every set is its lowest element, so once all unions are done,
+ * find() gives the same answer no matter the order they happened in.
+ */
+class ConcurrentUnionFind {
+public:
+    explicit ConcurrentUnionFind(int count) :
+        _parents(new std::atomic<int>[count > 0 ? count : 0]),
+        _count(count > 0 ? count : 0)
+    {
+        for (int i = 0; i < _count; i++) {
+            _parents[i].store(i, std::memory_order_relaxed);
+        }
+    }
+
+    int size() const { return _count; }
+
+    /* The root of element's set. Halves the path as it goes, which is safe alongside unite(). */
+    int find(int element)
+    {
+        while (true) {
+            int parent = _parents[element].load(std::memory_order_acquire);
+            if (parent == element) return element;
+
+            int grandparent = _parents[parent].load(std::memory_order_acquire);
+            if (grandparent != parent) {
+                _parents[element].compare_exchange_weak(parent, grandparent, std::memory_order_acq_rel);
+            }
+
+            element = grandparent;
+        }
+    }
+
+    /* Merge the sets of a and b, linking the higher root beneath the lower */
+    void unite(int a, int b)
+    {
+        while (true) {
+            a = find(a);
+            b = find(b);
+            if (a == b) return;
+            if (a > b) std::swap(a, b);
+
+            // Only a root may be linked. If another thread linked b first, search again.
+            int expected = b;
+            if (_parents[b].compare_exchange_strong(expected, a, std::memory_order_acq_rel)) return;
+        }
+    }
+
+private:
+    std::unique_ptr<std::atomic<int>[]> _parents;
+    int _count;
+};
+
+} // namespace standard_cyborg
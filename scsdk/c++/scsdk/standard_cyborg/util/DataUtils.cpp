@@ -21,6 +21,7 @@ limitations under the License.
 #include "standard_cyborg/math/Mat4x4.hpp"
 #include "standard_cyborg/math/Vec3.hpp"
 #include "standard_cyborg/sc3d/Face3.hpp"
+#include "standard_cyborg/sc3d/Float3View.hpp"
 
 namespace standard_cyborg {
 
@@ -62,6 +63,22 @@ const Eigen::Ref<const Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>>
     );
 }
 
+// MARK: Float3View adaptors
+
+const Eigen::Ref<const Eigen::Matrix<float, 3, Eigen::Dynamic>> toMatrix3Xf(const sc3d::Float3View& view)
+{
+    return Eigen::Map<const Eigen::Matrix<float, 3, Eigen::Dynamic>, Eigen::Unaligned, Eigen::OuterStride<>>(
+        view.data, 3, view.count, Eigen::OuterStride<>(view.stride)
+    );
+}
+
+const Eigen::Ref<const Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>> toMatrixX3f(const sc3d::Float3View& view)
+{
+    return Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>, Eigen::Unaligned, Eigen::OuterStride<>>(
+        view.data, view.count, 3, Eigen::OuterStride<>(view.stride)
+    );
+}
+
 // MARK: non-const Face3 adaptors
 
 Eigen::Ref<Eigen::Matrix<int, 3, Eigen::Dynamic>> toMatrix3Xi(std::vector<Face3>& data)
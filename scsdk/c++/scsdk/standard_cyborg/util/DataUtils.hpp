@@ -33,6 +33,7 @@ struct Mat4x4;
 
 namespace sc3d {
 struct Face3;
+struct Float3View;
 }
 
 /*
@@ -50,6 +51,10 @@ Eigen::Ref<Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>> toMatrixX3f
 const Eigen::Ref<const Eigen::Matrix<float, 3, Eigen::Dynamic, Eigen::ColMajor>> toMatrix3Xf(const std::vector<math::Vec3>& data);
 const Eigen::Ref<const Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>> toMatrixX3f(const std::vector<math::Vec3>& data);
 
+/* Const adaptors for views such as Geometry::getPositionsView(), in either storage mode */
+const Eigen::Ref<const Eigen::Matrix<float, 3, Eigen::Dynamic, Eigen::ColMajor>> toMatrix3Xf(const sc3d::Float3View& view);
+const Eigen::Ref<const Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>> toMatrixX3f(const sc3d::Float3View& view);
+
 /* Non-const Face3 adaptors */
 Eigen::Ref<Eigen::Matrix<int, 3, Eigen::Dynamic, Eigen::ColMajor>> toMatrix3Xi(std::vector<sc3d::Face3>& data);
 Eigen::Ref<Eigen::Matrix<int, Eigen::Dynamic, 3, Eigen::RowMajor>> toMatrixX3i(std::vector<sc3d::Face3>& data);
@@ -328,9 +328,9 @@ std::ostream& operator<<(std::ostream& os, const MeshTopology::MeshTopology& top
     os << "  },\n";
     
     os << "  vector<VertexEdges>={\n";
-    for (int j = 0; j < topology.getVertexEdges().size(); j++) {
-        auto vertexEdges = topology.getVertexEdges()[j];
-        int size = static_cast<int>(vertexEdges.size());
+    for (int j = 0; j < topology.getNumVertexEdges(); j++) {
+        MeshTopology::EdgeIndexSpan vertexEdges = topology.getEdgesAtVertex(j);
+        int size = vertexEdges.size();
         os << "    " << j << ": set<int>{";
         int i = 0;
         for (auto index : vertexEdges) {
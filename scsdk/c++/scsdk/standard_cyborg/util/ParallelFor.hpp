@@ -0,0 +1,239 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace standard_cyborg {
+
+/* The maximum number of threads parallelFor will use. Always at least one. Use this to size
+ * per-thread scratch buffers, which parallelFor indexes by its `threadIndex` argument. */
+inline int parallelThreadCount()
+{
+#ifdef EMBIND_ONLY
+    // The JS build does not enable pthreads
+    return 1;
+#else
+    return std::max(1, (int)std::thread::hardware_concurrency());
+#endif
+}
+
+/* True on parallelFor's worker threads, and on a calling thread while it runs its own range */
+inline bool& insideParallelFor()
+{
+    static thread_local bool inside = false;
+    return inside;
+}
+
+/*
+ * The worker threads behind parallelFor. They start on first use and then wait for work for the
+ * life of the process, so that algorithms which call parallelFor in a tight loop don't pay for
+ * creating and joining threads on every call. One call runs on the pool at a time.
+ */
+class ParallelWorkerPool {
+public:
+    static ParallelWorkerPool& shared()
+    {
+        static ParallelWorkerPool pool(parallelThreadCount() - 1);
+        return pool;
+    }
+    
+    explicit ParallelWorkerPool(int workerCount)
+    {
+        for (int workerIndex = 0; workerIndex < workerCount; workerIndex++) {
+            _workers.emplace_back([this, workerIndex]() { workerLoop(workerIndex + 1); });
+        }
+    }
+    
+    ~ParallelWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        
+        for (std::thread& worker : _workers) {
+            worker.join();
+        }
+    }
+    
+    ParallelWorkerPool(const ParallelWorkerPool&) = delete;
+    ParallelWorkerPool& operator=(const ParallelWorkerPool&) = delete;
+    
+    /* Call task(threadIndex) for each threadIndex in [0, threadCount), index 0 on the calling
+     * thread, and wait for all of them. threadCount may not exceed the worker count plus one.
+     * Returns false without calling anything if another thread is already using the pool. */
+    template <typename Task>
+    bool tryRun(int threadCount, const Task& task)
+    {
+        std::unique_lock<std::mutex> runLock(_runMutex, std::try_to_lock);
+        if (!runLock.owns_lock()) return false;
+        
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _task = &task;
+            _runTask = [](const void* task, int threadIndex) { (*static_cast<const Task*>(task))(threadIndex); };
+            _taskThreadCount = threadCount;
+            _pendingWorkerCount = threadCount - 1;
+            _generation++;
+        }
+        _wake.notify_all();
+        
+        insideParallelFor() = true;
+        task(0);
+        insideParallelFor() = false;
+        
+        std::unique_lock<std::mutex> lock(_mutex);
+        _finished.wait(lock, [this]() { return _pendingWorkerCount == 0; });
+        
+        return true;
+    }
+    
+private:
+    void workerLoop(int threadIndex)
+    {
+        insideParallelFor() = true;
+        uint64_t seenGeneration = 0;
+        
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _wake.wait(lock, [&]() { return _stopping || _generation != seenGeneration; });
+            if (_stopping) return;
+            
+            seenGeneration = _generation;
+            if (threadIndex >= _taskThreadCount) continue;
+            
+            const void* task = _task;
+            void (*runTask)(const void*, int) = _runTask;
+            
+            lock.unlock();
+            runTask(task, threadIndex);
+            lock.lock();
+            
+            if (--_pendingWorkerCount == 0) _finished.notify_one();
+        }
+    }
+    
+    std::vector<std::thread> _workers;
+    
+    // Held by the one caller whose task is on the pool
+    std::mutex _runMutex;
+    
+    // Guards everything below
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _finished;
+    bool _stopping = false;
+    uint64_t _generation = 0;
+    const void* _task = nullptr;
+    void (*_runTask)(const void*, int) = nullptr;
+    int _taskThreadCount = 0;
+    int _pendingWorkerCount = 0;
+};
+
+/*
+ * Partition the range [0, count) into contiguous sub-ranges and call
+ *
+ *   rangeFn(int begin, int end, int threadIndex)
+ *
+ * once per sub-range, each on its own thread. threadIndex is unique per call and less than
+ * parallelThreadCount(). Sub-ranges are never smaller than minRangeSize, so small inputs run
+ * inline on the calling thread without spawning anything. Blocks until all ranges complete.
+ *
+ * Ranges run on the shared ParallelWorkerPool. Nested calls, and calls made while another thread
+ * has the pool, start threads of their own instead.
+ */
+template <typename RangeFunction>
+void parallelFor(int count, const RangeFunction& rangeFn, int minRangeSize = 256)
+{
+    if (count <= 0) return;
+
+    minRangeSize = std::max(1, minRangeSize);
+    int threadCount = std::min(parallelThreadCount(), (count + minRangeSize - 1) / minRangeSize);
+
+    if (threadCount <= 1) {
+        rangeFn(0, count, 0);
+        return;
+    }
+
+    auto rangeStart = [count, threadCount](int threadIndex) {
+        return (int)((int64_t)count * threadIndex / threadCount);
+    };
+
+    if (!insideParallelFor()) {
+        bool ranOnPool = ParallelWorkerPool::shared().tryRun(threadCount, [&](int threadIndex) {
+            rangeFn(rangeStart(threadIndex), rangeStart(threadIndex + 1), threadIndex);
+        });
+        if (ranOnPool) return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+
+    for (int threadIndex = 1; threadIndex < threadCount; threadIndex++) {
+        int begin = rangeStart(threadIndex);
+        int end = rangeStart(threadIndex + 1);
+        threads.emplace_back([&rangeFn, begin, end, threadIndex]() { rangeFn(begin, end, threadIndex); });
+    }
+
+    // The calling thread takes the first range rather than sitting idle
+    rangeFn(0, rangeStart(1), 0);
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+/*
+ * Compute
+ *
+ *   Value chunkFn(int begin, int end)
+ *
+ * over consecutive chunks of chunkSize elements of [0, count) in parallel, and return zero plus
+ * their sum. Chunks are fixed in size and added in order, so floating point sums come out the
+ * same no matter how many threads there are.
+ */
+template <typename Value, typename ChunkFunction>
+Value parallelSum(int count, const Value& zero, const ChunkFunction& chunkFn, int chunkSize = 4096)
+{
+    if (count <= 0) return zero;
+
+    chunkSize = std::max(1, chunkSize);
+    int chunkCount = (count + chunkSize - 1) / chunkSize;
+    std::vector<Value> partialSums(chunkCount, zero);
+
+    parallelFor(chunkCount, [&](int beginChunk, int endChunk, int threadIndex) {
+        for (int chunk = beginChunk; chunk < endChunk; chunk++) {
+            partialSums[chunk] = chunkFn(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+        }
+    }, 1);
+
+    Value sum = zero;
+    for (const Value& partialSum : partialSums) {
+        sum += partialSum;
+    }
+
+    return sum;
+}
+
+} // namespace standard_cyborg
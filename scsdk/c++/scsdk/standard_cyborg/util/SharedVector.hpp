@@ -0,0 +1,90 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace standard_cyborg {
+
+/*
+ * A copy-on-write std::vector. Copying a SharedVector is O(1) and shares the underlying buffer;
+ * the buffer is only cloned when a holder asks to write to it while others still share it. Read
+ * through get() or the const accessors, and write through mutate(), which returns a vector that
+ * no other SharedVector shares.
+ *
+ * Like std::vector itself, a SharedVector is not safe to mutate while another thread reads it,
+ * but distinct SharedVectors sharing a buffer may be used from different threads.
+ */
+template <typename T>
+class SharedVector {
+public:
+    SharedVector() {}
+
+    SharedVector(const std::vector<T>& vector) :
+        _buffer(std::make_shared<std::vector<T>>(vector))
+    {}
+
+    SharedVector(std::vector<T>&& vector) :
+        _buffer(std::make_shared<std::vector<T>>(std::move(vector)))
+    {}
+
+    const std::vector<T>& get() const { return _buffer ? *_buffer : emptyVector(); }
+    operator const std::vector<T>&() const { return get(); }
+
+    size_t size() const { return _buffer ? _buffer->size() : 0; }
+    bool empty() const { return size() == 0; }
+    const T* data() const { return get().data(); }
+    const T& operator[](size_t index) const { return (*_buffer)[index]; }
+
+    typename std::vector<T>::const_iterator begin() const { return get().begin(); }
+    typename std::vector<T>::const_iterator end() const { return get().end(); }
+
+    /* Writable access to the contents, cloning the buffer first if it's shared */
+    std::vector<T>& mutate()
+    {
+        if (!_buffer) {
+            _buffer = std::make_shared<std::vector<T>>();
+        } else if (_buffer.use_count() > 1) {
+            _buffer = std::make_shared<std::vector<T>>(*_buffer);
+        }
+
+        return *_buffer;
+    }
+
+    /* Drop this holder's reference, leaving it empty */
+    void clear() { _buffer.reset(); }
+
+    bool isShared() const { return _buffer.use_count() > 1; }
+
+    /* Identifies the underlying buffer, e.g. to count memory shared by several holders once */
+    const void* bufferId() const { return _buffer.get(); }
+
+    size_t sizeInBytes() const { return sizeof(T) * size(); }
+
+private:
+    static const std::vector<T>& emptyVector()
+    {
+        static const std::vector<T> empty;
+        return empty;
+    }
+
+    std::shared_ptr<std::vector<T>> _buffer;
+};
+
+} // namespace standard_cyborg
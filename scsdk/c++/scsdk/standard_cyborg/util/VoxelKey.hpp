@@ -0,0 +1,54 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#include "standard_cyborg/math/Vec3.hpp"
+
+namespace standard_cyborg {
+
+static const int kVoxelKeyBitsPerAxis = 21;
+static const uint64_t kInvalidVoxelKey = ~(uint64_t)0;
+
+/*
+ * Packs the integer coordinates of the voxel containing a point into one 64-bit key, 21 bits per
+ * axis with x in the lowest bits, offset so the origin sits mid-range. That spans about a million
+ * voxels either side of the origin per axis. Positions outside that range, or not finite, get
+ * kInvalidVoxelKey, which sorts after every valid key.
+ */
+inline uint64_t voxelKey(const math::Vec3& position, float inverseVoxelSize)
+{
+    const int64_t axisOffset = (int64_t)1 << (kVoxelKeyBitsPerAxis - 1);
+    const int64_t axisLimit = (int64_t)1 << kVoxelKeyBitsPerAxis;
+    const float components[3] = {position.x, position.y, position.z};
+    uint64_t key = 0;
+    
+    for (int axis = 0; axis < 3; axis++) {
+        float coordinate = std::floor(components[axis] * inverseVoxelSize);
+        
+        // Also rejects NaN, which fails both comparisons
+        if (!(coordinate >= -axisOffset && coordinate < axisLimit - axisOffset)) return kInvalidVoxelKey;
+        
+        key |= (uint64_t)((int64_t)coordinate + axisOffset) << (axis * kVoxelKeyBitsPerAxis);
+    }
+    
+    return key;
+}
+
+} // namespace standard_cyborg
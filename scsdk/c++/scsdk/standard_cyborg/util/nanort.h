@@ -671,6 +671,14 @@ class BVHAccel {
   bool Build(const unsigned int num_primitives, const P &p, const Pred &pred,
              const BVHBuildOptions<T> &options = BVHBuildOptions<T>());
 
+  ///
+  /// Recompute node bounds after primitives moved, keeping the tree topology
+  /// built by Build(). Much cheaper than a rebuild, though traversal slows down
+  /// as primitives drift from where they were at build time.
+  ///
+  template <class P>
+  void Refit(const P &p);
+
   ///
   /// Get statistics of built BVH tree. Valid after Build()
   ///
@@ -2109,6 +2117,40 @@ bool BVHAccel<T>::Build(unsigned int num_primitives, const P &p,
   return true;
 }
 
+template <typename T>
+template <class P>
+void BVHAccel<T>::Refit(const P &p) {
+  bboxes_.clear();
+
+  // Children are always stored after their parent, so a reverse sweep visits
+  // both children of a branch before the branch itself.
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    BVHNode<T> &node = nodes_[i];
+    real3<T> bmin, bmax;
+
+    if (node.flag == 1) {  // leaf
+      unsigned int left_idx = node.data[1];
+      unsigned int right_idx = left_idx + node.data[0];
+      if (left_idx == right_idx) continue;
+
+      ComputeBoundingBox(&bmin, &bmax, &indices_.at(0), left_idx, right_idx, p);
+    } else {
+      const BVHNode<T> &left = nodes_[node.data[0]];
+      const BVHNode<T> &right = nodes_[node.data[1]];
+
+      for (int k = 0; k < 3; k++) {
+        bmin[k] = std::min(left.bmin[k], right.bmin[k]);
+        bmax[k] = std::max(left.bmax[k], right.bmax[k]);
+      }
+    }
+
+    for (int k = 0; k < 3; k++) {
+      node.bmin[k] = bmin[k];
+      node.bmax[k] = bmax[k];
+    }
+  }
+}
+
 template <typename T>
 void BVHAccel<T>::Debug() {
   for (size_t i = 0; i < indices_.size(); i++) {
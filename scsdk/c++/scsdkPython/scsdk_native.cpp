@@ -56,6 +56,18 @@ NPFloat Vec3sToNpFloat(const std::vector<math::Vec3>& vectors) {
    return NPFloat(std::vector<ptrdiff_t>{(ptrdiff_t)vectors.size(), 3}, &floats[0]);
 }
 
+// A read-only numpy array over the view's memory, which keeps `owner` alive rather than copying.
+// Padded storage is strided, so this is a plain array_t rather than a c_style NPFloat.
+pybind11::array_t<float> Float3ViewToNpFloat(const sc3d::Float3View& view, pybind11::handle owner) {
+   pybind11::array_t<float> array(
+      std::vector<ptrdiff_t>{(ptrdiff_t)view.size(), 3},
+      std::vector<ptrdiff_t>{(ptrdiff_t)view.strideInBytes(), (ptrdiff_t)sizeof(float)},
+      view.data,
+      owner);
+   array.attr("setflags")(pybind11::arg("write") = false);
+   return array;
+}
+
 NPFloat Vec3ToNpFloat(const math::Vec3& v) {
    std::vector<float> floats = {
       v.x, v.y, v.z
@@ -269,6 +281,28 @@ PYBIND11_MODULE(scsdk_native, m) {
             ValueError: When attempting to set to an ndarray that does not have the dimensions nx3. 
          )foo")
 
+      .def_property_readonly("positionsView",
+         [](py::object self) {
+            return Float3ViewToNpFloat(self.cast<const sc3d::Geometry&>().getPositionsView(), self);
+         }, R"foo(A read-only, zero-copy ndarray of float32s of dimensions nx3 over the position attribute.
+         It shares memory with this geometry, so it is only valid until the geometry is next modified.
+         )foo")
+
+      .def_property_readonly("normalsView",
+         [](py::object self) {
+            return Float3ViewToNpFloat(self.cast<const sc3d::Geometry&>().getNormalsView(), self);
+         }, "A read-only, zero-copy ndarray over the normal attribute. See positionsView.")
+
+      .def_property_readonly("colorsView",
+         [](py::object self) {
+            return Float3ViewToNpFloat(self.cast<const sc3d::Geometry&>().getColorsView(), self);
+         }, "A read-only, zero-copy ndarray over the color attribute. See positionsView.")
+
+      .def_property("compactStorage", &sc3d::Geometry::hasCompactStorage, &sc3d::Geometry::setCompactStorage,
+         R"foo(Whether positions, normals and colors are stored as packed float triples, using 12 rather than
+         16 bytes per element. Large point clouds are best read through the *View properties in this mode.
+         )foo")
+
       .def_property("texCoords",      
          // getter
          [](const sc3d::Geometry &geometry) {
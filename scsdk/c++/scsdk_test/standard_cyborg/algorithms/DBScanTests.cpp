@@ -18,6 +18,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <random>
+#include <thread>
 #include <vector>
 
 /*
@@ -117,3 +118,87 @@ TEST(DBScanTests, testDBscan) {
         EXPECT_EQ(result[ii], -1);
     }
 }
+
+TEST(DBScanTests, testDBscanMatchesBruteForce) {
+    // Clumps of varying density, chained by sparse bridges, plus scattered noise
+    srand(1);
+    std::vector<Vec3> positions;
+    for (int clump = 0; clump < 6; clump++) {
+        Vec3 center((float)(clump % 3) * 2.0f, (float)(clump / 3) * 2.0f, 0.0f);
+        float spread = 0.2f + 0.1f * clump;
+        for (int i = 0; i < 150; i++) {
+            positions.push_back(center + Vec3(randFloat(-spread, spread), randFloat(-spread, spread), randFloat(-spread, spread)));
+        }
+    }
+    for (int i = 0; i < 20; i++) {
+        positions.push_back(Vec3(randFloat(0.0f, 4.0f), 1.0f, 0.0f));
+    }
+    for (int i = 0; i < 100; i++) {
+        positions.push_back(Vec3(randFloat(-10.0f, 10.0f), randFloat(-10.0f, 10.0f), randFloat(-10.0f, 10.0f)));
+    }
+    
+    const int minPoints = 8;
+    const float epsilon = 0.04f;
+    std::vector<int> result = standard_cyborg::algorithms::DBScan::compute(positions, minPoints, epsilon);
+    ASSERT_EQ(result.size(), positions.size());
+    
+    // Reference clustering by brute force, flood filling from the lowest unvisited core point
+    int n = (int)positions.size();
+    auto areNeighbors = [&](int i, int j) {
+        Vec3 d = positions[i] - positions[j];
+        return d.x * d.x + d.y * d.y + d.z * d.z < epsilon;
+    };
+    std::vector<bool> isCore(n);
+    for (int i = 0; i < n; i++) {
+        int count = 0;
+        for (int j = 0; j < n; j++) count += areNeighbors(i, j);
+        isCore[i] = count >= minPoints;
+    }
+    std::vector<int> expected(n, -1);
+    int clusterCount = 0;
+    for (int seed = 0; seed < n; seed++) {
+        if (!isCore[seed] || expected[seed] != -1) continue;
+        std::vector<int> stack {seed};
+        expected[seed] = clusterCount;
+        while (!stack.empty()) {
+            int i = stack.back();
+            stack.pop_back();
+            for (int j = 0; j < n; j++) {
+                if (isCore[j] && expected[j] == -1 && areNeighbors(i, j)) {
+                    expected[j] = clusterCount;
+                    stack.push_back(j);
+                }
+            }
+        }
+        clusterCount++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (isCore[i]) continue;
+        for (int j = 0; j < n; j++) {
+            if (isCore[j] && areNeighbors(i, j) && (expected[i] == -1 || expected[j] < expected[i])) expected[i] = expected[j];
+        }
+    }
+    
+    EXPECT_GT(clusterCount, 1);
+    EXPECT_EQ(result, expected);
+    
+    // A far outlier stretches the cloud past what the grid can index, so the kd-tree is used
+    std::vector<Vec3> stretchedPositions = positions;
+    stretchedPositions.push_back(Vec3(1.0e6f, 0.0f, 0.0f));
+    std::vector<int> stretchedExpected = expected;
+    stretchedExpected.push_back(-1);
+    EXPECT_EQ(standard_cyborg::algorithms::DBScan::compute(stretchedPositions, minPoints, epsilon), stretchedExpected);
+    
+    // Clustering from several threads at once gives the same answer
+    std::vector<std::vector<int>> concurrentResults(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            concurrentResults[t] = standard_cyborg::algorithms::DBScan::compute(positions, minPoints, epsilon);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    for (const std::vector<int>& concurrentResult : concurrentResults) {
+        EXPECT_EQ(concurrentResult, expected);
+    }
+}
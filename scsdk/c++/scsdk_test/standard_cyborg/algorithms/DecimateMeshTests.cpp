@@ -0,0 +1,205 @@
+/*
+ Copyright 2020 Standard Cyborg
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include "standard_cyborg/algorithms/DecimateMesh.hpp"
+#include "standard_cyborg/algorithms/EdgeLoopFinder.hpp"
+#include "standard_cyborg/math/Vec2.hpp"
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/Face3.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+
+using standard_cyborg::algorithms::DecimateMeshParameters;
+using standard_cyborg::algorithms::decimateMesh;
+using standard_cyborg::algorithms::findEdgeLoops;
+using standard_cyborg::math::Vec2;
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Face3;
+using standard_cyborg::sc3d::Geometry;
+
+/* An n by n grid of quads over the unit square, raised to height(x, y), colored and
+ * texture-mapped by x and y */
+static Geometry makeGrid(int n, const std::function<float(float, float)>& height)
+{
+    std::vector<Vec3> positions;
+    std::vector<Vec3> colors;
+    std::vector<Vec2> texCoords;
+    std::vector<Face3> faces;
+    
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            float x = i / (float)n;
+            float y = j / (float)n;
+            positions.push_back(Vec3(x, y, height(x, y)));
+            colors.push_back(Vec3(x, y, 0));
+            texCoords.push_back(Vec2(x, y));
+        }
+    }
+    
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int corner = j * (n + 1) + i;
+            faces.push_back(Face3(corner, corner + 1, corner + n + 2));
+            faces.push_back(Face3(corner, corner + n + 2, corner + n + 1));
+        }
+    }
+    
+    Geometry grid(std::move(positions), std::vector<Vec3>(), std::move(colors), std::move(faces));
+    grid.setTexCoords(std::move(texCoords));
+    return grid;
+}
+
+TEST(DecimateMeshTests, testDecimatePlaneToTargetFaceCount) {
+    Geometry grid = makeGrid(20, [](float x, float y) { return 0.0f; });
+    
+    DecimateMeshParameters parameters;
+    parameters.targetFaceCount = 100;
+    std::unique_ptr<Geometry> decimated = decimateMesh(grid, parameters);
+    
+    EXPECT_LE(decimated->faceCount(), 100);
+    ASSERT_TRUE(decimated->hasColors());
+    ASSERT_TRUE(decimated->hasTexCoords());
+    
+    int perimeterVertexCount = 0;
+    for (int i = 0; i < decimated->vertexCount(); i++) {
+        const Vec3& position = decimated->getPositions()[i];
+        EXPECT_EQ(position.z, 0.0f);
+        
+        // Attributes that vary linearly stay true to the positions they were interpolated to
+        EXPECT_NEAR(decimated->getColors()[i].x, position.x, 1e-5f);
+        EXPECT_NEAR(decimated->getColors()[i].y, position.y, 1e-5f);
+        EXPECT_NEAR(decimated->getTexCoords()[i].x, position.x, 1e-5f);
+        EXPECT_NEAR(decimated->getTexCoords()[i].y, position.y, 1e-5f);
+        
+        if (position.x == 0 || position.x == 1 || position.y == 0 || position.y == 1) {
+            perimeterVertexCount++;
+        }
+    }
+    
+    // The boundary keeps every one of its vertices, and still forms a single loop
+    EXPECT_EQ(perimeterVertexCount, 80);
+    auto loops = findEdgeLoops(*decimated);
+    ASSERT_EQ(loops.size(), 1);
+    EXPECT_EQ(loops[0].size(), 80);
+}
+
+TEST(DecimateMeshTests, testDecimateDegenerateFaces) {
+    // Squash a strip of a flat grid to nothing by stacking one row of vertices on the next, as
+    // scans with repeated vertices do
+    Geometry grid = makeGrid(20, [](float x, float y) { return 0.0f; });
+    std::vector<Vec3> positions = grid.getPositions();
+    for (int i = 1; i < 20; i++) {
+        positions[5 * 21 + i] = positions[4 * 21 + i];
+    }
+    grid.setPositions(positions);
+    
+    DecimateMeshParameters parameters;
+    parameters.targetFaceCount = 100;
+    std::unique_ptr<Geometry> decimated = decimateMesh(grid, parameters);
+    
+    // The strip's vertices are as free to go as any, so it simplifies as far as an intact grid
+    EXPECT_LE(decimated->faceCount(), 100);
+}
+
+TEST(DecimateMeshTests, testDecimateWithinErrorBound) {
+    // Two flat slopes meeting at a ridge. Flat areas cost nothing to simplify, but the ridge does.
+    auto roof = [](float x, float y) { return 0.5f - std::abs(x - 0.5f); };
+    Geometry grid = makeGrid(20, roof);
+    
+    // Within a millimeter of a roof a meter across
+    DecimateMeshParameters parameters;
+    parameters.maxError = 1e-3f * 1e-3f;
+    std::unique_ptr<Geometry> decimated = decimateMesh(grid, parameters);
+    
+    EXPECT_LT(decimated->faceCount(), grid.faceCount() / 2);
+    
+    for (const Vec3& position : decimated->getPositions()) {
+        EXPECT_NEAR(position.z, roof(position.x, position.y), 1e-3f);
+    }
+    
+    // The error is a squared distance, so scaling the mesh and the bound together gives the same
+    // result, up to rounding reordering the collapses that tie at no error
+    Geometry scaledGrid = makeGrid(20, roof);
+    std::vector<Vec3> scaledPositions = scaledGrid.getPositions();
+    for (Vec3& position : scaledPositions) {
+        position *= 10.0f;
+    }
+    scaledGrid.setPositions(scaledPositions);
+    
+    DecimateMeshParameters scaledParameters;
+    scaledParameters.maxError = 100.0f * parameters.maxError;
+    std::unique_ptr<Geometry> scaledDecimated = decimateMesh(scaledGrid, scaledParameters);
+    EXPECT_NEAR(scaledDecimated->faceCount(), decimated->faceCount(), 10);
+    
+    for (const Vec3& position : scaledDecimated->getPositions()) {
+        EXPECT_NEAR(position.z, 10.0f * roof(0.1f * position.x, 0.1f * position.y), 1e-2f);
+    }
+}
+
+TEST(DecimateMeshTests, testDecimateClosedMesh) {
+    // A UV sphere, whose faces wind consistently outward
+    const int rings = 30;
+    const int segments = 60;
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    
+    auto ringVertex = [&](int ring, int segment) { return 2 + (ring - 1) * segments + segment % segments; };
+    
+    positions.push_back(Vec3(0, 0, 1));
+    positions.push_back(Vec3(0, 0, -1));
+    for (int ring = 1; ring < rings; ring++) {
+        float polar = M_PI * ring / rings;
+        for (int segment = 0; segment < segments; segment++) {
+            float azimuth = 2.0f * M_PI * segment / segments;
+            positions.push_back(Vec3(std::sin(polar) * std::cos(azimuth), std::sin(polar) * std::sin(azimuth), std::cos(polar)));
+        }
+    }
+    
+    for (int segment = 0; segment < segments; segment++) {
+        faces.push_back(Face3(0, ringVertex(1, segment), ringVertex(1, segment + 1)));
+        faces.push_back(Face3(1, ringVertex(rings - 1, segment + 1), ringVertex(rings - 1, segment)));
+        
+        for (int ring = 1; ring < rings - 1; ring++) {
+            int a = ringVertex(ring, segment);
+            int b = ringVertex(ring + 1, segment);
+            int c = ringVertex(ring + 1, segment + 1);
+            int d = ringVertex(ring, segment + 1);
+            faces.push_back(Face3(a, b, c));
+            faces.push_back(Face3(a, c, d));
+        }
+    }
+    
+    Geometry sphere(std::move(positions), std::move(faces));
+    ASSERT_TRUE(findEdgeLoops(sphere).empty());
+    
+    DecimateMeshParameters parameters;
+    parameters.targetFaceCount = sphere.faceCount() / 10;
+    std::unique_ptr<Geometry> decimated = decimateMesh(sphere, parameters);
+    
+    EXPECT_LE(decimated->faceCount(), parameters.targetFaceCount);
+    EXPECT_GT(decimated->faceCount(), parameters.targetFaceCount - 10);
+    EXPECT_EQ(decimated->vertexCount(), decimated->faceCount() / 2 + 2);
+    EXPECT_TRUE(findEdgeLoops(*decimated).empty());
+    
+    for (const Vec3& position : decimated->getPositions()) {
+        EXPECT_NEAR(position.norm(), 1.0f, 0.02f);
+    }
+}
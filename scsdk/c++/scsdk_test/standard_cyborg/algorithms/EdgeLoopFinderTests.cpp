@@ -85,6 +85,8 @@ TEST(EdgeLoopFinderTests, testFindEdgeLoops) {
     
     std::vector<std::vector<std::pair<int,int>>> edgeLoops =  standard_cyborg::algorithms::findEdgeLoops(geometry0);
     
+    ASSERT_EQ(edgeLoops.size(), 3);
+    
     {
         std::vector<std::pair<int,int> > loop0 = {
             {0, 1},
@@ -95,20 +97,59 @@ TEST(EdgeLoopFinderTests, testFindEdgeLoops) {
         EXPECT_TRUE(edgeLoops[0] == loop0);
         
         std::vector<std::pair<int,int> > loop1 = {
-            {9, 8},
-            {8, 6},
-            {6, 7},
-            {7, 9},
+            {3, 4},
+            {4, 5},
+            {5, 3},
         };
         
         EXPECT_TRUE(edgeLoops[1] == loop1);
         
         std::vector<std::pair<int,int> > loop2 = {
-            {4, 5},
-            {5, 3},
-            {3, 4},
+            {6, 7},
+            {7, 9},
+            {9, 8},
+            {8, 6},
         };
         
         EXPECT_TRUE(edgeLoops[2] == loop2);
     }
 }
+
+TEST(EdgeLoopFinderTests, testGridWithHoles) {
+    // A grid of quads with two holes cut out
+    const int n = 40;
+    std::vector<math::Vec3> positions;
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            positions.push_back(math::Vec3((float)x, (float)y, 0.0f));
+        }
+    }
+    
+    auto isHole = [](int x, int y) {
+        return (x >= 10 && x < 20 && y >= 10 && y < 15) || (x == 1 && y == 1);
+    };
+    
+    std::vector<standard_cyborg::sc3d::Face3> faces;
+    for (int y = 0; y < n - 1; y++) {
+        for (int x = 0; x < n - 1; x++) {
+            if (isHole(x, y)) continue;
+            int v = y * n + x;
+            faces.push_back({v, v + 1, v + n + 1});
+            faces.push_back({v, v + n + 1, v + n});
+        }
+    }
+    
+    standard_cyborg::sc3d::Geometry geometry(positions, faces);
+    std::vector<std::vector<std::pair<int,int>>> edgeLoops = standard_cyborg::algorithms::findEdgeLoops(geometry);
+    
+    ASSERT_EQ(edgeLoops.size(), 3);
+    EXPECT_EQ(edgeLoops[0].size(), 4 * (n - 1));
+    EXPECT_EQ(edgeLoops[1].size(), 4);
+    EXPECT_EQ(edgeLoops[2].size(), 2 * (10 + 5));
+    
+    for (const std::vector<std::pair<int,int>>& loop : edgeLoops) {
+        for (int i = 0; i < loop.size(); i++) {
+            EXPECT_EQ(loop[i].second, loop[(i + 1) % loop.size()].first);
+        }
+    }
+}
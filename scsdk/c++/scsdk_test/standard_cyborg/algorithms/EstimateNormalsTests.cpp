@@ -0,0 +1,121 @@
+/*
+ Copyright 2020 Standard Cyborg
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "standard_cyborg/algorithms/EstimateNormals.hpp"
+#include "standard_cyborg/math/Mat3x3.hpp"
+#include "standard_cyborg/math/Vec2.hpp"
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/ColorImage.hpp"
+#include "standard_cyborg/sc3d/DepthImage.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/sc3d/PerspectiveCamera.hpp"
+
+using standard_cyborg::algorithms::estimateNormals;
+using standard_cyborg::algorithms::unprojectFrameWithNormals;
+using standard_cyborg::math::Mat3x3;
+using standard_cyborg::math::Vec2;
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::ColorImage;
+using standard_cyborg::sc3d::DepthImage;
+using standard_cyborg::sc3d::Geometry;
+using standard_cyborg::sc3d::PerspectiveCamera;
+
+TEST(EstimateNormalsTests, testEstimateNormalsOfPlane) {
+    std::vector<Vec3> positions;
+    for (int i = 0; i < 40; i++) {
+        for (int j = 0; j < 40; j++) {
+            positions.push_back(Vec3(i * 0.01f, j * 0.01f, 0.0f));
+        }
+    }
+    
+    Geometry geometry(positions);
+    estimateNormals(geometry, Vec3(0.2, 0.2, 5.0), 16, true);
+    
+    ASSERT_TRUE(geometry.hasNormals());
+    EXPECT_TRUE(geometry.normalsEncodeSurfelRadius());
+    
+    for (const Vec3& normal : geometry.getNormals()) {
+        Vec3 direction = normal / normal.norm();
+        EXPECT_NEAR(direction.z, 1.0f, 1e-4f);
+        
+        // Sixteen neighbors of a 1cm grid reach out 2cm in the interior and 4cm in the corners
+        EXPECT_GT(normal.norm(), 0.002f);
+        EXPECT_LT(normal.norm(), 0.015f);
+    }
+}
+
+TEST(EstimateNormalsTests, testEstimateNormalsOrientsTowardViewpoint) {
+    // Points on the unit sphere, seen from its center, should have inward normals
+    std::mt19937 generator(7);
+    std::normal_distribution<float> distribution;
+    std::vector<Vec3> positions;
+    for (int i = 0; i < 4000; i++) {
+        Vec3 position(distribution(generator), distribution(generator), distribution(generator));
+        positions.push_back(position / position.norm());
+    }
+    
+    Geometry geometry(positions);
+    estimateNormals(geometry, Vec3(0, 0, 0));
+    
+    EXPECT_FALSE(geometry.normalsEncodeSurfelRadius());
+    
+    for (int i = 0; i < geometry.vertexCount(); i++) {
+        EXPECT_NEAR(geometry.getNormals()[i].norm(), 1.0f, 1e-4f);
+        EXPECT_LT(Vec3::dot(geometry.getNormals()[i], geometry.getPositions()[i]), -0.95f);
+    }
+}
+
+TEST(EstimateNormalsTests, testUnprojectFrameWithNormals) {
+    int width = 64;
+    int height = 48;
+    
+    PerspectiveCamera camera;
+    camera.setNominalIntrinsicMatrix(Mat3x3(100, 0, 32,
+                                            0, 100, 24,
+                                            0, 0, 1));
+    camera.setIntrinsicMatrixReferenceSize(Vec2(width, height));
+    
+    // Two planes facing the camera, a step apart, with a hole in the nearer one
+    DepthImage depth(width, height);
+    depth.mutatePixelsByColRow([&](int col, int row, float value) {
+        if (col == 10 && row == 10) return NAN;
+        return col < width / 2 ? 1.0f : 2.0f;
+    });
+    ColorImage color(width, height);
+    
+    Geometry geometry = unprojectFrameWithNormals(camera, depth, color, 0, 10, true);
+    Geometry reference = camera.unprojectFrame(depth, color, 0, 10);
+    
+    ASSERT_EQ(geometry.vertexCount(), width * height - 1);
+    ASSERT_EQ(geometry.vertexCount(), reference.vertexCount());
+    EXPECT_TRUE(geometry.normalsEncodeSurfelRadius());
+    
+    for (int i = 0; i < geometry.vertexCount(); i++) {
+        EXPECT_EQ(geometry.getPositions()[i], reference.getPositions()[i]);
+        
+        // Pixels on the step take one-sided differences and stay on their own plane
+        const Vec3& normal = geometry.getNormals()[i];
+        float pixelDepth = -geometry.getPositions()[i].z;
+        EXPECT_NEAR(normal.z / normal.norm(), 1.0f, 1e-4f);
+        EXPECT_NEAR(normal.norm(), 0.5f * std::sqrt(2.0f) * pixelDepth / 100.0f, 1e-5f);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ Copyright 2020 Standard Cyborg
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "standard_cyborg/algorithms/ICPTracker.hpp"
+#include "standard_cyborg/math/Mat3x4.hpp"
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+#include "standard_cyborg/test_helpers/TestHelpers.hpp"
+
+using standard_cyborg::algorithms::ICPTracker;
+using standard_cyborg::algorithms::ICPTrackerParameters;
+using standard_cyborg::algorithms::ICPTrackingResult;
+using standard_cyborg::math::Mat3x4;
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Geometry;
+
+// A unit-sized patch with bumps at the scale of the 0.05 correspondence distance
+static Geometry sampleBumpySurface(int resolution, float offset)
+{
+    return standard_cyborg::makeBumpySurface(resolution, offset, 0.5f, 0.08f, 6.0f, 8.0f);
+}
+
+TEST(ICPTrackerTests, testTrackSequence) {
+    Geometry model = sampleBumpySurface(50, 0.0f);
+    
+    ICPTrackerParameters parameters;
+    parameters.maxCorrespondenceDistance = 0.05f;
+    ICPTracker tracker(model, parameters);
+    
+    Geometry surface = sampleBumpySurface(30, 0.41f);
+    
+    // The camera drifts a little every frame, and each frame sees the surface in camera space
+    for (int frameIndex = 1; frameIndex <= 5; frameIndex++) {
+        float t = frameIndex * 0.01f;
+        Mat3x4 truePose = Mat3x4::fromTranslation(Vec3(t, -0.5f * t, 0.3f * t)) *
+                          Mat3x4::fromRotationZ(0.8f * t) *
+                          Mat3x4::fromRotationX(0.5f * t);
+        Mat3x4 inversePose = truePose.inverse();
+        
+        std::vector<Vec3> framePositions;
+        for (const Vec3& position : surface.getPositions()) {
+            framePositions.push_back(inversePose * position);
+        }
+        
+        ICPTrackingResult result = tracker.track(Geometry(framePositions));
+        
+        EXPECT_TRUE(result.succeeded);
+        EXPECT_TRUE(result.converged);
+        EXPECT_GT(result.inlierCount, (int)framePositions.size() / 2);
+        EXPECT_TRUE(Mat3x4::almostEqual(result.pose, truePose, 2e-3, 2e-3));
+        EXPECT_TRUE(Mat3x4::almostEqual(tracker.getPose(), result.pose, 0, 0));
+    }
+    
+    // A frame with nothing near the model fails and leaves the pose alone
+    Mat3x4 poseBefore = tracker.getPose();
+    ICPTrackingResult lost = tracker.track(Geometry(std::vector<Vec3>{Vec3(10, 10, 10), Vec3(11, 10, 10)}));
+    EXPECT_FALSE(lost.succeeded);
+    EXPECT_TRUE(Mat3x4::almostEqual(tracker.getPose(), poseBefore, 0, 0));
+}
@@ -175,3 +175,67 @@ TEST(MeshSliceTests, testVertexIntersection) {
     //std::cout<<MeshTopology::MeshTopology(geometry.getFaces());
 }
 
+
+TEST(MeshSliceTests, testSliceStack) {
+    // An open tube along z, with a slanted seam so that slices are a mix of closed and open
+    const int around = 24;
+    const int along = 30;
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    for (int j = 0; j < along; j++) {
+        for (int i = 0; i < around; i++) {
+            float angle = 2.0f * (float)M_PI * i / around;
+            positions.push_back(Vec3(std::cos(angle), std::sin(angle), 0.1f * j + 0.01f * i));
+        }
+    }
+    for (int j = 0; j < along - 1; j++) {
+        for (int i = 0; i < around; i++) {
+            // Leave a slit in the upper half
+            if (j > along / 2 && i == 0) continue;
+            int v00 = j * around + i;
+            int v10 = j * around + (i + 1) % around;
+            faces.push_back(Face3{v00, v10, v10 + around});
+            faces.push_back(Face3{v00, v10 + around, v00 + around});
+        }
+    }
+    Geometry geometry(positions, faces);
+    
+    // Offsets out of order, including ones that miss the tube entirely. None passes exactly
+    // through a vertex, which sliceMesh doesn't handle.
+    std::vector<float> offsets {2.055f, -1.0f, 0.555f, 1.2345f, 10.0f, 0.305f};
+    Vec3 normal(0.0f, 0.0f, 1.0f);
+    standard_cyborg::algorithms::MeshSliceStack stack = standard_cyborg::algorithms::sliceMeshStack(geometry, normal, offsets);
+    
+    ASSERT_EQ(stack.planeCount(), (int)offsets.size());
+    EXPECT_EQ(stack.planeContourOffsets.back(), stack.contourCount());
+    EXPECT_EQ(stack.contourOffsets.back(), (int)stack.points.size());
+    
+    // Each plane's contours match slicing with that plane alone
+    for (int plane = 0; plane < offsets.size(); plane++) {
+        standard_cyborg::sc3d::Plane singlePlane;
+        singlePlane.position = Vec3(0.0f, 0.0f, offsets[plane]);
+        singlePlane.normal = normal;
+        std::vector<Polyline> polylines = standard_cyborg::algorithms::sliceMesh(geometry, singlePlane);
+        
+        int firstContour = stack.planeContourOffsets[plane];
+        ASSERT_EQ(stack.planeContourOffsets[plane + 1] - firstContour, (int)polylines.size());
+        for (int i = 0; i < polylines.size(); i++) {
+            EXPECT_EQ(stack.getContour(firstContour + i), polylines[i]);
+        }
+    }
+    
+    EXPECT_EQ(stack.planeContourOffsets[2] - stack.planeContourOffsets[1], 0);
+    EXPECT_EQ(stack.planeContourOffsets[5] - stack.planeContourOffsets[4], 0);
+    EXPECT_TRUE(stack.getContour(stack.planeContourOffsets[5]).isClosed());
+    EXPECT_FALSE(stack.getContour(stack.planeContourOffsets[0]).isClosed());
+    
+    // Evenly spaced planes
+    standard_cyborg::sc3d::Plane firstPlane;
+    firstPlane.position = Vec3(0.0f, 0.0f, 0.255f);
+    firstPlane.normal = Vec3(0.0f, 0.0f, 2.0f);
+    standard_cyborg::algorithms::MeshSliceStack evenStack = standard_cyborg::algorithms::sliceMeshStack(geometry, firstPlane, 0.1f, 20);
+    EXPECT_EQ(evenStack.planeCount(), 20);
+    for (int plane = 0; plane < 20; plane++) {
+        EXPECT_EQ(evenStack.planeContourOffsets[plane + 1] - evenStack.planeContourOffsets[plane], 1);
+    }
+}
@@ -198,3 +198,80 @@ TEST(MeshSplitterTests, testMeshSplitterEmptyMesh) {
         EXPECT_EQ(standard_cyborg::algorithms::splitMeshIntoPieces(geometry0).size(), 0);
     }
 }
+
+TEST(MeshSplitterTests, testFindMeshComponents) {
+    // Strips of 1, 3 and 2 quads, listed out of order, plus an unused vertex
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    auto addStrip = [&](int quadCount, float z) {
+        int first = (int)positions.size();
+        for (int i = 0; i <= quadCount; i++) {
+            positions.push_back(Vec3{(float)i, 0.0f, z});
+            positions.push_back(Vec3{(float)i, 1.0f, z});
+        }
+        for (int i = 0; i < quadCount; i++) {
+            int v = first + 2 * i;
+            faces.push_back(Face3{v, v + 2, v + 3});
+            faces.push_back(Face3{v, v + 3, v + 1});
+        }
+    };
+    addStrip(1, 0.0f);
+    positions.push_back(Vec3{5.0f, 5.0f, 5.0f});
+    addStrip(3, 1.0f);
+    addStrip(2, 2.0f);
+    std::swap(faces[0], faces.back());
+    
+    Geometry geometry(positions, faces);
+    standard_cyborg::algorithms::MeshComponents components = standard_cyborg::algorithms::findMeshComponents(geometry);
+    
+    EXPECT_EQ(components.componentCount(), 3);
+    EXPECT_EQ(components.componentVertexCounts, std::vector<int>({4, 8, 6}));
+    EXPECT_EQ(components.componentFaceCounts, std::vector<int>({2, 6, 4}));
+    EXPECT_EQ(components.vertexComponents[0], 0);
+    EXPECT_EQ(components.vertexComponents[4], -1);
+    EXPECT_EQ(components.vertexComponents[5], 1);
+    EXPECT_EQ(components.vertexComponents[13], 2);
+    EXPECT_EQ(components.faceComponents[0], 2);
+    EXPECT_EQ(components.faceComponents.back(), 0);
+    
+    std::vector<std::shared_ptr<Geometry>> largest = standard_cyborg::algorithms::extractLargestComponents(geometry, components, 2);
+    ASSERT_EQ(largest.size(), 2);
+    EXPECT_EQ(largest[0]->faceCount(), 6);
+    EXPECT_EQ(largest[0]->vertexCount(), 8);
+    EXPECT_EQ(largest[0]->getPositions()[0], positions[5]);
+    EXPECT_EQ(largest[1]->faceCount(), 4);
+    EXPECT_EQ(largest[1]->vertexCount(), 6);
+    // Vertices are numbered in the order faces reach them, and faces[0] is now the strip's last
+    EXPECT_EQ(largest[1]->getPositions()[0], positions[15]);
+    
+    EXPECT_EQ(standard_cyborg::algorithms::splitMeshIntoPieces(geometry).size(), 3);
+}
+
+TEST(MeshSplitterTests, testManySmallComponents) {
+    // Enough separate triangles to split the union across threads
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    for (int i = 0; i < 20000; i++) {
+        positions.push_back(Vec3{(float)i, 0.0f, 0.0f});
+        positions.push_back(Vec3{(float)i, 1.0f, 0.0f});
+        positions.push_back(Vec3{(float)i, 0.0f, 1.0f});
+        faces.push_back(Face3{3 * i, 3 * i + 1, 3 * i + 2});
+    }
+    // Chain the first hundred into one component
+    for (int i = 0; i < 99; i++) {
+        faces.push_back(Face3{3 * i, 3 * i + 3, 3 * i + 1});
+    }
+    
+    Geometry geometry(positions, faces);
+    standard_cyborg::algorithms::MeshComponents components = standard_cyborg::algorithms::findMeshComponents(geometry);
+    
+    EXPECT_EQ(components.componentCount(), 20000 - 99);
+    EXPECT_EQ(components.componentVertexCounts[0], 300);
+    EXPECT_EQ(components.vertexComponents[3 * 100], 1);
+    EXPECT_EQ(components.vertexComponents.back(), 20000 - 100);
+    
+    std::vector<std::shared_ptr<Geometry>> largest = standard_cyborg::algorithms::extractLargestComponents(geometry, components, 1);
+    ASSERT_EQ(largest.size(), 1);
+    EXPECT_EQ(largest[0]->vertexCount(), 300);
+    EXPECT_EQ(largest[0]->faceCount(), 199);
+}
@@ -93,8 +93,116 @@ TEST(PlaneEstimationTests, testEstimatePlaneFromPointCloud) {
     
     EXPECT_LT(projectedDistanceFromActualPositionToEstimatedPlane, 1e-3);
     
-    // It could go either way, and this happens to detect the opposite normal. I believe maybe this
-    // is determined by the relative orientation of the first and second left singular vectors, but
-    // it's pretty irrelevant (things shouldn't depend on this!) so I've simply negated.
-    EXPECT_LT(Vec3::angleBetween(-result.plane.normal, normal), 1e-2);
+    // The normal could point either way, and which one comes out of the eigen solve is pretty
+    // irrelevant (things shouldn't depend on this!), so compare up to sign.
+    EXPECT_LT(std::min(Vec3::angleBetween(result.plane.normal, normal), Vec3::angleBetween(-result.plane.normal, normal)), 1e-2);
+}
+
+TEST(PlaneEstimationTests, testEstimatePlaneConvergence) {
+    // A noisy plane with clutter around it, from a generator that is the same on every platform
+    std::vector<Vec3> positions;
+    std::minstd_rand re(1);
+    auto uniform = [&]() { return 2.0f * (float)(re() - re.min()) / (float)(re.max() - re.min()) - 1.0f; };
+    
+    for (int i = 0; i < 5000; i++) {
+        float x = uniform();
+        float y = uniform();
+        float noise = 0.005f * (uniform() + uniform() + uniform());
+        positions.push_back(Vec3(x, y, 0.1f * x - 0.2f * y + noise));
+    }
+    for (int i = 0; i < 3000; i++) {
+        float x = uniform();
+        float y = uniform();
+        positions.push_back(Vec3(x, y, 0.5f * uniform()));
+    }
+    
+    // Seeding with clutter as well makes it take many iterations to shed the outliers
+    standard_cyborg::sc3d::VertexSelection seed;
+    for (int i = 0; i < (int)positions.size(); i += 7) {
+        seed.insertValue(i);
+    }
+    
+    // These pin the inlier sets and RMS values the original SVD-based implementation produced
+    auto estimate = [&](int maxIterations, float absoluteConvergenceTolerance) {
+        return standard_cyborg::algorithms::estimatePlane(positions, seed, maxIterations, 5.0f, 1e-4f, absoluteConvergenceTolerance);
+    };
+    
+    standard_cyborg::algorithms::EstimatePlaneResult converged = estimate(20, 1e-7f);
+    EXPECT_EQ(converged.planeVertices->size(), 5077);
+    EXPECT_NEAR(converged.rmsProjectedDistance, 0.00286314f, 1e-7f);
+    
+    // The inliers settle after 16 iterations and the RMS after 17
+    EXPECT_EQ(estimate(15, 1e-7f).planeVertices->size(), 5080);
+    EXPECT_TRUE(*estimate(16, 1e-7f).planeVertices == *converged.planeVertices);
+    EXPECT_NEAR(estimate(16, 1e-7f).rmsProjectedDistance, 0.00286951f, 1e-7f);
+    EXPECT_TRUE(*estimate(40, 1e-7f).planeVertices == *converged.planeVertices);
+    
+    // absoluteConvergenceTolerance is on the same scale as rmsProjectedDistance, so one between the
+    // 16th and 15th iterations' RMS stops after the 16th fit, before the inliers are recomputed
+    standard_cyborg::algorithms::EstimatePlaneResult stoppedEarly = estimate(20, 0.0029f);
+    EXPECT_EQ(stoppedEarly.planeVertices->size(), 5080);
+    EXPECT_NEAR(stoppedEarly.rmsProjectedDistance, 0.00286951f, 1e-7f);
+}
+
+TEST(PlaneEstimationTests, testExtractPlanes) {
+    std::vector<Vec3> positions;
+    
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> noise(-0.002f, 0.002f);
+    std::default_random_engine re;
+    re.seed(0);
+    
+    // A floor at y = 0, a wall at z = -2, a small table top at y = 0.7, and clutter
+    for (int i = 0; i < 20000; i++) {
+        positions.push_back(Vec3(2.0f * uniform(re), noise(re), 2.0f * uniform(re)));
+    }
+    for (int i = 0; i < 12000; i++) {
+        positions.push_back(Vec3(2.0f * uniform(re), 1.0f + uniform(re), -2.0f + noise(re)));
+    }
+    for (int i = 0; i < 4000; i++) {
+        positions.push_back(Vec3(0.5f + 0.4f * uniform(re), 0.7f + noise(re), 0.4f * uniform(re)));
+    }
+    for (int i = 0; i < 3000; i++) {
+        positions.push_back(Vec3(2.0f * uniform(re), 1.0f + uniform(re), 2.0f * uniform(re)));
+    }
+    
+    standard_cyborg::algorithms::ExtractPlanesParameters parameters;
+    parameters.inlierDistance = 0.01f;
+    parameters.minInlierCount = 1000;
+    parameters.maxPlanes = 5;
+    
+    std::vector<standard_cyborg::algorithms::EstimatePlaneResult> planes = standard_cyborg::algorithms::extractPlanes(positions, parameters);
+    
+    // The clutter holds no plane of 1000 points, so exactly three are found, largest first
+    ASSERT_EQ(planes.size(), 3);
+    
+    std::vector<Vec3> expectedNormals {{0, 1, 0}, {0, 0, 1}, {0, 1, 0}};
+    std::vector<float> expectedOffsets {0.0f, -2.0f, 0.7f};
+    std::vector<int> expectedCounts {20000, 12000, 4000};
+    
+    for (int i = 0; i < 3; i++) {
+        const auto& plane = planes[i].plane;
+        EXPECT_GT(std::abs(Vec3::dot(plane.normal, expectedNormals[i])), 0.999f);
+        EXPECT_NEAR(Vec3::dot(plane.position, expectedNormals[i]), expectedOffsets[i], 1e-3);
+        EXPECT_LT(planes[i].rmsProjectedDistance, 0.002f);
+        
+        // Nearly every point of the plane, less the wall's strip along the already claimed floor,
+        // and only a few stray clutter points besides
+        int count = planes[i].planeVertices->size();
+        EXPECT_GT(count, expectedCounts[i] - 150);
+        EXPECT_LT(count, expectedCounts[i] + 100);
+    }
+    
+    // The floor's noise is uniform on [-0.002, 0.002], so its RMS is 0.002 / sqrt(3), and a further
+    // sqrt(3) smaller taken over all three coordinates. estimatePlane reports the same for it.
+    float noiseRMS = 0.002f / 3.0f;
+    std::vector<Vec3> floor(positions.begin(), positions.begin() + 20000);
+    EXPECT_NEAR(planes[0].rmsProjectedDistance, noiseRMS, 1e-4f);
+    EXPECT_NEAR(standard_cyborg::algorithms::estimatePlane(floor).rmsProjectedDistance, noiseRMS, 1e-4f);
+    
+    // No point is claimed twice
+    standard_cyborg::sc3d::VertexSelection overlap;
+    overlap.copy(*planes[0].planeVertices);
+    overlap.intersectWith(*planes[1].planeVertices);
+    EXPECT_EQ(overlap.size(), 0);
 }
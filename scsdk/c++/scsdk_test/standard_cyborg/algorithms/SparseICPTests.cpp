@@ -17,6 +17,8 @@
 
 #include <gtest/gtest.h>
 
+#include <vector>
+
 
 #include "standard_cyborg/algorithms/SparseICPWrapper.hpp"
 
@@ -24,6 +26,7 @@
 #include "standard_cyborg/sc3d/Geometry.hpp"
 #include "standard_cyborg/math/Mat3x4.hpp"
 #include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/test_helpers/TestHelpers.hpp"
 
 using standard_cyborg::math::Mat3x4;
 using standard_cyborg::math::Vec3;
@@ -69,3 +72,42 @@ TEST(SparseICP, testSparseICP) {
         0, 0, 1, +0.01
     }), 1.0e-6, 1.0e-6));
 }
+
+// Two units across, with gentle bumps
+static Geometry makeBumpySurface(int resolution, float offset)
+{
+    return standard_cyborg::makeBumpySurface(resolution, offset, 1.0f, 0.3f, 2.0f, 3.0f);
+}
+
+TEST(SparseICP, testSparseICPFloatCoarseToFine) {
+    Geometry target = makeBumpySurface(50, 0.0f);
+    standard_cyborg::algorithms::SparseICPTarget preparedTarget(target);
+    
+    standard_cyborg::algorithms::SparseICPParameters pars;
+    pars.p = 0.5;
+    pars.max_icp = 40;
+    pars.stop = 1e-5;
+    pars.max_outer = 30;
+    pars.levels = 3;
+    
+    std::vector<Mat3x4> motions {
+        Mat3x4::fromTranslation(Vec3(0.03f, -0.02f, 0.04f)) * Mat3x4::fromRotationZ(0.05f) * Mat3x4::fromRotationX(0.03f),
+        Mat3x4::fromTranslation(Vec3(-0.02f, 0.03f, -0.01f)) * Mat3x4::fromRotationY(-0.04f),
+    };
+    
+    // Several sources, sampled differently from the target, reuse one prepared target
+    for (const Mat3x4& motion : motions) {
+        Geometry source = makeBumpySurface(32, 0.37f);
+        source.transform(motion);
+        
+        Mat3x4 alignment = standard_cyborg::algorithms::SparseICPPointToPlane(source, preparedTarget, pars);
+        
+        // Undoing the motion puts every source point back where it was sampled
+        Geometry original = makeBumpySurface(32, 0.37f);
+        const std::vector<Vec3>& moved = source.getPositions();
+        const std::vector<Vec3>& expected = original.getPositions();
+        for (int i = 0; i < moved.size(); i += 67) {
+            EXPECT_LT(Vec3::distanceBetween(alignment * moved[i], expected[i]), 5e-3);
+        }
+    }
+}
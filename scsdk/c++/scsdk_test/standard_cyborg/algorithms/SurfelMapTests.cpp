@@ -0,0 +1,98 @@
+/*
+ Copyright 2020 Standard Cyborg
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "standard_cyborg/algorithms/SurfelMap.hpp"
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+
+using standard_cyborg::algorithms::SurfelMap;
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Geometry;
+
+TEST(SurfelMapTests, testIntegrateFrames) {
+    SurfelMap map(1.0f);
+    
+    // Two frames seeing the same two voxels, plus one voxel only the second frame sees
+    Geometry frame1({{0.2, 0.2, 0.2}, {5.5, 0.5, 0.5}},
+                    {{0, 0, 2}, {0, 1, 0}},
+                    {{1, 0, 0}, {0, 0, 0}});
+    Geometry frame2({{0.4, 0.6, 0.8}, {5.5, 0.5, 0.5}, {-0.5, 0.5, 0.5}},
+                    {{0, 2, 0}, {0, 1, 0}, {1, 0, 0}},
+                    {{0, 1, 0}, {0, 0, 0}, {1, 1, 1}});
+    
+    EXPECT_EQ(map.integrate(frame1), 2);
+    EXPECT_EQ(map.integrate(frame2), 3);
+    EXPECT_EQ(map.surfelCount(), 3);
+    EXPECT_EQ(map.getSurfelWeight(0), 2);
+    EXPECT_EQ(map.getSurfelWeight(2), 1);
+    
+    std::unique_ptr<Geometry> surfels = map.toGeometry();
+    ASSERT_EQ(surfels->vertexCount(), 3);
+    ASSERT_TRUE(surfels->hasNormals());
+    ASSERT_TRUE(surfels->hasColors());
+    
+    const std::vector<Vec3>& positions = surfels->getPositions();
+    const std::vector<Vec3>& normals = surfels->getNormals();
+    const std::vector<Vec3>& colors = surfels->getColors();
+    
+    EXPECT_LT(Vec3::distanceBetween(positions[0], Vec3(0.3, 0.4, 0.5)), 1e-6);
+    EXPECT_LT(Vec3::distanceBetween(positions[1], Vec3(5.5, 0.5, 0.5)), 1e-6);
+    EXPECT_LT(Vec3::distanceBetween(positions[2], Vec3(-0.5, 0.5, 0.5)), 1e-6);
+    
+    // Normal directions average, but keep their average length
+    EXPECT_LT(Vec3::distanceBetween(normals[0], Vec3(0, std::sqrt(2.0f), std::sqrt(2.0f))), 1e-5);
+    EXPECT_LT(Vec3::distanceBetween(colors[0], Vec3(0.5, 0.5, 0)), 1e-6);
+}
+
+TEST(SurfelMapTests, testMemoryBoundedByVoxels) {
+    SurfelMap map(0.1f);
+    
+    std::vector<Vec3> positions;
+    for (int i = 0; i < 50; i++) {
+        for (int j = 0; j < 50; j++) {
+            positions.push_back(Vec3(i * 0.1f + 0.05f, j * 0.1f + 0.05f, 0.05f));
+        }
+    }
+    
+    // Re-observing the same surface many times, with a little jitter, adds no surfels
+    for (int frame = 0; frame < 20; frame++) {
+        std::vector<Vec3> jittered(positions);
+        for (Vec3& position : jittered) {
+            position += Vec3(0.01f * std::sin(frame * 1.7f), 0.01f * std::cos(frame * 2.3f), 0.0f);
+        }
+        EXPECT_EQ(map.integrate(Geometry(jittered)), (int)positions.size());
+    }
+    
+    EXPECT_EQ(map.surfelCount(), (int)positions.size());
+    EXPECT_EQ(map.getSurfelWeight(0), 20);
+    
+    // Points the map can't place are skipped
+    EXPECT_EQ(map.integrate(Geometry(std::vector<Vec3>{Vec3(NAN, 0, 0), Vec3(1e9, 0, 0)})), 0);
+    EXPECT_EQ(map.surfelCount(), (int)positions.size());
+    
+    std::unique_ptr<Geometry> surfels = map.toGeometry();
+    EXPECT_EQ(surfels->vertexCount(), (int)positions.size());
+    EXPECT_FALSE(surfels->hasNormals());
+    EXPECT_FALSE(surfels->hasColors());
+    
+    map.clear();
+    EXPECT_EQ(map.surfelCount(), 0);
+}
@@ -20,6 +20,7 @@
 #include "standard_cyborg/algorithms/Vec3KMeans.hpp"
 
 #import <cmath>
+#import <random>
 #import <vector>
 
 //#import <StandardCyborgData/DataUtils.hpp>
@@ -77,3 +78,100 @@ TEST(Vec3KMeansTests, testKMeansWithUnspecifiedK) {
     EXPECT_EQ(result.iterations, 8);
     EXPECT_EQ(result.counts, std::vector<int>({40, 7, 8, 12, 21, 6, 6}));
 }
+
+namespace {
+
+// Gaussian blobs around a handful of well-separated centers
+std::vector<Vec3> makeBlobs(const std::vector<Vec3>& centers, int pointsPerBlob, float spread, int seed)
+{
+    std::mt19937 prng(seed);
+    std::normal_distribution<float> noise(0.0f, spread);
+    
+    std::vector<Vec3> points;
+    for (int i = 0; i < pointsPerBlob; i++) {
+        for (const Vec3& center : centers) {
+            points.push_back(center + Vec3(noise(prng), noise(prng), noise(prng)));
+        }
+    }
+    
+    return points;
+}
+
+int nearestCentroid(const Vec3& point, const std::vector<Vec3>& centroids)
+{
+    int bestIndex = 0;
+    for (int j = 1; j < centroids.size(); j++) {
+        if ((centroids[j] - point).squaredNorm() < (centroids[bestIndex] - point).squaredNorm()) {
+            bestIndex = j;
+        }
+    }
+    return bestIndex;
+}
+
+} // namespace
+
+TEST(Vec3KMeansTests, testKMeansMatchesLloyd) {
+    std::vector<Vec3> centers {{0, 0, 0}, {5, 0, 0}, {0, 5, 0}, {0, 0, 5}, {5, 5, 5}};
+    std::vector<Vec3> positions = makeBlobs(centers, 2000, 1.0f, 1);
+    int n = static_cast<int>(positions.size());
+    
+    auto result = standard_cyborg::algorithms::Vec3KMeans::compute(positions.data(), positions.size(), 12);
+    
+    EXPECT_TRUE(result.converged);
+    EXPECT_EQ(result.centroids.size(), 12);
+    EXPECT_EQ(result.assignments.size(), n);
+    
+    // At a fixed point of Lloyd's algorithm, every point is assigned to its nearest centroid...
+    std::vector<Vec3> sums(12, Vec3());
+    std::vector<int> counts(12, 0);
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(result.assignments[i], nearestCentroid(positions[i], result.centroids));
+        sums[result.assignments[i]] += positions[i];
+        counts[result.assignments[i]]++;
+    }
+    
+    // ...and every centroid is the mean of its points
+    EXPECT_EQ(result.counts, counts);
+    for (int j = 0; j < 12; j++) {
+        ASSERT_GT(counts[j], 0);
+        EXPECT_LT((sums[j] / (float)counts[j] - result.centroids[j]).norm(), 1e-3);
+    }
+    
+    // Passing the vector itself reads the same points
+    auto vectorResult = standard_cyborg::algorithms::Vec3KMeans::compute(positions, 12);
+    EXPECT_EQ(vectorResult.assignments, result.assignments);
+    EXPECT_EQ(vectorResult.iterations, result.iterations);
+}
+
+TEST(Vec3KMeansTests, testMiniBatchKMeans) {
+    std::vector<Vec3> centers {{0, 0, 0}, {10, 0, 0}, {0, 10, 0}, {0, 0, 10}};
+    std::vector<Vec3> positions = makeBlobs(centers, 5000, 0.5f, 2);
+    int n = static_cast<int>(positions.size());
+    
+    auto result = standard_cyborg::algorithms::Vec3KMeans::computeMiniBatch(positions, 4, 256, 200);
+    
+    EXPECT_EQ(result.centroids.size(), 4);
+    EXPECT_EQ(result.assignments.size(), n);
+    EXPECT_GT(result.iterations, 0);
+    EXPECT_LE(result.iterations, 200);
+    
+    // Every true center is found by exactly one centroid
+    std::vector<int> matches(4, 0);
+    for (const Vec3& center : centers) {
+        int j = nearestCentroid(center, result.centroids);
+        EXPECT_LT((result.centroids[j] - center).norm(), 0.2);
+        matches[j]++;
+    }
+    EXPECT_EQ(matches, std::vector<int>({1, 1, 1, 1}));
+    
+    // The final pass assigns every point, not just the sampled ones
+    int total = 0;
+    for (int i = 0; i < n; i++) {
+        ASSERT_EQ(result.assignments[i], nearestCentroid(positions[i], result.centroids));
+    }
+    for (int count : result.counts) {
+        EXPECT_EQ(count, n / 4);
+        total += count;
+    }
+    EXPECT_EQ(total, n);
+}
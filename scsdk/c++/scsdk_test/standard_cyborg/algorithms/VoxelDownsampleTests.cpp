@@ -0,0 +1,111 @@
+/*
+ Copyright 2020 Standard Cyborg
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "standard_cyborg/algorithms/VoxelDownsample.hpp"
+#include "standard_cyborg/math/Vec3.hpp"
+#include "standard_cyborg/sc3d/Geometry.hpp"
+
+using standard_cyborg::algorithms::VoxelDownsampleResult;
+using standard_cyborg::algorithms::voxelDownsample;
+using standard_cyborg::math::Vec3;
+using standard_cyborg::sc3d::Geometry;
+
+static void expectNear(const Vec3& actual, const Vec3& expected)
+{
+    EXPECT_NEAR(actual.x, expected.x, 1e-6f);
+    EXPECT_NEAR(actual.y, expected.y, 1e-6f);
+    EXPECT_NEAR(actual.z, expected.z, 1e-6f);
+}
+
+TEST(VoxelDownsampleTests, testAveragesPerVoxel) {
+    // Two points in the voxel at the origin, one in the voxel below, and one that can't be bucketed
+    Geometry pointCloud({{0.2, 0.2, 0.2}, {0.5, -0.5, -0.2}, {0.4, 0.6, 0.8}, {NAN, 0, 0}},
+                        {{0, 0, 2}, {0, 1, 0}, {0, 2, 0}, {1, 0, 0}},
+                        {{1, 0, 0}, {0, 0, 0}, {0, 1, 0}, {1, 1, 1}});
+    
+    VoxelDownsampleResult result = voxelDownsample(pointCloud, 1.0f);
+    const Geometry& geometry = *result.geometry;
+    
+    // Voxels come out with z varying slowest, so the lower one is first
+    ASSERT_EQ(geometry.vertexCount(), 2);
+    EXPECT_EQ(result.sourceToCell, std::vector<int>({1, 0, 1, -1}));
+    
+    expectNear(geometry.getPositions()[0], Vec3(0.5, -0.5, -0.2));
+    expectNear(geometry.getPositions()[1], Vec3(0.3, 0.4, 0.5));
+    expectNear(geometry.getColors()[1], Vec3(0.5, 0.5, 0));
+    
+    // Directions average to the diagonal and lengths to their mean
+    expectNear(geometry.getNormals()[1], Vec3(0, std::sqrt(2.0f), std::sqrt(2.0f)));
+}
+
+TEST(VoxelDownsampleTests, testWeightedAverage) {
+    Geometry pointCloud(std::vector<Vec3>({{0.1, 0.1, 0.1}, {0.9, 0.1, 0.1}}));
+    
+    VoxelDownsampleResult result = voxelDownsample(pointCloud, 1.0f, {3.0f, 1.0f});
+    
+    ASSERT_EQ(result.geometry->vertexCount(), 1);
+    EXPECT_FALSE(result.geometry->hasNormals());
+    expectNear(result.geometry->getPositions()[0], Vec3(0.3, 0.1, 0.1));
+}
+
+TEST(VoxelDownsampleTests, testLargeCloud) {
+    // Enough points for the sort to take several chunks, in voxels either side of the origin
+    std::mt19937 generator(3);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<Vec3> positions(300000);
+    for (Vec3& position : positions) {
+        position = Vec3(distribution(generator), distribution(generator), distribution(generator));
+    }
+    
+    float voxelSize = 0.25f;
+    VoxelDownsampleResult result = voxelDownsample(Geometry(positions), voxelSize);
+    const std::vector<Vec3>& cellPositions = result.geometry->getPositions();
+    
+    ASSERT_EQ(cellPositions.size(), 512);
+    
+    std::vector<int> cellSizes(cellPositions.size());
+    for (int i = 0; i < (int)positions.size(); i++) {
+        int cell = result.sourceToCell[i];
+        ASSERT_GE(cell, 0);
+        cellSizes[cell]++;
+        
+        // Each point shares a voxel with its cell's centroid
+        EXPECT_EQ(std::floor(positions[i].x / voxelSize), std::floor(cellPositions[cell].x / voxelSize));
+        EXPECT_EQ(std::floor(positions[i].y / voxelSize), std::floor(cellPositions[cell].y / voxelSize));
+        EXPECT_EQ(std::floor(positions[i].z / voxelSize), std::floor(cellPositions[cell].z / voxelSize));
+    }
+    
+    for (int cellSize : cellSizes) {
+        EXPECT_GT(cellSize, 400);
+    }
+    
+    // Cells are in voxel order, z slowest then y then x
+    for (int cell = 1; cell < (int)cellPositions.size(); cell++) {
+        const Vec3& previous = cellPositions[cell - 1];
+        const Vec3& current = cellPositions[cell];
+        auto voxel = [voxelSize](const Vec3& p) {
+            return std::make_tuple(std::floor(p.z / voxelSize), std::floor(p.y / voxelSize), std::floor(p.x / voxelSize));
+        };
+        EXPECT_LT(voxel(previous), voxel(current));
+    }
+}
@@ -18,8 +18,12 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <thread>
+
 #include "standard_cyborg/sc3d/Geometry.hpp"
 #include "standard_cyborg/sc3d/Face3.hpp"
+#include "standard_cyborg/sc3d/MeshTopology.hpp"
 #include "standard_cyborg/sc3d/VertexSelection.hpp"
 
 #include "standard_cyborg/util/DebugHelpers.hpp"
@@ -27,6 +31,7 @@
 using standard_cyborg::sc3d::Geometry;
 using standard_cyborg::sc3d::VertexSelection;
 using standard_cyborg::sc3d::Face3;
+using standard_cyborg::sc3d::SurfacePointResult;
 
 namespace math = standard_cyborg::math;
 using math::Vec4;
@@ -433,6 +438,107 @@ TEST(GeometryTests, testPointsInRadius)
     EXPECT_EQ(closest.size(), 1);
 }
 
+TEST(GeometryTests, testBatchedNeighborQueries)
+{
+    std::vector<Vec3> positions;
+    for (int i = 0; i < 1000; i++) {
+        positions.push_back({(float)(i % 10), (float)((i / 10) % 10), (float)(i / 100)});
+    }
+    
+    Geometry geometry(positions);
+    
+    std::vector<Vec3> queries;
+    for (int i = 0; i < 2000; i++) {
+        queries.push_back({0.37f * (i % 29), 0.41f * (i % 23), 0.53f * (i % 19)});
+    }
+    
+    standard_cyborg::sc3d::NeighborQueryResult knn;
+    geometry.getNClosestVertexIndices(queries, 4, knn);
+    
+    EXPECT_EQ(knn.queryCount(), (int)queries.size());
+    EXPECT_EQ(knn.indices.size(), queries.size() * 4);
+    for (int i = 0; i < (int)queries.size(); i++) {
+        EXPECT_EQ(knn.neighborCount(i), 4);
+        EXPECT_EQ(knn.indices[knn.offsets[i]], geometry.getClosestVertexIndex(queries[i]));
+        EXPECT_NEAR(knn.squaredDistances[knn.offsets[i]], Vec3::squaredDistanceBetween(queries[i], positions[knn.indices[knn.offsets[i]]]), 1e-4);
+    }
+    
+    // Asking for more neighbors than there are vertices clamps to the vertex count
+    Geometry small(std::vector<Vec3>{{0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}});
+    small.getNClosestVertexIndices(queries, 5, knn);
+    EXPECT_EQ(knn.neighborCount(0), 2);
+    
+    standard_cyborg::sc3d::NeighborQueryResult inRadius;
+    geometry.getVertexIndicesInRadius(queries, 1.5f, inRadius);
+    
+    EXPECT_EQ(inRadius.queryCount(), (int)queries.size());
+    for (int i = 0; i < (int)queries.size(); i++) {
+        std::vector<int> expected = geometry.getVertexIndicesInRadius(queries[i], 1.5f);
+        std::vector<int> actual(inRadius.indices.begin() + inRadius.offsets[i], inRadius.indices.begin() + inRadius.offsets[i + 1]);
+        std::sort(expected.begin(), expected.end());
+        std::sort(actual.begin(), actual.end());
+        EXPECT_EQ(actual, expected);
+    }
+}
+
+TEST(GeometryTests, testConcurrentQueries)
+{
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    for (int i = 0; i < 100; i++) {
+        positions.push_back({(float)i, 0.0f, 0.0f});
+        positions.push_back({(float)i, 1.0f, 0.0f});
+    }
+    for (int i = 0; i < 99; i++) {
+        faces.push_back({2 * i, 2 * i + 2, 2 * i + 1});
+        faces.push_back({2 * i + 1, 2 * i + 2, 2 * i + 3});
+    }
+    
+    const Geometry geometry(positions, faces);
+    
+    // Threads race to lazily build the kd-tree and the BVH on the same const Geometry
+    std::vector<int> failures(8, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < (int)failures.size(); t++) {
+        threads.emplace_back([&geometry, &failures, t]() {
+            for (int i = 0; i < 99; i++) {
+                if (t % 2 == 0) {
+                    if (geometry.getClosestVertexIndex(Vec3{(float)i, 0.9f, 0.0f}) != 2 * i + 1) failures[t]++;
+                } else {
+                    auto hit = geometry.rayTrace(Vec3{i + 0.25f, 0.5f, 1.0f}, Vec3{0.0f, 0.0f, -1.0f});
+                    if (hit.index < 0 || std::abs(hit.t - 1.0f) > 1e-5f) failures[t]++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    
+    for (int failureCount : failures) {
+        EXPECT_EQ(failureCount, 0);
+    }
+}
+
+TEST(GeometryTests, testQueriesAfterCopy)
+{
+    std::vector<Vec3> positions{
+        {+1.0f, +2.0f, +3.0f},
+        {+6.0f, +7.0f, +8.0f},
+        {-2.0f, -1.0f, -6.0f},
+    };
+    
+    Geometry original(positions);
+    EXPECT_EQ(original.getClosestVertexIndex(Vec3{-2.1f, -1.0f, -6.0f}), 2);
+    
+    Geometry copyConstructed(original);
+    EXPECT_EQ(copyConstructed.getClosestVertexIndex(Vec3{+6.1f, +7.0f, +8.0f}), 1);
+    
+    // Copying into a Geometry that has already built its kd-tree must invalidate it
+    Geometry copied(std::vector<Vec3>{{+6.0f, +7.0f, +8.0f}});
+    EXPECT_EQ(copied.getClosestVertexIndex(Vec3{-2.1f, -1.0f, -6.0f}), 0);
+    copied.copy(original);
+    EXPECT_EQ(copied.getClosestVertexIndex(Vec3{-2.1f, -1.0f, -6.0f}), 2);
+}
+
 TEST(GeometryTests, testDeleteVertices)
 {
     std::vector<Vec3> positions{
@@ -756,3 +862,628 @@ TEST(GeometryTests, testRayTrace)
         EXPECT_EQ(result.index, 1);
     }
 }
+
+TEST(GeometryTests, testRayTraceBatch)
+{
+    // A wavy strip of triangles so that rays hit at a range of depths
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    for (int i = 0; i < 50; i++) {
+        float z = 0.5f * std::sin(0.3f * i);
+        positions.push_back({(float)i, 0.0f, z});
+        positions.push_back({(float)i, 10.0f, -z});
+    }
+    for (int i = 0; i < 49; i++) {
+        faces.push_back({2 * i, 2 * i + 2, 2 * i + 1});
+        faces.push_back({2 * i + 1, 2 * i + 2, 2 * i + 3});
+    }
+    
+    Geometry geometry(positions, faces);
+    
+    // A grid of rays from a single pinhole, some of which miss the strip entirely
+    Vec3 eye{25.0f, 5.0f, 20.0f};
+    std::vector<Vec3> origins{eye};
+    std::vector<Vec3> directions;
+    for (int row = 0; row < 40; row++) {
+        for (int col = 0; col < 80; col++) {
+            Vec3 target{-10.0f + 70.0f * col / 79.0f, -2.0f + 14.0f * row / 39.0f, 0.0f};
+            directions.push_back(Vec3::normalize(target - eye));
+        }
+    }
+    
+    std::vector<standard_cyborg::sc3d::RayTraceResult> results;
+    geometry.rayTraceBatch(origins, directions, results);
+    
+    ASSERT_EQ(results.size(), directions.size());
+    
+    int hitCount = 0;
+    for (int i = 0; i < (int)directions.size(); i++) {
+        standard_cyborg::sc3d::RayTraceResult expected = geometry.rayTrace(eye, directions[i]);
+        
+        EXPECT_EQ(results[i].index, expected.index);
+        if (expected.index >= 0) {
+            hitCount++;
+            EXPECT_NEAR(results[i].t, expected.t, 1e-4);
+            EXPECT_TRUE(Vec3::almostEqual(results[i].hitPoint, expected.hitPoint, 1e-4, 1e-4));
+        } else {
+            EXPECT_EQ(results[i].t, expected.t);
+        }
+    }
+    EXPECT_GT(hitCount, 0);
+    EXPECT_LT(hitCount, (int)directions.size());
+    
+    // Per-ray origins
+    std::vector<Vec3> perRayOrigins(directions.size(), eye);
+    std::vector<standard_cyborg::sc3d::RayTraceResult> perRayResults;
+    geometry.rayTraceBatch(perRayOrigins, directions, perRayResults);
+    for (int i = 0; i < (int)directions.size(); i++) {
+        EXPECT_EQ(perRayResults[i].index, results[i].index);
+    }
+    
+    // Point clouds never report a hit, and miss just as rayTrace does
+    Geometry pointCloud(positions);
+    pointCloud.rayTraceBatch(origins, directions, results);
+    for (int i = 0; i < (int)directions.size(); i++) {
+        standard_cyborg::sc3d::RayTraceResult expected = pointCloud.rayTrace(eye, directions[i]);
+        EXPECT_EQ(results[i].index, -1);
+        EXPECT_EQ(results[i].t, expected.t);
+    }
+}
+
+static void expectSameQueryResults(const Geometry& geometry, const Geometry& reference)
+{
+    for (int i = 0; i < 200; i++) {
+        // Irrational-ish offsets keep distances from tying on the grid
+        Vec3 query{0.37f * (i % 20) + 0.013f * i, 0.41f * (i / 10) + 0.007f * i, 0.5f * std::sin(0.1f * i)};
+        
+        EXPECT_EQ(geometry.getNClosestVertexIndices(query, 6), reference.getNClosestVertexIndices(query, 6));
+        
+        std::vector<int> inRadius = geometry.getVertexIndicesInRadius(query, 1.5f);
+        std::vector<int> expectedInRadius = reference.getVertexIndicesInRadius(query, 1.5f);
+        std::sort(inRadius.begin(), inRadius.end());
+        std::sort(expectedInRadius.begin(), expectedInRadius.end());
+        EXPECT_EQ(inRadius, expectedInRadius);
+        
+        Vec3 rayOrigin{query.x, query.y, 10.0f};
+        standard_cyborg::sc3d::RayTraceResult hit = geometry.rayTrace(rayOrigin, Vec3{0.0f, 0.0f, -1.0f});
+        standard_cyborg::sc3d::RayTraceResult expectedHit = reference.rayTrace(rayOrigin, Vec3{0.0f, 0.0f, -1.0f});
+        // Rays through a shared edge may report either triangle, so compare hits by depth
+        EXPECT_EQ(hit.index >= 0, expectedHit.index >= 0);
+        if (expectedHit.index >= 0) {
+            EXPECT_NEAR(hit.t, expectedHit.t, 1e-5);
+        }
+    }
+}
+
+static void makeGrid(int gridSize, std::vector<Vec3>& positions, std::vector<Face3>& faces)
+{
+    for (int y = 0; y < gridSize; y++) {
+        for (int x = 0; x < gridSize; x++) {
+            positions.push_back({0.5f * x, 0.5f * y, 0.0f});
+        }
+    }
+    for (int y = 0; y < gridSize - 1; y++) {
+        for (int x = 0; x < gridSize - 1; x++) {
+            int i = y * gridSize + x;
+            faces.push_back({i, i + 1, i + gridSize});
+            faces.push_back({i + 1, i + gridSize + 1, i + gridSize});
+        }
+    }
+}
+
+TEST(GeometryTests, testDeleteVerticesFromLargeGeometry)
+{
+    // Large enough for the renumbering and compaction to be split across threads
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeGrid(150, positions, faces);
+    
+    int vertexCount = (int)positions.size();
+    std::vector<Vec3> normals(vertexCount);
+    std::vector<Vec3> colors(vertexCount);
+    std::vector<Vec2> texCoords(vertexCount);
+    for (int i = 0; i < vertexCount; i++) {
+        normals[i] = Vec3(0.0f, 0.0f, (float)i);
+        colors[i] = Vec3((float)i, 0.0f, 0.0f);
+        texCoords[i] = Vec2((float)i, 1.0f);
+    }
+    
+    Geometry geometry(positions, normals, colors, faces);
+    geometry.setTexCoords(texCoords);
+    Geometry copy;
+    copy.copy(geometry);
+    
+    std::vector<int> deletedIndices;
+    for (int i = 0; i < vertexCount; i += 3) {
+        deletedIndices.push_back((i * 7919) % vertexCount);
+    }
+    VertexSelection selection(geometry, deletedIndices);
+    
+    // Reference result, renumbering with a plain serial loop
+    std::vector<int> renumbering(vertexCount, -1);
+    std::vector<Vec3> expectedPositions;
+    std::vector<Vec3> expectedNormals;
+    std::vector<Vec3> expectedColors;
+    std::vector<Vec2> expectedTexCoords;
+    for (int i = 0; i < vertexCount; i++) {
+        if (selection.contains(i)) continue;
+        renumbering[i] = (int)expectedPositions.size();
+        expectedPositions.push_back(positions[i]);
+        expectedNormals.push_back(normals[i]);
+        expectedColors.push_back(colors[i]);
+        expectedTexCoords.push_back(texCoords[i]);
+    }
+    std::vector<Face3> expectedFaces;
+    for (const Face3& face : faces) {
+        if (renumbering[face[0]] < 0 || renumbering[face[1]] < 0 || renumbering[face[2]] < 0) continue;
+        expectedFaces.push_back(Face3(renumbering[face[0]], renumbering[face[1]], renumbering[face[2]]));
+    }
+    
+    geometry.deleteVertices(selection);
+    EXPECT_EQ(geometry.getPositions(), expectedPositions);
+    EXPECT_EQ(geometry.getNormals(), expectedNormals);
+    EXPECT_EQ(geometry.getColors(), expectedColors);
+    EXPECT_EQ(geometry.getTexCoords(), expectedTexCoords);
+    EXPECT_EQ(geometry.getFaces(), expectedFaces);
+    
+    Geometry reference(expectedPositions, expectedNormals, expectedColors, expectedFaces);
+    expectSameQueryResults(geometry, reference);
+    
+    // Geometries sharing the deleted-from buffers keep their data
+    EXPECT_EQ(copy.getPositions(), positions);
+    EXPECT_EQ(copy.getFaces(), faces);
+}
+
+static void makeUnitCube(std::vector<Vec3>& positions, std::vector<Face3>& faces)
+{
+    // Vertex i is at (i & 1, (i >> 1) & 1, (i >> 2) & 1); faces wind counterclockwise seen from outside
+    for (int i = 0; i < 8; i++) {
+        positions.push_back(Vec3((float)(i & 1), (float)((i >> 1) & 1), (float)((i >> 2) & 1)));
+    }
+    faces = {
+        {0, 2, 3}, {0, 3, 1},
+        {4, 5, 7}, {4, 7, 6},
+        {0, 1, 5}, {0, 5, 4},
+        {2, 6, 7}, {2, 7, 3},
+        {0, 4, 6}, {0, 6, 2},
+        {1, 3, 7}, {1, 7, 5},
+    };
+}
+
+TEST(GeometryTests, testClosestSurfacePoints)
+{
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeUnitCube(positions, faces);
+    Geometry cube(positions, faces);
+    
+    std::vector<Vec3> queries;
+    for (float x = -0.95f; x < 2.0f; x += 0.3f) {
+        for (float y = -0.95f; y < 2.0f; y += 0.3f) {
+            for (float z = -0.95f; z < 2.0f; z += 0.3f) {
+                queries.push_back(Vec3(x, y, z));
+            }
+        }
+    }
+    
+    std::vector<SurfacePointResult> results;
+    cube.getClosestSurfacePoints(queries, results, true);
+    ASSERT_EQ(results.size(), queries.size());
+    
+    for (size_t i = 0; i < queries.size(); i++) {
+        const Vec3& query = queries[i];
+        const SurfacePointResult& result = results[i];
+        
+        // The distance to the cube's surface, negative inside
+        Vec3 outside = Vec3::max(Vec3(0.0f, 0.0f, 0.0f), Vec3::max(-1.0f * query, query - Vec3(1.0f, 1.0f, 1.0f)));
+        float insideDistance = std::min({query.x, query.y, query.z, 1.0f - query.x, 1.0f - query.y, 1.0f - query.z});
+        float expectedDistance = outside.norm() > 0.0f ? outside.norm() : -insideDistance;
+        
+        EXPECT_NEAR(result.distance, expectedDistance, 1e-5f);
+        EXPECT_NEAR(Vec3::distanceBetween(query, result.point), std::abs(expectedDistance), 1e-5f);
+        
+        ASSERT_GE(result.faceIndex, 0);
+        const Face3& face = faces[result.faceIndex];
+        Vec3 interpolated = result.barycentrics.x * positions[face[0]] + result.barycentrics.y * positions[face[1]] + result.barycentrics.z * positions[face[2]];
+        EXPECT_NEAR(Vec3::distanceBetween(interpolated, result.point), 0.0f, 1e-5f);
+    }
+    
+    // Just outside an edge and a corner, where the closest faces' own normals disagree
+    EXPECT_NEAR(cube.getClosestSurfacePoint(Vec3(1.1f, 1.1f, 0.5f), true).distance, std::sqrt(0.02f), 1e-5f);
+    EXPECT_NEAR(cube.getClosestSurfacePoint(Vec3(-0.1f, -0.1f, -0.1f), true).distance, std::sqrt(0.03f), 1e-5f);
+    EXPECT_NEAR(cube.getClosestSurfacePoint(Vec3(0.5f, 0.5f, 0.4f)).distance, 0.4f, 1e-5f);
+    
+    // Nothing within maxDistance
+    EXPECT_EQ(cube.getClosestSurfacePoint(Vec3(5.0f, 0.5f, 0.5f), false, 1.0f).faceIndex, -1);
+    EXPECT_NEAR(cube.getClosestSurfacePoint(Vec3(5.0f, 0.5f, 0.5f), false, 5.0f).distance, 4.0f, 1e-5f);
+    
+    // Deferred similarity transforms, including reflections, are accounted for
+    cube.transform(math::Mat3x4::fromTranslation(Vec3(1.0f, 0.0f, 0.0f)) * math::Mat3x4::fromRotationZ(0.5f) * math::Mat3x4(2.0f, 0.0f, 0.0f, 0.0f,
+                                                                                                                            0.0f, 2.0f, 0.0f, 0.0f,
+                                                                                                                            0.0f, 0.0f, -2.0f, 0.0f));
+    Geometry transformedCube(cube.getPositions(), cube.getFaces());
+    std::vector<SurfacePointResult> transformedResults;
+    std::vector<SurfacePointResult> expectedResults;
+    std::vector<Vec3> transformedQueries;
+    for (const Vec3& query : queries) transformedQueries.push_back(2.0f * query);
+    cube.getClosestSurfacePoints(transformedQueries, transformedResults, true);
+    transformedCube.getClosestSurfacePoints(transformedQueries, expectedResults, true);
+    for (size_t i = 0; i < transformedQueries.size(); i++) {
+        EXPECT_NEAR(transformedResults[i].distance, expectedResults[i].distance, 1e-4f);
+        EXPECT_NEAR(Vec3::distanceBetween(transformedResults[i].point, expectedResults[i].point), 0.0f, 1e-4f);
+    }
+    
+    // Point clouds have no surface
+    Geometry pointCloud(positions);
+    EXPECT_EQ(pointCloud.getClosestSurfacePoint(Vec3(0.5f, 0.5f, 0.5f)).faceIndex, -1);
+}
+
+TEST(GeometryTests, testIncrementalUpdates)
+{
+    const int gridSize = 30;
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeGrid(gridSize, positions, faces);
+    
+    std::vector<Vec3> normals(positions.size(), Vec3{0.0f, 0.0f, 1.0f});
+    std::vector<Vec3> colors(positions.size(), Vec3{1.0f, 1.0f, 1.0f});
+    Geometry geometry(positions, normals, colors, faces);
+    
+    // Build both acceleration structures before editing
+    geometry.getClosestVertexIndex(Vec3{0.0f, 0.0f, 0.0f});
+    geometry.rayTrace(Vec3{1.0f, 1.0f, 10.0f}, Vec3{0.0f, 0.0f, -1.0f});
+    
+    // Raise a small bump twice, each well within the default incremental fraction
+    VertexSelection bump(geometry);
+    for (int y = 10; y < 15; y++) {
+        for (int x = 10; x < 15; x++) {
+            bump.insertValue(y * gridSize + x);
+        }
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        geometry.mutatePositionsWithFunction([](int index, Vec3 position, Vec3 normal, Vec3 color) {
+            return position + Vec3{0.3f, -0.2f, 1.0f};
+        }, bump);
+        
+        Geometry reference(geometry.getPositions(), geometry.getFaces());
+        expectSameQueryResults(geometry, reference);
+    }
+    
+    // Only one vertex differs, so setPositions takes the incremental path too
+    std::vector<Vec3> editedPositions = geometry.getPositions();
+    editedPositions[3] = Vec3{7.0f, 7.0f, -2.0f};
+    EXPECT_TRUE(geometry.setPositions(editedPositions));
+    {
+        Geometry reference(editedPositions, faces);
+        expectSameQueryResults(geometry, reference);
+    }
+    
+    // Moves beyond the configured fraction fall back to a full rebuild
+    geometry.setIncrementalUpdateFraction(0.0f);
+    EXPECT_EQ(geometry.getIncrementalUpdateFraction(), 0.0f);
+    geometry.mutatePositionsWithFunction([](int index, Vec3 position, Vec3 normal, Vec3 color) {
+        return position + Vec3{0.0f, 0.0f, 0.1f * (index % 7)};
+    });
+    {
+        Geometry reference(geometry.getPositions(), faces);
+        expectSameQueryResults(geometry, reference);
+    }
+}
+
+TEST(GeometryTests, testDeferredTransform)
+{
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeGrid(30, positions, faces);
+    std::vector<Vec3> normals(positions.size(), Vec3{0.0f, 0.0f, 1.0f});
+    std::vector<Vec3> colors(positions.size(), Vec3{1.0f, 1.0f, 1.0f});
+    
+    Geometry geometry(positions, normals, colors, faces);
+    geometry.getClosestVertexIndex(Vec3{0.0f, 0.0f, 0.0f});
+    geometry.rayTrace(Vec3{1.0f, 1.0f, 10.0f}, Vec3{0.0f, 0.0f, -1.0f});
+    
+    // Small rigid and similarity steps, as when iteratively aligning a scan, that keep the grid
+    // under the test queries
+    std::vector<math::Mat3x4> steps{
+        math::Mat3x4::fromTranslation(Vec3{0.3f, -0.2f, 0.1f}) * math::Mat3x4::fromRotationZ(0.1f),
+        math::Mat3x4::fromRotationX(0.05f) * math::Mat3x4::fromScale(Vec3{1.1f, 1.1f, 1.1f}),
+        math::Mat3x4::fromTranslation(Vec3{-0.4f, 0.1f, 0.0f}) * math::Mat3x4::fromRotationY(-0.03f),
+    };
+    
+    std::vector<Vec3> expectedPositions = positions;
+    for (const math::Mat3x4& step : steps) {
+        geometry.transform(step);
+        for (Vec3& position : expectedPositions) {
+            position = step * position;
+        }
+        
+        Geometry reference(expectedPositions, faces);
+        expectSameQueryResults(geometry, reference);
+        
+        // Batched distances come back in world units
+        standard_cyborg::sc3d::NeighborQueryResult result, expectedResult;
+        geometry.getNClosestVertexIndices(std::vector<Vec3>{Vec3{3.3f, 4.1f, 0.2f}}, 4, result);
+        reference.getNClosestVertexIndices(std::vector<Vec3>{Vec3{3.3f, 4.1f, 0.2f}}, 4, expectedResult);
+        EXPECT_EQ(result.indices, expectedResult.indices);
+        for (int i = 0; i < 4; i++) {
+            EXPECT_NEAR(result.squaredDistances[i], expectedResult.squaredDistances[i], 1e-4);
+        }
+    }
+    
+    // Reading the positions writes the transform out, and queries keep working without a rebuild
+    for (int i = 0; i < (int)positions.size(); i++) {
+        EXPECT_TRUE(Vec3::almostEqual(geometry.getPositions()[i], expectedPositions[i], 1e-5, 1e-5));
+    }
+    EXPECT_NEAR(geometry.getNormals()[0].norm(), 1.1f, 1e-5);
+    {
+        Geometry reference(expectedPositions, faces);
+        expectSameQueryResults(geometry, reference);
+    }
+    
+    // Another transform on top of the written-out one
+    geometry.transform(steps[0]);
+    for (Vec3& position : expectedPositions) {
+        position = steps[0] * position;
+    }
+    {
+        Geometry reference(expectedPositions, faces);
+        expectSameQueryResults(geometry, reference);
+    }
+    
+    // Editing positions after a transform falls back to a rebuild
+    geometry.mutatePositionsWithFunction([](int index, Vec3 position, Vec3 normal, Vec3 color) {
+        return position + Vec3{0.0f, 0.0f, 0.5f};
+    }, VertexSelection(geometry, {100, 101, 102}));
+    {
+        Geometry reference(geometry.getPositions(), faces);
+        expectSameQueryResults(geometry, reference);
+    }
+    
+    // Non-uniform scales don't preserve distances and are applied immediately
+    math::Mat3x4 stretch = math::Mat3x4::fromScale(Vec3{1.2f, 0.9f, 1.0f});
+    std::vector<Vec3> stretchedPositions = geometry.getPositions();
+    for (Vec3& position : stretchedPositions) {
+        position = stretch * position;
+    }
+    geometry.transform(stretch);
+    {
+        Geometry reference(stretchedPositions, faces);
+        expectSameQueryResults(geometry, reference);
+    }
+}
+
+TEST(GeometryTests, testCompactStorage)
+{
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeGrid(20, positions, faces);
+    std::vector<Vec3> normals(positions.size(), Vec3{0.0f, 0.0f, 1.0f});
+    std::vector<Vec3> colors(positions.size(), Vec3{0.2f, 0.4f, 0.6f});
+    
+    Geometry geometry(positions, normals, colors, faces);
+    geometry.setCompactStorage(true);
+    EXPECT_TRUE(geometry.hasCompactStorage());
+    EXPECT_EQ(geometry.vertexCount(), (int)positions.size());
+    EXPECT_TRUE(geometry.hasNormals());
+    
+    // Texture coordinates are checked against the packed vertex count
+    {
+        Geometry textured(positions, normals, colors, faces);
+        textured.setCompactStorage(true);
+        EXPECT_FALSE(textured.setTexCoords(std::vector<Vec2>(positions.size() + 1)));
+        EXPECT_FALSE(textured.hasTexCoords());
+        EXPECT_TRUE(textured.setTexCoords(std::vector<Vec2>(positions.size())));
+        EXPECT_TRUE(textured.hasTexCoords());
+    }
+    
+    // Views read the packed triples directly
+    standard_cyborg::sc3d::Float3View positionsView = geometry.getPositionsView();
+    EXPECT_EQ(positionsView.size(), (int)positions.size());
+    EXPECT_EQ(positionsView.stride, 3);
+    EXPECT_EQ(positionsView[17], positions[17]);
+    EXPECT_EQ(geometry.getColorsView()[5], colors[5]);
+    
+    {
+        Geometry reference(positions, faces);
+        expectSameQueryResults(geometry, reference);
+    }
+    
+    // The padded accessors still work
+    EXPECT_EQ(geometry.getPositions(), positions);
+    EXPECT_EQ(geometry.getNormals(), normals);
+    
+    // Edits stay compact, and moving a few vertices still updates the structures incrementally
+    geometry.mutatePositionsWithFunction([](int index, Vec3 position, Vec3 normal, Vec3 color) {
+        return position + Vec3{0.0f, 0.0f, 0.5f};
+    }, VertexSelection(geometry, {30, 31, 32}));
+    EXPECT_TRUE(geometry.hasCompactStorage());
+    EXPECT_EQ(geometry.getPositionsView()[31], positions[31] + Vec3(0.0f, 0.0f, 0.5f));
+    {
+        Geometry reference(geometry.getPositions(), faces);
+        expectSameQueryResults(geometry, reference);
+    }
+    
+    // Deferred transforms apply to the packed positions
+    math::Mat3x4 step = math::Mat3x4::fromTranslation(Vec3{0.3f, -0.2f, 0.1f}) * math::Mat3x4::fromRotationZ(0.1f);
+    std::vector<Vec3> expectedPositions = geometry.getPositions();
+    for (Vec3& position : expectedPositions) {
+        position = step * position;
+    }
+    geometry.transform(step);
+    {
+        Geometry reference(expectedPositions, faces);
+        expectSameQueryResults(geometry, reference);
+    }
+    for (int i = 0; i < (int)expectedPositions.size(); i++) {
+        EXPECT_TRUE(Vec3::almostEqual(geometry.getPositionsView()[i], expectedPositions[i], 1e-5, 1e-5));
+        EXPECT_TRUE(Vec3::almostEqual(geometry.getPositions()[i], expectedPositions[i], 1e-5, 1e-5));
+    }
+    
+    // Copies keep the storage mode
+    Geometry copy;
+    copy.copy(geometry);
+    EXPECT_TRUE(copy.hasCompactStorage());
+    EXPECT_EQ(copy.getColors(), colors);
+    EXPECT_TRUE(copy == geometry);
+    
+    // And converting back yields the same padded attributes
+    geometry.setCompactStorage(false);
+    EXPECT_FALSE(geometry.hasCompactStorage());
+    EXPECT_EQ(geometry.getPositionsView().stride, 4);
+    EXPECT_EQ(geometry.getPositions(), copy.getPositions());
+    EXPECT_EQ(geometry.getColors(), colors);
+}
+
+TEST(GeometryTests, testMoveSemantics)
+{
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeGrid(10, positions, faces);
+    const std::vector<Vec3> expectedPositions = positions;
+    const std::vector<Face3> expectedFaces = faces;
+    
+    // Constructing from rvalues adopts the buffers
+    const Vec3* positionsData = positions.data();
+    Geometry geometry(std::move(positions), std::move(faces));
+    EXPECT_EQ(geometry.getPositions().data(), positionsData);
+    EXPECT_EQ(geometry.getFaces(), expectedFaces);
+    
+    // Moving carries the data and the built acceleration structures along
+    int closestIndex = geometry.getClosestVertexIndex(Vec3{1.1f, 2.1f, 0.0f});
+    Geometry moved(std::move(geometry));
+    EXPECT_EQ(moved.getPositions().data(), positionsData);
+    EXPECT_EQ(moved.getClosestVertexIndex(Vec3{1.1f, 2.1f, 0.0f}), closestIndex);
+    {
+        Geometry reference(expectedPositions, expectedFaces);
+        expectSameQueryResults(moved, reference);
+    }
+    
+    // The moved-from geometry is empty and still usable
+    EXPECT_EQ(geometry.vertexCount(), 0);
+    EXPECT_FALSE(geometry.hasFaces());
+    EXPECT_TRUE(geometry.setPositions(std::vector<Vec3>{Vec3{1.0f, 2.0f, 3.0f}}));
+    EXPECT_EQ(geometry.getClosestVertexIndex(Vec3{0.0f, 0.0f, 0.0f}), 0);
+    
+    Geometry assigned;
+    assigned = std::move(moved);
+    EXPECT_EQ(assigned.getPositions().data(), positionsData);
+    EXPECT_EQ(assigned.getFaces(), expectedFaces);
+    
+    // Rvalue setters adopt the buffers too, unless positions keep the vertex count
+    std::vector<Vec3> normals(expectedPositions.size(), Vec3{0.0f, 0.0f, 1.0f});
+    const Vec3* normalsData = normals.data();
+    EXPECT_TRUE(assigned.setNormals(std::move(normals)));
+    EXPECT_EQ(assigned.getNormals().data(), normalsData);
+    
+    std::vector<Vec3> raisedPositions = expectedPositions;
+    raisedPositions[3].z = 1.0f;
+    EXPECT_TRUE(assigned.setPositions(std::move(raisedPositions)));
+    EXPECT_EQ(assigned.getPositions().data(), positionsData);
+    EXPECT_EQ(assigned.getPositions()[3].z, 1.0f);
+    
+    std::vector<Vec3> fewerPositions(expectedPositions.begin(), expectedPositions.begin() + 5);
+    EXPECT_FALSE(assigned.setPositions(std::vector<Vec3>(5)));
+    EXPECT_TRUE(assigned.setVertexData(std::move(fewerPositions)));
+    EXPECT_EQ(assigned.vertexCount(), 5);
+}
+
+TEST(GeometryTests, testCopyOnWrite)
+{
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeGrid(10, positions, faces);
+    std::vector<Vec3> normals(positions.size(), Vec3{0.0f, 0.0f, 1.0f});
+    std::vector<Vec3> colors(positions.size(), Vec3{1.0f, 0.0f, 0.0f});
+    
+    Geometry original(positions, normals, colors, faces);
+    Geometry reference(positions, normals, colors, faces);
+    original.getClosestVertexIndex(Vec3{0.0f, 0.0f, 0.0f});
+    
+    // Copies share their buffers until one of them is edited
+    Geometry copy;
+    copy.copy(original);
+    EXPECT_EQ(copy.getPositions().data(), original.getPositions().data());
+    EXPECT_EQ(copy.getColors().data(), original.getColors().data());
+    EXPECT_EQ(copy.getFaces().data(), original.getFaces().data());
+    
+    std::set<const void*> countedBuffers;
+    int originalSize = original.getSize(countedBuffers);
+    int copySize = copy.getSize(countedBuffers);
+    EXPECT_LT(copySize, originalSize);
+    EXPECT_EQ(copySize, copy.getSize() - (int)(sizeof(Vec3) * 3 * positions.size() + sizeof(Face3) * faces.size()));
+    
+    // Only the edited attribute is cloned, and only for the geometry that was edited
+    copy.setColor(Vec3{0.0f, 1.0f, 0.0f}, 1.0f);
+    EXPECT_NE(copy.getColors().data(), original.getColors().data());
+    EXPECT_EQ(copy.getPositions().data(), original.getPositions().data());
+    EXPECT_EQ(original.getColors(), colors);
+    EXPECT_EQ(copy.getColors()[0], (Vec3{0.0f, 1.0f, 0.0f}));
+    
+    // Editing shared positions leaves the other geometry, and both geometries' queries, correct
+    original.mutatePositionsWithFunction([](int index, Vec3 position, Vec3 normal, Vec3 color) {
+        return index == 3 ? position + Vec3{0.0f, 0.0f, 1.0f} : position;
+    });
+    EXPECT_EQ(copy.getPositions(), positions);
+    EXPECT_EQ(original.getPositions()[3].z, positions[3].z + 1.0f);
+    expectSameQueryResults(copy, reference);
+    
+    std::vector<Vec3> raisedPositions = positions;
+    raisedPositions[3].z += 1.0f;
+    reference.setPositions(raisedPositions);
+    expectSameQueryResults(original, reference);
+    
+    // Compact geometries share their packed buffers the same way
+    original.setCompactStorage(true);
+    Geometry compactCopy;
+    compactCopy.copy(original);
+    EXPECT_EQ(compactCopy.getPositionsView().data, original.getPositionsView().data);
+    compactCopy.transform(math::Mat3x4::fromTranslation(Vec3{1.0f, 0.0f, 0.0f}));
+    EXPECT_EQ(compactCopy.getPositions()[0], original.getPositions()[0] + Vec3(1.0f, 0.0f, 0.0f));
+    EXPECT_EQ(original.getPositions(), raisedPositions);
+}
+
+TEST(GeometryTests, testTopologyCache)
+{
+    std::vector<Vec3> positions;
+    std::vector<Face3> faces;
+    makeGrid(10, positions, faces);
+    
+    Geometry geometry(positions, faces);
+    
+    // The topology is built once, and shared with copies that share the faces
+    std::shared_ptr<const standard_cyborg::sc3d::MeshTopology::MeshTopology> topology = geometry.getTopology();
+    EXPECT_EQ(topology->getNumFaceEdges(), (int)faces.size());
+    EXPECT_EQ(geometry.getTopology(), topology);
+    
+    Geometry copy;
+    copy.copy(geometry);
+    EXPECT_EQ(copy.getFacesVersion(), geometry.getFacesVersion());
+    EXPECT_EQ(copy.getTopology(), topology);
+    
+    // Moving positions keeps it
+    std::vector<Vec3> raisedPositions = positions;
+    for (Vec3& position : raisedPositions) { position.z += 1.0f; }
+    geometry.setPositions(raisedPositions);
+    EXPECT_EQ(geometry.getTopology(), topology);
+    
+    // Changing the faces replaces it, leaving the old one intact for whoever still holds it
+    uint64_t version = geometry.getFacesVersion();
+    geometry.setFaces(std::vector<Face3>(faces.begin(), faces.begin() + 10));
+    EXPECT_NE(geometry.getFacesVersion(), version);
+    EXPECT_NE(geometry.getTopology(), topology);
+    EXPECT_EQ(geometry.getTopology()->getNumFaceEdges(), 10);
+    EXPECT_EQ(topology->getNumFaceEdges(), (int)faces.size());
+    EXPECT_EQ(copy.getTopology(), topology);
+    
+    version = copy.getFacesVersion();
+    copy.deleteVertices(VertexSelection(copy, {0}));
+    EXPECT_NE(copy.getFacesVersion(), version);
+    EXPECT_EQ(copy.getTopology()->getNumFaceEdges(), copy.faceCount());
+    
+    version = copy.getFacesVersion();
+    Geometry moved(std::move(copy));
+    EXPECT_EQ(moved.getFacesVersion(), version);
+    EXPECT_NE(copy.getFacesVersion(), version);
+    EXPECT_EQ(moved.getTopology()->getNumFaceEdges(), moved.faceCount());
+    EXPECT_EQ(copy.getTopology()->getNumFaceEdges(), 0);
+}
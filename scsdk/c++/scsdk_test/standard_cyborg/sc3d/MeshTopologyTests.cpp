@@ -15,6 +15,8 @@
  */
 
 
+#include <algorithm>
+
 #include <gtest/gtest.h>
 
 #include "standard_cyborg/sc3d/MeshTopology.hpp"
@@ -129,6 +131,8 @@ TEST(MeshTopologyTests, testMeshTopologyConstructor) {
     EXPECT_EQ(topology.getFaceEdges(), faceEdges);
     
     EXPECT_EQ(topology.getVertexEdges(), vertexEdges);
+    
+    EXPECT_TRUE(topology.isManifold());
 }
 
 TEST(MeshTopologyTests, testDefaultConstructor) {
@@ -198,18 +202,80 @@ TEST(MeshTopologyTests, testFaceEdgesEdgeIndexBefore) {
  */
 
 
-/*
- // Uncomment to ensure non-manifold tests fail assertion. This should be properly tested
- // be creating new test schemes or something of the sort so that the assert helper is an
- // exception rather than an assertion and can be caught.
- TEST(MeshTopologyTests, testNonManifoldMesh {
- std::vector<Face3> faces {
- {0, 1, 2},
- {1, 0, 3},
- {0, 1, 4}
- };
- 
- MeshTopology::MeshTopology topology (faces);
- }
- */
+TEST(MeshTopologyTests, testNonManifoldMesh) {
+    // Three faces share the edge between vertices 0 and 1
+    std::vector<Face3> faces {
+        {0, 1, 2},
+        {1, 0, 3},
+        {0, 1, 4}
+    };
+    
+    MeshTopology::MeshTopology topology (faces);
+    
+    EXPECT_FALSE(topology.isManifold());
+    EXPECT_EQ(topology.getNonManifoldEdges(), std::vector<int>({0}));
+    
+    // The edge links its first two faces, and the third face still refers to it
+    EXPECT_EQ(topology.getEdges()[0], MeshTopology::Edge({0, 1, 0, 1}));
+    EXPECT_EQ(topology.getFaceEdges()[2][0], 0);
+    EXPECT_EQ(topology.getNumEdges(), 7);
+    
+    EXPECT_TRUE(MeshTopology::MeshTopology(std::vector<Face3>({{0, 1, 2}, {2, 1, 3}})).isManifold());
+    
+    // Rebuilding it from its parts finds the same non-manifold edge
+    MeshTopology::MeshTopology rebuilt (topology.getEdges(), topology.getFaceEdges(), topology.getVertexEdges());
+    EXPECT_EQ(rebuilt.getNonManifoldEdges(), std::vector<int>({0}));
+}
+
+TEST(MeshTopologyTests, testGridMesh) {
+    // A grid large enough to split the construction across threads
+    const int n = 120;
+    std::vector<Face3> faces;
+    for (int y = 0; y < n - 1; y++) {
+        for (int x = 0; x < n - 1; x++) {
+            int v = y * n + x;
+            faces.push_back({v, v + 1, v + n + 1});
+            faces.push_back({v, v + n + 1, v + n});
+        }
+    }
+    
+    MeshTopology::MeshTopology topology (faces);
+    
+    EXPECT_TRUE(topology.isManifold());
+    EXPECT_EQ(topology.getNumVertexEdges(), n * n);
+    EXPECT_EQ(topology.getNumEdges(), 2 * n * (n - 1) + (n - 1) * (n - 1));
+    
+    const std::vector<MeshTopology::Edge>& edges = topology.getEdges();
+    const std::vector<MeshTopology::FaceEdges>& faceEdges = topology.getFaceEdges();
+    
+    // Edges are numbered in the order faces first reach them
+    int nextNewEdge = 0;
+    for (int faceId = 0; faceId < faces.size(); faceId++) {
+        for (int corner = 0; corner < 3; corner++) {
+            int edgeIndex = faceEdges[faceId][corner];
+            const MeshTopology::Edge& edge = edges[edgeIndex];
+            int a = faces[faceId][corner];
+            int b = faces[faceId][(corner + 1) % 3];
+            
+            EXPECT_TRUE((edge.vertex0 == a && edge.vertex1 == b) || (edge.vertex0 == b && edge.vertex1 == a));
+            EXPECT_TRUE(edge.face0 == faceId || edge.face1 == faceId);
+            
+            if (edgeIndex >= nextNewEdge) {
+                EXPECT_EQ(edgeIndex, nextNewEdge);
+                EXPECT_EQ(edge.face0, faceId);
+                nextNewEdge++;
+            }
+        }
+    }
+    
+    // Interior vertices meet six edges, listed in increasing order
+    MeshTopology::EdgeIndexSpan centerEdges = topology.getEdgesAtVertex(n * n / 2 + n / 2);
+    EXPECT_EQ(centerEdges.size(), 6);
+    EXPECT_TRUE(std::is_sorted(centerEdges.begin(), centerEdges.end()));
+    for (int edgeIndex : centerEdges) {
+        const MeshTopology::Edge& edge = edges[edgeIndex];
+        EXPECT_TRUE(edge.vertex0 == n * n / 2 + n / 2 || edge.vertex1 == n * n / 2 + n / 2);
+        EXPECT_NE(edge.face1, -1);
+    }
+}
 
@@ -17,6 +17,10 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <iterator>
+#include <set>
+
 #include "standard_cyborg/sc3d/VertexSelection.hpp"
 #include "standard_cyborg/sc3d/Geometry.hpp"
 #include "standard_cyborg/sc3d/VertexSelection.hpp"
@@ -304,3 +308,105 @@ TEST(VertexSelectionTests, testInvertWRTGeometry)
     selection.invert();
     EXPECT_TRUE(selection == VertexSelection(geometry, {2}));
 }
+
+static std::set<int> toSet(const VertexSelection& selection)
+{
+    return std::set<int>(selection.begin(), selection.end());
+}
+
+static VertexSelection makeSelection(int totalVertexCount, const std::set<int>& indices)
+{
+    return VertexSelection(totalVertexCount, std::vector<int>(indices.begin(), indices.end()));
+}
+
+TEST(VertexSelectionTests, testDenseAndSparseRepresentations)
+{
+    const int vertexCount = 100000;
+    
+    // Every third vertex is dense, a handful sparse
+    std::set<int> denseIndices;
+    std::set<int> otherDenseIndices;
+    std::set<int> sparseIndices = {3, 500, 77777, 99999};
+    for (int i = 0; i < vertexCount; i += 3) denseIndices.insert(i);
+    for (int i = 0; i < vertexCount; i += 5) otherDenseIndices.insert(i);
+    
+    VertexSelection dense = makeSelection(vertexCount, denseIndices);
+    VertexSelection otherDense = makeSelection(vertexCount, otherDenseIndices);
+    VertexSelection sparse = makeSelection(vertexCount, sparseIndices);
+    EXPECT_TRUE(dense.isDense());
+    EXPECT_TRUE(otherDense.isDense());
+    EXPECT_FALSE(sparse.isDense());
+    
+    EXPECT_EQ(dense.size(), (int)denseIndices.size());
+    EXPECT_EQ(toSet(dense), denseIndices);
+    EXPECT_TRUE(dense.contains(99999));
+    EXPECT_FALSE(dense.contains(99998));
+    EXPECT_FALSE(dense.contains(-1));
+    EXPECT_FALSE(dense.contains(vertexCount + 64));
+    
+    // Every combination of representations agrees with std::set
+    const std::set<int>* indexSets[] = {&denseIndices, &otherDenseIndices, &sparseIndices};
+    const VertexSelection* selections[] = {&dense, &otherDense, &sparse};
+    
+    for (int a = 0; a < 3; a++) {
+        for (int b = 0; b < 3; b++) {
+            const std::set<int>& lhs = *indexSets[a];
+            const std::set<int>& rhs = *indexSets[b];
+            
+            std::set<int> expectedUnion = lhs;
+            expectedUnion.insert(rhs.begin(), rhs.end());
+            std::set<int> expectedDifference;
+            std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::inserter(expectedDifference, expectedDifference.end()));
+            std::set<int> expectedIntersection;
+            std::set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::inserter(expectedIntersection, expectedIntersection.end()));
+            
+            VertexSelection selection;
+            
+            selection.copy(*selections[a]);
+            selection.unionWith(*selections[b]);
+            EXPECT_EQ(toSet(selection), expectedUnion);
+            EXPECT_EQ(selection.size(), (int)expectedUnion.size());
+            EXPECT_TRUE(selection == makeSelection(vertexCount, expectedUnion));
+            
+            selection.copy(*selections[a]);
+            selection.differenceWith(*selections[b]);
+            EXPECT_EQ(toSet(selection), expectedDifference);
+            EXPECT_EQ(selection.size(), (int)expectedDifference.size());
+            
+            selection.copy(*selections[a]);
+            selection.intersectWith(*selections[b]);
+            EXPECT_EQ(toSet(selection), expectedIntersection);
+            EXPECT_EQ(selection.size(), (int)expectedIntersection.size());
+            EXPECT_EQ(selection.isDense(), expectedIntersection.size() * 256 > vertexCount);
+        }
+    }
+    
+    // Inverting a sparse selection makes it dense, and back
+    VertexSelection inverted;
+    inverted.copy(sparse);
+    inverted.invert();
+    EXPECT_TRUE(inverted.isDense());
+    EXPECT_EQ(inverted.size(), vertexCount - (int)sparseIndices.size());
+    EXPECT_FALSE(inverted.contains(77777));
+    EXPECT_TRUE(inverted.contains(77778));
+    inverted.invert();
+    EXPECT_FALSE(inverted.isDense());
+    EXPECT_EQ(toSet(inverted), sparseIndices);
+    
+    // Removing values thins a dense selection out into a sparse one
+    VertexSelection thinned;
+    thinned.copy(dense);
+    for (int index : denseIndices) {
+        if (index > 150) thinned.removeValue(index);
+    }
+    EXPECT_FALSE(thinned.isDense());
+    EXPECT_EQ(thinned.size(), 51);
+    
+    // Inserting far past the bitset doesn't grow it, and negative indices are kept too
+    VertexSelection small(0, {1, 2, 3});
+    EXPECT_TRUE(small.isDense());
+    small.insertValue(50000000);
+    small.insertValue(-4);
+    EXPECT_FALSE(small.isDense());
+    EXPECT_EQ(toSet(small), (std::set<int>{-4, 1, 2, 3, 50000000}));
+}
@@ -708,6 +708,25 @@ TEST(SceneGraphTests, testGetSize)
               b->approximateSizeInBytes() + a->approximateSizeInBytes() + d->approximateSizeInBytes());
 }
 
+TEST(SceneGraphTests, testHistorySizeCountsSharedGeometryOnce)
+{
+    std::vector<Vec3> positions(100, Vec3(1.0f, 2.0f, 3.0f));
+    std::vector<Vec3> colors(100, Vec3(0.0f, 1.0f, 0.0f));
+    
+    std::shared_ptr<standard_cyborg::scene_graph::GeometryNode> a(new standard_cyborg::scene_graph::GeometryNode("a"));
+    a->getGeometry().copy(standard_cyborg::sc3d::Geometry(positions, {}, colors));
+    
+    // A deep copy has its own id, but shares the geometry's buffers until either is edited
+    std::shared_ptr<standard_cyborg::scene_graph::GeometryNode> b(a->deepCopy());
+    
+    std::vector<std::shared_ptr<Node>> history = {a, b};
+    int bufferSize = sizeof(Vec3) * 2 * 100;
+    EXPECT_EQ(Node::calculateHistorySizeInBytes(history), a->approximateSizeInBytes() + b->approximateSizeInBytes() - bufferSize);
+    
+    b->getGeometry().setColor(Vec3(1.0f, 0.0f, 0.0f), 1.0f);
+    EXPECT_EQ(Node::calculateHistorySizeInBytes(history), a->approximateSizeInBytes() + b->approximateSizeInBytes() - bufferSize / 2);
+}
+
 
 TEST(SceneGraphTests, testGeometryAllocatedIds)
 {
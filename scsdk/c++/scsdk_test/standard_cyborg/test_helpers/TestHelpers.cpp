@@ -20,7 +20,11 @@
 #define SC_TEST_DEFAULT_FIXTURES_DIR "/opt/scsdk/scsdk/c++/test_fixture_data"
 #endif
 
+#include <cmath>
 #include <cstdlib>
+#include <vector>
+
+#include "standard_cyborg/math/Vec3.hpp"
 
 namespace standard_cyborg {
 
@@ -33,4 +37,28 @@ std::string getTestCasesPath() {
     }
 }
 
+sc3d::Geometry makeBumpySurface(int resolution, float offset, float halfExtent,
+                                float amplitude, float xFrequency, float yFrequency)
+{
+    using math::Vec3;
+    
+    std::vector<Vec3> positions;
+    std::vector<Vec3> normals;
+    
+    for (int i = 0; i < resolution; i++) {
+        for (int j = 0; j < resolution; j++) {
+            float x = halfExtent * (-1.0f + 2.0f * (i + offset) / resolution);
+            float y = halfExtent * (-1.0f + 2.0f * (j + offset) / resolution);
+            float z = amplitude * std::sin(xFrequency * x) * std::cos(yFrequency * y);
+            float dzdx = amplitude * xFrequency * std::cos(xFrequency * x) * std::cos(yFrequency * y);
+            float dzdy = -amplitude * yFrequency * std::sin(xFrequency * x) * std::sin(yFrequency * y);
+            
+            positions.push_back(Vec3(x, y, z));
+            normals.push_back(Vec3::normalize(Vec3(-dzdx, -dzdy, 1.0f)));
+        }
+    }
+    
+    return sc3d::Geometry(positions, normals);
+}
+
 }
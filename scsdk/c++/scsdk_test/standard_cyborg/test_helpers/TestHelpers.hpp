@@ -17,10 +17,19 @@ limitations under the License.
 
 #include <string>
 
+#include "standard_cyborg/sc3d/Geometry.hpp"
+
 namespace standard_cyborg {
 
 std::string getTestCasesPath();
 
 inline std::string getTempDir() { return "/tmp/"; }
 
+/* A resolution x resolution grid of points and normals on the height field
+   z = amplitude * sin(xFrequency * x) * cos(yFrequency * y) over [-halfExtent, halfExtent]^2,
+   with grid samples shifted by offset cells. Its bumps pin down all six degrees of freedom
+   for registration tests, and different offsets give non-coincident samplings of one surface. */
+sc3d::Geometry makeBumpySurface(int resolution, float offset, float halfExtent,
+                                float amplitude, float xFrequency, float yFrequency);
+
 }
\ No newline at end of file
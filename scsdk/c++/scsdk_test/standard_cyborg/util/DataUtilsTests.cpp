@@ -44,6 +44,7 @@
 
 #include "standard_cyborg/util/DataUtils.hpp"
 #include "standard_cyborg/sc3d/Face3.hpp"
+#include "standard_cyborg/sc3d/Float3View.hpp"
 
 using standard_cyborg::sc3d::Face3;
 
@@ -208,6 +209,25 @@ TEST(DataUtilsTests, testConstVec3ArrayToEigenX3f) {
     EXPECT_EQ(matrix(3, 2), 12.0f);
 }
 
+TEST(DataUtilsTests, testFloat3ViewToEigen) {
+    const std::vector<float> packed { 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f };
+    const std::vector<Vec3> padded { { 1.0f, 2.0f, 3.0f }, { 4.0f, 5.0f, 6.0f }, { 7.0f, 8.0f, 9.0f } };
+    
+    standard_cyborg::sc3d::Float3View packedView (packed.data(), 3);
+    standard_cyborg::sc3d::Float3View paddedView (padded);
+    
+    const auto packedMatrix {standard_cyborg::toMatrixX3f(packedView)};
+    const auto paddedMatrix {standard_cyborg::toMatrix3Xf(paddedView)};
+    
+    // No copies are made
+    EXPECT_EQ(packedMatrix.data(), packed.data());
+    EXPECT_EQ(paddedMatrix.data(), &padded[0].x);
+    EXPECT_EQ(paddedMatrix.outerStride(), 4);
+    
+    EXPECT_EQ(packedMatrix, standard_cyborg::toMatrixX3f(padded));
+    EXPECT_EQ(paddedMatrix, standard_cyborg::toMatrix3Xf(packedView));
+}
+
 // MARK: Face3 Tests
 
 TEST(DataUtilsTests, testFace3ArrayToEigen3Xi) {
@@ -0,0 +1,75 @@
+/*
+Copyright 2020 Standard Cyborg
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "standard_cyborg/util/ParallelFor.hpp"
+
+using standard_cyborg::ParallelWorkerPool;
+using standard_cyborg::parallelFor;
+
+TEST(ParallelForTests, testWorkerPoolRunsEachThreadIndexOnce) {
+    ParallelWorkerPool pool(3);
+    
+    // The same workers pick up call after call
+    for (int run = 0; run < 100; run++) {
+        int threadCount = 1 + run % 4;
+        std::vector<std::atomic<int>> calls(4);
+        
+        EXPECT_TRUE(pool.tryRun(threadCount, [&](int threadIndex) { calls[threadIndex]++; }));
+        
+        for (int threadIndex = 0; threadIndex < 4; threadIndex++) {
+            EXPECT_EQ(calls[threadIndex].load(), threadIndex < threadCount ? 1 : 0);
+        }
+    }
+}
+
+TEST(ParallelForTests, testWorkerPoolRejectsConcurrentCallers) {
+    ParallelWorkerPool pool(1);
+    bool otherCallerRan = true;
+    
+    EXPECT_TRUE(pool.tryRun(2, [&](int threadIndex) {
+        if (threadIndex != 0) return;
+        
+        std::thread otherCaller([&]() { otherCallerRan = pool.tryRun(2, [](int) {}); });
+        otherCaller.join();
+    }));
+    
+    EXPECT_FALSE(otherCallerRan);
+}
+
+TEST(ParallelForTests, testNestedParallelFor) {
+    const int count = 2000;
+    std::vector<std::atomic<int>> visits(count * 4);
+    
+    parallelFor(4, [&](int begin, int end, int threadIndex) {
+        for (int outer = begin; outer < end; outer++) {
+            parallelFor(count, [&](int innerBegin, int innerEnd, int innerThreadIndex) {
+                for (int i = innerBegin; i < innerEnd; i++) {
+                    visits[outer * count + i]++;
+                }
+            });
+        }
+    }, 1);
+    
+    for (const std::atomic<int>& visit : visits) {
+        EXPECT_EQ(visit.load(), 1);
+    }
+}